@@ -34,6 +34,9 @@
 Application::Application(BackgroundTask* task){
     assert(task != NULL);
     task_ = task;
+    CPU_ZERO(&cpus_);
+    pinned_ = false;
+    task_->setEvents(&events_);
 }
 
 /**
@@ -44,8 +47,16 @@ Application::Application(BackgroundTask* task){
  */
 void Application::start(void)
 {
+    /* The executor thread only starts once a consumer suspends */
+    events_.start();
+
     /* Run the background task in a thread */
     taskThread_ = std::thread(&BackgroundTask::run, task_);
+
+    /* Keep the worker next to the memory it parses */
+    if (pinned_) {
+        MemPolicy_PinThread(taskThread_.native_handle(), &cpus_);
+    }
 }
 
 /**
@@ -60,6 +71,9 @@ void Application::stop(void) {
 
     /* Wait for the thread to join */
     taskThread_.join();
+
+    /* Consumers still waiting are resumed */
+    events_.stop();
 }
 
 /**
@@ -72,3 +86,74 @@ void Application:: dataAvailable(void) {
      /* Signal the background task that data is available */
      task_->notifyDataAvailable();
 }
+
+/**
+ * @brief Pin the worker thread to a CPU set when the application starts
+ *
+ * Typically the CPUs of the NUMA node the shared memory is bound to,
+ * see MemPolicy_NodeCpus(). Must be called before start().
+ *
+ * @param  cpus  allowed CPUs
+ * @return None
+ */
+void Application::setCpuSet(const cpu_set_t& cpus) {
+    cpus_ = cpus;
+    pinned_ = true;
+}
+
+/**
+ * @brief Parse partially filled buffers once a byte threshold or a max
+ *        delay is reached, so the producer need not fill the buffer
+ *
+ * Must be called before start().
+ *
+ * @param  policy  max delay and byte threshold, see FlushPolicy
+ * @return None
+ */
+void Application::setFlushPolicy(const FlushPolicy& policy) {
+    task_->setFlushPolicy(policy);
+}
+
+/**
+ * @brief Get the count published by the worker after the last buffer
+ *
+ * Unlike CmdSeqParser::getCount() this is safe while the worker runs.
+ *
+ * @param  None
+ * @return count value
+ */
+uint64_t Application::getCount(void) {
+    return events_.getCount();
+}
+
+#if defined(PARSE_EVENTS_AWAIT)
+/**
+ * @brief Awaitable that resumes after n more matches
+ *
+ * @param  n  number of matches
+ * @return awaitable, co_await gives the count
+ */
+ParseEvents::Awaiter Application::nextMatches(uint64_t n) {
+    return events_.nextMatches(n);
+}
+
+/**
+ * @brief Awaitable that resumes once the count changes
+ *
+ * @param  None
+ * @return awaitable, co_await gives the count
+ */
+ParseEvents::Awaiter Application::countChanged(void) {
+    return events_.countChanged();
+}
+
+/**
+ * @brief Awaitable that resumes once the next buffer is processed
+ *
+ * @param  None
+ * @return awaitable, co_await gives the count
+ */
+ParseEvents::Awaiter Application::bufferProcessed(void) {
+    return events_.bufferProcessed();
+}
+#endif
@@ -18,6 +18,7 @@
 #include "SharedMem.h"
 #include "CmdSeqParser.h"
 #include "BackgroundTask.h"
+#include "MemPolicy.h"
 /*-----------------------------------------------------------------------*/
 /* Macro                                                                 */
 /*-----------------------------------------------------------------------*/
@@ -30,9 +31,20 @@ class Application {
         void start(void);            /**< Start the application */
         void stop(void);             /**< Stop the application */
         void dataAvailable(void);    /**< Signal about data availability */
+        void setCpuSet(const cpu_set_t& cpus); /**< Pin the worker thread on start */
+        void setFlushPolicy(const FlushPolicy& policy); /**< Parse partial buffers too */
+        uint64_t getCount(void);     /**< Count published by the worker, thread safe */
+#if defined(PARSE_EVENTS_AWAIT)
+        ParseEvents::Awaiter nextMatches(uint64_t n); /**< co_await n more matches */
+        ParseEvents::Awaiter countChanged(void);      /**< co_await a count change */
+        ParseEvents::Awaiter bufferProcessed(void);   /**< co_await the next buffer */
+#endif
     private:
         BackgroundTask* task_;   /**< Reference to background task obj */
         std::thread taskThread_; /**< Thread in the application  */
+        cpu_set_t cpus_;         /**< CPUs for the worker thread */
+        bool pinned_;            /**< Pin the worker thread to cpus_ */
+        ParseEvents events_;     /**< Progress events of the worker */
 };
 /*-----------------------------------------------------------------------*/
 /* Prototype                                                             */
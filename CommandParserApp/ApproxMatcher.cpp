@@ -0,0 +1,232 @@
+/**
+ * @file  ApproxMatcher.cpp
+ * @brief Approximate header matching within k bit errors (Shift-Add)
+ * @note  Bit corruption on the link is counted with the Shift-Add variant of
+ *        Shift-Or: every pattern byte has an 8 bit field in the state word
+ *        that accumulates the bit errors of the window ending at the current
+ *        byte, so one shift and one add per byte give the Hamming distance
+ *        of the whole window. Windows inside a block are independent and
+ *        summed per byte position instead, which vectorizes.
+ *
+ */
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include "ApproxMatcher.h"
+#include <cassert>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+/**
+ * @brief Build the Shift-Add table for a pattern
+ *
+ * @param  pattern  header bytes, e.g. A5 5A
+ * @param  len      pattern length, 1 to APPROX_MAX_PATTERN
+ * @param  k        maximum bit errors counted as approximate match
+ * @return None
+ */
+ApproxMatcher::ApproxMatcher(const uint8_t* pattern, size_t len, unsigned k)
+{
+    assert(pattern != NULL);
+    assert((len > 0) && (len <= APPROX_MAX_PATTERN));
+    assert(k <= len * 8);
+
+    /*
+     * Field f of table_[c] holds the bit errors of c at pattern byte f, the
+     * field of the last pattern byte then sums the errors of the window
+     */
+    for (unsigned c = 0; c < 256; c++) {
+        table_[c] = 0;
+        for (size_t f = 0; f < len; f++) {
+            uint64_t errors = (uint64_t)__builtin_popcount(c ^ pattern[f]);
+            table_[c] |= errors << (8 * f);
+        }
+    }
+    for (size_t f = 0; f < len; f++) {
+        pattern_[f] = pattern[f];
+        for (unsigned c = 0; c < 256; c++) {
+            errors_[f][c] = (uint8_t)__builtin_popcount(c ^ pattern[f]);
+        }
+    }
+    state_ = 0;
+    shift_ = (unsigned)(8 * (len - 1));
+    k_ = k;
+    len_ = len;
+    seen_ = 0;
+    memset(counts_, 0, sizeof(counts_));
+#if defined(__x86_64__) || defined(__i386__)
+    useSimd_ = __builtin_cpu_supports("ssse3");
+#endif
+}
+
+/**
+ * @brief Process a block of the stream, the state continues across blocks
+ *
+ * Windows that end in the first len-1 bytes of the block straddle the
+ * previous block and go through the Shift-Add state. Windows inside the
+ * block have no dependency on each other and are summed independently,
+ * 16 at a time when SSSE3 is available. The state is then rebuilt from the
+ * last len-1 bytes for the next block.
+ *
+ * @param  data  bytes to scan
+ * @param  len   number of bytes
+ * @return None
+ */
+void ApproxMatcher::scan(const uint8_t* data, size_t len)
+{
+    size_t head = (len < len_ - 1) ? len : len_ - 1;
+    size_t i = 0;
+    uint64_t state = state_;
+
+    /* The first windows of the stream are not complete yet */
+    for (; (i < head) && (seen_ + 1 < len_); i++) {
+        state = (state << 8) + table_[data[i]];
+        seen_++;
+    }
+    for (; i < head; i++) {
+        state = (state << 8) + table_[data[i]];
+        count((unsigned)(state >> shift_) & 0xFF);
+    }
+    if (len < len_) {
+        state_ = state;
+        return;
+    }
+
+    /* Windows starting in the block, the first one ends at head */
+    size_t starts = len - len_ + 1;
+    size_t s = 0;
+#if defined(__x86_64__) || defined(__i386__)
+    if (useSimd_) {
+        s = scanSimd(data, starts);
+    }
+#endif
+    for (; s < starts; s++) {
+        unsigned distance = 0;
+        for (size_t f = 0; f < len_; f++) {
+            distance += errors_[f][data[s + f]];
+        }
+        count(distance);
+    }
+    seen_ = len_;
+
+    /* Only the last len-1 bytes matter for windows of the next block */
+    state = 0;
+    for (i = len - head; i < len; i++) {
+        state = (state << 8) + table_[data[i]];
+    }
+    state_ = state;
+}
+
+/**
+ * @brief Count a window if it is within k bit errors
+ *
+ * @param  distance  bit errors of the window
+ * @return None
+ */
+inline void ApproxMatcher::count(unsigned distance)
+{
+    if (distance <= k_) {
+        counts_[distance]++;
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * @brief Sum the bit errors of 16 windows at a time with SSSE3
+ *
+ * The popcount of each byte is looked up per nibble with PSHUFB.
+ *
+ * @param  data    bytes to scan
+ * @param  starts  number of windows that start in data
+ * @return number of windows processed, a multiple of 16
+ */
+__attribute__((target("ssse3")))
+size_t ApproxMatcher::scanSimd(const uint8_t* data, size_t starts)
+{
+    const __m128i nibbles = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                          1, 2, 2, 3, 2, 3, 3, 4);
+    const __m128i low = _mm_set1_epi8(0x0F);
+    const __m128i limit = _mm_set1_epi8((char)k_);
+    alignas(16) uint8_t distances[16];
+    size_t s = 0;
+
+    for (; s + 16 <= starts; s += 16) {
+        __m128i sum = _mm_setzero_si128();
+        for (size_t f = 0; f < len_; f++) {
+            __m128i v = _mm_loadu_si128((const __m128i*)&data[s + f]);
+            v = _mm_xor_si128(v, _mm_set1_epi8((char)pattern_[f]));
+            __m128i lo = _mm_shuffle_epi8(nibbles, _mm_and_si128(v, low));
+            __m128i hi = _mm_shuffle_epi8(nibbles, _mm_and_si128(_mm_srli_epi16(v, 4), low));
+            sum = _mm_add_epi8(sum, _mm_add_epi8(lo, hi));
+        }
+
+        /* Windows within k errors: min(sum, k) == sum */
+        __m128i hit = _mm_cmpeq_epi8(_mm_min_epu8(sum, limit), sum);
+        unsigned mask = (unsigned)_mm_movemask_epi8(hit);
+        if (mask != 0) {
+            _mm_store_si128((__m128i*)distances, sum);
+            while (mask != 0) {
+                counts_[distances[__builtin_ctz(mask)]]++;
+                mask &= mask - 1;
+            }
+        }
+    }
+    return s;
+}
+#endif
+
+/**
+ * @brief Get the number of windows that match the pattern exactly
+ *
+ * @param  None
+ * @return exact count
+ */
+uint64_t ApproxMatcher::getExactCount()
+{
+    return counts_[0];
+}
+
+/**
+ * @brief Get the number of windows within 1 to k bit errors
+ *
+ * @param  None
+ * @return approximate count, excluding the exact matches
+ */
+uint64_t ApproxMatcher::getApproxCount()
+{
+    uint64_t count = 0;
+
+    for (unsigned d = 1; d <= k_; d++) {
+        count += counts_[d];
+    }
+    return count;
+}
+
+/**
+ * @brief Get the number of windows at a given bit distance
+ *
+ * @param  distance  bit errors, 0 to k
+ * @return count at the distance, 0 beyond k
+ */
+uint64_t ApproxMatcher::getCount(unsigned distance)
+{
+    return (distance <= k_) ? counts_[distance] : 0;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file  ApproxMatcher.h
+ * @brief Approximate header matching within k bit errors (Shift-Add)
+ * @note
+ *
+ */
+#ifndef __APPROX_MATCHER_H__
+#define __APPROX_MATCHER_H__
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include <cstdint>
+#include <cstddef>
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*
+ * Longest pattern, one 8 bit mismatch field per pattern byte in a word
+ */
+#define APPROX_MAX_PATTERN (8)
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+class ApproxMatcher {
+    public:
+        ApproxMatcher(const uint8_t* pattern, size_t len, unsigned k);
+        void scan(const uint8_t* data, size_t len); /**< Process a block of the stream */
+        uint64_t getExactCount();    /**< Windows equal to the pattern */
+        uint64_t getApproxCount();   /**< Windows within 1..k bit errors */
+        uint64_t getCount(unsigned distance); /**< Windows at a bit distance */
+    private:
+        void count(unsigned distance); /**< Count a window within k errors */
+        size_t scanSimd(const uint8_t* data, size_t starts); /**< SSSE3 window sums */
+
+        uint64_t table_[256];        /**< Bit errors of a byte per pattern position */
+        uint8_t errors_[APPROX_MAX_PATTERN][256]; /**< Bit errors per position, unpacked */
+        uint8_t pattern_[APPROX_MAX_PATTERN];     /**< Pattern bytes */
+        bool useSimd_ = false;       /**< SSSE3 is available at runtime */
+        uint64_t state_;             /**< Shift-Add state, kept across blocks */
+        unsigned shift_;             /**< Position of the last pattern field */
+        unsigned k_;                 /**< Allowed number of bit errors */
+        size_t len_;                 /**< Pattern length in bytes */
+        size_t seen_;                /**< Bytes seen, saturates at len_ */
+        uint64_t counts_[APPROX_MAX_PATTERN * 8 + 1]; /**< Windows per distance up to k */
+};
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+#endif /* __APPROX_MATCHER_H__ */
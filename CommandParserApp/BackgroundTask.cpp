@@ -9,6 +9,9 @@
 /*-----------------------------------------------------------------------*/
 #include "BackgroundTask.h"
 #include "CmdSeqParser.h"
+#include "Trace.h"
+#include <cerrno>
+#include <ctime>
 /*-----------------------------------------------------------------------*/
 /* Macro                                                                 */
 /*-----------------------------------------------------------------------*/
@@ -18,6 +21,7 @@
 /*-----------------------------------------------------------------------*/
 /* Prototype                                                             */
 /*-----------------------------------------------------------------------*/
+static uint64_t BackgroundTask_Now(void);
 
 /*-----------------------------------------------------------------------*/
 /* Variable                                                              */
@@ -37,6 +41,17 @@ BackgroundTask::BackgroundTask(CmdSeqParser* parser)
     assert(parser != NULL);
     /* Initialize the members */
     parser_= parser;
+    checkpointer_ = NULL;
+    channel_ = 0;
+    events_ = NULL;
+    buffers_ = 0;
+    for (auto& f : flushes_) {
+        f = 0;
+    }
+    threshold_ = 0;
+    rate_ = 0.0;
+    lastTick_ = 0;
+    lastTotal_ = 0;
     isStopped_ = false;
     sem_init(&sem_, 0, 0);
 }
@@ -54,24 +69,155 @@ void BackgroundTask::run()
      * data available routine(simulated isr) and calls the cmd process
      * routine to identify and count valid command sequences
      */
+    if (policy_.maxDelayUs == 0) {
+        while (true) {
+            sem_wait(&sem_);
+            Trace::record(TraceEvent::WAKE, 1);
+            if(isStopped_.load(std::memory_order_acquire)){
+                break;
+            }
+            parser_->parser();
+            publish();
+        }
+        return;
+    }
+
+    /*
+     * With a flush policy the buffer is also looked at every half max
+     * delay: data already seen at the previous tick is parsed, so no byte
+     * waits longer than the max delay, and so is data above the threshold
+     */
+    const uint64_t tick = (uint64_t)policy_.maxDelayUs * 500;
+    bool seen = false;
+    lastTick_ = BackgroundTask_Now();
+    lastTotal_ = parser_->getOffset() + parser_->getPending();
+    uint64_t next = lastTick_ + tick;
     while (true) {
-        sem_wait(&sem_);
+        bool signaled = wait(next);
+        Trace::record(TraceEvent::WAKE, signaled);
         if(isStopped_.load(std::memory_order_acquire)){
             break;
         }
-        parser_->parser();
+        if (signaled) {
+            if (parser_->parseAvailable() > 0) {
+                flushes_[0].fetch_add(1, std::memory_order_relaxed);
+                publish();
+            }
+            seen = false;
+            continue;
+        }
+
+        uint64_t now = BackgroundTask_Now();
+        next = (next + tick > now) ? next + tick : now + tick;
+        size_t pending = parser_->getPending();
+        tune(now, pending);
+        if (pending == 0) {
+            seen = false;
+            continue;
+        }
+        if (pending >= threshold_.load(std::memory_order_relaxed)) {
+            flushes_[1].fetch_add(1, std::memory_order_relaxed);
+        } else if (seen) {
+            flushes_[2].fetch_add(1, std::memory_order_relaxed);
+        } else {
+            seen = true;
+            continue;
+        }
+        parser_->parseAvailable();
+        publish();
+        seen = false;
+    }
+}
+
+/**
+ * @brief Publish the parser state and progress after a parse
+ *
+ * @param  None
+ * @return None
+ */
+void BackgroundTask::publish()
+{
+    /* Publish the state for the periodic snapshot */
+    if (checkpointer_ != NULL) {
+        ParserCheckpoint cp;
+        parser_->checkpoint(cp);
+        checkpointer_->publish(channel_, cp);
+    }
+
+    /* Wake the consumers waiting on progress */
+    buffers_++;
+    if (events_ != NULL) {
+        events_->publish(parser_->getCount(), buffers_);
     }
 }
 
+/**
+ * @brief Wait for notifyDataAvailable() or stop() until a deadline
+ *
+ * @param  deadlineNs  CLOCK_MONOTONIC deadline
+ * @return true/false signaled or timed out
+ */
+bool BackgroundTask::wait(uint64_t deadlineNs)
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t)(deadlineNs / 1000000000ull);
+    ts.tv_nsec = (long)(deadlineNs % 1000000000ull);
+    while (sem_clockwait(&sem_, CLOCK_MONOTONIC, &ts) != 0) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Smooth the arrival rate and derive the byte threshold from it
+ *
+ * The tuned threshold is what arrives in one max delay: a quiet channel
+ * is parsed at the next tick, a busy one in batches that the deadline
+ * would have produced anyway.
+ *
+ * @param  now      tick time in ns
+ * @param  pending  bytes waiting in the buffer
+ * @return None
+ */
+void BackgroundTask::tune(uint64_t now, size_t pending)
+{
+    uint64_t total = parser_->getOffset() + pending;
+    double dt = (double)(now - lastTick_) / 1e9;
+    if (dt > 0.0) {
+        double sample = (double)(total - lastTotal_) / dt;
+        double rate = rate_.load(std::memory_order_relaxed);
+        rate_.store((rate == 0.0) ? sample : rate * 0.875 + sample * 0.125,
+                    std::memory_order_relaxed);
+    }
+    lastTick_ = now;
+    lastTotal_ = total;
+
+    size_t threshold = policy_.thresholdBytes;
+    if (threshold == 0) {
+        threshold = (size_t)(rate_.load(std::memory_order_relaxed) * policy_.maxDelayUs / 1e6);
+        threshold = (threshold > 0) ? threshold : 1;
+    }
+    threshold_.store(threshold, std::memory_order_relaxed);
+}
+
 /**
  * @brief Notify that data is available from the test harness
  *
+ * Safe in a signal handler in the embedded profile, which compiles the
+ * trace record out.
+ *
  * @param  None
  * @return None
  */
 void BackgroundTask::notifyDataAvailable() 
 {
-    /* Signal that data is available */
+    if (Trace::isEnabled()) {
+        Trace::record(TraceEvent::NOTIFY, parser_->getPending());
+    }
+
+    /* Signal that data is available, sem_post is async-signal-safe */
     sem_post(&sem_);
 }
 
@@ -89,3 +235,77 @@ void BackgroundTask::stop()
     /* Signal to come out of wait condition */
     sem_post(&sem_);
 }
+
+/**
+ * @brief Publish the parser state to a checkpointer after each buffer
+ *
+ * Must be called before the task is started.
+ *
+ * @param  cp       checkpointer, NULL to disable
+ * @param  channel  channel number of this task in the snapshot
+ * @return None
+ */
+void BackgroundTask::setCheckpointer(Checkpointer* cp, size_t channel)
+{
+    checkpointer_ = cp;
+    channel_ = channel;
+}
+
+/**
+ * @brief Publish the count and the buffers processed after each buffer
+ *
+ * Must be called before the task is started.
+ *
+ * @param  events  progress events, NULL to disable
+ * @return None
+ */
+void BackgroundTask::setEvents(ParseEvents* events)
+{
+    events_ = events;
+}
+
+/**
+ * @brief Also parse partially filled buffers, by byte threshold or delay
+ *
+ * Off by default: the buffer is parsed only when notifyDataAvailable()
+ * reports it full. Must be called before the task is started.
+ *
+ * @param  policy  max delay and byte threshold
+ * @return None
+ */
+void BackgroundTask::setFlushPolicy(const FlushPolicy& policy)
+{
+    policy_ = policy;
+    threshold_.store((policy.thresholdBytes > 0) ? policy.thresholdBytes : 1,
+                     std::memory_order_relaxed);
+}
+
+/**
+ * @brief Get the flush counts and the current tuning
+ *
+ * @param  None
+ * @return stats
+ */
+FlushStats BackgroundTask::getFlushStats()
+{
+    FlushStats st;
+    st.signaled = flushes_[0].load(std::memory_order_relaxed);
+    st.threshold = flushes_[1].load(std::memory_order_relaxed);
+    st.deadline = flushes_[2].load(std::memory_order_relaxed);
+    st.thresholdBytes = threshold_.load(std::memory_order_relaxed);
+    st.bytesPerSec = rate_.load(std::memory_order_relaxed);
+    return st;
+}
+
+/**
+ * @brief Monotonic time, the clock of sem_clockwait
+ *
+ * @param  None
+ * @return ns
+ */
+static uint64_t BackgroundTask_Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
@@ -13,20 +13,56 @@
 #include <thread>
 #include <semaphore.h>
 #include "CmdSeqParser.h"
+#include "Checkpoint.h"
+#include "ParseEvents.h"
 /*-----------------------------------------------------------------------*/
 /* Macro                                                                 */
 /*-----------------------------------------------------------------------*/
 /*-----------------------------------------------------------------------*/
 /* DataType                                                              */
 /*-----------------------------------------------------------------------*/
+/*
+ * Parse partially filled buffers instead of waiting for a full one
+ */
+struct FlushPolicy {
+    uint32_t maxDelayUs = 0;    /**< Longest a byte waits for the parser, 0 full buffers only */
+    size_t thresholdBytes = 0;  /**< Parse once this much waits, 0 tuned from the arrival rate */
+};
+
+struct FlushStats {
+    uint64_t signaled = 0;      /**< Parses after notifyDataAvailable() */
+    uint64_t threshold = 0;     /**< Parses at the byte threshold */
+    uint64_t deadline = 0;      /**< Parses at the max delay */
+    size_t thresholdBytes = 0;  /**< Current threshold */
+    double bytesPerSec = 0.0;   /**< Smoothed arrival rate */
+};
+
 class BackgroundTask {
     public:
         BackgroundTask(CmdSeqParser* parser); /**< Initialize command process obj */
         void run();                  /**< Run the background task */
         void notifyDataAvailable();  /**< Notify that data is available */
         void stop();                 /**< Stop the background task */
+        void setCheckpointer(Checkpointer* cp, size_t channel); /**< Publish state after each buffer */
+        void setEvents(ParseEvents* events); /**< Publish progress after each buffer */
+        void setFlushPolicy(const FlushPolicy& policy); /**< Bound the latency of quiet channels */
+        FlushStats getFlushStats();  /**< Flush counts and tuning, thread safe */
     private:
+        void publish();              /**< Publish the state after a parse */
+        bool wait(uint64_t deadlineNs); /**< Wait for a signal or the deadline, true if signaled */
+        void tune(uint64_t now, size_t pending); /**< Update the rate and threshold at a tick */
+
         CmdSeqParser* parser_;       /**< Command process obj reference */
+        Checkpointer* checkpointer_; /**< Optional state snapshot, may be NULL */
+        size_t channel_;             /**< Channel number in the snapshot */
+        ParseEvents* events_;        /**< Optional progress events, may be NULL */
+        uint64_t buffers_;           /**< Number of buffers processed */
+        FlushPolicy policy_;         /**< Flush policy, maxDelayUs 0 when off */
+        std::atomic<uint64_t> flushes_[3]; /**< Signaled, threshold and deadline parses */
+        std::atomic<size_t> threshold_;   /**< Current byte threshold */
+        std::atomic<double> rate_;   /**< Smoothed arrival rate in bytes/s */
+        uint64_t lastTick_;          /**< Time of the previous tick in ns */
+        uint64_t lastTotal_;         /**< Bytes parsed plus pending at the previous tick */
         std::atomic<bool> isStopped_; /**< variable to control task stop */
         sem_t sem_; /**< semaphore to signal that data is available */
 };
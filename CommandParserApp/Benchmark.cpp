@@ -0,0 +1,1218 @@
+/**
+ * @file  Benchmark.cpp
+ * @brief Throughput benchmarks of the command sequence parser
+ * @note  Build: g++ -std=c++20 -O2 Benchmark.cpp -lpthread -Wall -o benchmark
+ *        Run with SEQPARSER_TRACE=<file> to write a Chrome trace of the run
+ *
+ */
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <random>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* Include application code here */
+#include "Application.cpp"
+#include "CmdSeqParser.cpp"
+#include "BackgroundTask.cpp"
+#include "SharedMem.cpp"
+#include "MemPolicy.cpp"
+#include "Checkpoint.cpp"
+#include "ApproxMatcher.cpp"
+#include "Crc.cpp"
+#include "FrameVerifier.cpp"
+#include "ParseEvents.cpp"
+#include "Pipeline.cpp"
+#include "IngestServer.cpp"
+#include "FileReader.cpp"
+#include "RateStats.cpp"
+#include "PatternDfa.cpp"
+#include "LaneScheduler.cpp"
+#include "PerfCounters.cpp"
+#include "Trace.cpp"
+#include "OutputSink.cpp"
+#include "PatternSet.cpp"
+#include "BitSlipMatcher.cpp"
+#include "CommandStats.cpp"
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*
+ * Size of the generated stream and the block handed to the parser
+ */
+#define BENCH_STREAM_SIZE (64u * 1024u * 1024u)
+#define BENCH_BLOCK_SIZE  (64u * 1024u)
+#define BENCH_REPEAT      (3)
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+typedef void (CmdSeqParser::*BenchKernel)(const uint8_t* data, size_t len);
+
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+static void Bench_Generate(std::vector<uint8_t>& stream, double density);
+static double Bench_Kernel(const std::vector<uint8_t>& stream, BenchKernel kernel,
+                           uint64_t* count);
+static void Bench_RunSkipping(void);
+static void Bench_Approx(void);
+static void Bench_BitSlip(void);
+static void Bench_Crc(void);
+static void Bench_Placement(void);
+static void Bench_Pipeline(void);
+static void Bench_Ingest(void);
+static void Bench_FileReader(void);
+static void Bench_RateStats(void);
+static void Bench_Pattern(void);
+static void Bench_Lanes(void);
+static void Bench_Flush(void);
+static void Bench_Counters(void);
+static void Bench_Trace(void);
+static void Bench_Output(void);
+static void Bench_Reload(void);
+static void Bench_Commands(void);
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+/**
+ * @brief Generate 0x00/0xFF fill traffic with A5 5A headers at a density
+ *
+ * @param  stream   generated stream
+ * @param  density  probability that a header starts at a byte
+ * @return None
+ */
+static void Bench_Generate(std::vector<uint8_t>& stream, double density)
+{
+    std::mt19937_64 rng(12345);
+    std::uniform_real_distribution<double> uni(0.0, 1.0);
+
+    stream.resize(BENCH_STREAM_SIZE);
+    size_t i = 0;
+    while (i < stream.size()) {
+        if ((uni(rng) < density) && (i + 2 <= stream.size())) {
+            stream[i++] = 0xA5;
+            stream[i++] = 0x5A;
+        } else {
+            /* Runs of fill bytes as seen between commands */
+            stream[i] = ((i >> 12) & 1) ? 0xFF : 0x00;
+            i++;
+        }
+    }
+}
+
+/**
+ * @brief Run a parser kernel over the stream in blocks
+ *
+ * @param  stream  input stream
+ * @param  kernel  CmdSeqParser block kernel
+ * @param  count   resulting command count
+ * @return best throughput in MB/s
+ */
+static double Bench_Kernel(const std::vector<uint8_t>& stream, BenchKernel kernel,
+                           uint64_t* count)
+{
+    double best = 0.0;
+
+    for (int r = 0; r < BENCH_REPEAT; r++) {
+        SharedMem shmem;
+        CmdSeqParser parser(&shmem);
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < stream.size(); i += BENCH_BLOCK_SIZE) {
+            size_t len = stream.size() - i;
+            if (len > BENCH_BLOCK_SIZE) {
+                len = BENCH_BLOCK_SIZE;
+            }
+            (parser.*kernel)(&stream[i], len);
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        double sec = std::chrono::duration<double>(end - start).count();
+        double mbps = (double)stream.size() / sec / 1e6;
+        if (mbps > best) {
+            best = mbps;
+        }
+        *count = parser.getCount();
+    }
+    return best;
+}
+
+/**
+ * @brief Compare the byte by byte path and the run skipping path
+ *
+ * @param  None
+ * @return None
+ */
+static void Bench_RunSkipping(void)
+{
+    const double densities[] = { 0.0, 1e-6, 1e-4, 1e-3, 1e-2, 1e-1 };
+    std::vector<uint8_t> stream;
+
+    printf("Run skipping (MB/s, %u MiB stream)\n", BENCH_STREAM_SIZE >> 20);
+    printf("%-10s %12s %12s %8s %10s\n", "density", "scalar", "bulk", "speedup", "count");
+    for (double density : densities) {
+        uint64_t scalarCount;
+        uint64_t bulkCount;
+
+        Bench_Generate(stream, density);
+        double scalar = Bench_Kernel(stream, &CmdSeqParser::parseBlockScalar, &scalarCount);
+        double bulk = Bench_Kernel(stream, &CmdSeqParser::parseBlock, &bulkCount);
+        printf("%-10g %12.1f %12.1f %7.1fx %10llu%s\n", density, scalar, bulk,
+               bulk / scalar, (unsigned long long)bulkCount,
+               (scalarCount == bulkCount) ? "" : "  MISMATCH");
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Throughput of approximate matching next to the exact path
+ *
+ * @param  None
+ * @return None
+ */
+static void Bench_Approx(void)
+{
+    const uint8_t header[] = { 0xA5, 0x5A };
+    std::vector<uint8_t> stream;
+    std::mt19937_64 rng(777);
+    uint64_t count;
+
+    /* Corrupt one bit in every tenth header */
+    Bench_Generate(stream, 1e-3);
+    for (size_t i = 0; i + 1 < stream.size(); i++) {
+        if ((stream[i] == 0xA5) && (stream[i + 1] == 0x5A) && ((rng() % 10) == 0)) {
+            stream[i + (rng() & 1)] ^= (uint8_t)(1u << (rng() % 8));
+        }
+    }
+
+    printf("Approximate matching (MB/s, density 1e-3, 10%% headers with 1 bit error)\n");
+    printf("%-10s %12s %10s %10s\n", "engine", "MB/s", "exact", "approx");
+    double scalar = Bench_Kernel(stream, &CmdSeqParser::parseBlockScalar, &count);
+    printf("%-10s %12.1f %10llu %10s\n", "scalar", scalar, (unsigned long long)count, "-");
+    double bulk = Bench_Kernel(stream, &CmdSeqParser::parseBlock, &count);
+    printf("%-10s %12.1f %10llu %10s\n", "bulk", bulk, (unsigned long long)count, "-");
+
+    for (unsigned k = 0; k <= 2; k++) {
+        double best = 0.0;
+        uint64_t exact = 0;
+        uint64_t approxCount = 0;
+        for (int r = 0; r < BENCH_REPEAT; r++) {
+            ApproxMatcher approx(header, sizeof(header), k);
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < stream.size(); i += BENCH_BLOCK_SIZE) {
+                approx.scan(&stream[i], std::min<size_t>(BENCH_BLOCK_SIZE, stream.size() - i));
+            }
+            auto end = std::chrono::steady_clock::now();
+            double mbps = (double)stream.size() / std::chrono::duration<double>(end - start).count() / 1e6;
+            best = std::max(best, mbps);
+            exact = approx.getExactCount();
+            approxCount = approx.getApproxCount();
+        }
+        char name[16];
+        snprintf(name, sizeof(name), "k=%u", k);
+        printf("%-10s %12.1f %10llu %10llu\n", name, best, (unsigned long long)exact,
+               (unsigned long long)approxCount);
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Throughput of the bit-granular header search next to the byte path
+ *
+ * The same stream is slipped by 0 to 7 bits; the byte parser only sees
+ * the headers at slip 0, the bit search finds them at every slip.
+ *
+ * @param  None
+ * @return None
+ */
+static void Bench_BitSlip(void)
+{
+    std::vector<uint8_t> aligned;
+    std::vector<uint8_t> stream(BENCH_STREAM_SIZE);
+    uint64_t count;
+    Bench_Generate(aligned, 1e-3);
+
+    auto run = [&](const char* name) {
+        double bulk = Bench_Kernel(stream, &CmdSeqParser::parseBlock, &count);
+        double best = 0.0;
+        uint64_t found = 0;
+        for (int r = 0; r < BENCH_REPEAT; r++) {
+            BitSlipMatcher matcher;
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < stream.size(); i += BENCH_BLOCK_SIZE) {
+                matcher.scan(&stream[i], std::min<size_t>(BENCH_BLOCK_SIZE, stream.size() - i));
+            }
+            auto end = std::chrono::steady_clock::now();
+            double mbps = (double)stream.size() / std::chrono::duration<double>(end - start).count() / 1e6;
+            best = std::max(best, mbps);
+            found = matcher.getCount();
+        }
+        printf("%-6s %12.1f %10llu %12.1f %10llu\n", name, bulk, (unsigned long long)count, best,
+               (unsigned long long)found);
+    };
+
+    printf("Bit-slip search (MB/s, density 1e-3)\n");
+    printf("%-6s %12s %10s %12s %10s\n", "slip", "bulk MB/s", "bulk", "bit MB/s", "bit");
+    for (unsigned slip = 0; slip < 8; slip++) {
+        for (size_t i = 0; i < aligned.size(); i++) {
+            uint8_t prev = (i > 0) ? aligned[i - 1] : 0;
+            stream[i] = (slip == 0) ? aligned[i] :
+                        (uint8_t)((aligned[i] >> slip) | (prev << (8 - slip)));
+        }
+        char name[8];
+        snprintf(name, sizeof(name), "%u", slip);
+        run(name);
+    }
+
+    /* Random bytes: about one in 32 is a candidate middle byte */
+    std::mt19937_64 rng(45);
+    for (size_t i = 0; i < stream.size(); i += 8) {
+        uint64_t r = rng();
+        memcpy(&stream[i], &r, sizeof(r));
+    }
+    run("random");
+    printf("\n");
+}
+
+/**
+ * @brief CRC throughput per implementation next to the parse throughput
+ *
+ * @param  None
+ * @return None
+ */
+static void Bench_Crc(void)
+{
+    const size_t payloadLen = 64;
+    std::vector<uint8_t> stream;
+    std::mt19937_64 rng(99);
+    uint64_t count;
+
+    /* Back to back CRC32C frames with random payloads free of headers */
+    while (stream.size() + payloadLen + 7 <= BENCH_STREAM_SIZE) {
+        uint8_t payload[payloadLen];
+        for (size_t i = 0; i < payloadLen; i++) {
+            payload[i] = (uint8_t)(rng() & 0x7F);
+        }
+        uint32_t crc = Crc32c(payload, payloadLen);
+        stream.insert(stream.end(), { 0xA5, 0x5A, (uint8_t)payloadLen });
+        stream.insert(stream.end(), payload, payload + payloadLen);
+        stream.insert(stream.end(), { (uint8_t)crc, (uint8_t)(crc >> 8),
+                                      (uint8_t)(crc >> 16), (uint8_t)(crc >> 24) });
+    }
+
+    printf("CRC and frame verification (MB/s, %u byte payload frames)\n", (unsigned)payloadLen);
+    printf("%-22s %12s\n", "stage", "MB/s");
+    printf("%-22s %12.1f\n", "parse scalar",
+           Bench_Kernel(stream, &CmdSeqParser::parseBlockScalar, &count));
+    printf("%-22s %12.1f\n", "parse bulk",
+           Bench_Kernel(stream, &CmdSeqParser::parseBlock, &count));
+
+    struct {
+        const char* name;
+        bool crc32;
+        CrcImpl impl;
+    } impls[] = {
+        { "crc16 bytewise", false, CrcImpl::BYTEWISE },
+        { "crc16 slice-by-8", false, CrcImpl::SLICE_BY_8 },
+        { "crc32c bytewise", true, CrcImpl::BYTEWISE },
+        { "crc32c slice-by-8", true, CrcImpl::SLICE_BY_8 },
+        { "crc32c hardware", true, CrcImpl::HARDWARE },
+    };
+    for (auto& impl : impls) {
+        double best = 0.0;
+        uint32_t crc = 0;
+        for (int r = 0; r < BENCH_REPEAT; r++) {
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < stream.size(); i += BENCH_BLOCK_SIZE) {
+                size_t len = std::min<size_t>(BENCH_BLOCK_SIZE, stream.size() - i);
+                if (impl.crc32) {
+                    crc = Crc32c_UpdateImpl(impl.impl, crc, &stream[i], len);
+                } else {
+                    crc = Crc16_UpdateImpl(impl.impl, (uint16_t)crc, &stream[i], len);
+                }
+            }
+            auto end = std::chrono::steady_clock::now();
+            best = std::max(best, (double)stream.size() /
+                            std::chrono::duration<double>(end - start).count() / 1e6);
+        }
+        printf("%-22s %12.1f  (crc %08x)\n", impl.name, best, crc);
+    }
+
+    double best = 0.0;
+    uint64_t valid = 0;
+    for (int r = 0; r < BENCH_REPEAT; r++) {
+        FrameVerifier verifier(FrameVerifier::CrcType::CRC32C);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < stream.size(); i += BENCH_BLOCK_SIZE) {
+            verifier.feed(&stream[i], std::min<size_t>(BENCH_BLOCK_SIZE, stream.size() - i));
+        }
+        auto end = std::chrono::steady_clock::now();
+        best = std::max(best, (double)stream.size() /
+                        std::chrono::duration<double>(end - start).count() / 1e6);
+        valid = verifier.getValidCount();
+    }
+    printf("%-22s %12.1f  (%llu valid frames, crc32c %s)\n\n", "verify frames", best,
+           (unsigned long long)valid,
+           (Crc32c_Selected() == CrcImpl::HARDWARE) ? "hardware" : "slice-by-8");
+}
+
+/**
+ * @brief Parse throughput with local/remote and 4 KiB/2 MiB page placement
+ *
+ * The benchmark thread is pinned to node 0, the buffer is bound to each
+ * node in turn.
+ *
+ * @param  None
+ * @return None
+ */
+static void Bench_Placement(void)
+{
+    std::vector<uint8_t> stream;
+    int nodes = MemPolicy_NodeCount();
+    cpu_set_t cpus;
+
+    Bench_Generate(stream, 1e-2);
+    if (MemPolicy_NodeCpus(0, &cpus)) {
+        MemPolicy_PinThread(pthread_self(), &cpus);
+    }
+
+    printf("Buffer placement (MB/s, thread on node 0, %d node(s))\n", nodes);
+    printf("%-6s %-6s %6s %6s %8s %12s\n", "node", "pages", "bound", "huge", "actual", "MB/s");
+    for (int node = 0; node < nodes; node++) {
+        for (int huge = 0; huge <= 1; huge++) {
+            MemPolicy policy;
+            MemRegion region;
+            policy.hugePages = (huge != 0);
+            policy.node = node;
+            if (!region.allocate(stream.size(), policy)) {
+                printf("%-6d %-6s allocation failed\n", node, huge ? "2M" : "4K");
+                continue;
+            }
+            memcpy(region.data(), stream.data(), stream.size());
+
+            double best = 0.0;
+            for (int r = 0; r < BENCH_REPEAT; r++) {
+                SharedMem shmem;
+                CmdSeqParser parser(&shmem);
+                auto start = std::chrono::steady_clock::now();
+                for (size_t i = 0; i < stream.size(); i += BENCH_BLOCK_SIZE) {
+                    parser.parseBlock(region.data() + i,
+                                      std::min<size_t>(BENCH_BLOCK_SIZE, stream.size() - i));
+                }
+                auto end = std::chrono::steady_clock::now();
+                best = std::max(best, (double)stream.size() /
+                                std::chrono::duration<double>(end - start).count() / 1e6);
+            }
+            printf("%-6d %-6s %6s %6s %8d %12.1f\n", node, huge ? "2M" : "4K",
+                   region.isBound() ? "yes" : "no", region.isHuge() ? "yes" : "no",
+                   MemPolicy_NodeOf(region.data()), best);
+        }
+    }
+    if (nodes == 1) {
+        printf("single node host, no remote placement to compare\n");
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Staged pipeline throughput per batch size with stage metrics
+ *
+ * @param  None
+ * @return None
+ */
+static void Bench_Pipeline(void)
+{
+    const size_t batchSizes[] = { 1, 8, 64 };
+    const size_t ringSize = 1024 * 1024;
+    std::vector<uint8_t> stream;
+
+    Bench_Generate(stream, 1e-3);
+    printf("Staged pipeline (ring %zu KiB, 16 KiB buffers, %u CPU(s))\n", ringSize >> 10,
+           std::thread::hardware_concurrency());
+    for (size_t batch : batchSizes) {
+        PipelineConfig config;
+        config.batchSize = batch;
+        config.bufferSize = 16 * 1024;
+        config.buffers = 256;
+        config.queueDepth = 64;
+        for (int s = 0; s < PIPELINE_STAGES; s++) {
+            config.cpus[s] = (int)(s % std::max(1u, std::thread::hardware_concurrency()));
+        }
+        SharedMem shmem(ringSize, MemPolicy());
+        CmdSeqParser parser(&shmem);
+        FrameVerifier frames(FrameVerifier::CrcType::CRC32C);
+        Pipeline pipeline(&shmem, &parser, &frames, config);
+        pipeline.start();
+
+        auto start = std::chrono::steady_clock::now();
+        size_t pos = 0;
+        while (pos < stream.size()) {
+            size_t n = shmem.PutBlock(&stream[pos], stream.size() - pos);
+            pos += n;
+            pipeline.notifyDataAvailable();
+            if (n == 0) {
+                std::this_thread::yield();
+            }
+        }
+        pipeline.stop();
+        auto end = std::chrono::steady_clock::now();
+
+        double mbps = (double)stream.size() / std::chrono::duration<double>(end - start).count() / 1e6;
+        printf("batch %-4zu %10.1f MB/s  count %llu\n", batch, mbps,
+               (unsigned long long)pipeline.getCount());
+        printf("  %-8s %10s %10s %12s %12s %10s\n", "stage", "items", "batches",
+               "stall-empty", "stall-full", "occupancy");
+        for (int s = 0; s < PIPELINE_STAGES; s++) {
+            StageStats st = pipeline.getStats((Pipeline::Stage)s);
+            printf("  %-8s %10llu %10llu %12llu %12llu %9.0f%%\n",
+                   Pipeline::getStageName((Pipeline::Stage)s),
+                   (unsigned long long)st.items, (unsigned long long)st.batches,
+                   (unsigned long long)st.stallsEmpty, (unsigned long long)st.stallsFull,
+                   st.occupancy * 100.0);
+        }
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Loopback unix socket ingestion throughput and syscalls per MB
+ *
+ * All connections are served by the single epoll thread, i.e. one core.
+ *
+ * @param  None
+ * @return None
+ */
+static void Bench_Ingest(void)
+{
+    const char* path = "/tmp/seqparser_bench.sock";
+    const int connections[] = { 1, 4, 16, 64 };
+    const size_t writeSize = 64 * 1024;
+    std::vector<uint8_t> stream;
+
+    Bench_Generate(stream, 1e-3);
+    printf("Unix socket ingestion (%u MiB total, %zu KiB writes, 1 server thread)\n",
+           BENCH_STREAM_SIZE >> 20, writeSize >> 10);
+    printf("%-6s %10s %12s %12s %10s\n", "conns", "MB/s", "reads/MB", "waits/MB", "count");
+    for (int conns : connections) {
+        IngestServer server(256 * 1024, MemPolicy());
+        if (!server.listen(path) || !server.start()) {
+            printf("server setup failed\n");
+            return;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> clients;
+        size_t share = stream.size() / conns;
+        for (int c = 0; c < conns; c++) {
+            clients.emplace_back([&, c]() {
+                struct sockaddr_un addr;
+                memset(&addr, 0, sizeof(addr));
+                addr.sun_family = AF_UNIX;
+                strcpy(addr.sun_path, path);
+                int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+                if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+                    close(fd);
+                    return;
+                }
+                const uint8_t* data = &stream[c * share];
+                for (size_t pos = 0; pos < share; ) {
+                    ssize_t ret = write(fd, data + pos, std::min(writeSize, share - pos));
+                    if (ret <= 0) {
+                        break;
+                    }
+                    pos += (size_t)ret;
+                }
+                close(fd);
+            });
+        }
+        for (auto& t : clients) {
+            t.join();
+        }
+        while (server.getStats().closed < (uint64_t)conns) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        auto end = std::chrono::steady_clock::now();
+        server.stop();
+
+        IngestStats st = server.getStats();
+        double mb = (double)st.bytes / 1e6;
+        printf("%-6d %10.1f %12.2f %12.2f %10llu\n", conns,
+               mb / std::chrono::duration<double>(end - start).count(),
+               (double)st.reads / mb, (double)st.waits / mb,
+               (unsigned long long)server.getTotalCount());
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Capture file replay throughput per read backend
+ *
+ * The page cache of the file is dropped before every run so the reads hit
+ * the device; the O_DIRECT runs bypass it altogether.
+ *
+ * @param  None
+ * @return None
+ */
+static void Bench_FileReader(void)
+{
+    const char* path = "/tmp/seqparser_bench_capture.bin";
+    const FileReader::Backend backends[] = {
+        FileReader::Backend::IO_URING, FileReader::Backend::THREAD_POOL,
+        FileReader::Backend::READ, FileReader::Backend::MMAP
+    };
+    std::vector<uint8_t> stream;
+
+    Bench_Generate(stream, 1e-3);
+    FILE* fp = fopen(path, "wb");
+    if ((fp == NULL) || (fwrite(stream.data(), 1, stream.size(), fp) != stream.size())) {
+        printf("capture file setup failed\n");
+        if (fp != NULL) {
+            fclose(fp);
+        }
+        return;
+    }
+    fflush(fp);
+    fsync(fileno(fp));
+    fclose(fp);
+
+    printf("Capture file replay (%u MiB, 256 KiB blocks, depth 8, cold cache)\n",
+           BENCH_STREAM_SIZE >> 20);
+    printf("%-12s %-8s %10s %10s\n", "backend", "direct", "MB/s", "count");
+    for (bool direct : { false, true }) {
+        for (FileReader::Backend backend : backends) {
+            if (direct && (backend == FileReader::Backend::MMAP)) {
+                continue;
+            }
+            int fd = open(path, O_RDONLY);
+            if (fd >= 0) {
+                posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+                close(fd);
+            }
+
+            FileReaderConfig config;
+            config.backend = backend;
+            config.direct = direct;
+            FileReader reader(config);
+            SharedMem shmem;
+            CmdSeqParser parser(&shmem);
+            auto start = std::chrono::steady_clock::now();
+            bool ok = reader.read(path, &parser);
+            auto end = std::chrono::steady_clock::now();
+            if (!ok) {
+                printf("%-12s %-8s %10s\n", FileReader::getBackendName(backend),
+                       direct ? "yes" : "no", "n/a");
+                continue;
+            }
+            printf("%-12s %-8s %10.1f %10llu\n", FileReader::getBackendName(backend),
+                   direct ? "yes" : "no",
+                   (double)reader.getBytes() / 1e6 / std::chrono::duration<double>(end - start).count(),
+                   (unsigned long long)parser.getCount());
+        }
+    }
+    unlink(path);
+    printf("\n");
+}
+
+/**
+ * @brief Cost of the windowed statistics on the bulk path
+ *
+ * Each block reads the coarse clock once and each match adds a gap, so
+ * small blocks and dense traffic are the worst case.
+ *
+ * @param  None
+ * @return None
+ */
+static void Bench_RateStats(void)
+{
+    const double densities[] = { 1e-4, 1e-2, 1e-1 };
+    const size_t blocks[] = { 4096, BENCH_BLOCK_SIZE };
+    std::vector<uint8_t> stream;
+
+    printf("Rate statistics overhead (%u MiB)\n", BENCH_STREAM_SIZE >> 20);
+    printf("%-10s %-8s %10s %10s %8s\n", "density", "block", "off MB/s", "on MB/s", "cost");
+    for (double density : densities) {
+        Bench_Generate(stream, density);
+        for (size_t block : blocks) {
+            double best[2] = { 0.0, 0.0 };
+            for (int r = 0; r < BENCH_REPEAT; r++) {
+                for (int on = 0; on < 2; on++) {
+                    SharedMem shmem;
+                    CmdSeqParser parser(&shmem);
+                    RateStats stats;
+                    if (on) {
+                        parser.setRateStats(&stats);
+                    }
+                    auto start = std::chrono::steady_clock::now();
+                    for (size_t i = 0; i < stream.size(); i += block) {
+                        parser.parseBlock(&stream[i], std::min(block, stream.size() - i));
+                    }
+                    auto end = std::chrono::steady_clock::now();
+                    double mbps = (double)stream.size() / 1e6 /
+                                  std::chrono::duration<double>(end - start).count();
+                    best[on] = (mbps > best[on]) ? mbps : best[on];
+                }
+            }
+            printf("%-10g %-8zu %10.1f %10.1f %7.1f%%\n", density, block, best[0], best[1],
+                   (best[0] / best[1] - 1.0) * 100.0);
+        }
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Compile cost, table size and scan speed of header patterns
+ *
+ * Fill traffic lets the start state be skipped, uniform random bytes make
+ * the DFA take every byte.
+ *
+ * @param  None
+ * @return None
+ */
+static void Bench_Pattern(void)
+{
+    const char* patterns[] = {
+        "A5+ 5A",
+        "A5 ?? 5A",
+        "A5 [00-0F] 5A",
+        "A5 ??{1,4} 5A [10-1F 30-3F]",
+        "A5 5A [00-0F]{2} ?? [80-FF] 5A{2,} 0D 0A",
+        "[A0-AF]{3,8} ??{0,6} 5A [^00] [01 03 05 07]{2,4}",
+    };
+    std::vector<uint8_t> fill;
+    std::vector<uint8_t> random(BENCH_STREAM_SIZE);
+    std::mt19937_64 rng(36);
+
+    Bench_Generate(fill, 1e-3);
+    for (size_t i = 0; i < random.size(); i += 8) {
+        uint64_t r = rng();
+        memcpy(&random[i], &r, sizeof(r));
+    }
+    printf("Pattern DFA (%u MiB)\n", BENCH_STREAM_SIZE >> 20);
+    printf("%-50s %8s %6s %7s %8s %10s %10s\n", "pattern", "compile", "states", "classes",
+           "table", "fill MB/s", "rand MB/s");
+    for (const char* pattern : patterns) {
+        PatternDfa dfa;
+        if (!dfa.compile(pattern)) {
+            printf("%-50s %s\n", pattern, dfa.getError());
+            continue;
+        }
+        double best[2] = { 0.0, 0.0 };
+        for (int r = 0; r < BENCH_REPEAT; r++) {
+            for (int k = 0; k < 2; k++) {
+                const std::vector<uint8_t>& stream = (k == 0) ? fill : random;
+                dfa.reset();
+                auto start = std::chrono::steady_clock::now();
+                for (size_t i = 0; i < stream.size(); i += BENCH_BLOCK_SIZE) {
+                    dfa.scan(&stream[i], std::min<size_t>(BENCH_BLOCK_SIZE, stream.size() - i));
+                }
+                auto end = std::chrono::steady_clock::now();
+                double mbps = (double)stream.size() / 1e6 /
+                              std::chrono::duration<double>(end - start).count();
+                best[k] = (mbps > best[k]) ? mbps : best[k];
+            }
+        }
+        const PatternStats& st = dfa.getStats();
+        printf("%-50s %6.1fus %6u %7u %7zuB %10.1f %10.1f\n", pattern, (double)st.compileNs / 1e3,
+               st.states, st.classes, st.tableBytes, best[0], best[1]);
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Control lane latency while bulk lanes are saturated
+ *
+ * Four producers flood bulk rings while a control producer sends a header
+ * every 100 us. "fifo" gives every lane the same config, "lanes" gives the
+ * control lane a deadline and priority and batches the bulk lanes.
+ *
+ * @param  None
+ * @return None
+ */
+static void Bench_Lanes(void)
+{
+    const int bulkLanes = 4;
+    const size_t ringSize = 256 * 1024;
+    std::vector<uint8_t> stream;
+
+    Bench_Generate(stream, 1e-3);
+    printf("Lane scheduling (%d saturated bulk lanes, control header every 100 us, 1 s)\n",
+           bulkLanes);
+    printf("%-6s %-8s %10s %10s %10s %10s %10s\n", "mode", "lane", "services", "MB", "p50 us",
+           "p99 us", "max us");
+    for (int mode = 0; mode < 2; mode++) {
+        LaneScheduler scheduler;
+        std::vector<SharedMem*> mems;
+        std::vector<CmdSeqParser*> parsers;
+        for (int l = 0; l <= bulkLanes; l++) {
+            mems.push_back(new SharedMem(ringSize, MemPolicy()));
+            parsers.push_back(new CmdSeqParser(mems.back()));
+            LaneConfig config;
+            if ((mode == 1) && (l == 0)) {
+                config.priority = 1;
+                config.deadlineUs = 200;
+            } else if (mode == 1) {
+                config.batchBytes = 16 * 1024;
+                config.deadlineUs = 10000;
+            }
+            scheduler.addLane(mems.back(), parsers.back(), config);
+        }
+        scheduler.start();
+
+        std::atomic<bool> done{false};
+        std::vector<std::thread> producers;
+        for (int l = 1; l <= bulkLanes; l++) {
+            producers.emplace_back([&, l]() {
+                size_t pos = 0;
+                while (!done.load(std::memory_order_relaxed)) {
+                    size_t len = std::min<size_t>(4096, stream.size() - pos);
+                    size_t n = mems[l]->PutBlock(&stream[pos], len);
+                    if (n > 0) {
+                        scheduler.notify((size_t)l);
+                    } else {
+                        std::this_thread::sleep_for(std::chrono::microseconds(50));
+                    }
+                    pos = (pos + n) % stream.size();
+                }
+            });
+        }
+        producers.emplace_back([&]() {
+            const uint8_t header[] = { 0xA5, 0x5A };
+            auto next = std::chrono::steady_clock::now();
+            while (!done.load(std::memory_order_relaxed)) {
+                next += std::chrono::microseconds(100);
+                std::this_thread::sleep_until(next);
+                if (mems[0]->PutBlock(header, sizeof(header)) > 0) {
+                    scheduler.notify(0);
+                }
+            }
+        });
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        done = true;
+        for (auto& t : producers) {
+            t.join();
+        }
+        scheduler.stop();
+
+        for (int l = 0; l <= bulkLanes; l++) {
+            LaneStats st = scheduler.getStats((size_t)l);
+            printf("%-6s %-8s %10llu %10.1f %10.1f %10.1f %10.1f\n", (mode == 0) ? "fifo" : "lanes",
+                   (l == 0) ? "control" : "bulk", (unsigned long long)st.services,
+                   (double)st.bytes / 1e6, (double)st.p50Ns / 1e3, (double)st.p99Ns / 1e3,
+                   (double)st.maxNs / 1e3);
+            delete parsers[l];
+            delete mems[l];
+        }
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Auto tuned flush threshold against the arrival rate
+ *
+ * A paced producer writes 64 byte chunks and only signals when the ring is
+ * full, the max delay is 1 ms.
+ *
+ * @param  None
+ * @return None
+ */
+static void Bench_Flush(void)
+{
+    const double rates[] = { 1e4, 1e6, 2e7, 2e8 };
+    const size_t chunk = 64;
+    std::vector<uint8_t> stream;
+
+    Bench_Generate(stream, 1e-3);
+    printf("Latency bounded flush (max delay 1 ms, auto threshold, 64 KiB ring, 0.5 s)\n");
+    printf("%-10s %12s %10s %10s %10s %10s %12s\n", "rate B/s", "measured", "threshold",
+           "by thresh", "by delay", "signaled", "bytes/parse");
+    for (double rate : rates) {
+        SharedMem shmem(64 * 1024, MemPolicy());
+        CmdSeqParser parser(&shmem);
+        BackgroundTask task(&parser);
+        Application app(&task);
+        FlushPolicy policy;
+        policy.maxDelayUs = 1000;
+        app.setFlushPolicy(policy);
+        app.start();
+
+        auto start = std::chrono::steady_clock::now();
+        auto end = start + std::chrono::milliseconds(500);
+        size_t pos = 0;
+        uint64_t sent = 0;
+        while (std::chrono::steady_clock::now() < end) {
+            /* Pace in bursts of at most 1 ms worth of chunks */
+            double due = rate * std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            while ((double)sent < due) {
+                size_t n = shmem.PutBlock(&stream[pos], chunk);
+                if (n < chunk) {
+                    app.dataAvailable();
+                    std::this_thread::yield();
+                }
+                pos = (pos + n) % (stream.size() - chunk);
+                sent += n;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        app.stop();
+
+        FlushStats st = task.getFlushStats();
+        uint64_t parses = st.threshold + st.deadline + st.signaled;
+        printf("%-10g %12.0f %10zu %10llu %10llu %10llu %12.0f\n", rate, st.bytesPerSec,
+               st.thresholdBytes, (unsigned long long)st.threshold,
+               (unsigned long long)st.deadline, (unsigned long long)st.signaled,
+               (parses > 0) ? (double)parser.getOffset() / (double)parses : 0.0);
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Hardware counters per byte for each kernel and input
+ *
+ * @param  None
+ * @return None
+ */
+static void Bench_Counters(void)
+{
+    const struct {
+        const char* name;
+        double density;
+    } inputs[] = { { "fill", 0.0 }, { "density 1e-3", 1e-3 }, { "density 1e-1", 1e-1 }, { "random", -1.0 } };
+    const uint8_t header[] = { 0xA5, 0x5A };
+    PerfCounters perf;
+    std::vector<uint8_t> stream;
+
+    printf("Hardware counters per kernel and input (%u MiB, %u KiB batches)\n",
+           BENCH_STREAM_SIZE >> 20, BENCH_BLOCK_SIZE >> 10);
+    for (const auto& input : inputs) {
+        if (input.density >= 0.0) {
+            Bench_Generate(stream, input.density);
+        } else {
+            std::mt19937_64 rng(40);
+            for (size_t i = 0; i < stream.size(); i += 8) {
+                uint64_t r = rng();
+                memcpy(&stream[i], &r, sizeof(r));
+            }
+        }
+
+        SharedMem shmem;
+        CmdSeqParser scalar(&shmem);
+        CmdSeqParser bulk(&shmem);
+        PatternDfa dfa;
+        ApproxMatcher approx(header, sizeof(header), 2);
+        dfa.compile("A5+ 5A");
+        for (size_t i = 0; i < stream.size(); i += BENCH_BLOCK_SIZE) {
+            const uint8_t* block = &stream[i];
+            size_t len = std::min<size_t>(BENCH_BLOCK_SIZE, stream.size() - i);
+            perf.begin();
+            scalar.parseBlockScalar(block, len);
+            perf.end("scalar", input.name, len);
+            perf.begin();
+            bulk.parseBlock(block, len);
+            perf.end("bulk", input.name, len);
+            perf.begin();
+            dfa.scan(block, len);
+            perf.end("pattern-dfa", input.name, len);
+            perf.begin();
+            approx.scan(block, len);
+            perf.end("approx k=2", input.name, len);
+        }
+        if ((scalar.getCount() != bulk.getCount()) || (dfa.getCount() != bulk.getCount()) ||
+            (approx.getExactCount() != bulk.getCount())) {
+            printf("count mismatch on %s\n", input.name);
+        }
+    }
+    perf.print(stdout);
+    printf("\n");
+}
+
+/**
+ * @brief Cost of tracing a parse call, switched off and on
+ *
+ * Each call is a PutBlock and a parseAvailable: three records when on.
+ *
+ * @param  None
+ * @return None
+ */
+static void Bench_Trace(void)
+{
+    const size_t chunks[] = { 64, 4096 };
+    const bool wasEnabled = Trace::isEnabled();
+    std::vector<uint8_t> stream;
+
+    Bench_Generate(stream, 1e-3);
+    printf("Event tracing (PutBlock + parseAvailable per call)\n");
+    printf("%-8s %14s %14s %10s\n", "chunk", "off ns/call", "on ns/call", "overhead");
+    for (size_t chunk : chunks) {
+        double ns[2];
+        for (int on = 0; on < 2; on++) {
+            SharedMem shmem(chunk, MemPolicy());
+            CmdSeqParser parser(&shmem);
+            size_t calls = stream.size() / chunk;
+            Trace::enable(on != 0);
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < calls; i++) {
+                shmem.PutBlock(&stream[i * chunk], chunk);
+                parser.parseAvailable();
+            }
+            auto end = std::chrono::steady_clock::now();
+            ns[on] = std::chrono::duration<double, std::nano>(end - start).count() / (double)calls;
+        }
+        printf("%-8zu %14.1f %14.1f %9.1f%%\n", chunk, ns[0], ns[1], (ns[1] / ns[0] - 1.0) * 100.0);
+    }
+    Trace::enable(wasEnabled);
+    printf("\n");
+}
+
+/**
+ * @brief Bulk parse throughput with match records written to files
+ *
+ * A 64 KiB queue of records is drained by the writer thread while the
+ * stream is parsed; whatever it cannot take in time is dropped.
+ *
+ * @param  None
+ * @return None
+ */
+static void Bench_Output(void)
+{
+    const struct {
+        const char* name;
+        bool enabled;
+        OutputConfig::Format format;
+        bool direct;
+    } sinks[] = {
+        { "none", false, OutputConfig::Format::BINARY, false },
+        { "binary", true, OutputConfig::Format::BINARY, false },
+        { "binary", true, OutputConfig::Format::BINARY, true },
+        { "csv", true, OutputConfig::Format::CSV, false },
+    };
+    const double densities[] = { 1e-3, 1e-2 };
+
+    printf("Match records to files (64 MiB rotation, 1 MiB writes)\n");
+    printf("%-8s %-8s %-8s %10s %10s %10s %10s %10s\n", "density", "format", "direct", "MB/s",
+           "records", "dropped", "writes", "MB out");
+    for (double density : densities) {
+        std::vector<uint8_t> stream;
+        Bench_Generate(stream, density);
+        for (const auto& s : sinks) {
+            OutputConfig config;
+            config.path = "/tmp/seqparser_bench_out";
+            config.format = s.format;
+            config.direct = s.direct;
+            config.maxFileBytes = 64ull * 1024 * 1024;
+            OutputSink sink(config);
+            SharedMem shmem;
+            CmdSeqParser parser(&shmem);
+            if (s.enabled) {
+                if (!sink.start()) {
+                    printf("%-8g %-8s %-8s %10s\n", density, s.name, s.direct ? "yes" : "no", "n/a");
+                    continue;
+                }
+                parser.setOutputSink(&sink);
+            }
+            auto start = std::chrono::steady_clock::now();
+            for (size_t pos = 0; pos < stream.size(); pos += BENCH_BLOCK_SIZE) {
+                parser.parseBlock(&stream[pos], BENCH_BLOCK_SIZE);
+            }
+            auto end = std::chrono::steady_clock::now();
+            sink.stop();
+
+            OutputStats st = sink.getStats();
+            printf("%-8g %-8s %-8s %10.1f %10llu %10llu %10llu %10.1f\n", density, s.name,
+                   st.direct ? "yes" : "no",
+                   (double)stream.size() / 1e6 / std::chrono::duration<double>(end - start).count(),
+                   (unsigned long long)st.queued, (unsigned long long)st.dropped,
+                   (unsigned long long)st.writes, (double)st.bytes / 1e6);
+            for (uint64_t f = 0; f < st.files; f++) {
+                unlink(sink.getFileName(f).c_str());
+            }
+        }
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Cost of reloadable patterns on the parse loop, and swap latency
+ *
+ * "dfa" scans with a bare PatternDfa, "set" with the same pattern in a
+ * PatternSet, "set+reload" while another thread reloads every interval.
+ * Swap latency is reload() to take up by the parse loop, so it includes
+ * the wait for the next block.
+ *
+ * @param  None
+ * @return None
+ */
+static void Bench_Reload(void)
+{
+    const char* pattern = "A5 ??{1,4} 5A [10-1F 30-3F]";
+    const std::vector<PatternSpec> specs[2] = {
+        { { "hdr", pattern }, { "other", "A5 5A [00-0F]" } },
+        { { "hdr", pattern }, { "other", "A5 5A [00-1F]" } },
+    };
+    const unsigned intervalsUs[] = { 10000, 1000, 100 };
+    std::vector<uint8_t> stream;
+    Bench_Generate(stream, 1e-3);
+
+    auto scan = [&](auto&& f) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < stream.size(); i += BENCH_BLOCK_SIZE) {
+            f(&stream[i], std::min<size_t>(BENCH_BLOCK_SIZE, stream.size() - i));
+        }
+        auto end = std::chrono::steady_clock::now();
+        return (double)stream.size() / 1e6 / std::chrono::duration<double>(end - start).count();
+    };
+
+    printf("Pattern reload (%u MiB, %u KiB blocks, 2 patterns)\n", BENCH_STREAM_SIZE >> 20,
+           BENCH_BLOCK_SIZE >> 10);
+    printf("%-12s %10s %10s %8s %12s %12s %12s\n", "mode", "interval", "MB/s", "swaps",
+           "reload us", "last swap us", "max swap us");
+    double best = 0.0;
+    for (int r = 0; r < BENCH_REPEAT; r++) {
+        PatternDfa dfa[2];
+        dfa[0].compile(specs[0][0].pattern.c_str());
+        dfa[1].compile(specs[0][1].pattern.c_str());
+        double mbps = scan([&](const uint8_t* data, size_t len) {
+            dfa[0].scan(data, len);
+            dfa[1].scan(data, len);
+        });
+        best = (mbps > best) ? mbps : best;
+    }
+    printf("%-12s %10s %10.1f\n", "dfa", "-", best);
+
+    best = 0.0;
+    for (int r = 0; r < BENCH_REPEAT; r++) {
+        PatternSet set;
+        set.reload(specs[0]);
+        double mbps = scan([&](const uint8_t* data, size_t len) { set.scan(data, len); });
+        best = (mbps > best) ? mbps : best;
+    }
+    printf("%-12s %10s %10.1f\n", "set", "-", best);
+
+    for (unsigned us : intervalsUs) {
+        PatternSet set;
+        set.reload(specs[0]);
+        std::atomic<bool> done(false);
+        uint64_t reloads = 0;
+        uint64_t reloadNs = 0;
+        std::thread control([&]() {
+            while (!done.load()) {
+                auto start = std::chrono::steady_clock::now();
+                set.reload(specs[++reloads % 2]);
+                reloadNs += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+                std::this_thread::sleep_for(std::chrono::microseconds(us));
+            }
+        });
+        double mbps = scan([&](const uint8_t* data, size_t len) { set.scan(data, len); });
+        done = true;
+        control.join();
+        PatternSetStats st = set.getStats();
+        printf("%-12s %8uus %10.1f %8llu %12.1f %12.1f %12.1f\n", "set+reload", us, mbps,
+               (unsigned long long)st.swaps, (double)reloadNs / 1e3 / (double)reloads,
+               (double)st.lastSwapNs / 1e3, (double)st.maxSwapNs / 1e3);
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Parse throughput with command ID statistics, and merge cost
+ *
+ * The ID after each header is drawn from a skewed set so the summary
+ * sees both repeats and evictions.
+ *
+ * @param  None
+ * @return None
+ */
+static void Bench_Commands(void)
+{
+    const double densities[] = { 1e-3, 1e-2, 1e-1 };
+    std::mt19937_64 rng(46);
+
+    printf("Command ID heavy hitters (1 byte IDs, K=32, 4x2048 sketch)\n");
+    printf("%-8s %12s %12s %10s %10s\n", "density", "plain MB/s", "stats MB/s", "ns/header",
+           "merge us");
+    for (double density : densities) {
+        std::vector<uint8_t> stream;
+        Bench_Generate(stream, density);
+        for (size_t i = 0; i + 2 < stream.size(); i++) {
+            if ((stream[i] == 0xA5) && (stream[i + 1] == 0x5A) && (stream[i + 2] != 0xA5)) {
+                uint64_t r = rng() % 100;
+                stream[i + 2] = (uint8_t)((r < 50) ? 0x10 : (r < 80) ? 0x20 + (r % 4) : rng() % 0x50);
+            }
+        }
+        double best[2] = { 0.0, 0.0 };
+        uint64_t headers = 0;
+        CommandStats stats;
+        for (int r = 0; r < BENCH_REPEAT; r++) {
+            for (int k = 0; k < 2; k++) {
+                SharedMem shmem;
+                CmdSeqParser parser(&shmem);
+                stats.reset();
+                if (k == 1) {
+                    parser.setCommandStats(&stats);
+                }
+                auto start = std::chrono::steady_clock::now();
+                for (size_t pos = 0; pos < stream.size(); pos += BENCH_BLOCK_SIZE) {
+                    parser.parseBlock(&stream[pos], BENCH_BLOCK_SIZE);
+                }
+                auto end = std::chrono::steady_clock::now();
+                double mbps = (double)stream.size() / 1e6 /
+                              std::chrono::duration<double>(end - start).count();
+                best[k] = std::max(best[k], mbps);
+                headers = parser.getCount();
+            }
+        }
+
+        CommandStats total;
+        auto start = std::chrono::steady_clock::now();
+        total.merge(stats);
+        auto end = std::chrono::steady_clock::now();
+        double ns = ((double)stream.size() / best[1] - (double)stream.size() / best[0]) * 1e3 /
+                    (double)headers;
+        printf("%-8g %12.1f %12.1f %10.1f %10.1f\n", density, best[0], best[1], ns,
+               std::chrono::duration<double>(end - start).count() * 1e6);
+    }
+    printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+    const char* tracePath = getenv("SEQPARSER_TRACE");
+    if (tracePath != NULL) {
+        Trace::enable(true);
+    }
+
+    Bench_RunSkipping();
+    Bench_Approx();
+    Bench_BitSlip();
+    Bench_Crc();
+    Bench_Placement();
+    Bench_Pipeline();
+    Bench_Ingest();
+    Bench_FileReader();
+    Bench_RateStats();
+    Bench_Pattern();
+    Bench_Lanes();
+    Bench_Flush();
+    Bench_Counters();
+    Bench_Trace();
+    Bench_Output();
+    Bench_Reload();
+    Bench_Commands();
+    if ((tracePath != NULL) && !Trace::dump(tracePath)) {
+        fprintf(stderr, "cannot write %s\n", tracePath);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,231 @@
+/**
+ * @file  BitSlipMatcher.cpp
+ * @brief Header detection at any bit offset, for links that lose bit alignment
+ * @note  At a slip s the 16 header bits cover the low 8-s bits of byte j-1,
+ *        all of byte j and the high s bits of byte j+1, so every header
+ *        has a middle byte equal to one of 8 values and starts at stream
+ *        bit 8*(j-1)+s. The search looks for those 8 byte values with
+ *        SSE2, 16 bytes per step, and checks the few candidates with one
+ *        table lookup per neighbouring byte. Slip 0 needs no byte j+1.
+ *
+ */
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include "BitSlipMatcher.h"
+#include <cstring>
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*
+ * Slips that need the byte after the middle byte
+ */
+#define BIT_SLIP_WITH_NEXT (0xFEu)
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+/**
+ * @brief Build the per slip byte tables of a header
+ *
+ * @param  header  16 bit header, first bit is the most significant
+ * @return None
+ */
+BitSlipMatcher::BitSlipMatcher(uint16_t header)
+{
+    memset(prevMask_, 0, sizeof(prevMask_));
+    memset(midMask_, 0, sizeof(midMask_));
+    memset(nextMask_, 0, sizeof(nextMask_));
+    for (unsigned s = 0; s < 8; s++) {
+        unsigned prevBits = 0xFFu >> s;                       /* Low 8-s bits of byte j-1 */
+        unsigned prevValue = (header >> (8 + s)) & prevBits;
+        unsigned nextBits = (0xFF00u >> s) & 0xFFu;           /* High s bits of byte j+1 */
+        unsigned nextValue = (header << (8 - s)) & nextBits;
+        mid_[s] = (uint8_t)(header >> s);
+        midMask_[mid_[s]] |= (uint8_t)(1u << s);
+        for (unsigned c = 0; c < 256; c++) {
+            if ((c & prevBits) == prevValue) {
+                prevMask_[c] |= (uint8_t)(1u << s);
+            }
+            if ((c & nextBits) == nextValue) {
+                nextMask_[c] |= (uint8_t)(1u << s);
+            }
+        }
+    }
+    tail_[0] = 0;
+    tail_[1] = 0;
+    bytes_ = 0;
+    memset(counts_, 0, sizeof(counts_));
+    lastBitOffset_ = 0;
+    slip_ = -1;
+}
+
+/**
+ * @brief Process a block of the stream, headers may span blocks
+ *
+ * The last byte of a block is only checked for slip 0 until the next
+ * block brings the byte after it.
+ *
+ * @param  data  bytes to scan
+ * @param  len   number of bytes
+ * @return None
+ */
+void BitSlipMatcher::scan(const uint8_t* data, size_t len)
+{
+    if (len == 0) {
+        return;
+    }
+    uint64_t base = bytes_;
+    auto at = [&](ptrdiff_t k) { return (k >= 0) ? data[k] : tail_[k + 2]; };
+
+    /* Middle bytes -1 and 0 lean on the previous block */
+    if (base >= 2) {
+        check(tail_[0], tail_[1], data[0], BIT_SLIP_WITH_NEXT, base - 1);
+    }
+    size_t j = 0;
+    for (; (j < 1) && (j + 1 < len); j++) {
+        if (base + j >= 1) {
+            check(at((ptrdiff_t)j - 1), data[j], data[j + 1], 0xFFu, base + j);
+        }
+    }
+#if defined(__x86_64__)
+    j += scanSimd(&data[j], len - j, base + j);
+#endif
+    for (; j + 1 < len; j++) {
+        check(at((ptrdiff_t)j - 1), data[j], data[j + 1], 0xFFu, base + j);
+    }
+    if (base + j >= 1) {
+        check(at((ptrdiff_t)j - 1), data[j], 0, 0x01u, base + j);
+    }
+
+    if (len >= 2) {
+        tail_[0] = data[len - 2];
+    } else {
+        tail_[0] = tail_[1];
+    }
+    tail_[1] = data[len - 1];
+    bytes_ += len;
+}
+
+/**
+ * @brief Count the headers whose middle byte is at one stream position
+ *
+ * @param  prev   byte before the middle byte
+ * @param  mid    middle byte
+ * @param  next   byte after the middle byte
+ * @param  slips  slips to check, a bit per slip
+ * @param  index  stream byte offset of the middle byte, at least 1
+ * @return None
+ */
+inline void BitSlipMatcher::check(uint8_t prev, uint8_t mid, uint8_t next, unsigned slips,
+                                  uint64_t index)
+{
+    unsigned hits = prevMask_[prev] & midMask_[mid] & nextMask_[next] & slips;
+    while (hits != 0) {
+        unsigned s = (unsigned)__builtin_ctz(hits);
+        counts_[s]++;
+        lastBitOffset_ = 8 * (index - 1) + s;
+        slip_ = (int)s;
+        hits &= hits - 1;
+    }
+}
+
+#if defined(__x86_64__)
+/**
+ * @brief Find candidate middle bytes 16 at a time with SSE2
+ *
+ * data[-1] must be readable, as the block or the previous one ensures
+ * for every middle byte after the first.
+ *
+ * @param  data   first middle byte to check, at least index 1 of the block
+ * @param  len    bytes from data to the end of the block
+ * @param  index  stream byte offset of data
+ * @return number of middle bytes processed, a multiple of 16
+ */
+size_t BitSlipMatcher::scanSimd(const uint8_t* data, size_t len, uint64_t index)
+{
+    __m128i mids[8];
+    for (unsigned s = 0; s < 8; s++) {
+        mids[s] = _mm_set1_epi8((char)mid_[s]);
+    }
+    size_t j = 0;
+
+    /* Every middle byte of a step also needs the byte after it */
+    for (; j + 17 <= len; j += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&data[j]);
+        __m128i any = _mm_cmpeq_epi8(v, mids[0]);
+        for (unsigned s = 1; s < 8; s++) {
+            any = _mm_or_si128(any, _mm_cmpeq_epi8(v, mids[s]));
+        }
+        unsigned mask = (unsigned)_mm_movemask_epi8(any);
+        while (mask != 0) {
+            size_t p = j + (size_t)__builtin_ctz(mask);
+            check(data[p - 1], data[p], data[p + 1], 0xFFu, index + p);
+            mask &= mask - 1;
+        }
+    }
+    return j;
+}
+#endif
+
+/**
+ * @brief Get the number of headers at any bit offset
+ *
+ * @param  None
+ * @return count over all slips
+ */
+uint64_t BitSlipMatcher::getCount()
+{
+    uint64_t count = 0;
+    for (uint64_t c : counts_) {
+        count += c;
+    }
+    return count;
+}
+
+/**
+ * @brief Get the number of headers at one slip
+ *
+ * @param  slip  bit offset of the header within a byte, 0 to 7
+ * @return count, 0 for a slip out of range
+ */
+uint64_t BitSlipMatcher::getCount(unsigned slip)
+{
+    return (slip < 8) ? counts_[slip] : 0;
+}
+
+/**
+ * @brief Get the alignment of the link as seen by the last header
+ *
+ * @param  None
+ * @return slip of the last header, -1 when none was found
+ */
+int BitSlipMatcher::getSlip()
+{
+    return slip_;
+}
+
+/**
+ * @brief Get where the last header starts
+ *
+ * @param  None
+ * @return stream bit offset of the first header bit, 0 when none was found
+ */
+uint64_t BitSlipMatcher::getLastBitOffset()
+{
+    return lastBitOffset_;
+}
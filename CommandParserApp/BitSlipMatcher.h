@@ -0,0 +1,62 @@
+/**
+ * @file  BitSlipMatcher.h
+ * @brief Header detection at any bit offset, for links that lose bit alignment
+ * @note
+ *
+ */
+#ifndef __BIT_SLIP_MATCHER_H__
+#define __BIT_SLIP_MATCHER_H__
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include <cstdint>
+#include <cstddef>
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*
+ * Header length in bits
+ */
+#define BIT_SLIP_HEADER_BITS (16)
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*
+ * The stream is taken as a bit sequence, most significant bit of each
+ * byte first. The slip of a header is the bit offset of its first bit
+ * within a byte: 0 is byte aligned, 1 to 7 are headers shifted later by
+ * that many bits.
+ */
+class BitSlipMatcher {
+    public:
+        BitSlipMatcher(uint16_t header = 0xA55A);
+        void scan(const uint8_t* data, size_t len); /**< Process a block of the stream */
+        uint64_t getCount();          /**< Headers at any bit offset */
+        uint64_t getCount(unsigned slip); /**< Headers at a slip of 0 to 7 bits */
+        int getSlip();                /**< Slip of the last header, -1 none yet */
+        uint64_t getLastBitOffset();  /**< Stream bit offset of the last header's first bit */
+    private:
+        void check(uint8_t prev, uint8_t mid, uint8_t next, unsigned slips, uint64_t index); /**< Headers around one byte */
+        size_t scanSimd(const uint8_t* data, size_t len, uint64_t index); /**< SSE2 search for middle bytes */
+
+        uint8_t prevMask_[256];       /**< Slips whose first header byte fits a byte value */
+        uint8_t midMask_[256];        /**< Slips whose middle header byte is a byte value */
+        uint8_t nextMask_[256];       /**< Slips whose last header byte fits a byte value */
+        uint8_t mid_[8];              /**< Middle header byte per slip */
+        uint8_t tail_[2];             /**< Last two bytes of the previous block */
+        uint64_t bytes_;              /**< Bytes seen */
+        uint64_t counts_[8];          /**< Headers per slip */
+        uint64_t lastBitOffset_;      /**< First bit of the last header */
+        int slip_;                    /**< Slip of the last header, -1 none */
+};
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+#endif /* __BIT_SLIP_MATCHER_H__ */
@@ -0,0 +1,400 @@
+/**
+ * @file  Checkpoint.cpp
+ * @brief Serialize/restore of the parser state and periodic snapshot to disk
+ * @note  The parse loop only publishes into a per channel sequence lock, the
+ *        file is written from a separate thread so that parsing never blocks
+ *
+ */
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include "Checkpoint.h"
+#include <cstdio>
+#include <cassert>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+static void Checkpoint_Put32(uint8_t* buf, uint32_t value);
+static void Checkpoint_Put64(uint8_t* buf, uint64_t value);
+static uint32_t Checkpoint_Get32(const uint8_t* buf);
+static uint64_t Checkpoint_Get64(const uint8_t* buf);
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+static void Checkpoint_Put32(uint8_t* buf, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        buf[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static void Checkpoint_Put64(uint8_t* buf, uint64_t value)
+{
+    for (int i = 0; i < 8; i++) {
+        buf[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint32_t Checkpoint_Get32(const uint8_t* buf)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        value |= (uint32_t)buf[i] << (8 * i);
+    }
+    return value;
+}
+
+static uint64_t Checkpoint_Get64(const uint8_t* buf)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value |= (uint64_t)buf[i] << (8 * i);
+    }
+    return value;
+}
+
+/**
+ * @brief Encode a checkpoint into CHECKPOINT_RECORD_SIZE bytes
+ *
+ * @param  cp   checkpoint to encode
+ * @param  buf  output buffer of at least CHECKPOINT_RECORD_SIZE bytes
+ * @return number of bytes written
+ */
+size_t Checkpoint_Encode(const ParserCheckpoint& cp, uint8_t* buf)
+{
+    buf[0] = cp.state;
+    Checkpoint_Put64(&buf[1], cp.counter);
+    Checkpoint_Put64(&buf[9], cp.offset);
+    return CHECKPOINT_RECORD_SIZE;
+}
+
+/**
+ * @brief Decode a checkpoint record
+ *
+ * @param  buf  encoded record
+ * @param  len  length of the buffer
+ * @param  cp   decoded checkpoint
+ * @return true/false record was decoded or not
+ */
+bool Checkpoint_Decode(const uint8_t* buf, size_t len, ParserCheckpoint& cp)
+{
+    if (len < CHECKPOINT_RECORD_SIZE) {
+        return false;
+    }
+    cp.state = buf[0];
+    cp.counter = Checkpoint_Get64(&buf[1]);
+    cp.offset = Checkpoint_Get64(&buf[9]);
+    return true;
+}
+
+/**
+ * @brief Size of the blob holding a number of channels
+ *
+ * @param  count  number of channels (at most CHECKPOINT_BLOB_CHANNELS)
+ * @return blob size in bytes
+ */
+size_t Checkpoint_BlobSize(size_t count)
+{
+    return CHECKPOINT_HEADER_SIZE + count * CHECKPOINT_RECORD_SIZE;
+}
+
+/**
+ * @brief Encode a group of channels as one contiguous blob
+ *
+ * @param  cps    checkpoints of the group
+ * @param  first  channel number of cps[0]
+ * @param  count  number of channels (at most CHECKPOINT_BLOB_CHANNELS)
+ * @param  buf    output buffer of at least Checkpoint_BlobSize(count) bytes
+ * @return number of bytes written
+ */
+size_t Checkpoint_EncodeBlob(const ParserCheckpoint* cps, uint32_t first,
+                             uint32_t count, uint8_t* buf)
+{
+    assert(count <= CHECKPOINT_BLOB_CHANNELS);
+
+    Checkpoint_Put32(&buf[0], CHECKPOINT_MAGIC);
+    buf[4] = (uint8_t)CHECKPOINT_VERSION;
+    buf[5] = 0;
+    buf[6] = 0;
+    buf[7] = 0;
+    Checkpoint_Put32(&buf[8], first);
+    Checkpoint_Put32(&buf[12], count);
+
+    uint8_t* rec = &buf[CHECKPOINT_HEADER_SIZE];
+    for (uint32_t i = 0; i < count; i++) {
+        rec += Checkpoint_Encode(cps[i], rec);
+    }
+    return Checkpoint_BlobSize(count);
+}
+
+/**
+ * @brief Decode a sequence of blobs, channels are stored by channel number
+ *
+ * @param  buf  encoded blobs
+ * @param  len  length of the buffer
+ * @param  cps  decoded checkpoints, resized to hold all channels
+ * @return true/false blobs were decoded or not
+ */
+bool Checkpoint_DecodeBlobs(const uint8_t* buf, size_t len,
+                            std::vector<ParserCheckpoint>& cps)
+{
+    size_t pos = 0;
+
+    cps.clear();
+    while (pos < len) {
+        if (len - pos < CHECKPOINT_HEADER_SIZE) {
+            return false;
+        }
+        const uint8_t* hdr = &buf[pos];
+        uint32_t first = Checkpoint_Get32(&hdr[8]);
+        uint32_t count = Checkpoint_Get32(&hdr[12]);
+        if ((Checkpoint_Get32(&hdr[0]) != CHECKPOINT_MAGIC) ||
+            (hdr[4] != CHECKPOINT_VERSION) ||
+            (count > CHECKPOINT_BLOB_CHANNELS) ||
+            (first != cps.size()) ||
+            (len - pos < Checkpoint_BlobSize(count))) {
+            return false;
+        }
+
+        const uint8_t* rec = &hdr[CHECKPOINT_HEADER_SIZE];
+        for (uint32_t i = 0; i < count; i++) {
+            ParserCheckpoint cp;
+            Checkpoint_Decode(rec, CHECKPOINT_RECORD_SIZE, cp);
+            cps.push_back(cp);
+            rec += CHECKPOINT_RECORD_SIZE;
+        }
+        pos += Checkpoint_BlobSize(count);
+    }
+    return true;
+}
+
+/**
+ * @brief Initialize the snapshot slots and the encode buffer
+ *
+ * @param  path        snapshot file path
+ * @param  channels    number of channels to snapshot
+ * @param  intervalMs  snapshot period of the background thread
+ * @return None
+ */
+Checkpointer::Checkpointer(const char* path, size_t channels, uint32_t intervalMs)
+{
+    assert(path != NULL);
+    assert(channels > 0);
+
+    path_ = path;
+    channels_ = channels;
+    intervalMs_ = intervalMs;
+    slots_ = new Slot[channels];
+    scratch_.resize(channels);
+
+    /* Allocate the encode buffer once so that snapshots do not allocate */
+    size_t blobs = (channels + CHECKPOINT_BLOB_CHANNELS - 1) / CHECKPOINT_BLOB_CHANNELS;
+    buffer_.resize(blobs * CHECKPOINT_HEADER_SIZE + channels * CHECKPOINT_RECORD_SIZE);
+    stopped_ = true;
+}
+
+/**
+ * @brief Stop the snapshot thread and release the slots
+ *
+ * @param  None
+ * @return None
+ */
+Checkpointer::~Checkpointer()
+{
+    stop();
+    delete[] slots_;
+}
+
+/**
+ * @brief Publish the state of a channel, called from the parse loop
+ *
+ * There is a single writer per channel, so this is wait free.
+ *
+ * @param  channel  channel number
+ * @param  cp       state to publish
+ * @return None
+ */
+void Checkpointer::publish(size_t channel, const ParserCheckpoint& cp)
+{
+    assert(channel < channels_);
+    Slot& slot = slots_[channel];
+    uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+
+    slot.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.state.store(cp.state, std::memory_order_relaxed);
+    slot.counter.store(cp.counter, std::memory_order_relaxed);
+    slot.offset.store(cp.offset, std::memory_order_relaxed);
+    slot.seq.store(seq + 2, std::memory_order_release);
+}
+
+/**
+ * @brief Read a consistent copy of a channel slot
+ *
+ * @param  channel  channel number
+ * @param  cp       copy of the published state
+ * @return None
+ */
+void Checkpointer::read(size_t channel, ParserCheckpoint& cp)
+{
+    Slot& slot = slots_[channel];
+    uint32_t before;
+    uint32_t after;
+
+    do {
+        before = slot.seq.load(std::memory_order_acquire);
+        cp.state = slot.state.load(std::memory_order_relaxed);
+        cp.counter = slot.counter.load(std::memory_order_relaxed);
+        cp.offset = slot.offset.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = slot.seq.load(std::memory_order_relaxed);
+    } while ((before & 1) || (before != after));
+}
+
+/**
+ * @brief Write the published state of all channels to disk now
+ *
+ * @param  None
+ * @return true/false snapshot was written or not
+ */
+bool Checkpointer::snapshot()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return writeFile();
+}
+
+/**
+ * @brief Encode and write the published state, called with mutex_ held
+ *
+ * The file is written to a temporary name and renamed so that a crash
+ * in the middle of a snapshot leaves the previous snapshot intact.
+ *
+ * @param  None
+ * @return true/false snapshot was written or not
+ */
+bool Checkpointer::writeFile()
+{
+    for (size_t i = 0; i < channels_; i++) {
+        read(i, scratch_[i]);
+    }
+
+    size_t len = 0;
+    for (size_t first = 0; first < channels_; first += CHECKPOINT_BLOB_CHANNELS) {
+        size_t count = channels_ - first;
+        if (count > CHECKPOINT_BLOB_CHANNELS) {
+            count = CHECKPOINT_BLOB_CHANNELS;
+        }
+        len += Checkpoint_EncodeBlob(&scratch_[first], (uint32_t)first,
+                                     (uint32_t)count, &buffer_[len]);
+    }
+
+    std::string tmp = path_ + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    size_t done = 0;
+    while (done < len) {
+        ssize_t ret = write(fd, &buffer_[done], len - done);
+        if (ret <= 0) {
+            close(fd);
+            return false;
+        }
+        done += (size_t)ret;
+    }
+    if ((fsync(fd) != 0) || (close(fd) != 0)) {
+        return false;
+    }
+    return rename(tmp.c_str(), path_.c_str()) == 0;
+}
+
+/**
+ * @brief Read a snapshot file written by snapshot()
+ *
+ * @param  path  snapshot file path
+ * @param  cps   checkpoints indexed by channel
+ * @return true/false snapshot was read or not
+ */
+bool Checkpointer::load(const char* path, std::vector<ParserCheckpoint>& cps)
+{
+    std::vector<uint8_t> data;
+    uint8_t chunk[4096];
+    ssize_t ret;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    while ((ret = ::read(fd, chunk, sizeof(chunk))) > 0) {
+        data.insert(data.end(), chunk, chunk + ret);
+    }
+    close(fd);
+    if (ret < 0) {
+        return false;
+    }
+    return Checkpoint_DecodeBlobs(data.data(), data.size(), cps);
+}
+
+/**
+ * @brief Start the periodic snapshot thread
+ *
+ * @param  None
+ * @return None
+ */
+void Checkpointer::start()
+{
+    stopped_ = false;
+    thread_ = std::thread(&Checkpointer::run, this);
+}
+
+/**
+ * @brief Stop the snapshot thread, a final snapshot is written on exit
+ *
+ * @param  None
+ * @return None
+ */
+void Checkpointer::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+    }
+    cv_.notify_one();
+    if (thread_.joinable()) {
+        thread_.join();
+
+        /* Final snapshot with everything published before stop */
+        snapshot();
+    }
+}
+
+/**
+ * @brief Periodic snapshot loop, runs until stop() is called
+ *
+ * @param  None
+ * @return None
+ */
+void Checkpointer::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (!stopped_) {
+        cv_.wait_for(lock, std::chrono::milliseconds(intervalMs_));
+        if (!stopped_) {
+            writeFile();
+        }
+    }
+}
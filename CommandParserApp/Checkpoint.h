@@ -0,0 +1,100 @@
+/**
+ * @file  Checkpoint.h
+ * @brief Serialize/restore of the parser state and periodic snapshot to disk
+ * @note
+ *
+ */
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <string>
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*
+ * Encoded record: state(1) + counter(8) + offset(8), little endian
+ */
+#define CHECKPOINT_RECORD_SIZE (17)
+
+/*
+ * Blob header: magic(4) + version(2) + reserved(2) + first channel(4) +
+ * channel count(4), little endian
+ */
+#define CHECKPOINT_MAGIC        (0x4B435053u) /* "SPCK" */
+#define CHECKPOINT_VERSION      (1)
+#define CHECKPOINT_HEADER_SIZE  (16)
+
+/*
+ * The channels are written as one contiguous blob per thousand channels
+ */
+#define CHECKPOINT_BLOB_CHANNELS (1000)
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*
+ * Parser state needed to continue counting mid-stream after a restart
+ */
+struct ParserCheckpoint {
+    uint8_t state = 0;     /**< CmdSeqParser::State of the state machine */
+    uint64_t counter = 0;  /**< Valid command count */
+    uint64_t offset = 0;   /**< Stream offset of the next byte to parse */
+};
+
+class Checkpointer {
+    public:
+        Checkpointer(const char* path, size_t channels, uint32_t intervalMs);
+        ~Checkpointer();
+        void publish(size_t channel, const ParserCheckpoint& cp); /**< Publish state, never blocks */
+        void start();        /**< Start the periodic snapshot thread */
+        void stop();         /**< Stop the thread after a final snapshot */
+        bool snapshot();     /**< Write the published state to disk now */
+        static bool load(const char* path, std::vector<ParserCheckpoint>& cps); /**< Read a snapshot */
+    private:
+        struct Slot {
+            std::atomic<uint32_t> seq{0};     /**< Sequence lock, odd while writing */
+            std::atomic<uint8_t> state{0};    /**< Published state */
+            std::atomic<uint64_t> counter{0}; /**< Published count */
+            std::atomic<uint64_t> offset{0};  /**< Published stream offset */
+        };
+        void run();                     /**< Periodic snapshot loop */
+        bool writeFile();               /**< Encode and write the snapshot */
+        void read(size_t channel, ParserCheckpoint& cp); /**< Consistent read of a slot */
+
+        std::string path_;              /**< Snapshot file path */
+        size_t channels_;               /**< Number of channels */
+        uint32_t intervalMs_;           /**< Snapshot interval */
+        Slot* slots_;                   /**< One slot per channel */
+        std::vector<ParserCheckpoint> scratch_; /**< Records of a snapshot */
+        std::vector<uint8_t> buffer_;   /**< Encoded snapshot */
+        std::thread thread_;            /**< Snapshot thread */
+        std::mutex mutex_;              /**< Protects stopped_ and the file */
+        std::condition_variable cv_;    /**< Wakes the thread on stop */
+        bool stopped_;                  /**< Thread stop request */
+};
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+size_t Checkpoint_Encode(const ParserCheckpoint& cp, uint8_t* buf);
+bool Checkpoint_Decode(const uint8_t* buf, size_t len, ParserCheckpoint& cp);
+size_t Checkpoint_BlobSize(size_t count);
+size_t Checkpoint_EncodeBlob(const ParserCheckpoint* cps, uint32_t first,
+                             uint32_t count, uint8_t* buf);
+bool Checkpoint_DecodeBlobs(const uint8_t* buf, size_t len,
+                            std::vector<ParserCheckpoint>& cps);
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+#endif /* __CHECKPOINT_H__ */
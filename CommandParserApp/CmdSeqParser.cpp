@@ -8,6 +8,10 @@
 /* Header                                                                */
 /*-----------------------------------------------------------------------*/
 #include "CmdSeqParser.h"
+#include "Trace.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 /*-----------------------------------------------------------------------*/
 /* Macro                                                                 */
 /*-----------------------------------------------------------------------*/
@@ -17,6 +21,7 @@
 /*-----------------------------------------------------------------------*/
 /* Prototype                                                             */
 /*-----------------------------------------------------------------------*/
+static size_t CmdSeqParser_FindCandidate(const uint8_t* data, size_t len);
 
 /*-----------------------------------------------------------------------*/
 /* Variable                                                              */
@@ -44,54 +49,250 @@ CmdSeqParser:: CmdSeqParser(SharedMem* shmem){
  */
 void CmdSeqParser::parser()
 {
-    int i = 0;
-    uint8_t data;
-
     /* Check that shared memory is full at this point */
     assert(shmem_->IsFull() == true);
 
+    parseAvailable();
+}
+
+/**
+ * @brief Process whatever data is in the buffer, full or not
+ *
+ * @param  maxLen  most bytes to process, the rest stays in the buffer
+ * @return number of bytes processed
+ */
+size_t CmdSeqParser::parseAvailable(size_t maxLen)
+{
+    const uint8_t* first;
+    const uint8_t* second;
+    size_t firstLen;
+    size_t secondLen;
+
     /* 
-     * Go through the shared memory data and count the sequence
+     * Go through the shared memory data in place and count the sequence
      */
-    for (i = 0; i < SHARED_MEM_SIZE; i++) {
-        /* Fetch the data byte from shared memory */
-        data = shmem_->GetData();
-
-        /*
-	 * Based on state and received data, go to different state
-	 * DEFAULT: State in which the search for the sequence begins
-	 * FOUND_A5: State in which 0xA5 is received
-	 * FOUND_5A: State in which 0x5A is received
-	 */
-        if(state_ == State::DEFAULT){
-            if (data == 0x5A) {
-                state_ = State::FOUND_5A;
-	    }else if(data == 0xA5){
-                state_ = State::FOUND_A5;
-	    }
-        }else if (state_ == State::FOUND_5A) {
-            if (data == 0xA5) {
-                state_ = State::FOUND_A5;
-	    } else if(data != 0x5A){
-                state_ = State::DEFAULT;
+    size_t len = shmem_->GetRegions(&first, &firstLen, &second, &secondLen);
+    if (len > maxLen) {
+        len = maxLen;
+        firstLen = (firstLen < len) ? firstLen : len;
+        secondLen = len - firstLen;
+    }
+    uint64_t counter = counter_;
+    Trace::record(TraceEvent::PARSE_BEGIN, len);
+    if (perf_ != NULL) {
+        perf_->begin();
+    }
+    parseBlock(first, firstLen);
+    parseBlock(second, secondLen);
+    if (perf_ != NULL) {
+        perf_->end(perfSample_, len);
+    }
+    shmem_->Release(len);
+    Trace::record(TraceEvent::PARSE_END, counter_ - counter);
+    return len;
+}
+
+/**
+ * @brief Byte by byte state machine, the reference for the fast path
+ *
+ * @param  data  bytes to parse
+ * @param  len   number of bytes
+ * @return None
+ */
+void CmdSeqParser::parseBlockScalar(const uint8_t* data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        step(data[i]);
+    }
+    offset_ += len;
+}
+
+/**
+ * @brief Parse a block, skipping runs of bytes that cannot change the count
+ *
+ * Any byte other than 0xA5/0x5A takes the state machine to DEFAULT, so in
+ * DEFAULT a run of such bytes is skipped in bulk and the state machine only
+ * runs from the next candidate byte until it falls back to DEFAULT.
+ *
+ * @param  data  bytes to parse
+ * @param  len   number of bytes
+ * @return None
+ */
+void CmdSeqParser::parseBlock(const uint8_t* data, size_t len)
+{
+    size_t i = 0;
+    uint64_t start = counter_;
+    uint64_t matched = counter_;
+
+    if (idNeeded_ > 0) {
+        takeCommandId(data, len, 0);
+    }
+    while (i < len) {
+        if (state_ == State::DEFAULT) {
+            i += CmdSeqParser_FindCandidate(&data[i], len - i);
+            if (i >= len) {
+                break;
             }
-	} else if (state_ == State::FOUND_A5) {
-	    if (data == 0x5A) {
-                state_ = State::FOUND_5A;
-                counter_++;
-            } else if(data != 0xA5){
-                state_ = State::DEFAULT;
+        } else if ((data[i] != 0xA5) && (data[i] != 0x5A)) {
+            /* Non candidate ends a partial sequence, the run after it is
+             * skipped in bulk on the next pass through FindCandidate */
+            state_ = State::DEFAULT;
+            i++;
+            continue;
+        }
+        step(data[i]);
+        if (counter_ != matched) {
+            matched = counter_;
+            if (stats_ != NULL) {
+                stats_->recordMatch(offset_ + i);
+            }
+            if (sink_ != NULL) {
+                sink_->emitMatch(offset_ + i, counter_);
             }
-        } else {
-            if (data == 0x5A) {
-                state_ = State::FOUND_5A;
-            }else if(data == 0xA5){
-                state_ = State::FOUND_A5;
-            }else{
-                state_ = State::DEFAULT;
+            if (commands_ != NULL) {
+                idNeeded_ = commands_->getIdBytes();
+                id_ = 0;
+                takeCommandId(data, len, i + 1);
             }
         }
+        i++;
+    }
+    if (stats_ != NULL) {
+        stats_->record(counter_ - start, len);
+    }
+    if (sink_ != NULL) {
+        sink_->flush();
+    }
+    if (approx_ != NULL) {
+        approx_->scan(data, len);
+    }
+    if (dfa_ != NULL) {
+        dfa_->scan(data, len);
+    }
+    if (patterns_ != NULL) {
+        patterns_->scan(data, len);
+    }
+    if (slip_ != NULL) {
+        slip_->scan(data, len);
+    }
+    if (verifier_ != NULL) {
+        verifier_->feed(data, len);
+    }
+    offset_ += len;
+}
+
+/**
+ * @brief Collect the command ID that follows a header
+ *
+ * The ID bytes are still parsed as usual, an ID may contain A5 5A. An ID
+ * cut by the end of the block is completed by the next block.
+ *
+ * @param  data  bytes being parsed
+ * @param  len   number of bytes
+ * @param  pos   first ID byte not collected yet
+ * @return None
+ */
+void CmdSeqParser::takeCommandId(const uint8_t* data, size_t len, size_t pos)
+{
+    for (; (idNeeded_ > 0) && (pos < len); pos++) {
+        id_ = (id_ << 8) | data[pos];
+        idNeeded_--;
+    }
+    if (idNeeded_ == 0) {
+        commands_->add(id_);
+    }
+}
+
+/**
+ * @brief Advance the state machine by one byte
+ *
+ * @param  data  received byte
+ * @return None
+ */
+inline void CmdSeqParser::step(uint8_t data)
+{
+    /*
+     * Based on state and received data, go to different state
+     * DEFAULT: State in which the search for the sequence begins
+     * FOUND_A5: State in which 0xA5 is received
+     * FOUND_5A: State in which 0x5A is received
+     */
+    if(state_ == State::DEFAULT){
+        if (data == 0x5A) {
+            state_ = State::FOUND_5A;
+        }else if(data == 0xA5){
+            state_ = State::FOUND_A5;
+        }
+    }else if (state_ == State::FOUND_5A) {
+        if (data == 0xA5) {
+            state_ = State::FOUND_A5;
+        } else if(data != 0x5A){
+            state_ = State::DEFAULT;
+        }
+    } else if (state_ == State::FOUND_A5) {
+        if (data == 0x5A) {
+            state_ = State::FOUND_5A;
+            counter_++;
+        } else if(data != 0xA5){
+            state_ = State::DEFAULT;
+        }
+    } else {
+        if (data == 0x5A) {
+            state_ = State::FOUND_5A;
+        }else if(data == 0xA5){
+            state_ = State::FOUND_A5;
+        }else{
+            state_ = State::DEFAULT;
+        }
+    }
+}
+
+/**
+ * @brief Find the first byte that can change the state from DEFAULT
+ *
+ * @param  data  bytes to search
+ * @param  len   number of bytes
+ * @return index of the first 0xA5/0x5A byte, len if there is none
+ */
+static size_t CmdSeqParser_FindCandidate(const uint8_t* data, size_t len)
+{
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i a5 = _mm_set1_epi8((char)0xA5);
+    const __m128i x5a = _mm_set1_epi8((char)0x5A);
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&data[i]);
+        __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(v, a5), _mm_cmpeq_epi8(v, x5a));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask != 0) {
+            return i + (size_t)__builtin_ctz((unsigned)mask);
+        }
+    }
+#else
+    const uint64_t ones = 0x0101010101010101ull;
+    const uint64_t highs = 0x8080808080808080ull;
+
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, &data[i], sizeof(word));
+        uint64_t va5 = word ^ (ones * 0xA5);
+        uint64_t v5a = word ^ (ones * 0x5A);
+        uint64_t hit = ((va5 - ones) & ~va5 & highs) | ((v5a - ones) & ~v5a & highs);
+        if (hit != 0) {
+            /* Scan the word bytewise as the zero byte trick is only exact
+             * for the lowest match */
+            break;
+        }
+    }
+#endif
+    for (; i < len; i++) {
+        if ((data[i] == 0xA5) || (data[i] == 0x5A)) {
+            return i;
+        }
     }
+    return len;
 }
 
 /**
@@ -105,3 +306,241 @@ uint64_t CmdSeqParser::getCount(){
     return counter_;
 }
 
+/**
+ * @brief Get the stream offset, i.e. the number of bytes parsed so far
+ *
+ * @param  None
+ * @return offset_ stream offset
+ */
+uint64_t CmdSeqParser::getOffset(){
+    return offset_;
+}
+
+/**
+ * @brief Get the number of bytes in the buffer not parsed yet
+ *
+ * @param  None
+ * @return pending bytes
+ */
+size_t CmdSeqParser::getPending(){
+    return shmem_->Count();
+}
+
+/**
+ * @brief Get the current state of the state machine
+ *
+ * @param  None
+ * @return state_ current state
+ */
+CmdSeqParser::State CmdSeqParser::getState(){
+    return state_;
+}
+
+/**
+ * @brief Capture the parser state so that it can be restored after restart
+ *
+ * Must be called from the thread running the parser (or while it is idle).
+ *
+ * @param  cp  checkpoint to be filled
+ * @return None
+ */
+void CmdSeqParser::checkpoint(ParserCheckpoint& cp){
+    cp.state = static_cast<uint8_t>(state_);
+    cp.counter = counter_;
+    cp.offset = offset_;
+}
+
+/**
+ * @brief Restore the parser state from a checkpoint
+ *
+ * Must be called before the background task is started.
+ *
+ * @param  cp  checkpoint to restore from
+ * @return true/false checkpoint was valid or not
+ */
+bool CmdSeqParser::restore(const ParserCheckpoint& cp){
+    if (cp.state > static_cast<uint8_t>(State::FOUND_A5)) {
+        return false;
+    }
+    state_ = static_cast<State>(cp.state);
+    counter_ = cp.counter;
+    offset_ = cp.offset;
+    return true;
+}
+
+/**
+ * @brief Count headers within k bit errors next to the exact count
+ *
+ * The matcher is fed from parseBlock(), so the Pipeline and FileReader
+ * paths count too. Must be called before the background task is started.
+ *
+ * @param  approx  approximate matcher, NULL to disable
+ * @return None
+ */
+void CmdSeqParser::setApproxMatcher(ApproxMatcher* approx){
+    approx_ = approx;
+}
+
+/**
+ * @brief Get the count of headers with 1 to k bit errors
+ *
+ * @param  None
+ * @return approximate count, 0 when disabled
+ */
+uint64_t CmdSeqParser::getApproxCount(){
+    return (approx_ != NULL) ? approx_->getApproxCount() : 0;
+}
+
+/**
+ * @brief Verify the frame CRC after each header once the block is counted
+ *
+ * The verifier is fed from parseBlock(), so captures read by FileReader
+ * are checked too. A Pipeline verifies frames in its own stage with the
+ * verifier given to its constructor, a parser inside a Pipeline must not
+ * have one, see Pipeline::start(). Must be called before the background
+ * task is started.
+ *
+ * @param  verifier  frame verifier, NULL to disable
+ * @return None
+ */
+void CmdSeqParser::setFrameVerifier(FrameVerifier* verifier){
+    verifier_ = verifier;
+}
+
+/**
+ * @brief Get the verifier fed by parseBlock()
+ *
+ * @param  None
+ * @return frame verifier, NULL when disabled
+ */
+FrameVerifier* CmdSeqParser::getFrameVerifier(){
+    return verifier_;
+}
+
+/**
+ * @brief Record per second/minute rates and match gaps of the bulk path
+ *
+ * Must be called before the background task is started.
+ *
+ * @param  stats  statistics, NULL to disable
+ * @return None
+ */
+void CmdSeqParser::setRateStats(RateStats* stats){
+    stats_ = stats;
+}
+
+/**
+ * @brief Count a compiled header pattern next to the A5 5A count
+ *
+ * The pattern is scanned in parseBlock(), so the Pipeline and FileReader
+ * paths count it too. Must be called before the background task is started.
+ *
+ * @param  dfa  compiled pattern, NULL to disable
+ * @return None
+ */
+void CmdSeqParser::setPatternDfa(PatternDfa* dfa){
+    dfa_ = dfa;
+}
+
+/**
+ * @brief Get the count of the compiled header pattern
+ *
+ * @param  None
+ * @return pattern count, 0 when disabled
+ */
+uint64_t CmdSeqParser::getPatternCount(){
+    return (dfa_ != NULL) ? dfa_->getCount() : 0;
+}
+
+/**
+ * @brief Measure the bulk parse of each batch with hardware counters
+ *
+ * The counters belong to the thread that parses first, so this is meant
+ * for the worker thread only. Must be called before the background task
+ * is started.
+ *
+ * @param  perf   counters, NULL to disable
+ * @param  label  input name the batches are reported under
+ * @return None
+ */
+void CmdSeqParser::setPerfCounters(PerfCounters* perf, const char* label){
+    perf_ = perf;
+    /* Looked up once, end() then only reads the counters */
+    perfSample_ = (perf != NULL) ? perf->resolve("bulk", label) : NULL;
+}
+
+/**
+ * @brief Emit a record for each match to an output sink
+ *
+ * The records are emitted from the bulk path on the parsing thread, see
+ * OutputSink for the threading rules. A FrameVerifier in a Pipeline runs
+ * on another thread and needs a sink of its own. Must be called before the
+ * background task is started.
+ *
+ * @param  sink  output sink, NULL to disable
+ * @return None
+ */
+void CmdSeqParser::setOutputSink(OutputSink* sink){
+    sink_ = sink;
+}
+
+/**
+ * @brief Get the sink the match records go to
+ *
+ * @param  None
+ * @return output sink, NULL when disabled
+ */
+OutputSink* CmdSeqParser::getOutputSink(){
+    return sink_;
+}
+
+/**
+ * @brief Count a set of named patterns that can be reloaded while parsing
+ *
+ * A reload is taken up at the next block passed to parseBlock(), which
+ * covers the Pipeline and FileReader paths too, see PatternSet. Must be
+ * called before the background task is started.
+ *
+ * @param  patterns  pattern set, NULL to disable
+ * @return None
+ */
+void CmdSeqParser::setPatternSet(PatternSet* patterns){
+    patterns_ = patterns;
+}
+
+/**
+ * @brief Find headers at any bit offset next to the byte aligned count
+ *
+ * The matcher is fed from parseBlock(), so the Pipeline and FileReader
+ * paths find them too. Must be called before the background task is started.
+ *
+ * @param  slip  bit-granular matcher, NULL to disable
+ * @return None
+ */
+void CmdSeqParser::setBitSlipMatcher(BitSlipMatcher* slip){
+    slip_ = slip;
+}
+
+/**
+ * @brief Get the count of headers at any bit offset
+ *
+ * @param  None
+ * @return count over all slips, 0 when disabled
+ */
+uint64_t CmdSeqParser::getBitSlipCount(){
+    return (slip_ != NULL) ? slip_->getCount() : 0;
+}
+
+/**
+ * @brief Count the command ID after each header
+ *
+ * The ID is the getIdBytes() bytes after A5 5A, big endian. Must be
+ * called before the background task is started.
+ *
+ * @param  commands  command statistics, NULL to disable
+ * @return None
+ */
+void CmdSeqParser::setCommandStats(CommandStats* commands){
+    commands_ = commands;
+    idNeeded_ = 0;
+}
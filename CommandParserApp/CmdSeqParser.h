@@ -10,6 +10,16 @@
 /* Header                                                                */
 /*-----------------------------------------------------------------------*/
 #include "SharedMem.h"
+#include "Checkpoint.h"
+#include "ApproxMatcher.h"
+#include "FrameVerifier.h"
+#include "RateStats.h"
+#include "PatternDfa.h"
+#include "PerfCounters.h"
+#include "OutputSink.h"
+#include "PatternSet.h"
+#include "BitSlipMatcher.h"
+#include "CommandStats.h"
 #include <cassert>
 /*-----------------------------------------------------------------------*/
 /* Macro                                                                 */
@@ -19,14 +29,52 @@
 /*-----------------------------------------------------------------------*/
 class CmdSeqParser{
     public:
+        enum class State { DEFAULT, FOUND_5A, FOUND_A5 }; /**< State of processing data */
+
         CmdSeqParser(SharedMem* shmem); /**< Initialize reference to shared mem obj */
         void parser();                  /**< Process the data in shared buffer */
+        size_t parseAvailable(size_t maxLen = SIZE_MAX); /**< Process a partially filled buffer */
+        void parseBlock(const uint8_t* data, size_t len);       /**< Bulk path with run skipping */
+        void parseBlockScalar(const uint8_t* data, size_t len); /**< Byte by byte reference path */
         uint64_t getCount();            /**< Get the valid command count */
+        uint64_t getOffset();           /**< Get the number of bytes consumed */
+        size_t getPending();            /**< Get the bytes waiting in the buffer */
+        State getState();               /**< Get the current state */
+        void checkpoint(ParserCheckpoint& cp);     /**< Capture the parser state */
+        bool restore(const ParserCheckpoint& cp);  /**< Resume from a checkpoint */
+        void setApproxMatcher(ApproxMatcher* approx); /**< Also count approximate headers */
+        uint64_t getApproxCount();      /**< Get the approximate header count */
+        void setFrameVerifier(FrameVerifier* verifier); /**< Verify the frame CRC after headers */
+        FrameVerifier* getFrameVerifier();             /**< Verifier set by setFrameVerifier() */
+        void setRateStats(RateStats* stats); /**< Record rates and match gaps while parsing */
+        void setPatternDfa(PatternDfa* dfa); /**< Also count a compiled header pattern */
+        uint64_t getPatternCount();     /**< Get the pattern match count */
+        void setPerfCounters(PerfCounters* perf, const char* label); /**< Count each parse batch */
+        void setOutputSink(OutputSink* sink); /**< Emit a record for each match */
+        OutputSink* getOutputSink();          /**< Sink set by setOutputSink() */
+        void setPatternSet(PatternSet* patterns); /**< Also count reloadable named patterns */
+        void setBitSlipMatcher(BitSlipMatcher* slip); /**< Also find headers at any bit offset */
+        uint64_t getBitSlipCount();     /**< Get the count of headers at any bit offset */
+        void setCommandStats(CommandStats* commands); /**< Count the command ID after each header */
     private:
-        enum class State { DEFAULT, FOUND_5A, FOUND_A5 }; /**< State of processing data */
+        void step(uint8_t data);       /**< Advance the state machine by one byte */
+        void takeCommandId(const uint8_t* data, size_t len, size_t pos); /**< Collect ID bytes from pos */
         State state_ = State::DEFAULT; /**< Current state of the processing */
         SharedMem* shmem_;             /**< Reference to shared memory obj */
+        ApproxMatcher* approx_ = NULL; /**< Optional approximate matching */
+        FrameVerifier* verifier_ = NULL; /**< Optional frame CRC verification */
+        RateStats* stats_ = NULL;      /**< Optional windowed statistics */
+        PatternDfa* dfa_ = NULL;       /**< Optional header pattern */
+        PerfCounters* perf_ = NULL;    /**< Optional hardware counters */
+        PerfSample* perfSample_ = NULL; /**< Totals of the counted batches */
+        OutputSink* sink_ = NULL;      /**< Optional match records */
+        PatternSet* patterns_ = NULL;  /**< Optional reloadable patterns */
+        BitSlipMatcher* slip_ = NULL;  /**< Optional bit-granular header search */
+        CommandStats* commands_ = NULL; /**< Optional command ID statistics */
+        unsigned idNeeded_ = 0;        /**< ID bytes still to come after the last header */
+        uint32_t id_ = 0;              /**< ID bytes collected so far */
         uint64_t counter_ = 0;         /**< Counter to keep track of valid sequences */
+        uint64_t offset_ = 0;          /**< Stream offset of the next byte */
 };
 /*-----------------------------------------------------------------------*/
 /* Prototype                                                             */
@@ -0,0 +1,441 @@
+/**
+ * @file  CommandStats.cpp
+ * @brief Heavy hitters on the command IDs after each header
+ * @note  The sketch counters are only ever added to, so readers load them
+ *        one by one without a snapshot. The Space-Saving heap moves
+ *        entries around, so it is guarded by a sequence lock: the writer
+ *        makes seq_ odd while it changes the heap and readers copy the K
+ *        entries again if seq_ moved. All shared fields are relaxed
+ *        atomics; with one writer a load and a store replace the RMW.
+ *
+ */
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include "CommandStats.h"
+#include <algorithm>
+#include <cassert>
+#include <thread>
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+static void CommandStats_Add(std::atomic<uint64_t>& counter, uint64_t n);
+static size_t CommandStats_Home(uint32_t id, size_t mask);
+
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+/*
+ * Multiply-shift hash per sketch row, the same in every instance so that
+ * summaries merge column by column
+ */
+static const uint64_t CommandStats_Mul[COMMAND_STATS_MAX_DEPTH] = {
+    0x9E3779B97F4A7C15ull, 0xBF58476D1CE4E5B9ull, 0x94D049BB133111EBull, 0xD6E8FEB86659FD93ull,
+    0xA0761D6478BD642Full, 0xE7037ED1A0B428DBull, 0x8EBC6AF09C88C6E3ull, 0xC2B2AE3D27D4EB4Full,
+};
+static const uint64_t CommandStats_Inc[COMMAND_STATS_MAX_DEPTH] = {
+    0x165667B19E3779F9ull, 0x27D4EB2F165667C5ull, 0x85EBCA77C2B2AE63ull, 0xFF51AFD7ED558CCDull,
+    0xC4CEB9FE1A85EC53ull, 0x589965CC75374CC3ull, 0x1D8E4E27C47D124Full, 0x4CF5AD432745937Full,
+};
+
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+/**
+ * @brief Allocate the sketch and the summary, nothing is allocated later
+ *
+ * @param  config  ID size, K and sketch dimensions
+ * @return None
+ */
+CommandStats::CommandStats(const CommandStatsConfig& config)
+{
+    assert((config.idBytes >= 1) && (config.idBytes <= 4));
+    assert(config.topK >= 1);
+    assert((config.width >= 2) && ((config.width & (config.width - 1)) == 0));
+    assert((config.depth >= 1) && (config.depth <= COMMAND_STATS_MAX_DEPTH));
+
+    config_ = config;
+    shift_ = 64 - (unsigned)__builtin_ctzll(config.width);
+    sketch_.reset(new std::atomic<uint64_t>[config.width * config.depth]);
+    heap_.reset(new Entry[config.topK]);
+    size_t slots = 4;
+    while (slots < 2 * config.topK) {
+        slots *= 2;
+    }
+    index_.reset(new Slot[slots]);
+    mask_ = slots - 1;
+    seq_ = 0;
+    reset();
+}
+
+/**
+ * @brief Count an ID in the sketch and the summary
+ *
+ * @param  id  command ID
+ * @param  n   occurrences
+ * @return None
+ */
+void CommandStats::add(uint32_t id, uint64_t n)
+{
+    CommandStats_Add(total_, n);
+    for (size_t r = 0; r < config_.depth; r++) {
+        CommandStats_Add(sketch_[r * config_.width + column(r, id)], n);
+    }
+
+    uint64_t seq = seq_.load(std::memory_order_relaxed);
+    seq_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    size_t s = slot(id);
+    size_t size = size_.load(std::memory_order_relaxed);
+    if (index_[s].pos >= 0) {
+        size_t pos = (size_t)index_[s].pos;
+        CommandStats_Add(heap_[pos].count, n);
+        siftDown(pos);
+    } else if (size < config_.topK) {
+        /* Not full: append and move up to its place */
+        size_t pos = size;
+        store(pos, id, n, 0);
+        size_.store(size + 1, std::memory_order_relaxed);
+        while (pos > 0) {
+            size_t parent = (pos - 1) / 2;
+            uint64_t count = heap_[parent].count.load(std::memory_order_relaxed);
+            if (count <= n) {
+                break;
+            }
+            store(pos, heap_[parent].id.load(std::memory_order_relaxed), count,
+                  heap_[parent].error.load(std::memory_order_relaxed));
+            store(parent, id, n, 0);
+            pos = parent;
+        }
+    } else {
+        /* Full: the new ID takes over the least count, which bounds its error */
+        uint64_t least = heap_[0].count.load(std::memory_order_relaxed);
+        erase(slot(heap_[0].id.load(std::memory_order_relaxed)));
+        store(0, id, least + n, least);
+        siftDown(0);
+    }
+
+    seq_.store(seq + 2, std::memory_order_release);
+}
+
+/**
+ * @brief Add another summary with the same config, e.g. another channel
+ *
+ * The sketches add column by column. The summaries merge as in Agarwal et
+ * al., "Mergeable Summaries": an ID missing from a full summary gets its
+ * least count as count and error, then the K highest counts are kept, so
+ * the bounds of the result are those of one summary over both streams.
+ * The other summary may still be written to; it is read like any reader.
+ *
+ * @param  other  summary to add
+ * @return true/false merged or the configs differ
+ */
+bool CommandStats::merge(CommandStats& other)
+{
+    if ((&other == this) || !isCompatible(other)) {
+        return false;
+    }
+    std::vector<CommandCount> mine = getTop();
+    std::vector<CommandCount> theirs = other.getTop();
+    for (size_t i = 0; i < config_.width * config_.depth; i++) {
+        CommandStats_Add(sketch_[i], other.sketch_[i].load(std::memory_order_relaxed));
+    }
+    CommandStats_Add(total_, other.getTotal());
+
+    uint64_t mineLeast = (mine.size() == config_.topK) ? mine.back().count : 0;
+    uint64_t theirLeast = (theirs.size() == config_.topK) ? theirs.back().count : 0;
+    auto byId = [](const CommandCount& a, const CommandCount& b) { return a.id < b.id; };
+    std::sort(mine.begin(), mine.end(), byId);
+    std::sort(theirs.begin(), theirs.end(), byId);
+    std::vector<CommandCount> merged;
+    size_t a = 0;
+    size_t b = 0;
+    while ((a < mine.size()) || (b < theirs.size())) {
+        CommandCount c;
+        if ((b >= theirs.size()) || ((a < mine.size()) && (mine[a].id < theirs[b].id))) {
+            c = mine[a++];
+            c.count += theirLeast;
+            c.error += theirLeast;
+        } else if ((a >= mine.size()) || (theirs[b].id < mine[a].id)) {
+            c = theirs[b++];
+            c.count += mineLeast;
+            c.error += mineLeast;
+        } else {
+            c = mine[a++];
+            c.count += theirs[b].count;
+            c.error += theirs[b].error;
+            b++;
+        }
+        merged.push_back(c);
+    }
+    std::sort(merged.begin(), merged.end(),
+              [](const CommandCount& x, const CommandCount& y) { return x.count > y.count; });
+    if (merged.size() > config_.topK) {
+        merged.resize(config_.topK);
+    }
+
+    /* Ascending counts are a valid min-heap */
+    uint64_t seq = seq_.load(std::memory_order_relaxed);
+    seq_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::fill(&index_[0], &index_[mask_ + 1], Slot{ 0, -1 });
+    for (size_t i = 0; i < merged.size(); i++) {
+        const CommandCount& c = merged[merged.size() - 1 - i];
+        store(i, c.id, c.count, c.error);
+    }
+    size_.store(merged.size(), std::memory_order_relaxed);
+    seq_.store(seq + 2, std::memory_order_release);
+    return true;
+}
+
+/**
+ * @brief Forget all counts
+ *
+ * @param  None
+ * @return None
+ */
+void CommandStats::reset()
+{
+    uint64_t seq = seq_.load(std::memory_order_relaxed);
+    seq_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < config_.width * config_.depth; i++) {
+        sketch_[i].store(0, std::memory_order_relaxed);
+    }
+    std::fill(&index_[0], &index_[mask_ + 1], Slot{ 0, -1 });
+    size_.store(0, std::memory_order_relaxed);
+    total_.store(0, std::memory_order_relaxed);
+    seq_.store(seq + 2, std::memory_order_release);
+}
+
+/**
+ * @brief Count of an ID from the sketch
+ *
+ * Never below the true count, and above it by no more than
+ * getErrorBound() with probability 1 - e^-depth.
+ *
+ * @param  id  command ID
+ * @return estimated count
+ */
+uint64_t CommandStats::estimate(uint32_t id)
+{
+    uint64_t least = UINT64_MAX;
+    for (size_t r = 0; r < config_.depth; r++) {
+        uint64_t c = sketch_[r * config_.width + column(r, id)].load(std::memory_order_relaxed);
+        least = (c < least) ? c : least;
+    }
+    return least;
+}
+
+/**
+ * @brief Get the tracked IDs, a consistent snapshot of the summary
+ *
+ * @param  None
+ * @return IDs by count, highest first
+ */
+std::vector<CommandCount> CommandStats::getTop()
+{
+    std::vector<CommandCount> top;
+    while (true) {
+        uint64_t seq = seq_.load(std::memory_order_acquire);
+        if ((seq & 1) != 0) {
+            std::this_thread::yield();
+            continue;
+        }
+        size_t size = size_.load(std::memory_order_relaxed);
+        top.resize(size);
+        for (size_t i = 0; i < size; i++) {
+            top[i].id = heap_[i].id.load(std::memory_order_relaxed);
+            top[i].count = heap_[i].count.load(std::memory_order_relaxed);
+            top[i].error = heap_[i].error.load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq_.load(std::memory_order_relaxed) == seq) {
+            break;
+        }
+    }
+    std::sort(top.begin(), top.end(),
+              [](const CommandCount& a, const CommandCount& b) { return a.count > b.count; });
+    return top;
+}
+
+/**
+ * @brief Get the number of IDs counted
+ *
+ * @param  None
+ * @return total
+ */
+uint64_t CommandStats::getTotal()
+{
+    return total_.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Get how far estimate() may be above the true count
+ *
+ * @param  None
+ * @return e * total / width, rounded up
+ */
+uint64_t CommandStats::getErrorBound()
+{
+    return (uint64_t)(2.718281828459045 * (double)getTotal() / (double)config_.width) + 1;
+}
+
+/**
+ * @brief Get the size of the ID the parser collects after each header
+ *
+ * @param  None
+ * @return bytes, 1 to 4
+ */
+unsigned CommandStats::getIdBytes()
+{
+    return config_.idBytes;
+}
+
+/**
+ * @brief Sketch column of an ID
+ *
+ * @param  row  sketch row
+ * @param  id   command ID
+ * @return column
+ */
+inline size_t CommandStats::column(size_t row, uint32_t id)
+{
+    return (size_t)((CommandStats_Mul[row] * id + CommandStats_Inc[row]) >> shift_);
+}
+
+/**
+ * @brief Find the index slot of an ID
+ *
+ * @param  id  command ID
+ * @return slot holding the ID, or the empty slot ending its probe
+ */
+size_t CommandStats::slot(uint32_t id)
+{
+    size_t s = CommandStats_Home(id, mask_);
+    while ((index_[s].pos >= 0) && (index_[s].id != id)) {
+        s = (s + 1) & mask_;
+    }
+    return s;
+}
+
+/**
+ * @brief Free an index slot, moving later entries of a probe back into it
+ *
+ * @param  s  slot to free
+ * @return None
+ */
+void CommandStats::erase(size_t s)
+{
+    size_t hole = s;
+    size_t next = s;
+    while (true) {
+        next = (next + 1) & mask_;
+        if (index_[next].pos < 0) {
+            break;
+        }
+        size_t home = CommandStats_Home(index_[next].id, mask_);
+
+        /* The entry may move back unless its home lies in (hole, next] */
+        bool keep = (hole <= next) ? ((home > hole) && (home <= next))
+                                   : ((home > hole) || (home <= next));
+        if (!keep) {
+            index_[hole] = index_[next];
+            hole = next;
+        }
+    }
+    index_[hole].pos = -1;
+}
+
+/**
+ * @brief Write a heap entry and point the index at it
+ *
+ * @param  pos    heap position
+ * @param  id     command ID
+ * @param  count  count
+ * @param  error  overestimate bound
+ * @return None
+ */
+void CommandStats::store(size_t pos, uint32_t id, uint64_t count, uint64_t error)
+{
+    heap_[pos].id.store(id, std::memory_order_relaxed);
+    heap_[pos].count.store(count, std::memory_order_relaxed);
+    heap_[pos].error.store(error, std::memory_order_relaxed);
+    index_[slot(id)] = Slot{ id, (int32_t)pos };
+}
+
+/**
+ * @brief Move an entry whose count grew down to its place
+ *
+ * @param  pos  heap position
+ * @return None
+ */
+void CommandStats::siftDown(size_t pos)
+{
+    size_t size = size_.load(std::memory_order_relaxed);
+    uint32_t id = heap_[pos].id.load(std::memory_order_relaxed);
+    uint64_t count = heap_[pos].count.load(std::memory_order_relaxed);
+    uint64_t error = heap_[pos].error.load(std::memory_order_relaxed);
+    while (true) {
+        size_t child = 2 * pos + 1;
+        if (child >= size) {
+            break;
+        }
+        if ((child + 1 < size) &&
+            (heap_[child + 1].count.load(std::memory_order_relaxed) <
+             heap_[child].count.load(std::memory_order_relaxed))) {
+            child++;
+        }
+        if (heap_[child].count.load(std::memory_order_relaxed) >= count) {
+            break;
+        }
+        store(pos, heap_[child].id.load(std::memory_order_relaxed),
+              heap_[child].count.load(std::memory_order_relaxed),
+              heap_[child].error.load(std::memory_order_relaxed));
+        pos = child;
+    }
+    store(pos, id, count, error);
+}
+
+/**
+ * @brief Check that two summaries can merge
+ *
+ * @param  other  summary
+ * @return true/false same config or not
+ */
+bool CommandStats::isCompatible(CommandStats& other)
+{
+    return (config_.idBytes == other.config_.idBytes) && (config_.topK == other.config_.topK) &&
+           (config_.width == other.config_.width) && (config_.depth == other.config_.depth);
+}
+
+/**
+ * @brief Add to a counter that only this thread writes
+ *
+ * @param  counter  counter
+ * @param  n        amount
+ * @return None
+ */
+static void CommandStats_Add(std::atomic<uint64_t>& counter, uint64_t n)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+/**
+ * @brief First index slot probed for an ID
+ *
+ * @param  id    command ID
+ * @param  mask  index size - 1
+ * @return slot
+ */
+static size_t CommandStats_Home(uint32_t id, size_t mask)
+{
+    return (size_t)((id * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
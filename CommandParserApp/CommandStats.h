@@ -0,0 +1,95 @@
+/**
+ * @file  CommandStats.h
+ * @brief Heavy hitters on the command IDs after each header
+ * @note
+ *
+ */
+#ifndef __COMMAND_STATS_H__
+#define __COMMAND_STATS_H__
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <vector>
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*
+ * Most rows of the count-min sketch
+ */
+#define COMMAND_STATS_MAX_DEPTH (8)
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+struct CommandCount {
+    uint32_t id = 0;          /**< Command ID, the bytes after A5 5A big endian */
+    uint64_t count = 0;       /**< Space-Saving count, never below the true count */
+    uint64_t error = 0;       /**< count - error is never above the true count */
+};
+
+struct CommandStatsConfig {
+    unsigned idBytes = 1;     /**< Bytes of the ID, 1 to 4 */
+    size_t topK = 32;         /**< Tracked IDs, any ID above total/topK is among them */
+    size_t width = 2048;      /**< Sketch columns, a power of two, error e/width of the total */
+    size_t depth = 4;         /**< Sketch rows, the error holds with probability 1 - e^-depth */
+};
+
+/*
+ * Fixed memory whatever the traffic: a count-min sketch answers the count
+ * of any ID, a Space-Saving summary keeps the top K. Single writer (the
+ * parse thread, or whoever merges into this one), any number of lock-free
+ * readers. Summaries with the same config merge, e.g. one per channel
+ * into a total.
+ */
+class CommandStats {
+    public:
+        CommandStats(const CommandStatsConfig& config = CommandStatsConfig());
+        void add(uint32_t id, uint64_t n = 1); /**< Count an ID, writer only */
+        bool merge(CommandStats& other); /**< Add another summary, writer only */
+        void reset();                 /**< Forget everything, writer only */
+        uint64_t estimate(uint32_t id); /**< Sketch count, never below the true count */
+        std::vector<CommandCount> getTop(); /**< Tracked IDs by count, highest first */
+        uint64_t getTotal();          /**< IDs counted */
+        uint64_t getErrorBound();     /**< Sketch overestimate bound, e/width of the total */
+        unsigned getIdBytes();        /**< Bytes of the ID */
+    private:
+        struct Slot {
+            uint32_t id;
+            int32_t pos;              /**< Heap position, -1 free */
+        };
+        struct Entry {
+            std::atomic<uint32_t> id{0};
+            std::atomic<uint64_t> count{0};
+            std::atomic<uint64_t> error{0};
+        };
+        size_t column(size_t row, uint32_t id); /**< Sketch column of an ID in a row */
+        size_t slot(uint32_t id);     /**< Index slot of an ID, or the free slot it would take */
+        void erase(size_t s);         /**< Free an index slot, keeping probes intact */
+        void store(size_t pos, uint32_t id, uint64_t count, uint64_t error); /**< Heap entry and index */
+        void siftDown(size_t pos);    /**< Restore the min-heap below pos */
+        bool isCompatible(CommandStats& other); /**< Same config */
+
+        CommandStatsConfig config_;   /**< Configuration */
+        unsigned shift_;              /**< 64 - log2(width) */
+        std::unique_ptr<std::atomic<uint64_t>[]> sketch_; /**< depth x width counters */
+        std::unique_ptr<Entry[]> heap_; /**< Space-Saving min-heap by count */
+        std::unique_ptr<Slot[]> index_; /**< ID to heap position, linear probing, writer only */
+        size_t mask_;                 /**< Index size - 1 */
+        std::atomic<size_t> size_;    /**< Entries in heap_ */
+        std::atomic<uint64_t> total_; /**< IDs counted */
+        std::atomic<uint64_t> seq_;   /**< Odd while the heap changes */
+};
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+#endif /* __COMMAND_STATS_H__ */
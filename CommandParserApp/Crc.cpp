@@ -0,0 +1,239 @@
+/**
+ * @file  Crc.cpp
+ * @brief CRC16 (X-25) and CRC32C with runtime selected implementation
+ * @note  Both CRCs are reflected, so the same slice-by-8 scheme is used:
+ *        eight bytes are folded per step through eight derived tables.
+ *        CRC32C uses the SSE4.2 crc32 instruction when the CPU has it.
+ *
+ */
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include "Crc.h"
+#include <cstring>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+struct CrcTables {
+    uint16_t crc16[8][256];   /**< Slice-by-8 tables of CRC16 */
+    uint32_t crc32c[8][256];  /**< Slice-by-8 tables of CRC32C */
+    CrcImpl crc32cImpl;       /**< Implementation picked for the CPU */
+    CrcTables();
+};
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+static uint64_t Crc_Load64(const uint8_t* data);
+static uint32_t Crc32c_Hardware(uint32_t crc, const uint8_t* data, size_t len);
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+/*
+ * Built before main, so the tables are read only afterwards
+ */
+static const CrcTables crcTables;
+
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+/**
+ * @brief Build the slice-by-8 tables and select the CRC32C implementation
+ *
+ * @param  None
+ * @return None
+ */
+CrcTables::CrcTables()
+{
+    for (unsigned n = 0; n < 256; n++) {
+        uint32_t c16 = n;
+        uint32_t c32 = n;
+        for (int bit = 0; bit < 8; bit++) {
+            c16 = (c16 & 1) ? (c16 >> 1) ^ CRC16_POLY : (c16 >> 1);
+            c32 = (c32 & 1) ? (c32 >> 1) ^ CRC32C_POLY : (c32 >> 1);
+        }
+        crc16[0][n] = (uint16_t)c16;
+        crc32c[0][n] = c32;
+    }
+    for (unsigned n = 0; n < 256; n++) {
+        for (int k = 1; k < 8; k++) {
+            crc16[k][n] = (uint16_t)((crc16[k - 1][n] >> 8) ^ crc16[0][crc16[k - 1][n] & 0xFF]);
+            crc32c[k][n] = (crc32c[k - 1][n] >> 8) ^ crc32c[0][crc32c[k - 1][n] & 0xFF];
+        }
+    }
+
+    crc32cImpl = CrcImpl::SLICE_BY_8;
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc32cImpl = CrcImpl::HARDWARE;
+    }
+#endif
+}
+
+static uint64_t Crc_Load64(const uint8_t* data)
+{
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+#if defined(__x86_64__)
+/**
+ * @brief CRC32C with the SSE4.2 crc32 instruction
+ *
+ * @param  crc   raw CRC register
+ * @param  data  bytes to add
+ * @param  len   number of bytes
+ * @return updated CRC register
+ */
+__attribute__((target("sse4.2")))
+static uint32_t Crc32c_Hardware(uint32_t crc, const uint8_t* data, size_t len)
+{
+    uint64_t c = crc;
+
+    for (; len >= 8; len -= 8, data += 8) {
+        c = _mm_crc32_u64(c, Crc_Load64(data));
+    }
+    for (; len > 0; len--, data++) {
+        c = _mm_crc32_u8((uint32_t)c, *data);
+    }
+    return (uint32_t)c;
+}
+#else
+static uint32_t Crc32c_Hardware(uint32_t crc, const uint8_t* data, size_t len)
+{
+    return Crc32c_UpdateImpl(CrcImpl::SLICE_BY_8, crc, data, len);
+}
+#endif
+
+/**
+ * @brief Update a CRC16 register with a given implementation
+ *
+ * There is no instruction for CRC16, HARDWARE falls back to slice-by-8.
+ *
+ * @param  impl  implementation to use
+ * @param  crc   raw CRC register
+ * @param  data  bytes to add
+ * @param  len   number of bytes
+ * @return updated CRC register
+ */
+uint16_t Crc16_UpdateImpl(CrcImpl impl, uint16_t crc, const uint8_t* data, size_t len)
+{
+    const uint16_t (*t)[256] = crcTables.crc16;
+    uint32_t c = crc;
+
+    if (impl != CrcImpl::BYTEWISE) {
+        for (; len >= 8; len -= 8, data += 8) {
+            uint64_t w = Crc_Load64(data) ^ c;
+            c = t[7][w & 0xFF] ^ t[6][(w >> 8) & 0xFF] ^
+                t[5][(w >> 16) & 0xFF] ^ t[4][(w >> 24) & 0xFF] ^
+                t[3][(w >> 32) & 0xFF] ^ t[2][(w >> 40) & 0xFF] ^
+                t[1][(w >> 48) & 0xFF] ^ t[0][w >> 56];
+        }
+    }
+    for (; len > 0; len--, data++) {
+        c = (c >> 8) ^ t[0][(c ^ *data) & 0xFF];
+    }
+    return (uint16_t)c;
+}
+
+/**
+ * @brief Update a CRC32C register with a given implementation
+ *
+ * @param  impl  implementation to use
+ * @param  crc   raw CRC register
+ * @param  data  bytes to add
+ * @param  len   number of bytes
+ * @return updated CRC register
+ */
+uint32_t Crc32c_UpdateImpl(CrcImpl impl, uint32_t crc, const uint8_t* data, size_t len)
+{
+    const uint32_t (*t)[256] = crcTables.crc32c;
+    uint32_t c = crc;
+
+    if (impl == CrcImpl::HARDWARE) {
+        return Crc32c_Hardware(crc, data, len);
+    }
+    if (impl == CrcImpl::SLICE_BY_8) {
+        for (; len >= 8; len -= 8, data += 8) {
+            uint64_t w = Crc_Load64(data) ^ c;
+            c = t[7][w & 0xFF] ^ t[6][(w >> 8) & 0xFF] ^
+                t[5][(w >> 16) & 0xFF] ^ t[4][(w >> 24) & 0xFF] ^
+                t[3][(w >> 32) & 0xFF] ^ t[2][(w >> 40) & 0xFF] ^
+                t[1][(w >> 48) & 0xFF] ^ t[0][w >> 56];
+        }
+    }
+    for (; len > 0; len--, data++) {
+        c = (c >> 8) ^ t[0][(c ^ *data) & 0xFF];
+    }
+    return c;
+}
+
+/**
+ * @brief Update a CRC16 register with the fastest implementation
+ *
+ * @param  crc   raw CRC register
+ * @param  data  bytes to add
+ * @param  len   number of bytes
+ * @return updated CRC register
+ */
+uint16_t Crc16_Update(uint16_t crc, const uint8_t* data, size_t len)
+{
+    return Crc16_UpdateImpl(CrcImpl::SLICE_BY_8, crc, data, len);
+}
+
+/**
+ * @brief Update a CRC32C register with the implementation picked at startup
+ *
+ * @param  crc   raw CRC register
+ * @param  data  bytes to add
+ * @param  len   number of bytes
+ * @return updated CRC register
+ */
+uint32_t Crc32c_Update(uint32_t crc, const uint8_t* data, size_t len)
+{
+    return Crc32c_UpdateImpl(crcTables.crc32cImpl, crc, data, len);
+}
+
+/**
+ * @brief CRC16 of a buffer
+ *
+ * @param  data  bytes
+ * @param  len   number of bytes
+ * @return CRC value
+ */
+uint16_t Crc16(const uint8_t* data, size_t len)
+{
+    return (uint16_t)(Crc16_Update(CRC16_INIT, data, len) ^ CRC16_XOR);
+}
+
+/**
+ * @brief CRC32C of a buffer
+ *
+ * @param  data  bytes
+ * @param  len   number of bytes
+ * @return CRC value
+ */
+uint32_t Crc32c(const uint8_t* data, size_t len)
+{
+    return Crc32c_Update(CRC32C_INIT, data, len) ^ CRC32C_XOR;
+}
+
+/**
+ * @brief Get the CRC32C implementation selected for this CPU
+ *
+ * @param  None
+ * @return implementation
+ */
+CrcImpl Crc32c_Selected(void)
+{
+    return crcTables.crc32cImpl;
+}
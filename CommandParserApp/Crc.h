@@ -0,0 +1,57 @@
+/**
+ * @file  Crc.h
+ * @brief CRC16 (X-25) and CRC32C with runtime selected implementation
+ * @note
+ *
+ */
+#ifndef __CRC_H__
+#define __CRC_H__
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include <cstdint>
+#include <cstddef>
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*
+ * CRC-16/X-25: reflected 0x1021, init 0xFFFF, xorout 0xFFFF
+ */
+#define CRC16_POLY  (0x8408u)
+#define CRC16_INIT  (0xFFFFu)
+#define CRC16_XOR   (0xFFFFu)
+
+/*
+ * CRC-32C (Castagnoli): reflected 0x1EDC6F41, init and xorout 0xFFFFFFFF
+ */
+#define CRC32C_POLY (0x82F63B78u)
+#define CRC32C_INIT (0xFFFFFFFFu)
+#define CRC32C_XOR  (0xFFFFFFFFu)
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+enum class CrcImpl { BYTEWISE, SLICE_BY_8, HARDWARE }; /**< CRC implementation */
+
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+/*
+ * The update functions work on the raw register, i.e. the caller starts
+ * with the INIT value and applies the XOR value at the end. This allows
+ * a CRC to be computed over data that arrives in pieces.
+ */
+uint16_t Crc16_Update(uint16_t crc, const uint8_t* data, size_t len);
+uint32_t Crc32c_Update(uint32_t crc, const uint8_t* data, size_t len);
+uint16_t Crc16_UpdateImpl(CrcImpl impl, uint16_t crc, const uint8_t* data, size_t len);
+uint32_t Crc32c_UpdateImpl(CrcImpl impl, uint32_t crc, const uint8_t* data, size_t len);
+uint16_t Crc16(const uint8_t* data, size_t len);
+uint32_t Crc32c(const uint8_t* data, size_t len);
+CrcImpl Crc32c_Selected(void);
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+#endif /* __CRC_H__ */
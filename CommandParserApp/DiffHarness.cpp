@@ -0,0 +1,430 @@
+/**
+ * @file  DiffHarness.cpp
+ * @brief Differential verification of the parser kernels
+ * @note  The reference model is deliberately not a state machine: the
+ *        count is the number of A5 5A byte pairs in the stream and the
+ *        final state follows from the last byte alone.
+ *
+ */
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include "DiffHarness.h"
+#include <cstdio>
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*
+ * Stream bytes quoted in a failure report
+ */
+#define DIFF_REPORT_BYTES (48)
+
+/*
+ * Ring of the pipeline kernel and the pool buffer size, small so pieces
+ * are split across buffers and batches
+ */
+#define DIFF_PIPELINE_RING   (64)
+#define DIFF_PIPELINE_BUFFER (7)
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+/**
+ * @brief Compile the header pattern used by the DFA kernel and start the
+ *        pipeline of the pipeline kernel
+ *
+ * @param  None
+ * @return None
+ */
+DiffHarness::DiffHarness()
+    : pipeMem_(DIFF_PIPELINE_RING, MemPolicy()), pipeParser_(&pipeMem_)
+{
+    bool ok = dfa_.compile("A5+ 5A");
+    assert(ok);
+    (void)ok;
+    runs_ = 0;
+
+    PipelineConfig config;
+    config.batchSize = 3;
+    config.bufferSize = DIFF_PIPELINE_BUFFER;
+    config.buffers = 16;
+    config.queueDepth = 4;
+    pipeline_ = new Pipeline(&pipeMem_, &pipeParser_, NULL, config);
+    pipeline_->start();
+    pipeBytes_ = 0;
+}
+
+/**
+ * @brief Stop the pipeline
+ *
+ * @param  None
+ * @return None
+ */
+DiffHarness::~DiffHarness()
+{
+    delete pipeline_;
+}
+
+/**
+ * @brief Run all kernels with no cut and with a single cut at each offset
+ *
+ * @param  stream  stream to parse
+ * @return true/false all kernels agreed with the reference or not
+ */
+bool DiffHarness::checkEverySplit(const std::vector<uint8_t>& stream)
+{
+    std::vector<size_t> cuts;
+
+    if (!checkCuts(stream, cuts)) {
+        return false;
+    }
+    for (size_t split = 0; split <= stream.size(); split++) {
+        cuts.assign(1, split);
+        if (!checkCuts(stream, cuts)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Run all kernels with the stream cut at the given offsets
+ *
+ * @param  stream  stream to parse
+ * @param  cuts    ascending offsets, each at most stream.size()
+ * @return true/false all kernels agreed with the reference or not
+ */
+bool DiffHarness::checkCuts(const std::vector<uint8_t>& stream, const std::vector<size_t>& cuts)
+{
+    DiffResult expected = reference(stream);
+
+    for (int k = 0; k < (int)Kernel::COUNT; k++) {
+        Kernel kernel = (Kernel)k;
+        DiffResult got = run(kernel, stream, cuts);
+        runs_++;
+        bool stateChecked = (kernel != Kernel::PATTERN_DFA);
+        if ((got.count == expected.count) && (!stateChecked || (got.state == expected.state))) {
+            continue;
+        }
+
+        char line[128];
+        snprintf(line, sizeof(line), "%s: count %llu state %d, expected count %llu state %d\n",
+                 getKernelName(kernel), (unsigned long long)got.count, (int)got.state,
+                 (unsigned long long)expected.count, (int)expected.state);
+        failure_ = line;
+        failure_ += "cuts:";
+        for (size_t c : cuts) {
+            failure_ += " " + std::to_string(c);
+        }
+        failure_ += "\nstream (" + std::to_string(stream.size()) + " bytes):";
+        for (size_t i = 0; (i < stream.size()) && (i < DIFF_REPORT_BYTES); i++) {
+            snprintf(line, sizeof(line), " %02X", stream[i]);
+            failure_ += line;
+        }
+        if (stream.size() > DIFF_REPORT_BYTES) {
+            failure_ += " ...";
+        }
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Check every stream over {A5, 5A, 00} up to a length
+ *
+ * @param  maxLen  longest stream, 3^maxLen streams of that length
+ * @return true/false all kernels agreed with the reference or not
+ */
+bool DiffHarness::checkExhaustive(size_t maxLen)
+{
+    const uint8_t symbols[] = { 0xA5, 0x5A, 0x00 };
+    std::vector<uint8_t> stream;
+
+    for (size_t len = 0; len <= maxLen; len++) {
+        std::vector<unsigned> digits(len, 0);
+        while (true) {
+            stream.resize(len);
+            for (size_t i = 0; i < len; i++) {
+                stream[i] = symbols[digits[i]];
+            }
+            if (!checkEverySplit(stream)) {
+                return false;
+            }
+            /* Next string in base 3 */
+            size_t i = 0;
+            while ((i < len) && (++digits[i] == 3)) {
+                digits[i++] = 0;
+            }
+            if (i == len) {
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Parse the pieces of a stream with one kernel
+ *
+ * @param  kernel  kernel to run
+ * @param  stream  stream to parse
+ * @param  cuts    ascending cut offsets
+ * @return count and final state
+ */
+DiffResult DiffHarness::run(Kernel kernel, const std::vector<uint8_t>& stream,
+                            const std::vector<size_t>& cuts)
+{
+    DiffResult result;
+    SharedMem shmem;
+    CmdSeqParser parser(&shmem);
+    ParserCheckpoint cp;
+    std::vector<size_t> bounds(1, 0);
+
+    bounds.insert(bounds.end(), cuts.begin(), cuts.end());
+    bounds.push_back(stream.size());
+
+    if (kernel == Kernel::SHMEM) {
+        /* Start the ring at an offset so pieces wrap around its end */
+        uint8_t zeros[SHARED_MEM_SIZE] = { 0 };
+        const uint8_t* first;
+        const uint8_t* second;
+        size_t firstLen;
+        size_t secondLen;
+        size_t rotate = (cuts.empty() ? stream.size() : cuts[0]) % SHARED_MEM_SIZE;
+        shmem.PutBlock(zeros, rotate);
+        shmem.Release(shmem.GetRegions(&first, &firstLen, &second, &secondLen));
+    } else if (kernel == Kernel::PIPELINE) {
+        /* The pipeline is idle after the last run, see below */
+        pipeParser_.restore(cp);
+    } else if (kernel == Kernel::PATTERN_DFA) {
+        dfa_.reset();
+    }
+
+    for (size_t p = 0; p + 1 < bounds.size(); p++) {
+        const uint8_t* data = stream.data() + bounds[p];
+        size_t len = bounds[p + 1] - bounds[p];
+        switch (kernel) {
+        case Kernel::SCALAR:
+            parser.parseBlockScalar(data, len);
+            break;
+        case Kernel::BULK:
+            parser.parseBlock(data, len);
+            break;
+        case Kernel::MIXED:
+            if (p % 2) {
+                parser.parseBlockScalar(data, len);
+            } else {
+                parser.parseBlock(data, len);
+            }
+            break;
+        case Kernel::SHMEM:
+            for (size_t i = 0; i < len; i++) {
+                shmem.PutData(data[i]);
+                if (shmem.IsFull()) {
+                    parser.parser();
+                }
+            }
+            parser.parseAvailable();
+            break;
+        case Kernel::CHECKPOINT: {
+            SharedMem resumedMem;
+            CmdSeqParser resumed(&resumedMem);
+            resumed.restore(cp);
+            resumed.parseBlock(data, len);
+            resumed.checkpoint(cp);
+            break;
+        }
+        case Kernel::PIPELINE:
+            for (size_t done = 0; done < len; ) {
+                size_t n = pipeMem_.PutBlock(data + done, len - done);
+                pipeline_->notifyDataAvailable();
+                done += n;
+                pipeBytes_ += n;
+                if (n == 0) {
+                    std::this_thread::yield();
+                }
+            }
+            break;
+        case Kernel::PARTIAL:
+            /* Parse at most a few bytes per call, the rest waits in the ring */
+            for (size_t done = 0, step = p; done < len; step++) {
+                done += shmem.PutBlock(data + done, len - done);
+                parser.parseAvailable(1 + step % 5);
+            }
+            break;
+        case Kernel::PATTERN_DFA:
+            dfa_.scan(data, len);
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (kernel == Kernel::CHECKPOINT) {
+        parser.restore(cp);
+    } else if (kernel == Kernel::PARTIAL) {
+        while (parser.parseAvailable() > 0) {
+        }
+    }
+    if (kernel == Kernel::PATTERN_DFA) {
+        result.count = dfa_.getCount();
+    } else if (kernel == Kernel::PIPELINE) {
+        /* The sink counts a buffer after the scan stage is done with it */
+        while (pipeline_->getBytes() < pipeBytes_) {
+            std::this_thread::yield();
+        }
+        result.count = pipeParser_.getCount();
+        result.state = pipeParser_.getState();
+    } else {
+        result.count = parser.getCount();
+        result.state = parser.getState();
+    }
+    return result;
+}
+
+/**
+ * @brief Count and final state by definition
+ *
+ * @param  stream  stream to parse
+ * @return count of A5 5A pairs, state of the last byte
+ */
+DiffResult DiffHarness::reference(const std::vector<uint8_t>& stream)
+{
+    DiffResult result;
+
+    for (size_t i = 1; i < stream.size(); i++) {
+        if ((stream[i - 1] == 0xA5) && (stream[i] == 0x5A)) {
+            result.count++;
+        }
+    }
+    if (!stream.empty()) {
+        if (stream.back() == 0xA5) {
+            result.state = CmdSeqParser::State::FOUND_A5;
+        } else if (stream.back() == 0x5A) {
+            result.state = CmdSeqParser::State::FOUND_5A;
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Generate a random or adversarial stream
+ *
+ * @param  rng     random source
+ * @param  kind    kind of stream
+ * @param  len     stream length
+ * @param  stream  generated stream
+ * @return None
+ */
+void DiffHarness::generate(std::mt19937_64& rng, Stream kind, size_t len,
+                           std::vector<uint8_t>& stream)
+{
+    const uint8_t alphabet[] = { 0xA5, 0x5A, 0x00, 0xFF };
+
+    stream.assign(len, 0x00);
+    switch (kind) {
+    case Stream::RANDOM:
+        for (auto& b : stream) {
+            b = (uint8_t)rng();
+        }
+        break;
+    case Stream::ALPHABET:
+        for (auto& b : stream) {
+            b = alphabet[rng() % 4];
+        }
+        break;
+    case Stream::RUNS:
+        for (size_t i = 0; i < len; ) {
+            uint8_t b = alphabet[rng() % 4];
+            size_t run = 1 + (size_t)(rng() % ((rng() % 4 == 0) ? 40 : 4));
+            for (; (run > 0) && (i < len); run--) {
+                stream[i++] = b;
+            }
+        }
+        break;
+    case Stream::BOUNDARY: {
+        /* Short header groups centered on 16 byte boundaries */
+        const uint8_t groups[][4] = {
+            { 0xA5, 0x5A, 0x00, 0x00 }, { 0xA5, 0xA5, 0x5A, 0x00 },
+            { 0x5A, 0xA5, 0x5A, 0x00 }, { 0xA5, 0x5A, 0xA5, 0x5A },
+            { 0xA5, 0xA5, 0xA5, 0x00 }, { 0x5A, 0x5A, 0xA5, 0x00 },
+        };
+        for (size_t edge = 16; edge < len + 2; edge += 16) {
+            if (rng() % 4 == 0) {
+                continue;
+            }
+            const uint8_t* g = groups[rng() % (sizeof(groups) / sizeof(groups[0]))];
+            size_t start = edge - 1 - (size_t)(rng() % 3);
+            for (size_t k = 0; (k < 4) && (start + k < len); k++) {
+                stream[start + k] = g[k];
+            }
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Get the number of kernel runs compared
+ *
+ * @param  None
+ * @return runs
+ */
+uint64_t DiffHarness::getRuns()
+{
+    return runs_;
+}
+
+/**
+ * @brief Get the first mismatch
+ *
+ * @param  None
+ * @return kernel, cuts and stream of the mismatch, empty if none
+ */
+const std::string& DiffHarness::getFailure()
+{
+    return failure_;
+}
+
+/**
+ * @brief Name of a kernel
+ *
+ * @param  kernel  kernel
+ * @return name
+ */
+const char* DiffHarness::getKernelName(Kernel kernel)
+{
+    switch (kernel) {
+    case Kernel::SCALAR:
+        return "scalar";
+    case Kernel::BULK:
+        return "bulk";
+    case Kernel::MIXED:
+        return "mixed";
+    case Kernel::SHMEM:
+        return "shmem";
+    case Kernel::CHECKPOINT:
+        return "checkpoint";
+    case Kernel::PIPELINE:
+        return "pipeline";
+    case Kernel::PARTIAL:
+        return "partial";
+    case Kernel::PATTERN_DFA:
+        return "pattern-dfa";
+    default:
+        return "?";
+    }
+}
@@ -0,0 +1,87 @@
+/**
+ * @file  DiffHarness.h
+ * @brief Differential verification of the parser kernels
+ * @note  Every kernel is run on the same stream cut into pieces and must
+ *        reproduce the count and final state of a reference model.
+ *
+ */
+#ifndef __DIFF_HARNESS_H__
+#define __DIFF_HARNESS_H__
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include <cstdint>
+#include <cstddef>
+#include <random>
+#include <string>
+#include <vector>
+#include "CmdSeqParser.h"
+#include "Pipeline.h"
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*
+ * Outcome of parsing a stream
+ */
+struct DiffResult {
+    uint64_t count = 0;                                    /**< Valid command count */
+    CmdSeqParser::State state = CmdSeqParser::State::DEFAULT; /**< Final state */
+};
+
+class DiffHarness {
+    public:
+        enum class Kernel {
+            SCALAR,      /**< parseBlockScalar per piece */
+            BULK,        /**< parseBlock (run skipping) per piece */
+            MIXED,       /**< Pieces alternate between bulk and scalar */
+            SHMEM,       /**< PutData, parser() when full, parseAvailable() at cuts */
+            CHECKPOINT,  /**< New parser restored from a checkpoint per piece */
+            PIPELINE,    /**< Staged Pipeline, cuts are PutBlock/notify boundaries */
+            PARTIAL,     /**< parseAvailable(maxLen) leaving the rest in the ring */
+            PATTERN_DFA, /**< "A5+ 5A" DFA, count only */
+            COUNT
+        };
+        enum class Stream {
+            RANDOM,      /**< Uniform random bytes */
+            ALPHABET,    /**< Bytes from {A5, 5A, 00, FF} */
+            RUNS,        /**< Runs of A5 or 5A of random length */
+            BOUNDARY,    /**< Headers straddling 16 byte SIMD/ring boundaries */
+            COUNT
+        };
+
+        DiffHarness();
+        ~DiffHarness();
+        bool checkEverySplit(const std::vector<uint8_t>& stream); /**< All kernels, each single cut */
+        bool checkCuts(const std::vector<uint8_t>& stream, const std::vector<size_t>& cuts); /**< All kernels, given cuts */
+        bool checkExhaustive(size_t maxLen); /**< All {A5, 5A, 00} strings up to maxLen, every split */
+        uint64_t getRuns();                  /**< Kernel runs compared so far */
+        const std::string& getFailure();     /**< First mismatch, empty if none */
+        static void generate(std::mt19937_64& rng, Stream kind, size_t len,
+                             std::vector<uint8_t>& stream); /**< Test stream */
+        static DiffResult reference(const std::vector<uint8_t>& stream); /**< Reference model */
+        static const char* getKernelName(Kernel kernel);
+    private:
+        DiffResult run(Kernel kernel, const std::vector<uint8_t>& stream,
+                       const std::vector<size_t>& cuts); /**< Parse the pieces with a kernel */
+
+        PatternDfa dfa_;        /**< Compiled header pattern */
+        SharedMem pipeMem_;     /**< Ring of the pipeline kernel */
+        CmdSeqParser pipeParser_; /**< Scan stage of the pipeline kernel */
+        Pipeline* pipeline_;    /**< Kept running across runs, threads are costly */
+        uint64_t pipeBytes_;    /**< Bytes put into the pipeline so far */
+        uint64_t runs_;         /**< Kernel runs compared */
+        std::string failure_;   /**< First mismatch */
+};
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+#endif /* __DIFF_HARNESS_H__ */
@@ -0,0 +1,665 @@
+/**
+ * @file  FileReader.cpp
+ * @brief Capture file ingestion with read-ahead (io_uring, pread pool)
+ * @note  Reads are issued for the next depth blocks of the file and
+ *        parsed strictly in file order as they complete, so the disk keeps
+ *        working while the CPU parses. io_uring is driven through the raw
+ *        syscalls with registered buffers, no liburing is needed. When the
+ *        kernel has no io_uring the same scheme runs on a pread pool.
+ *
+ */
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include "FileReader.h"
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*
+ * Minimal io_uring: one submission and one completion ring
+ */
+class UringQueue {
+    public:
+        UringQueue();
+        ~UringQueue();
+        bool setup(unsigned entries);
+        bool registerBuffers(const struct iovec* iov, unsigned n);
+        void prepReadFixed(int fd, void* buf, unsigned len, uint64_t offset,
+                           unsigned bufIndex, uint64_t userData);
+        bool submitAndWait(unsigned waitNr);
+        bool reap(uint64_t* userData, int32_t* res);
+    private:
+        int fd_;
+        void* sqRing_;
+        void* cqRing_;
+        size_t sqRingSize_;
+        size_t cqRingSize_;
+        struct io_uring_sqe* sqes_;
+        size_t sqesSize_;
+        unsigned* sqHead_;
+        unsigned* sqTail_;
+        unsigned* sqMask_;
+        unsigned* sqArray_;
+        unsigned* cqHead_;
+        unsigned* cqTail_;
+        unsigned* cqMask_;
+        struct io_uring_cqe* cqes_;
+        unsigned pending_;
+};
+
+/*
+ * Read of one block in flight
+ */
+struct ReadSlot {
+    uint8_t* buf;        /**< Block buffer */
+    uint64_t offset;     /**< File offset of the block */
+    size_t len;          /**< Bytes requested */
+    size_t done;         /**< Bytes read so far */
+    int error;           /**< errno of a failed read, 0 if none */
+    bool complete;       /**< Read finished */
+};
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+static size_t FileReader_ResumeAt(size_t done, bool direct);
+
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+UringQueue::UringQueue()
+{
+    fd_ = -1;
+    sqRing_ = MAP_FAILED;
+    cqRing_ = MAP_FAILED;
+    sqes_ = (struct io_uring_sqe*)MAP_FAILED;
+    sqRingSize_ = 0;
+    cqRingSize_ = 0;
+    sqesSize_ = 0;
+    pending_ = 0;
+}
+
+UringQueue::~UringQueue()
+{
+    if (sqes_ != MAP_FAILED) {
+        munmap(sqes_, sqesSize_);
+    }
+    if ((cqRing_ != MAP_FAILED) && (cqRing_ != sqRing_)) {
+        munmap(cqRing_, cqRingSize_);
+    }
+    if (sqRing_ != MAP_FAILED) {
+        munmap(sqRing_, sqRingSize_);
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+/**
+ * @brief Create the rings and map them
+ *
+ * @param  entries  submission queue entries
+ * @return true/false io_uring available or not
+ */
+bool UringQueue::setup(unsigned entries)
+{
+    struct io_uring_params p;
+
+    memset(&p, 0, sizeof(p));
+    fd_ = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (fd_ < 0) {
+        return false;
+    }
+
+    sqRingSize_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqRingSize_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        sqRingSize_ = (cqRingSize_ > sqRingSize_) ? cqRingSize_ : sqRingSize_;
+    }
+    sqRing_ = mmap(NULL, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   fd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED) {
+        return false;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        cqRing_ = sqRing_;
+    } else {
+        cqRing_ = mmap(NULL, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       fd_, IORING_OFF_CQ_RING);
+        if (cqRing_ == MAP_FAILED) {
+            return false;
+        }
+    }
+    sqesSize_ = p.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = (struct io_uring_sqe*)mmap(NULL, sqesSize_, PROT_READ | PROT_WRITE,
+                                       MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes_ == MAP_FAILED) {
+        return false;
+    }
+
+    uint8_t* sq = (uint8_t*)sqRing_;
+    uint8_t* cq = (uint8_t*)cqRing_;
+    sqHead_ = (unsigned*)(sq + p.sq_off.head);
+    sqTail_ = (unsigned*)(sq + p.sq_off.tail);
+    sqMask_ = (unsigned*)(sq + p.sq_off.ring_mask);
+    sqArray_ = (unsigned*)(sq + p.sq_off.array);
+    cqHead_ = (unsigned*)(cq + p.cq_off.head);
+    cqTail_ = (unsigned*)(cq + p.cq_off.tail);
+    cqMask_ = (unsigned*)(cq + p.cq_off.ring_mask);
+    cqes_ = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    return true;
+}
+
+/**
+ * @brief Register the read buffers so the kernel maps them only once
+ *
+ * @param  iov  buffers
+ * @param  n    number of buffers
+ * @return true/false registered or not
+ */
+bool UringQueue::registerBuffers(const struct iovec* iov, unsigned n)
+{
+    return syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS, iov, n) == 0;
+}
+
+/**
+ * @brief Queue a read into a registered buffer
+ *
+ * @param  fd        file
+ * @param  buf       destination inside registered buffer bufIndex
+ * @param  len       bytes to read
+ * @param  offset    file offset
+ * @param  bufIndex  registered buffer index
+ * @param  userData  returned with the completion
+ * @return None
+ */
+void UringQueue::prepReadFixed(int fd, void* buf, unsigned len, uint64_t offset,
+                               unsigned bufIndex, uint64_t userData)
+{
+    unsigned tail = *sqTail_;
+    unsigned index = tail & *sqMask_;
+    struct io_uring_sqe* sqe = &sqes_[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->buf_index = (uint16_t)bufIndex;
+    sqe->user_data = userData;
+    sqArray_[index] = index;
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+    pending_++;
+}
+
+/**
+ * @brief Submit the queued reads and wait for completions
+ *
+ * @param  waitNr  completions to wait for
+ * @return true/false syscall succeeded or not
+ */
+bool UringQueue::submitAndWait(unsigned waitNr)
+{
+    while (true) {
+        long ret = syscall(__NR_io_uring_enter, fd_, pending_, waitNr,
+                           (waitNr > 0) ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (ret >= 0) {
+            pending_ -= (unsigned)ret;
+            return true;
+        }
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+/**
+ * @brief Take one completion if there is one
+ *
+ * @param  userData  user data of the read
+ * @param  res       bytes read or -errno
+ * @return true/false completion taken or not
+ */
+bool UringQueue::reap(uint64_t* userData, int32_t* res)
+{
+    unsigned head = *cqHead_;
+    if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    struct io_uring_cqe* cqe = &cqes_[head & *cqMask_];
+    *userData = cqe->user_data;
+    *res = cqe->res;
+    __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/**
+ * @brief Allocate the aligned read buffers
+ *
+ * @param  config  backend, block size and read-ahead depth
+ * @return None
+ */
+FileReader::FileReader(const FileReaderConfig& config)
+{
+    assert(config.depth > 0);
+    assert((config.blockSize > 0) && (config.blockSize % FILE_READER_ALIGN == 0));
+
+    config_ = config;
+    void* mem = NULL;
+    if (posix_memalign(&mem, FILE_READER_ALIGN, config.blockSize * config.depth) != 0) {
+        mem = NULL;
+    }
+    assert(mem != NULL);
+    buffers_ = (uint8_t*)mem;
+    backend_ = config.backend;
+    bytes_ = 0;
+}
+
+/**
+ * @brief Release the read buffers
+ *
+ * @param  None
+ * @return None
+ */
+FileReader::~FileReader()
+{
+    free(buffers_);
+}
+
+/**
+ * @brief Read a whole file and parse it in order
+ *
+ * @param  path    capture file
+ * @param  parser  parser fed through its bulk path
+ * @return true/false file was read completely or not
+ */
+bool FileReader::read(const char* path, CmdSeqParser* parser)
+{
+    struct stat st;
+    bool ok = false;
+
+    bytes_ = 0;
+    int flags = O_RDONLY | O_CLOEXEC;
+    if (config_.direct && (config_.backend != Backend::MMAP)) {
+        flags |= O_DIRECT;
+    }
+    int fd = open(path, flags);
+    if (fd < 0) {
+        return false;
+    }
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+
+    backend_ = config_.backend;
+    if ((backend_ == Backend::AUTO) || (backend_ == Backend::IO_URING)) {
+        ok = readUring(fd, (uint64_t)st.st_size, parser);
+        if (ok) {
+            backend_ = Backend::IO_URING;
+        } else if ((backend_ == Backend::AUTO) && (bytes_ == 0)) {
+            /* No io_uring in this kernel, or not allowed */
+            backend_ = Backend::THREAD_POOL;
+        }
+    }
+    if (backend_ == Backend::THREAD_POOL) {
+        ok = readPool(fd, (uint64_t)st.st_size, parser);
+    } else if (backend_ == Backend::READ) {
+        ok = readPlain(fd, parser);
+    } else if (backend_ == Backend::MMAP) {
+        ok = readMmap(fd, (uint64_t)st.st_size, parser);
+    }
+    close(fd);
+    return ok;
+}
+
+/**
+ * @brief Read with io_uring, depth fixed buffer reads in flight
+ *
+ * @param  fd      file
+ * @param  size    file size
+ * @param  parser  parser
+ * @return true/false file was read completely or not, false without any
+ *         byte parsed when io_uring is not available
+ */
+bool FileReader::readUring(int fd, uint64_t size, CmdSeqParser* parser)
+{
+    UringQueue ring;
+    std::vector<ReadSlot> slots(config_.depth);
+    std::vector<struct iovec> iov(config_.depth);
+
+    if (!ring.setup(config_.depth)) {
+        return false;
+    }
+    for (unsigned i = 0; i < config_.depth; i++) {
+        slots[i].buf = buffers_ + i * config_.blockSize;
+        iov[i].iov_base = slots[i].buf;
+        iov[i].iov_len = config_.blockSize;
+    }
+    if (!ring.registerBuffers(iov.data(), config_.depth)) {
+        return false;
+    }
+
+    /* Prime the read-ahead window */
+    uint64_t next = 0;
+    unsigned inFlight = 0;
+    for (unsigned i = 0; (i < config_.depth) && (next < size); i++) {
+        ReadSlot& s = slots[i];
+        s.offset = next;
+        s.len = (size - next < config_.blockSize) ? (size_t)(size - next) : config_.blockSize;
+        s.done = 0;
+        s.error = 0;
+        s.complete = false;
+        ring.prepReadFixed(fd, s.buf, (unsigned)config_.blockSize, s.offset, i, i);
+        next += s.len;
+        inFlight++;
+    }
+
+    /* Parse the blocks in file order, refill each slot after parsing it */
+    unsigned current = 0;
+    while (inFlight > 0) {
+        ReadSlot& s = slots[current];
+        while (!s.complete) {
+            if (!ring.submitAndWait(1)) {
+                return false;
+            }
+            uint64_t id;
+            int32_t res;
+            while (ring.reap(&id, &res)) {
+                ReadSlot& r = slots[id];
+                if (res < 0) {
+                    r.error = -res;
+                    r.complete = true;
+                } else if ((res == 0) || (r.done + (size_t)res >= r.len)) {
+                    r.done += (size_t)res;
+                    r.complete = true;
+                } else {
+                    /* Short read, continue into the rest of the buffer */
+                    r.done = FileReader_ResumeAt(r.done + (size_t)res, config_.direct);
+                    ring.prepReadFixed(fd, r.buf + r.done, (unsigned)(config_.blockSize - r.done),
+                                       r.offset + r.done, (unsigned)id, id);
+                }
+            }
+        }
+        if (s.error != 0) {
+            return false;
+        }
+        size_t len = (s.done < s.len) ? s.done : s.len;
+        parser->parseBlock(s.buf, len);
+        bytes_ += len;
+        inFlight--;
+
+        if (next < size) {
+            s.offset = next;
+            s.len = (size - next < config_.blockSize) ? (size_t)(size - next) : config_.blockSize;
+            s.done = 0;
+            s.complete = false;
+            ring.prepReadFixed(fd, s.buf, (unsigned)config_.blockSize, s.offset, current, current);
+            next += s.len;
+            inFlight++;
+        }
+        current = (current + 1) % config_.depth;
+    }
+    return bytes_ == size;
+}
+
+/**
+ * @brief Read with a pool of pread workers, depth blocks in flight
+ *
+ * @param  fd      file
+ * @param  size    file size
+ * @param  parser  parser
+ * @return true/false file was read completely or not
+ */
+bool FileReader::readPool(int fd, uint64_t size, CmdSeqParser* parser)
+{
+    std::vector<ReadSlot> slots(config_.depth);
+    std::deque<unsigned> jobs;
+    std::mutex mutex;
+    std::condition_variable jobReady;
+    std::condition_variable readDone;
+    bool stopped = false;
+
+    /* Workers read whole blocks, pread handles short reads by looping */
+    auto worker = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            jobReady.wait(lock, [&]() { return stopped || !jobs.empty(); });
+            if (jobs.empty()) {
+                return;
+            }
+            unsigned id = jobs.front();
+            jobs.pop_front();
+            ReadSlot& s = slots[id];
+            lock.unlock();
+
+            size_t done = 0;
+            int error = 0;
+            while (done < s.len) {
+                ssize_t ret = pread(fd, s.buf + done, config_.blockSize - done, s.offset + done);
+                if (ret < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    error = errno;
+                    break;
+                }
+                if (ret == 0) {
+                    break;
+                }
+                done += (size_t)ret;
+                if (done < s.len) {
+                    /* Short read, continue into the rest of the buffer */
+                    done = FileReader_ResumeAt(done, config_.direct);
+                }
+            }
+
+            lock.lock();
+            s.done = done;
+            s.error = error;
+            s.complete = true;
+            readDone.notify_one();
+        }
+    };
+
+    uint64_t next = 0;
+    auto issue = [&](unsigned id) {
+        ReadSlot& s = slots[id];
+        s.buf = buffers_ + id * config_.blockSize;
+        s.offset = next;
+        s.len = (size - next < config_.blockSize) ? (size_t)(size - next) : config_.blockSize;
+        s.done = 0;
+        s.error = 0;
+        s.complete = false;
+        next += s.len;
+        jobs.push_back(id);
+        jobReady.notify_one();
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < config_.threads; t++) {
+        threads.emplace_back(worker);
+    }
+
+    unsigned inFlight = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (unsigned i = 0; (i < config_.depth) && (next < size); i++) {
+            issue(i);
+            inFlight++;
+        }
+    }
+
+    bool ok = true;
+    unsigned current = 0;
+    while (inFlight > 0) {
+        ReadSlot& s = slots[current];
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            readDone.wait(lock, [&]() { return s.complete; });
+        }
+        if (s.error != 0) {
+            ok = false;
+            break;
+        }
+        parser->parseBlock(s.buf, (s.done < s.len) ? s.done : s.len);
+        bytes_ += (s.done < s.len) ? s.done : s.len;
+        inFlight--;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (next < size) {
+            issue(current);
+            inFlight++;
+        }
+        current = (current + 1) % config_.depth;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopped = true;
+        jobs.clear();
+    }
+    jobReady.notify_all();
+    for (auto& t : threads) {
+        t.join();
+    }
+    return ok && (bytes_ == size);
+}
+
+/**
+ * @brief Blocking read then parse, the baseline
+ *
+ * @param  fd      file
+ * @param  parser  parser
+ * @return true/false file was read completely or not
+ */
+bool FileReader::readPlain(int fd, CmdSeqParser* parser)
+{
+    while (true) {
+        ssize_t ret = ::read(fd, buffers_, config_.blockSize);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (ret == 0) {
+            return true;
+        }
+        parser->parseBlock(buffers_, (size_t)ret);
+        bytes_ += (uint64_t)ret;
+    }
+}
+
+/**
+ * @brief Parse the mapped file, the kernel does the read-ahead
+ *
+ * @param  fd      file
+ * @param  size    file size
+ * @param  parser  parser
+ * @return true/false file was mapped or not
+ */
+bool FileReader::readMmap(int fd, uint64_t size, CmdSeqParser* parser)
+{
+    if (size == 0) {
+        return true;
+    }
+    void* addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+    madvise(addr, size, MADV_SEQUENTIAL);
+
+    const uint8_t* data = (const uint8_t*)addr;
+    for (uint64_t pos = 0; pos < size; pos += config_.blockSize) {
+        size_t len = (size - pos < config_.blockSize) ? (size_t)(size - pos) : config_.blockSize;
+        parser->parseBlock(data + pos, len);
+        bytes_ += len;
+    }
+    munmap(addr, size);
+    return true;
+}
+
+/**
+ * @brief Backend used by the last read
+ *
+ * @param  None
+ * @return backend, never AUTO after a read
+ */
+FileReader::Backend FileReader::getBackend()
+{
+    return backend_;
+}
+
+/**
+ * @brief Bytes parsed by the last read
+ *
+ * @param  None
+ * @return byte count
+ */
+uint64_t FileReader::getBytes()
+{
+    return bytes_;
+}
+
+/**
+ * @brief Name of a backend
+ *
+ * @param  backend  backend
+ * @return name
+ */
+const char* FileReader::getBackendName(Backend backend)
+{
+    switch (backend) {
+    case Backend::IO_URING:
+        return "io_uring";
+    case Backend::THREAD_POOL:
+        return "pread-pool";
+    case Backend::READ:
+        return "read";
+    case Backend::MMAP:
+        return "mmap";
+    default:
+        return "auto";
+    }
+}
+
+/**
+ * @brief Where to continue a block after a short read
+ *
+ * O_DIRECT needs the buffer, offset and length aligned, so the partial
+ * sector at the end of the short read is read again. Blocks and buffers
+ * start aligned, see FILE_READER_ALIGN.
+ *
+ * @param  done    bytes of the block read so far
+ * @param  direct  file is open with O_DIRECT
+ * @return bytes of the block to keep, the next read starts there
+ */
+static size_t FileReader_ResumeAt(size_t done, bool direct)
+{
+    return direct ? (done & ~(size_t)(FILE_READER_ALIGN - 1)) : done;
+}
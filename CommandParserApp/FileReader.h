@@ -0,0 +1,66 @@
+/**
+ * @file  FileReader.h
+ * @brief Capture file ingestion with read-ahead (io_uring, pread pool)
+ * @note
+ *
+ */
+#ifndef __FILE_READER_H__
+#define __FILE_READER_H__
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include <cstdint>
+#include <cstddef>
+#include "CmdSeqParser.h"
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*
+ * Alignment of the read buffers, enough for O_DIRECT
+ */
+#define FILE_READER_ALIGN (4096)
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+struct FileReaderConfig {
+    enum class Backend { AUTO, IO_URING, THREAD_POOL, READ, MMAP }; /**< Read method */
+
+    Backend backend = Backend::AUTO; /**< AUTO: io_uring, else the pread pool */
+    size_t blockSize = 256 * 1024;   /**< Bytes per read, a multiple of FILE_READER_ALIGN */
+    unsigned depth = 8;              /**< Reads in flight */
+    unsigned threads = 4;            /**< Workers of the pread pool */
+    bool direct = false;             /**< Open with O_DIRECT */
+};
+
+class FileReader {
+    public:
+        typedef FileReaderConfig::Backend Backend;
+
+        FileReader(const FileReaderConfig& config);
+        ~FileReader();
+        bool read(const char* path, CmdSeqParser* parser); /**< Parse a whole file */
+        Backend getBackend();         /**< Backend used by the last read */
+        uint64_t getBytes();          /**< Bytes parsed by the last read */
+        static const char* getBackendName(Backend backend); /**< Name for reports */
+    private:
+        bool readUring(int fd, uint64_t size, CmdSeqParser* parser); /**< io_uring fixed buffers */
+        bool readPool(int fd, uint64_t size, CmdSeqParser* parser);  /**< pread thread pool */
+        bool readPlain(int fd, CmdSeqParser* parser);                /**< Blocking read loop */
+        bool readMmap(int fd, uint64_t size, CmdSeqParser* parser);  /**< Mapped file */
+
+        FileReaderConfig config_;     /**< Configuration */
+        uint8_t* buffers_;            /**< depth aligned buffers of blockSize */
+        Backend backend_;             /**< Backend used by the last read */
+        uint64_t bytes_;              /**< Bytes parsed by the last read */
+};
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+#endif /* __FILE_READER_H__ */
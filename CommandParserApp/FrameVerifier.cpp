@@ -0,0 +1,181 @@
+/**
+ * @file  FrameVerifier.cpp
+ * @brief Verify the trailing CRC of the command frame after each header
+ * @note  The frame is assembled incrementally: the CRC register is updated
+ *        with whatever part of the payload is in the block, so frames that
+ *        span buffers or the wraparound of the shared memory need no copy.
+ *
+ */
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include "FrameVerifier.h"
+#include <cstring>
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+/**
+ * @brief Initialize the frame assembly
+ *
+ * @param  type  CRC used in the frame trailer
+ * @return None
+ */
+FrameVerifier::FrameVerifier(CrcType type)
+{
+    type_ = type;
+    trailerLen_ = (type == CrcType::CRC16) ? 2 : 4;
+    state_ = State::HUNT;
+    lastA5_ = false;
+    remaining_ = 0;
+    crc_ = 0;
+    trailer_ = 0;
+    valid_ = 0;
+    invalid_ = 0;
+    offset_ = 0;
+    length_ = 0;
+    sink_ = NULL;
+}
+
+/**
+ * @brief Process a block of the stream, frames may continue across blocks
+ *
+ * @param  data  bytes to process
+ * @param  len   number of bytes
+ * @return None
+ */
+void FrameVerifier::feed(const uint8_t* data, size_t len)
+{
+    size_t i = 0;
+
+    while (i < len) {
+        switch (state_) {
+        case State::HUNT: {
+            /* Header ends at a 0x5A right after 0xA5 */
+            if (lastA5_ && (data[i] == 0x5A)) {
+                lastA5_ = false;
+                state_ = State::LENGTH;
+                i++;
+                break;
+            }
+            const uint8_t* next = (const uint8_t*)memchr(&data[i + 1], 0x5A, len - i - 1);
+            if (next == NULL) {
+                lastA5_ = (data[len - 1] == 0xA5);
+                i = len;
+                break;
+            }
+            size_t pos = (size_t)(next - data);
+            lastA5_ = (data[pos - 1] == 0xA5);
+            i = pos;
+            break;
+        }
+        case State::LENGTH:
+            remaining_ = data[i++];
+            length_ = (uint8_t)remaining_;
+            crc_ = (type_ == CrcType::CRC16) ? CRC16_INIT : CRC32C_INIT;
+            trailer_ = 0;
+            state_ = (remaining_ > 0) ? State::PAYLOAD : State::TRAILER;
+            if (state_ == State::TRAILER) {
+                remaining_ = trailerLen_;
+            }
+            break;
+        case State::PAYLOAD: {
+            size_t n = (len - i < remaining_) ? len - i : remaining_;
+            if (type_ == CrcType::CRC16) {
+                crc_ = Crc16_Update((uint16_t)crc_, &data[i], n);
+            } else {
+                crc_ = Crc32c_Update(crc_, &data[i], n);
+            }
+            i += n;
+            remaining_ -= n;
+            if (remaining_ == 0) {
+                state_ = State::TRAILER;
+                remaining_ = trailerLen_;
+            }
+            break;
+        }
+        case State::TRAILER:
+            trailer_ |= (uint32_t)data[i++] << (8 * (trailerLen_ - remaining_));
+            if (--remaining_ == 0) {
+                uint32_t expected = (type_ == CrcType::CRC16) ?
+                    (crc_ ^ CRC16_XOR) & 0xFFFF : crc_ ^ CRC32C_XOR;
+                if (trailer_ == expected) {
+                    valid_++;
+                } else {
+                    invalid_++;
+                }
+                if (sink_ != NULL) {
+                    sink_->emitFrame(offset_ + i - 1, length_, trailer_, trailer_ == expected);
+                }
+                state_ = State::HUNT;
+            }
+            break;
+        }
+    }
+    offset_ += len;
+    if (sink_ != NULL) {
+        sink_->flush();
+    }
+}
+
+/**
+ * @brief Get the number of frames with a matching CRC
+ *
+ * @param  None
+ * @return valid frame count
+ */
+uint64_t FrameVerifier::getValidCount()
+{
+    return valid_;
+}
+
+/**
+ * @brief Get the number of frames with a wrong CRC
+ *
+ * @param  None
+ * @return invalid frame count
+ */
+uint64_t FrameVerifier::getInvalidCount()
+{
+    return invalid_;
+}
+
+/**
+ * @brief Emit a record for each frame to an output sink
+ *
+ * The records are emitted from the thread feeding the verifier and an
+ * OutputSink takes a single producer. In a Pipeline the frame stage and
+ * the scan stage run on different threads, so the verifier and the parser
+ * need separate sinks there.
+ *
+ * @param  sink  output sink, NULL to disable
+ * @return None
+ */
+void FrameVerifier::setOutputSink(OutputSink* sink)
+{
+    sink_ = sink;
+}
+
+/**
+ * @brief Get the sink the frame records go to
+ *
+ * @param  None
+ * @return output sink, NULL when disabled
+ */
+OutputSink* FrameVerifier::getOutputSink()
+{
+    return sink_;
+}
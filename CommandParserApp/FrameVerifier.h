@@ -0,0 +1,58 @@
+/**
+ * @file  FrameVerifier.h
+ * @brief Verify the trailing CRC of the command frame after each header
+ * @note  Frame: A5 5A | length (1 byte) | payload | CRC over the payload,
+ *        the CRC is stored little endian (2 bytes CRC16, 4 bytes CRC32C)
+ *
+ */
+#ifndef __FRAME_VERIFIER_H__
+#define __FRAME_VERIFIER_H__
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include <cstdint>
+#include <cstddef>
+#include "Crc.h"
+#include "OutputSink.h"
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+class FrameVerifier {
+    public:
+        enum class CrcType { CRC16, CRC32C }; /**< Trailer of the frame */
+
+        FrameVerifier(CrcType type);
+        void feed(const uint8_t* data, size_t len); /**< Process a block of the stream */
+        uint64_t getValidCount();    /**< Frames with a matching CRC */
+        uint64_t getInvalidCount();  /**< Frames with a wrong CRC */
+        void setOutputSink(OutputSink* sink); /**< Emit a record for each frame */
+        OutputSink* getOutputSink();          /**< Sink set by setOutputSink() */
+    private:
+        enum class State { HUNT, LENGTH, PAYLOAD, TRAILER }; /**< Frame assembly state */
+
+        CrcType type_;               /**< CRC of the trailer */
+        size_t trailerLen_;          /**< Trailer length in bytes */
+        State state_;                /**< Current frame assembly state */
+        bool lastA5_;                /**< Previous byte was 0xA5 while hunting */
+        size_t remaining_;           /**< Payload or trailer bytes still expected */
+        uint32_t crc_;               /**< Running CRC register of the payload */
+        uint32_t trailer_;           /**< Received trailer bytes */
+        uint64_t valid_;             /**< Count of frames with a good CRC */
+        uint64_t invalid_;           /**< Count of frames with a bad CRC */
+        uint64_t offset_;            /**< Stream offset of the next block */
+        uint8_t length_;             /**< Payload length of the current frame */
+        OutputSink* sink_;           /**< Optional frame records, may be NULL */
+};
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+#endif /* __FRAME_VERIFIER_H__ */
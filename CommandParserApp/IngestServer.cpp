@@ -0,0 +1,397 @@
+/**
+ * @file  IngestServer.cpp
+ * @brief Unix domain socket / pipe ingestion into per channel rings
+ * @note  One epoll thread serves all channels. Data is read with readv
+ *        straight into the free space of the channel ring, so the kernel
+ *        copy is the only copy, and parsed in place once the ring is full
+ *        or the fd has no more data. A channel is read until EAGAIN with
+ *        up to a whole ring per call, which keeps the syscalls per MB low.
+ *
+ */
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include "IngestServer.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*
+ * epoll user data of the listening socket and the stop eventfd, channels
+ * use their channel number
+ */
+#define INGEST_LISTEN_ID (UINT64_MAX)
+#define INGEST_STOP_ID   (UINT64_MAX - 1)
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+/**
+ * @brief Create the epoll instance
+ *
+ * @param  ringSize  ring size of each channel
+ * @param  policy    placement of the rings
+ * @return None
+ */
+IngestServer::IngestServer(size_t ringSize, const MemPolicy& policy)
+{
+    ringSize_ = ringSize;
+    policy_ = policy;
+    epfd_ = epoll_create1(EPOLL_CLOEXEC);
+    listenFd_ = -1;
+    stopFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    bytes_ = 0;
+    reads_ = 0;
+    waits_ = 0;
+    accepted_ = 0;
+    closed_ = 0;
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = INGEST_STOP_ID;
+    epoll_ctl(epfd_, EPOLL_CTL_ADD, stopFd_, &ev);
+}
+
+/**
+ * @brief Stop the server and close all fds
+ *
+ * @param  None
+ * @return None
+ */
+IngestServer::~IngestServer()
+{
+    stop();
+    for (Channel* ch : channels_) {
+        if (ch->fd >= 0) {
+            ::close(ch->fd);
+        }
+        delete ch;
+    }
+    if (listenFd_ >= 0) {
+        ::close(listenFd_);
+        unlink(path_.c_str());
+    }
+    ::close(stopFd_);
+    ::close(epfd_);
+}
+
+/**
+ * @brief Listen on a unix domain stream socket, each connection is a channel
+ *
+ * @param  path  socket path
+ * @return true/false listening or not
+ */
+bool IngestServer::listen(const char* path)
+{
+    struct sockaddr_un addr;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return false;
+    }
+    listenFd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd_ < 0) {
+        return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if ((bind(listenFd_, (struct sockaddr*)&addr, sizeof(addr)) != 0) ||
+        (::listen(listenFd_, SOMAXCONN) != 0)) {
+        ::close(listenFd_);
+        listenFd_ = -1;
+        return false;
+    }
+    path_ = path;
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = INGEST_LISTEN_ID;
+    return epoll_ctl(epfd_, EPOLL_CTL_ADD, listenFd_, &ev) == 0;
+}
+
+/**
+ * @brief Read a pipe or FIFO as a channel, the server owns the fd
+ *
+ * @param  fd  read end
+ * @return channel number, -1 on error
+ */
+int IngestServer::addPipe(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return addChannel(fd);
+}
+
+/**
+ * @brief Register a channel fd with epoll
+ *
+ * @param  fd  non blocking fd
+ * @return channel number, -1 on error
+ */
+int IngestServer::addChannel(int fd)
+{
+    Channel* ch = new Channel(ringSize_, policy_);
+    ch->fd = fd;
+
+    size_t id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        id = channels_.size();
+        channels_.push_back(ch);
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.u64 = id;
+    if (epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        close(ch);
+        return -1;
+    }
+    return (int)id;
+}
+
+/**
+ * @brief Start the epoll thread
+ *
+ * @param  None
+ * @return true/false started or not
+ */
+bool IngestServer::start()
+{
+    if ((epfd_ < 0) || (stopFd_ < 0)) {
+        return false;
+    }
+    thread_ = std::thread(&IngestServer::run, this);
+    return true;
+}
+
+/**
+ * @brief Stop the epoll thread, data not read yet stays in the fds
+ *
+ * @param  None
+ * @return None
+ */
+void IngestServer::stop()
+{
+    if (!thread_.joinable()) {
+        return;
+    }
+    uint64_t one = 1;
+    ssize_t ret = write(stopFd_, &one, sizeof(one));
+    (void)ret;
+    thread_.join();
+}
+
+/**
+ * @brief Accept all pending connections
+ *
+ * @param  None
+ * @return None
+ */
+void IngestServer::acceptAll()
+{
+    while (true) {
+        int fd = accept4(listenFd_, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        accepted_.fetch_add(1, std::memory_order_relaxed);
+        addChannel(fd);
+    }
+}
+
+/**
+ * @brief Read a channel into its ring until the fd would block
+ *
+ * @param  ch  channel
+ * @return None
+ */
+void IngestServer::drain(Channel* ch)
+{
+    while (true) {
+        uint8_t* first;
+        uint8_t* second;
+        size_t firstLen;
+        size_t secondLen;
+        struct iovec iov[2];
+
+        ch->shmem.GetFreeRegions(&first, &firstLen, &second, &secondLen);
+        iov[0].iov_base = first;
+        iov[0].iov_len = firstLen;
+        iov[1].iov_base = second;
+        iov[1].iov_len = secondLen;
+
+        ssize_t ret = readv(ch->fd, iov, (secondLen > 0) ? 2 : 1);
+        /* Parsing below may change errno */
+        int err = errno;
+        reads_.fetch_add(1, std::memory_order_relaxed);
+        if (ret > 0) {
+            ch->shmem.Commit((size_t)ret);
+            bytes_.fetch_add((uint64_t)ret, std::memory_order_relaxed);
+            if (ch->shmem.IsFull()) {
+                ch->parser.parser();
+                ch->count.store(ch->parser.getCount(), std::memory_order_release);
+            }
+            continue;
+        }
+
+        /* Parse what arrived before waiting again */
+        ch->parser.parseAvailable();
+        ch->count.store(ch->parser.getCount(), std::memory_order_release);
+        if ((ret == 0) || ((err != EAGAIN) && (err != EWOULDBLOCK) && (err != EINTR))) {
+            close(ch);
+            return;
+        }
+        if (err != EINTR) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Close a channel at end of stream, its count stays available
+ *
+ * @param  ch  channel
+ * @return None
+ */
+void IngestServer::close(Channel* ch)
+{
+    if (ch->fd < 0) {
+        return;
+    }
+    epoll_ctl(epfd_, EPOLL_CTL_DEL, ch->fd, NULL);
+    ::close(ch->fd);
+    ch->fd = -1;
+    ch->closed.store(true, std::memory_order_release);
+    closed_.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief epoll loop, runs until stop() is called
+ *
+ * @param  None
+ * @return None
+ */
+void IngestServer::run()
+{
+    struct epoll_event events[INGEST_MAX_EVENTS];
+
+    while (true) {
+        int n = epoll_wait(epfd_, events, INGEST_MAX_EVENTS, -1);
+        waits_.fetch_add(1, std::memory_order_relaxed);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        for (int i = 0; i < n; i++) {
+            uint64_t id = events[i].data.u64;
+            if (id == INGEST_STOP_ID) {
+                /* Reset the eventfd so that a later start() runs */
+                uint64_t value;
+                ssize_t ret = read(stopFd_, &value, sizeof(value));
+                (void)ret;
+                return;
+            }
+            if (id == INGEST_LISTEN_ID) {
+                acceptAll();
+                continue;
+            }
+            Channel* ch;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                ch = channels_[id];
+            }
+            drain(ch);
+        }
+    }
+}
+
+/**
+ * @brief Number of channels created so far, open or closed
+ *
+ * @param  None
+ * @return channel count
+ */
+size_t IngestServer::getChannels()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return channels_.size();
+}
+
+/**
+ * @brief Header count of a channel after its last parse
+ *
+ * @param  channel  channel number
+ * @return count value
+ */
+uint64_t IngestServer::getCount(size_t channel)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return channels_[channel]->count.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Check if a channel has reached end of stream
+ *
+ * @param  channel  channel number
+ * @return true/false closed or not
+ */
+bool IngestServer::isClosed(size_t channel)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return channels_[channel]->closed.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Header count of all channels
+ *
+ * @param  None
+ * @return count value
+ */
+uint64_t IngestServer::getTotalCount()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t count = 0;
+    for (Channel* ch : channels_) {
+        count += ch->count.load(std::memory_order_acquire);
+    }
+    return count;
+}
+
+/**
+ * @brief Throughput and syscall counters
+ *
+ * @param  None
+ * @return counters
+ */
+IngestStats IngestServer::getStats()
+{
+    IngestStats stats;
+    stats.bytes = bytes_.load(std::memory_order_relaxed);
+    stats.reads = reads_.load(std::memory_order_relaxed);
+    stats.waits = waits_.load(std::memory_order_relaxed);
+    stats.accepted = accepted_.load(std::memory_order_relaxed);
+    stats.closed = closed_.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,93 @@
+/**
+ * @file  IngestServer.h
+ * @brief Unix domain socket / pipe ingestion into per channel rings
+ * @note
+ *
+ */
+#ifndef __INGEST_SERVER_H__
+#define __INGEST_SERVER_H__
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "SharedMem.h"
+#include "CmdSeqParser.h"
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*
+ * Events handled per epoll_wait call
+ */
+#define INGEST_MAX_EVENTS (256)
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+struct IngestStats {
+    uint64_t bytes;        /**< Bytes received on all channels */
+    uint64_t reads;        /**< readv calls */
+    uint64_t waits;        /**< epoll_wait calls */
+    uint64_t accepted;     /**< Socket connections accepted */
+    uint64_t closed;       /**< Channels closed at end of stream */
+};
+
+class IngestServer {
+    public:
+        IngestServer(size_t ringSize, const MemPolicy& policy);
+        ~IngestServer();
+        bool listen(const char* path); /**< Accept connections on a unix socket */
+        int addPipe(int fd);           /**< Read a pipe or FIFO as a channel */
+        bool start();                  /**< Start the epoll thread */
+        void stop();                   /**< Stop the epoll thread */
+        size_t getChannels();          /**< Number of channels so far */
+        uint64_t getCount(size_t channel); /**< Header count of a channel */
+        bool isClosed(size_t channel); /**< Channel reached end of stream */
+        uint64_t getTotalCount();      /**< Header count of all channels */
+        IngestStats getStats();        /**< Throughput and syscall counters */
+    private:
+        struct Channel {
+            Channel(size_t ringSize, const MemPolicy& policy) :
+                shmem(ringSize, policy), parser(&shmem) {}
+            int fd = -1;                   /**< Socket or pipe */
+            SharedMem shmem;               /**< Ring of the channel */
+            CmdSeqParser parser;           /**< Parser of the channel */
+            std::atomic<uint64_t> count{0}; /**< Count after the last parse */
+            std::atomic<bool> closed{false}; /**< End of stream seen */
+        };
+
+        void run();                    /**< epoll loop */
+        int addChannel(int fd);        /**< Register a channel fd */
+        void acceptAll();              /**< Accept pending connections */
+        void drain(Channel* ch);       /**< Read a channel until it would block */
+        void close(Channel* ch);       /**< End of stream of a channel */
+
+        size_t ringSize_;              /**< Ring size of a channel */
+        MemPolicy policy_;             /**< Ring placement */
+        int epfd_;                     /**< epoll instance */
+        int listenFd_;                 /**< Listening socket, -1 if none */
+        int stopFd_;                   /**< eventfd to stop the loop */
+        std::string path_;             /**< Socket path, unlinked on exit */
+        std::mutex mutex_;             /**< Protects channels_ growth */
+        std::vector<Channel*> channels_; /**< Channels by number */
+        std::thread thread_;           /**< epoll thread */
+        std::atomic<uint64_t> bytes_;  /**< Bytes received */
+        std::atomic<uint64_t> reads_;  /**< readv calls */
+        std::atomic<uint64_t> waits_;  /**< epoll_wait calls */
+        std::atomic<uint64_t> accepted_; /**< Connections accepted */
+        std::atomic<uint64_t> closed_; /**< Channels closed */
+};
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+#endif /* __INGEST_SERVER_H__ */
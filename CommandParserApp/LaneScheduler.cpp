@@ -0,0 +1,385 @@
+/**
+ * @file  LaneScheduler.cpp
+ * @brief Priority and deadline aware servicing of many channel rings
+ * @note  One service thread parses many rings. A lane is picked in this
+ *        order: overdue lanes by priority, then lanes without batching by
+ *        earliest deadline, then batch lanes holding at least batchBytes,
+ *        fullest first. Batch lanes are parsed LANE_BATCH_SLICE bytes per
+ *        pick so that an urgent lane never waits behind a whole bulk ring.
+ *
+ */
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include "LaneScheduler.h"
+#include "Trace.h"
+#include <cerrno>
+#include <ctime>
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+static uint64_t LaneScheduler_Now(void);
+static unsigned LaneScheduler_Bucket(uint64_t ns);
+static uint64_t LaneScheduler_BucketMax(unsigned bucket);
+
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+/**
+ * @brief Scheduler without lanes
+ *
+ * @param  None
+ * @return None
+ */
+LaneScheduler::LaneScheduler()
+{
+    services_ = 0;
+    signaled_ = false;
+    isStopped_ = false;
+    sem_init(&sem_, 0, 0);
+}
+
+/**
+ * @brief Stop the thread if still running and free the lanes
+ *
+ * @param  None
+ * @return None
+ */
+LaneScheduler::~LaneScheduler()
+{
+    if (thread_.joinable()) {
+        stop();
+    }
+    for (Lane* lane : lanes_) {
+        delete lane;
+    }
+    sem_destroy(&sem_);
+}
+
+/**
+ * @brief Register a channel ring and its parser
+ *
+ * Must be called before the scheduler is started.
+ *
+ * @param  shmem   ring filled by the producer
+ * @param  parser  parser of the ring
+ * @param  config  priority, deadline and batching of the lane
+ * @return lane number for notify()
+ */
+size_t LaneScheduler::addLane(SharedMem* shmem, CmdSeqParser* parser, const LaneConfig& config)
+{
+    assert((shmem != NULL) && (parser != NULL));
+    assert(lanes_.size() < LANE_MAX_LANES);
+    assert(config.batchBytes <= shmem->Size());
+
+    Lane* lane = new Lane();
+    lane->shmem = shmem;
+    lane->parser = parser;
+    lane->config = config;
+    for (auto& b : lane->latency) {
+        b.store(0, std::memory_order_relaxed);
+    }
+    lanes_.push_back(lane);
+    return lanes_.size() - 1;
+}
+
+/**
+ * @brief Notify that data was put in a lane
+ *
+ * The first notify after the lane was serviced starts its latency clock.
+ *
+ * @param  lane  lane number
+ * @return None
+ */
+void LaneScheduler::notify(size_t lane)
+{
+    Lane* l = lanes_[lane];
+    if (l->pendingSince.load(std::memory_order_relaxed) == 0) {
+        uint64_t expected = 0;
+        l->pendingSince.compare_exchange_strong(expected, LaneScheduler_Now());
+    }
+    if (Trace::isEnabled()) {
+        Trace::record(TraceEvent::NOTIFY, l->parser->getPending());
+    }
+    if (!signaled_.exchange(true)) {
+        sem_post(&sem_);
+    }
+}
+
+/**
+ * @brief Start the service thread
+ *
+ * @param  None
+ * @return None
+ */
+void LaneScheduler::start()
+{
+    isStopped_.store(false, std::memory_order_release);
+    thread_ = std::thread(&LaneScheduler::run, this);
+}
+
+/**
+ * @brief Stop the service thread, then parse whatever is left in the lanes
+ *
+ * @param  None
+ * @return None
+ */
+void LaneScheduler::stop()
+{
+    isStopped_.store(true, std::memory_order_release);
+    sem_post(&sem_);
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    for (Lane* l : lanes_) {
+        while (l->parser->parseAvailable() > 0) {
+        }
+        l->pendingSince.store(0, std::memory_order_relaxed);
+        l->count.store(l->parser->getCount(), std::memory_order_release);
+    }
+}
+
+/**
+ * @brief Service loop: pick a lane, parse it, sleep until the next deadline
+ *        when nothing is ready
+ *
+ * @param  None
+ * @return None
+ */
+void LaneScheduler::run()
+{
+    while (true) {
+        /* Cleared before looking at the lanes, a notify after this point
+         * posts the semaphore again */
+        signaled_.store(false);
+        if (isStopped_.load(std::memory_order_acquire)) {
+            break;
+        }
+
+        uint64_t now = LaneScheduler_Now();
+        uint64_t wakeAt = UINT64_MAX;
+        int lane = pick(now, &wakeAt);
+        if (lane >= 0) {
+            service((size_t)lane, now);
+            continue;
+        }
+        bool signaled = true;
+        if (wakeAt == UINT64_MAX) {
+            sem_wait(&sem_);
+        } else {
+            struct timespec ts;
+            ts.tv_sec = (time_t)(wakeAt / 1000000000ull);
+            ts.tv_nsec = (long)(wakeAt % 1000000000ull);
+            int ret;
+            while (((ret = sem_clockwait(&sem_, CLOCK_MONOTONIC, &ts)) != 0) && (errno == EINTR)) {
+            }
+            signaled = (ret == 0);
+        }
+        Trace::record(TraceEvent::WAKE, signaled);
+    }
+}
+
+/**
+ * @brief Choose the lane to service next
+ *
+ * @param  now     current time in ns
+ * @param  wakeAt  earliest deadline of a pending lane that is not ready yet
+ * @return lane number, -1 if no lane is ready
+ */
+int LaneScheduler::pick(uint64_t now, uint64_t* wakeAt)
+{
+    int best = -1;
+    int bestTier = 3;
+    uint64_t bestKey = UINT64_MAX;
+    unsigned bestPriority = 0;
+
+    for (size_t i = 0; i < lanes_.size(); i++) {
+        Lane* l = lanes_[i];
+        uint64_t since = l->pendingSince.load();
+        if (since == 0) {
+            continue;
+        }
+        uint64_t deadline = (uint64_t)l->config.deadlineUs * 1000;
+        uint64_t due = (deadline > 0) ? since + deadline : UINT64_MAX;
+        int tier;
+        uint64_t key;
+        if (now >= due) {
+            /* Overdue: highest priority, then oldest */
+            tier = 0;
+            key = since;
+        } else if (l->config.batchBytes == 0) {
+            /* Latency lane: earliest deadline first */
+            tier = 1;
+            key = due;
+        } else {
+            size_t fill = l->shmem->Count();
+            if (fill < l->config.batchBytes) {
+                *wakeAt = (due < *wakeAt) ? due : *wakeAt;
+                continue;
+            }
+            /* Batch lane: fullest first */
+            tier = 2;
+            key = UINT64_MAX - fill;
+        }
+
+        /* Priority only ranks overdue lanes, the other tiers go by key */
+        unsigned priority = (tier == 0) ? l->config.priority : 0;
+        bool better = (tier < bestTier) ||
+                      ((tier == bestTier) && ((priority > bestPriority) ||
+                                              ((priority == bestPriority) && (key < bestKey))));
+        if (better) {
+            best = (int)i;
+            bestTier = tier;
+            bestKey = key;
+            bestPriority = priority;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Parse the pending data of a lane and record its latency
+ *
+ * @param  lane  lane number
+ * @param  now   time the lane was picked in ns
+ * @return true/false data was parsed or not
+ */
+bool LaneScheduler::service(size_t lane, uint64_t now)
+{
+    Lane* l = lanes_[lane];
+    uint64_t since = l->pendingSince.exchange(0);
+    size_t limit = (l->config.batchBytes > 0) ? LANE_BATCH_SLICE : SIZE_MAX;
+
+    size_t len = l->parser->parseAvailable(limit);
+    l->count.store(l->parser->getCount(), std::memory_order_release);
+    if (len == 0) {
+        return false;
+    }
+    uint64_t end = LaneScheduler_Now();
+
+    /* Only the service thread writes the metrics */
+    uint64_t ns = end - since;
+    unsigned b = LaneScheduler_Bucket(ns);
+    l->latency[b].store(l->latency[b].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    l->services.store(l->services.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    l->bytes.store(l->bytes.load(std::memory_order_relaxed) + len, std::memory_order_relaxed);
+    l->lastService.store(++services_, std::memory_order_relaxed);
+    if (ns > l->maxNs.load(std::memory_order_relaxed)) {
+        l->maxNs.store(ns, std::memory_order_relaxed);
+    }
+    uint64_t deadline = (uint64_t)l->config.deadlineUs * 1000;
+    if ((deadline > 0) && (now - since >= deadline)) {
+        l->overdue.store(l->overdue.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    /* A slice left data behind: it is still as old as the first notify */
+    if (l->shmem->Count() > 0) {
+        uint64_t current = l->pendingSince.load();
+        while (((current == 0) || (current > since)) &&
+               !l->pendingSince.compare_exchange_weak(current, since)) {
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Get the valid command count of a lane
+ *
+ * @param  lane  lane number
+ * @return count as of the last service
+ */
+uint64_t LaneScheduler::getCount(size_t lane)
+{
+    return lanes_[lane]->count.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Get the latency metrics of a lane
+ *
+ * @param  lane  lane number
+ * @return stats
+ */
+LaneStats LaneScheduler::getStats(size_t lane)
+{
+    Lane* l = lanes_[lane];
+    LaneStats st;
+    uint64_t hist[LANE_LATENCY_BUCKETS];
+    uint64_t total = 0;
+
+    for (unsigned b = 0; b < LANE_LATENCY_BUCKETS; b++) {
+        hist[b] = l->latency[b].load(std::memory_order_relaxed);
+        total += hist[b];
+    }
+    st.services = l->services.load(std::memory_order_relaxed);
+    st.bytes = l->bytes.load(std::memory_order_relaxed);
+    st.overdue = l->overdue.load(std::memory_order_relaxed);
+    st.maxNs = l->maxNs.load(std::memory_order_relaxed);
+    st.lastService = l->lastService.load(std::memory_order_relaxed);
+
+    uint64_t seen = 0;
+    for (unsigned b = 0; (b < LANE_LATENCY_BUCKETS) && (total > 0); b++) {
+        seen += hist[b];
+        if ((st.p50Ns == 0) && (seen * 2 >= total)) {
+            st.p50Ns = LaneScheduler_BucketMax(b);
+        }
+        if (seen * 100 >= total * 99) {
+            st.p99Ns = LaneScheduler_BucketMax(b);
+            break;
+        }
+    }
+    return st;
+}
+
+/**
+ * @brief Monotonic time, the clock of sem_clockwait
+ *
+ * @param  None
+ * @return ns
+ */
+static uint64_t LaneScheduler_Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Latency histogram bucket, 8 linear steps per power of two
+ *
+ * @param  ns  latency
+ * @return bucket
+ */
+static unsigned LaneScheduler_Bucket(uint64_t ns)
+{
+    if (ns < 8) {
+        return (unsigned)ns;
+    }
+    unsigned msb = 63 - (unsigned)__builtin_clzll(ns);
+    return (msb - 2) * 8 + (unsigned)((ns >> (msb - 3)) & 7);
+}
+
+/**
+ * @brief Largest latency falling in a bucket
+ *
+ * @param  bucket  bucket
+ * @return ns
+ */
+static uint64_t LaneScheduler_BucketMax(unsigned bucket)
+{
+    if (bucket < 8) {
+        return bucket;
+    }
+    unsigned msb = bucket / 8 + 2;
+    uint64_t low = (8ull + bucket % 8) << (msb - 3);
+    return low + (1ull << (msb - 3)) - 1;
+}
@@ -0,0 +1,106 @@
+/**
+ * @file  LaneScheduler.h
+ * @brief Priority and deadline aware servicing of many channel rings
+ * @note
+ *
+ */
+#ifndef __LANE_SCHEDULER_H__
+#define __LANE_SCHEDULER_H__
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <semaphore.h>
+#include "SharedMem.h"
+#include "CmdSeqParser.h"
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*
+ * Most lanes of a scheduler
+ */
+#define LANE_MAX_LANES (64)
+
+/*
+ * Latency histogram: 8 linear sub-buckets per power of two nanoseconds
+ */
+#define LANE_LATENCY_BUCKETS (512)
+
+/*
+ * Bytes parsed per pick of a batch lane before the lanes are looked at
+ * again, bounds how long a bulk batch delays an urgent lane
+ */
+#define LANE_BATCH_SLICE (64 * 1024)
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+struct LaneConfig {
+    unsigned priority = 0;    /**< Higher is serviced first once overdue */
+    uint32_t deadlineUs = 0;  /**< Pending data older than this is overdue, 0 never */
+    size_t batchBytes = 0;    /**< Wait for this much data unless overdue, 0 service at once */
+};
+
+/*
+ * Service latency: from the first notify of pending data to the end of
+ * the parse that consumed it
+ */
+struct LaneStats {
+    uint64_t services = 0;    /**< Parses of the lane */
+    uint64_t bytes = 0;       /**< Bytes parsed */
+    uint64_t overdue = 0;     /**< Services that started past the deadline */
+    uint64_t p50Ns = 0;       /**< Median latency, bucket upper bound */
+    uint64_t p99Ns = 0;       /**< 99th percentile latency, bucket upper bound */
+    uint64_t maxNs = 0;       /**< Largest latency */
+    uint64_t lastService = 0; /**< Scheduler wide number of the last service, 0 none */
+};
+
+class LaneScheduler {
+    public:
+        LaneScheduler();
+        ~LaneScheduler();
+        size_t addLane(SharedMem* shmem, CmdSeqParser* parser, const LaneConfig& config); /**< Before start */
+        void notify(size_t lane);   /**< Data was put in the lane, never blocks */
+        void start();               /**< Start the service thread */
+        void stop();                /**< Stop the thread and drain all lanes */
+        uint64_t getCount(size_t lane); /**< Valid commands of a lane */
+        LaneStats getStats(size_t lane); /**< Latency metrics of a lane */
+    private:
+        struct Lane {
+            SharedMem* shmem;
+            CmdSeqParser* parser;
+            LaneConfig config;
+            std::atomic<uint64_t> pendingSince{0};  /**< ns of the oldest unserviced notify, 0 none */
+            std::atomic<uint64_t> count{0};         /**< Published count */
+            std::atomic<uint64_t> services{0};
+            std::atomic<uint64_t> bytes{0};
+            std::atomic<uint64_t> overdue{0};
+            std::atomic<uint64_t> maxNs{0};
+            std::atomic<uint64_t> lastService{0};
+            std::atomic<uint64_t> latency[LANE_LATENCY_BUCKETS]; /**< Service latency histogram */
+        };
+        void run();                        /**< Service loop */
+        int pick(uint64_t now, uint64_t* wakeAt); /**< Next lane to service, -1 none */
+        bool service(size_t lane, uint64_t now);  /**< Parse a lane, false if it was empty */
+
+        std::vector<Lane*> lanes_;         /**< Registered lanes */
+        uint64_t services_;                /**< Services of all lanes, service thread only */
+        std::atomic<bool> signaled_;       /**< A notify is pending on sem_ */
+        std::atomic<bool> isStopped_;      /**< Stop request */
+        std::thread thread_;               /**< Service thread */
+        sem_t sem_;                        /**< Wakes the service thread */
+};
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+#endif /* __LANE_SCHEDULER_H__ */
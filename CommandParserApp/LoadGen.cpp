@@ -0,0 +1,186 @@
+/**
+ * @file  LoadGen.cpp
+ * @brief Load generator tool for soak and capacity runs of the pipeline
+ * @note  Build: g++ -std=c++20 -O2 LoadGen.cpp -lpthread -Wall -o loadgen
+ *        Usage: ./loadgen [--producers N] [--rate B/s] [--shape steady|onoff|poisson]
+ *                         [--duty D] [--period us] [--chunk B] [--density D]
+ *                         [--split P] [--ring B] [--max-delay us] [--blocking]
+ *                         [--duration ms] [--seed S]
+ *                         [--ramp [--max-drop R] [--max-p99 us]]
+ *
+ */
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+/* Include application code here */
+#include "Application.cpp"
+#include "CmdSeqParser.cpp"
+#include "BackgroundTask.cpp"
+#include "SharedMem.cpp"
+#include "MemPolicy.cpp"
+#include "Checkpoint.cpp"
+#include "ApproxMatcher.cpp"
+#include "Crc.cpp"
+#include "FrameVerifier.cpp"
+#include "ParseEvents.cpp"
+#include "RateStats.cpp"
+#include "PatternDfa.cpp"
+#include "PerfCounters.cpp"
+#include "Trace.cpp"
+#include "OutputSink.cpp"
+#include "PatternSet.cpp"
+#include "BitSlipMatcher.cpp"
+#include "CommandStats.cpp"
+#include "LoadGenerator.cpp"
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+static void LoadGen_Usage(const char* name);
+
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+/**
+ * @brief Print the options
+ *
+ * @param  name  program name
+ * @return None
+ */
+static void LoadGen_Usage(const char* name)
+{
+    LoadConfig d;
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --producers N     producer threads, one worker each (%zu)\n"
+            "  --rate B/s        offered bytes/s per producer, 0 unpaced (%g)\n"
+            "  --shape S         steady, onoff or poisson (steady)\n"
+            "  --duty D          onoff: share of the period sending (%g)\n"
+            "  --period us       onoff: burst period (%u)\n"
+            "  --chunk B         bytes per PutBlock (%zu)\n"
+            "  --density D       headers per byte (%g)\n"
+            "  --split P         chance a chunk ends inside a header (%g)\n"
+            "  --ring B          shared memory per producer (%zu)\n"
+            "  --max-delay us    worker flush delay, 0 full buffers only (%u)\n"
+            "  --blocking        wait for ring space instead of dropping\n"
+            "  --duration ms     length of a run (%u)\n"
+            "  --seed S          traffic seed (%llu)\n"
+            "  --ramp            ramp the rate to the saturation point\n"
+            "  --max-drop R      ramp: highest passing drop rate (0.001)\n"
+            "  --max-p99 us      ramp: highest passing p99 latency, 0 none (0)\n",
+            name, d.producers, d.rate, d.burstDuty, d.burstPeriodUs, d.chunkBytes, d.density,
+            d.splitProbability, d.ringBytes, d.flush.maxDelayUs, d.durationMs,
+            (unsigned long long)d.seed);
+}
+
+/**
+ * @brief Run the load once or ramp it, exit status 1 on a count mismatch
+ *
+ * @param  argc  argument count
+ * @param  argv  arguments
+ * @return exit status
+ */
+int main(int argc, char** argv)
+{
+    LoadConfig config;
+    bool ramp = false;
+    double maxDrop = 0.001;
+    uint64_t maxP99Ns = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char* opt = argv[i];
+        if (strcmp(opt, "--blocking") == 0) {
+            config.blocking = true;
+            continue;
+        }
+        if (strcmp(opt, "--ramp") == 0) {
+            ramp = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            LoadGen_Usage(argv[0]);
+            return 2;
+        }
+        const char* val = argv[++i];
+        if (strcmp(opt, "--producers") == 0) {
+            config.producers = (size_t)strtoull(val, NULL, 0);
+        } else if (strcmp(opt, "--rate") == 0) {
+            config.rate = strtod(val, NULL);
+        } else if (strcmp(opt, "--shape") == 0) {
+            if (strcmp(val, "steady") == 0) {
+                config.shape = LoadShape::STEADY;
+            } else if (strcmp(val, "onoff") == 0) {
+                config.shape = LoadShape::ON_OFF;
+            } else if (strcmp(val, "poisson") == 0) {
+                config.shape = LoadShape::POISSON;
+            } else {
+                LoadGen_Usage(argv[0]);
+                return 2;
+            }
+        } else if (strcmp(opt, "--duty") == 0) {
+            config.burstDuty = strtod(val, NULL);
+        } else if (strcmp(opt, "--period") == 0) {
+            config.burstPeriodUs = (uint32_t)strtoul(val, NULL, 0);
+        } else if (strcmp(opt, "--chunk") == 0) {
+            config.chunkBytes = (size_t)strtoull(val, NULL, 0);
+        } else if (strcmp(opt, "--density") == 0) {
+            config.density = strtod(val, NULL);
+        } else if (strcmp(opt, "--split") == 0) {
+            config.splitProbability = strtod(val, NULL);
+        } else if (strcmp(opt, "--ring") == 0) {
+            config.ringBytes = (size_t)strtoull(val, NULL, 0);
+        } else if (strcmp(opt, "--max-delay") == 0) {
+            config.flush.maxDelayUs = (uint32_t)strtoul(val, NULL, 0);
+        } else if (strcmp(opt, "--duration") == 0) {
+            config.durationMs = (uint32_t)strtoul(val, NULL, 0);
+        } else if (strcmp(opt, "--seed") == 0) {
+            config.seed = strtoull(val, NULL, 0);
+        } else if (strcmp(opt, "--max-drop") == 0) {
+            maxDrop = strtod(val, NULL);
+        } else if (strcmp(opt, "--max-p99") == 0) {
+            maxP99Ns = strtoull(val, NULL, 0) * 1000;
+        } else {
+            LoadGen_Usage(argv[0]);
+            return 2;
+        }
+    }
+    if ((config.producers == 0) || (config.chunkBytes == 0) || (config.ringBytes == 0) ||
+        (config.burstDuty <= 0.0) || (config.burstDuty > 1.0) ||
+        ((config.shape == LoadShape::ON_OFF) && (config.burstPeriodUs == 0))) {
+        LoadGen_Usage(argv[0]);
+        return 2;
+    }
+
+    bool ok = true;
+    if (!ramp) {
+        LoadReport r = LoadGenerator(config).run();
+        LoadGenerator::print(stdout, r, true);
+        ok = r.ok;
+    } else {
+        std::vector<LoadReport> steps;
+        double best = LoadGenerator(config).findSaturation(maxDrop, maxP99Ns, &steps);
+        for (size_t i = 0; i < steps.size(); i++) {
+            LoadGenerator::print(stdout, steps[i], i == 0);
+            ok = ok && steps[i].ok;
+        }
+        printf("saturation: %.2f MB/s parsed with %zu producers\n", best / 1e6, config.producers);
+    }
+    if (!ok) {
+        fprintf(stderr, "count mismatch: the parsers missed or invented headers\n");
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,422 @@
+/**
+ * @file  LoadGenerator.cpp
+ * @brief Synthetic multi-producer load through Application/BackgroundTask
+ * @note  Every producer thread feeds its own shared memory, parser and
+ *        worker, like a channel of the real system. Bytes that do not
+ *        fit in the ring are dropped as a device would drop them, and the
+ *        expected count is taken over the bytes that were accepted, so
+ *        the check at the end stays exact at any drop rate.
+ *
+ */
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include "LoadGenerator.h"
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <random>
+#include <thread>
+#include <utility>
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*
+ * Longest sleep of a producer between polls of its ring, bounds the
+ * error of the measured latency
+ */
+#define LOAD_POLL_NS (50000)
+
+/*
+ * A producer that falls further behind its schedule skips ahead instead
+ * of sending the backlog back to back
+ */
+#define LOAD_MAX_LAG_NS (10000000)
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+static uint64_t LoadGenerator_Now(void);
+static unsigned LoadGenerator_Bucket(uint64_t ns);
+static uint64_t LoadGenerator_BucketMax(unsigned bucket);
+
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+/**
+ * @brief Keep the configuration, nothing runs until run()
+ *
+ * @param  config  traffic and pipeline configuration
+ * @return None
+ */
+LoadGenerator::LoadGenerator(const LoadConfig& config)
+{
+    assert(config.producers > 0);
+    assert(config.chunkBytes > 0);
+    assert(config.ringBytes > 0);
+    assert((config.shape != LoadShape::ON_OFF) || (config.burstPeriodUs > 0));
+    config_ = config;
+}
+
+/**
+ * @brief One run at the configured rate
+ *
+ * @param  None
+ * @return report
+ */
+LoadReport LoadGenerator::run()
+{
+    return run(config_.rate);
+}
+
+/**
+ * @brief One run: start the workers, produce for the configured time,
+ *        stop, parse what is left and compare the counts
+ *
+ * @param  rate  offered bytes/s per producer, 0 as fast as possible
+ * @return report
+ */
+LoadReport LoadGenerator::run(double rate)
+{
+    const size_t n = config_.producers;
+    std::vector<std::unique_ptr<SharedMem>> shmems;
+    std::vector<std::unique_ptr<CmdSeqParser>> parsers;
+    std::vector<std::unique_ptr<BackgroundTask>> tasks;
+    std::vector<std::unique_ptr<Application>> apps;
+    std::vector<Producer> producers(n);
+    std::vector<std::thread> threads;
+
+    for (size_t i = 0; i < n; i++) {
+        shmems.emplace_back(new SharedMem(config_.ringBytes, MemPolicy()));
+        parsers.emplace_back(new CmdSeqParser(shmems[i].get()));
+        tasks.emplace_back(new BackgroundTask(parsers[i].get()));
+        apps.emplace_back(new Application(tasks[i].get()));
+        if (config_.flush.maxDelayUs > 0) {
+            apps[i]->setFlushPolicy(config_.flush);
+        }
+        apps[i]->start();
+
+        Producer& p = producers[i];
+        memset(&p, 0, sizeof(p));
+        p.index = i;
+        p.shmem = shmems[i].get();
+        p.app = apps[i].get();
+    }
+
+    uint64_t start = LoadGenerator_Now();
+    uint64_t end = start + (uint64_t)config_.durationMs * 1000000ull;
+    for (size_t i = 0; i < n; i++) {
+        threads.emplace_back(&LoadGenerator::produce, this, &producers[i], rate, end);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    LoadReport r;
+    uint64_t parsed = 0;
+    r.rate = rate;
+    r.seconds = (double)(LoadGenerator_Now() - start) / 1e9;
+    for (size_t i = 0; i < n; i++) {
+        parsed += producers[i].accepted - shmems[i]->Count();
+    }
+
+    /* The tail left in the rings is parsed here, outside the timing */
+    for (size_t i = 0; i < n; i++) {
+        apps[i]->stop();
+        while (parsers[i]->parseAvailable() > 0) {
+        }
+        r.counted += parsers[i]->getCount();
+    }
+
+    uint64_t hist[LOAD_LATENCY_BUCKETS] = { 0 };
+    uint64_t total = 0;
+    for (const Producer& p : producers) {
+        r.offered += p.offered;
+        r.accepted += p.accepted;
+        r.dropped += p.dropped;
+        r.expected += p.expected;
+        r.maxNs = (p.maxNs > r.maxNs) ? p.maxNs : r.maxNs;
+        for (unsigned b = 0; b < LOAD_LATENCY_BUCKETS; b++) {
+            hist[b] += p.latency[b];
+            total += p.latency[b];
+        }
+    }
+    uint64_t seen = 0;
+    for (unsigned b = 0; (b < LOAD_LATENCY_BUCKETS) && (total > 0); b++) {
+        seen += hist[b];
+        if ((r.p50Ns == 0) && (seen * 2 >= total)) {
+            r.p50Ns = LoadGenerator_BucketMax(b);
+        }
+        if ((r.p99Ns == 0) && (seen * 100 >= total * 99)) {
+            r.p99Ns = LoadGenerator_BucketMax(b);
+        }
+        if (seen * 1000 >= total * 999) {
+            r.p999Ns = LoadGenerator_BucketMax(b);
+            break;
+        }
+    }
+    r.p50Ns = (r.p50Ns < r.maxNs) ? r.p50Ns : r.maxNs;
+    r.p99Ns = (r.p99Ns < r.maxNs) ? r.p99Ns : r.maxNs;
+    r.p999Ns = (r.p999Ns < r.maxNs) ? r.p999Ns : r.maxNs;
+    r.offeredBytesPerSec = (double)r.offered / r.seconds;
+    r.sustainedBytesPerSec = (double)parsed / r.seconds;
+    r.dropRate = (r.offered > 0) ? (double)r.dropped / (double)r.offered : 0.0;
+    r.ok = (r.counted == r.expected);
+    return r;
+}
+
+/**
+ * @brief Ramp the rate until the pipeline no longer keeps up, then
+ *        narrow down the limit
+ *
+ * The rate doubles from the configured rate (100 kB/s if unpaced) while
+ * a run passes: counts match, drops and p99 latency are within bounds
+ * and the producers could offer 90% of the rate. Three bisection steps
+ * between the last passing and the first failing rate follow.
+ *
+ * @param  maxDropRate  highest passing drop rate
+ * @param  maxP99Ns     highest passing p99 latency, 0 no bound
+ * @param  steps        every run in order, may be NULL
+ * @return sustained bytes/s of the best passing run, 0 if none passed
+ */
+double LoadGenerator::findSaturation(double maxDropRate, uint64_t maxP99Ns,
+                                     std::vector<LoadReport>* steps)
+{
+    double best = 0.0;
+    double good = 0.0;
+    double bad = 0.0;
+    double rate = (config_.rate > 0.0) ? config_.rate : 1e5;
+
+    auto attempt = [&](double r) {
+        LoadReport rep = run(r);
+        if (steps != NULL) {
+            steps->push_back(rep);
+        }
+        bool pass = rep.ok && (rep.dropRate <= maxDropRate) &&
+                    ((maxP99Ns == 0) || (rep.p99Ns <= maxP99Ns)) &&
+                    (rep.offeredBytesPerSec >= 0.9 * r * (double)config_.producers);
+        if (pass && (rep.sustainedBytesPerSec > best)) {
+            best = rep.sustainedBytesPerSec;
+        }
+        return pass;
+    };
+
+    for (int i = 0; i < 32; i++, rate *= 2.0) {
+        if (!attempt(rate)) {
+            bad = rate;
+            break;
+        }
+        good = rate;
+    }
+    for (int i = 0; (i < 3) && (good > 0.0) && (bad > 0.0); i++) {
+        double mid = (good + bad) / 2.0;
+        if (attempt(mid)) {
+            good = mid;
+        } else {
+            bad = mid;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Print a report as a table row
+ *
+ * @param  fp      output
+ * @param  report  report
+ * @param  header  print the column names first
+ * @return None
+ */
+void LoadGenerator::print(FILE* fp, const LoadReport& report, bool header)
+{
+    if (header) {
+        fprintf(fp, "%-12s %10s %10s %8s %9s %9s %9s %9s %10s %4s\n", "rate/prod", "offer MB/s",
+                "parse MB/s", "drop %", "p50 us", "p99 us", "p99.9 us", "max us", "headers", "ok");
+    }
+    fprintf(fp, "%-12.4g %10.2f %10.2f %8.3f %9.1f %9.1f %9.1f %9.1f %10llu %4s\n", report.rate,
+            report.offeredBytesPerSec / 1e6, report.sustainedBytesPerSec / 1e6,
+            report.dropRate * 100.0, (double)report.p50Ns / 1e3, (double)report.p99Ns / 1e3,
+            (double)report.p999Ns / 1e3, (double)report.maxNs / 1e3,
+            (unsigned long long)report.expected, report.ok ? "yes" : "NO");
+}
+
+/**
+ * @brief Producer thread: generate chunks on schedule, put them in the
+ *        ring and follow how far the worker has parsed
+ *
+ * @param  p      producer state
+ * @param  rate   offered bytes/s, 0 as fast as possible
+ * @param  endNs  end of the run
+ * @return None
+ */
+void LoadGenerator::produce(Producer* p, double rate, uint64_t endNs)
+{
+    const size_t len = config_.chunkBytes;
+    const size_t size = p->shmem->Size();
+    std::mt19937_64 rng(config_.seed + p->index);
+    std::geometric_distribution<uint64_t> gapDist((config_.density > 0.0) ? config_.density : 0.5);
+    std::exponential_distribution<double> expDist(1.0);
+    std::uniform_real_distribution<double> uniDist(0.0, 1.0);
+    std::vector<uint8_t> chunk(len);
+    std::deque<std::pair<uint64_t, uint64_t>> inflight;  /* accepted bytes after a put, put time */
+    uint64_t gap = (config_.density > 0.0) ? gapDist(rng) : UINT64_MAX;
+    bool carry = false;   /* Generated stream owes the 5A of a split header */
+    bool prevA5 = false;  /* Last accepted byte was A5 */
+
+    const double interval = (rate > 0.0) ? (double)len * 1e9 / rate : 0.0;
+    const uint64_t periodNs = (uint64_t)config_.burstPeriodUs * 1000;
+    const uint64_t onNs = (uint64_t)(config_.burstDuty * (double)periodNs);
+    const uint64_t start = LoadGenerator_Now();
+    double next = (double)start;
+
+    auto poll = [&](uint64_t now) {
+        uint64_t consumed = p->accepted - p->shmem->Count();
+        while (!inflight.empty() && (inflight.front().first <= consumed)) {
+            uint64_t ns = now - inflight.front().second;
+            p->latency[LoadGenerator_Bucket(ns)]++;
+            p->maxNs = (ns > p->maxNs) ? ns : p->maxNs;
+            inflight.pop_front();
+        }
+    };
+
+    while (true) {
+        uint64_t now = LoadGenerator_Now();
+        poll(now);
+        if (now >= endNs) {
+            break;
+        }
+        if ((interval > 0.0) && ((double)now < next)) {
+            uint64_t wait = (uint64_t)(next - (double)now);
+            std::this_thread::sleep_for(std::chrono::nanoseconds((wait < LOAD_POLL_NS) ? wait : LOAD_POLL_NS));
+            continue;
+        }
+
+        /* Fill with headers at geometric gaps, a split owes its 5A to the next chunk */
+        size_t i = 0;
+        if (carry) {
+            chunk[i++] = 0x5A;
+            carry = false;
+        }
+        while (i < len) {
+            if (gap == 0) {
+                chunk[i++] = 0xA5;
+                if (i < len) {
+                    chunk[i++] = 0x5A;
+                } else {
+                    carry = true;
+                }
+                gap = gapDist(rng);
+            } else {
+                size_t fill = (gap < len - i) ? (size_t)gap : len - i;
+                memset(&chunk[i], 0x00, fill);
+                i += fill;
+                gap -= fill;
+            }
+        }
+        if (!carry && (chunk[len - 1] == 0x00) && (uniDist(rng) < config_.splitProbability)) {
+            chunk[len - 1] = 0xA5;
+            carry = true;
+        }
+
+        /* Drop what does not fit, or wait for the worker to make room */
+        auto putBlock = [&](size_t from) {
+            size_t n = p->shmem->PutBlock(&chunk[from], len - from);
+            /* Signaled once per fill, a full buffer is parsed as a whole */
+            if ((n > 0) && (p->shmem->Count() == size)) {
+                p->app->dataAvailable();
+            }
+            return n;
+        };
+        size_t put = putBlock(0);
+        while (config_.blocking && (put < len) && (LoadGenerator_Now() < endNs)) {
+            std::this_thread::yield();
+            put += putBlock(put);
+        }
+        for (size_t k = 0; k < put; k++) {
+            p->expected += (prevA5 && (chunk[k] == 0x5A)) ? 1 : 0;
+            prevA5 = (chunk[k] == 0xA5);
+        }
+        p->offered += len;
+        p->accepted += put;
+        p->dropped += len - put;
+        if (put > 0) {
+            inflight.emplace_back(p->accepted, LoadGenerator_Now());
+        }
+
+        /* Next send time of the burst shape */
+        if (interval > 0.0) {
+            switch (config_.shape) {
+                case LoadShape::STEADY:
+                    next += interval;
+                    break;
+                case LoadShape::POISSON:
+                    next += interval * expDist(rng);
+                    break;
+                case LoadShape::ON_OFF: {
+                    next += interval * config_.burstDuty;
+                    uint64_t phase = ((uint64_t)next - start) % periodNs;
+                    if (phase >= onNs) {
+                        next += (double)(periodNs - phase);
+                    }
+                    break;
+                }
+            }
+            if (next + LOAD_MAX_LAG_NS < (double)now) {
+                next = (double)now;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Monotonic time
+ *
+ * @param  None
+ * @return ns
+ */
+static uint64_t LoadGenerator_Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Latency histogram bucket, 8 linear steps per power of two
+ *
+ * @param  ns  latency
+ * @return bucket
+ */
+static unsigned LoadGenerator_Bucket(uint64_t ns)
+{
+    if (ns < 8) {
+        return (unsigned)ns;
+    }
+    unsigned msb = 63 - (unsigned)__builtin_clzll(ns);
+    return (msb - 2) * 8 + (unsigned)((ns >> (msb - 3)) & 7);
+}
+
+/**
+ * @brief Largest latency falling in a bucket
+ *
+ * @param  bucket  bucket
+ * @return ns
+ */
+static uint64_t LoadGenerator_BucketMax(unsigned bucket)
+{
+    if (bucket < 8) {
+        return bucket;
+    }
+    unsigned msb = bucket / 8 + 2;
+    uint64_t low = (8ull + bucket % 8) << (msb - 3);
+    return low + (1ull << (msb - 3)) - 1;
+}
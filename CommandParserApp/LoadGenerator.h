@@ -0,0 +1,105 @@
+/**
+ * @file  LoadGenerator.h
+ * @brief Synthetic multi-producer load through Application/BackgroundTask
+ * @note
+ *
+ */
+#ifndef __LOAD_GENERATOR_H__
+#define __LOAD_GENERATOR_H__
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+#include "Application.h"
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*
+ * Latency histogram: 8 linear sub-buckets per power of two nanoseconds
+ */
+#define LOAD_LATENCY_BUCKETS (512)
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+enum class LoadShape {
+    STEADY,   /**< Evenly spaced chunks */
+    ON_OFF,   /**< Bursts at rate / duty, then silence */
+    POISSON   /**< Exponential gaps between chunks */
+};
+
+struct LoadConfig {
+    size_t producers = 2;           /**< Producer threads, each with its own Application */
+    double rate = 1e6;              /**< Offered bytes/s per producer, 0 as fast as possible */
+    LoadShape shape = LoadShape::STEADY;
+    double burstDuty = 0.25;        /**< ON_OFF: share of the period spent sending */
+    uint32_t burstPeriodUs = 10000; /**< ON_OFF: burst period, more than 0 */
+    size_t chunkBytes = 256;        /**< Bytes per PutBlock */
+    double density = 1e-3;          /**< Headers per byte */
+    double splitProbability = 0.1;  /**< Chance that a chunk ends inside a header */
+    size_t ringBytes = 16 * 1024;   /**< Shared memory per producer */
+    FlushPolicy flush = { 1000, 0 }; /**< Flush policy of the workers */
+    bool blocking = false;          /**< Wait for space instead of dropping */
+    uint32_t durationMs = 1000;     /**< Length of a run */
+    uint64_t seed = 1;              /**< Traffic seed, producer i uses seed + i */
+};
+
+/*
+ * Latency is from the PutBlock of a chunk until the producer sees it
+ * consumed by the worker, so it includes up to one poll interval (50 us).
+ */
+struct LoadReport {
+    double rate = 0.0;              /**< Configured rate per producer */
+    double seconds = 0.0;           /**< Length of the run */
+    double offeredBytesPerSec = 0.0;   /**< Generated, all producers */
+    double sustainedBytesPerSec = 0.0; /**< Parsed, all producers */
+    uint64_t offered = 0;           /**< Bytes generated */
+    uint64_t accepted = 0;          /**< Bytes that fit in the rings */
+    uint64_t dropped = 0;           /**< Bytes that did not */
+    double dropRate = 0.0;          /**< dropped / offered */
+    uint64_t p50Ns = 0;             /**< Median latency, bucket upper bound */
+    uint64_t p99Ns = 0;             /**< 99th percentile, bucket upper bound */
+    uint64_t p999Ns = 0;            /**< 99.9th percentile, bucket upper bound */
+    uint64_t maxNs = 0;             /**< Largest latency */
+    uint64_t expected = 0;          /**< Headers in the accepted bytes */
+    uint64_t counted = 0;           /**< Headers counted by the parsers */
+    bool ok = false;                /**< counted == expected */
+};
+
+class LoadGenerator {
+    public:
+        LoadGenerator(const LoadConfig& config);
+        LoadReport run();            /**< One run at the configured rate */
+        LoadReport run(double rate); /**< One run at another rate per producer */
+        double findSaturation(double maxDropRate, uint64_t maxP99Ns,
+                              std::vector<LoadReport>* steps); /**< Ramp to the highest sustained rate */
+        static void print(FILE* fp, const LoadReport& report, bool header); /**< One table row */
+    private:
+        struct Producer {
+            size_t index;
+            SharedMem* shmem;
+            Application* app;
+            uint64_t offered;
+            uint64_t accepted;
+            uint64_t dropped;
+            uint64_t expected;
+            uint64_t maxNs;
+            uint64_t latency[LOAD_LATENCY_BUCKETS];
+        };
+        void produce(Producer* p, double rate, uint64_t endNs); /**< Producer thread */
+
+        LoadConfig config_;          /**< Configuration */
+};
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+#endif /* __LOAD_GENERATOR_H__ */
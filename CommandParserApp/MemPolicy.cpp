@@ -0,0 +1,280 @@
+/**
+ * @file  MemPolicy.cpp
+ * @brief Hugepage and NUMA aware buffer allocation and thread pinning
+ * @note  mbind/get_mempolicy are called through syscall() so that no
+ *        libnuma is needed to build.
+ *
+ */
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include "MemPolicy.h"
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*
+ * Nodes supported in the mbind node mask
+ */
+#define MEM_MAX_NODES (64)
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+/**
+ * @brief Initialize an empty region
+ *
+ * @param  None
+ * @return None
+ */
+MemRegion::MemRegion()
+{
+    kind_ = Kind::NONE;
+    data_ = NULL;
+    size_ = 0;
+    mapped_ = 0;
+    huge_ = false;
+    bound_ = false;
+}
+
+/**
+ * @brief Release the memory
+ *
+ * @param  None
+ * @return None
+ */
+MemRegion::~MemRegion()
+{
+    release();
+}
+
+/**
+ * @brief Allocate memory according to the policy and fault it in
+ *
+ * With hugePages, explicit 2 MiB pages are tried first and transparent
+ * hugepages are requested with madvise when none are reserved. The node
+ * binding is applied before the first touch so all pages land on it.
+ *
+ * @param  size    number of bytes
+ * @param  policy  placement policy
+ * @return true/false memory was allocated or not
+ */
+bool MemRegion::allocate(size_t size, const MemPolicy& policy)
+{
+    release();
+    size_ = size;
+
+    if (!policy.hugePages && (policy.node < 0)) {
+        data_ = new uint8_t[size];
+        kind_ = Kind::HEAP;
+        memset(data_, 0, size);
+        return true;
+    }
+
+    void* addr = MAP_FAILED;
+    if (policy.hugePages) {
+        mapped_ = (size + MEM_HUGE_PAGE_SIZE - 1) & ~((size_t)MEM_HUGE_PAGE_SIZE - 1);
+        addr = mmap(NULL, mapped_, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        huge_ = (addr != MAP_FAILED);
+    }
+    if (addr == MAP_FAILED) {
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        mapped_ = (size + page - 1) & ~(page - 1);
+        addr = mmap(NULL, mapped_, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (addr == MAP_FAILED) {
+            mapped_ = 0;
+            return false;
+        }
+        if (policy.hugePages) {
+            madvise(addr, mapped_, MADV_HUGEPAGE);
+        }
+    }
+    data_ = (uint8_t*)addr;
+    kind_ = Kind::MMAP;
+
+    if ((policy.node >= 0) && (policy.node < MEM_MAX_NODES)) {
+        /* The kernel reads maxnode - 1 bits, so one more, as libnuma does */
+        unsigned long mask = 1ul << policy.node;
+        bound_ = (syscall(SYS_mbind, addr, mapped_, MPOL_BIND, &mask,
+                          (unsigned long)MEM_MAX_NODES + 1, 0) == 0);
+    }
+
+    /* First touch places the pages */
+    memset(data_, 0, mapped_);
+    return true;
+}
+
+/**
+ * @brief Release the memory
+ *
+ * @param  None
+ * @return None
+ */
+void MemRegion::release()
+{
+    if (kind_ == Kind::HEAP) {
+        delete[] data_;
+    } else if (kind_ == Kind::MMAP) {
+        munmap(data_, mapped_);
+    }
+    kind_ = Kind::NONE;
+    data_ = NULL;
+    size_ = 0;
+    mapped_ = 0;
+    huge_ = false;
+    bound_ = false;
+}
+
+/**
+ * @brief Start of the memory
+ *
+ * @param  None
+ * @return pointer to the memory, NULL if not allocated
+ */
+uint8_t* MemRegion::data()
+{
+    return data_;
+}
+
+/**
+ * @brief Requested size of the memory
+ *
+ * @param  None
+ * @return size in bytes
+ */
+size_t MemRegion::size()
+{
+    return size_;
+}
+
+/**
+ * @brief Check if the memory is backed by explicit 2 MiB pages
+ *
+ * @param  None
+ * @return true/false hugepages or not
+ */
+bool MemRegion::isHuge()
+{
+    return huge_;
+}
+
+/**
+ * @brief Check if the memory is bound to the requested node
+ *
+ * @param  None
+ * @return true/false bound or not
+ */
+bool MemRegion::isBound()
+{
+    return bound_;
+}
+
+/**
+ * @brief Number of NUMA nodes with memory
+ *
+ * @param  None
+ * @return node count, 1 when the topology is not available
+ */
+int MemPolicy_NodeCount(void)
+{
+    int count = 0;
+
+    for (int node = 0; node < MEM_MAX_NODES; node++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", node);
+        if (access(path, F_OK) == 0) {
+            count = node + 1;
+        }
+    }
+    return (count > 0) ? count : 1;
+}
+
+/**
+ * @brief Get the CPUs of a NUMA node
+ *
+ * @param  node  NUMA node
+ * @param  cpus  CPU set of the node
+ * @return true/false CPU list was read or not
+ */
+bool MemPolicy_NodeCpus(int node, cpu_set_t* cpus)
+{
+    char path[64];
+    char list[1024];
+
+    CPU_ZERO(cpus);
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        return false;
+    }
+    bool ok = (fgets(list, sizeof(list), fp) != NULL);
+    fclose(fp);
+    if (!ok) {
+        return false;
+    }
+
+    /* Format: "0-3,8-11" */
+    char* p = list;
+    while ((*p >= '0') && (*p <= '9')) {
+        long first = strtol(p, &p, 10);
+        long last = first;
+        if (*p == '-') {
+            last = strtol(p + 1, &p, 10);
+        }
+        for (long cpu = first; (cpu <= last) && (cpu < CPU_SETSIZE); cpu++) {
+            CPU_SET(cpu, cpus);
+        }
+        if (*p == ',') {
+            p++;
+        }
+    }
+    return CPU_COUNT(cpus) > 0;
+}
+
+/**
+ * @brief Pin a thread to a CPU set
+ *
+ * @param  thread  thread to pin
+ * @param  cpus    allowed CPUs
+ * @return true/false affinity was set or not
+ */
+bool MemPolicy_PinThread(pthread_t thread, const cpu_set_t* cpus)
+{
+    return pthread_setaffinity_np(thread, sizeof(cpu_set_t), cpus) == 0;
+}
+
+/**
+ * @brief NUMA node of the page holding an address
+ *
+ * @param  addr  address of a touched page
+ * @return node, -1 when unknown
+ */
+int MemPolicy_NodeOf(const void* addr)
+{
+    int node = -1;
+
+    if (syscall(SYS_get_mempolicy, &node, NULL, 0UL, addr,
+                MPOL_F_NODE | MPOL_F_ADDR) != 0) {
+        return -1;
+    }
+    return node;
+}
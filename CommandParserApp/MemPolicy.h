@@ -0,0 +1,65 @@
+/**
+ * @file  MemPolicy.h
+ * @brief Hugepage and NUMA aware buffer allocation and thread pinning
+ * @note
+ *
+ */
+#ifndef __MEM_POLICY_H__
+#define __MEM_POLICY_H__
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include <cstdint>
+#include <cstddef>
+#include <pthread.h>
+#include <sched.h>
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+#define MEM_HUGE_PAGE_SIZE (2u * 1024u * 1024u)
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*
+ * Placement of a buffer, the default is a plain heap allocation
+ */
+struct MemPolicy {
+    bool hugePages = false; /**< Use 2 MiB pages, falls back to 4 KiB pages */
+    int node = -1;          /**< NUMA node to bind to, -1 for no binding */
+};
+
+class MemRegion {
+    public:
+        MemRegion();
+        ~MemRegion();
+        bool allocate(size_t size, const MemPolicy& policy); /**< Allocate and prefault */
+        void release();       /**< Release the memory */
+        uint8_t* data();      /**< Start of the memory */
+        size_t size();        /**< Requested size */
+        bool isHuge();        /**< Backed by explicit 2 MiB pages */
+        bool isBound();       /**< Bound to the requested node */
+    private:
+        enum class Kind { NONE, HEAP, MMAP }; /**< How the memory was obtained */
+
+        Kind kind_;           /**< Allocation kind */
+        uint8_t* data_;       /**< Start of the memory */
+        size_t size_;         /**< Requested size */
+        size_t mapped_;       /**< Mapped size, rounded to the page size */
+        bool huge_;           /**< MAP_HUGETLB succeeded */
+        bool bound_;          /**< mbind succeeded */
+};
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+int MemPolicy_NodeCount(void);
+bool MemPolicy_NodeCpus(int node, cpu_set_t* cpus);
+bool MemPolicy_PinThread(pthread_t thread, const cpu_set_t* cpus);
+int MemPolicy_NodeOf(const void* addr);
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+#endif /* __MEM_POLICY_H__ */
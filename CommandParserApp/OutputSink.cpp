@@ -0,0 +1,463 @@
+/**
+ * @file  OutputSink.cpp
+ * @brief Match and frame records written to rotating files by a writer thread
+ * @note  The parse thread stages records and pushes them in batches to an
+ *        SPSC queue. The writer formats them into one aligned buffer and
+ *        writes it in OUTPUT_ALIGN multiples once writeBytes have
+ *        collected, so every write is large and valid for O_DIRECT. Only
+ *        the tail of a file, at rotation or stop, is written unaligned.
+ *
+ */
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include "OutputSink.h"
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*
+ * Records popped from the queue at once by the writer
+ */
+#define OUTPUT_BATCH (256)
+
+/*
+ * Longest formatted record
+ */
+#define OUTPUT_MAX_LINE (96)
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+static uint64_t OutputSink_Now(void);
+static char* OutputSink_Decimal(char* p, uint64_t value);
+
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+static const char OutputSink_CsvHeader[] = "type,offset,time_ns,length,value\n";
+static const char* const OutputSink_TypeNames[] = { "match", "frame", "bad_frame" };
+
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+/**
+ * @brief Allocate the queue and the write buffer, no file is opened yet
+ *
+ * @param  config  files, format, queue and write sizes
+ * @return None
+ */
+OutputSink::OutputSink(const OutputConfig& config) : queue_(config.queueRecords)
+{
+    void* mem = NULL;
+
+    config_ = config;
+    config_.writeBytes = (config.writeBytes + OUTPUT_ALIGN - 1) / OUTPUT_ALIGN * OUTPUT_ALIGN;
+    if (config_.writeBytes == 0) {
+        config_.writeBytes = OUTPUT_ALIGN;
+    }
+    capacity_ = config_.writeBytes + OUTPUT_ALIGN;
+    if (posix_memalign(&mem, OUTPUT_ALIGN, capacity_) != 0) {
+        mem = NULL;
+    }
+    assert(mem != NULL);
+    buffer_ = (uint8_t*)mem;
+    staged_ = 0;
+    used_ = 0;
+    fd_ = -1;
+    fileIndex_ = 0;
+    fileBytes_ = 0;
+    queued_ = 0;
+    dropped_ = 0;
+    written_ = 0;
+    bytes_ = 0;
+    writes_ = 0;
+    errors_ = 0;
+    files_ = 0;
+    direct_ = false;
+    signaled_ = false;
+    isStopped_ = false;
+    sem_init(&sem_, 0, 0);
+}
+
+/**
+ * @brief Stop the writer if running and release the buffer
+ *
+ * @param  None
+ * @return None
+ */
+OutputSink::~OutputSink()
+{
+    stop();
+    free(buffer_);
+    sem_destroy(&sem_);
+}
+
+/**
+ * @brief Open the first file and start the writer thread
+ *
+ * @param  None
+ * @return true/false started or the file could not be created
+ */
+bool OutputSink::start()
+{
+    if (!open()) {
+        return false;
+    }
+    isStopped_.store(false, std::memory_order_release);
+    thread_ = std::thread(&OutputSink::run, this);
+    return true;
+}
+
+/**
+ * @brief Write everything queued, then close the file
+ *
+ * Flushes the staged records too, so it must be called from the parse
+ * thread or once that thread has finished.
+ *
+ * @param  None
+ * @return None
+ */
+void OutputSink::stop()
+{
+    if (!thread_.joinable()) {
+        return;
+    }
+    flush();
+    isStopped_.store(true, std::memory_order_release);
+    sem_post(&sem_);
+    thread_.join();
+}
+
+/**
+ * @brief Record a header, called by the parser for each match
+ *
+ * @param  offset  stream offset of the 0x5A byte
+ * @param  count   count including this header
+ * @return None
+ */
+void OutputSink::emitMatch(uint64_t offset, uint64_t count)
+{
+    emit(OutputType::MATCH, offset, 2, (uint32_t)count);
+}
+
+/**
+ * @brief Record a frame, called by the frame verifier at its trailer
+ *
+ * @param  offset   stream offset of the last trailer byte
+ * @param  length   payload length
+ * @param  trailer  received CRC
+ * @param  valid    the CRC matched
+ * @return None
+ */
+void OutputSink::emitFrame(uint64_t offset, uint16_t length, uint32_t trailer, bool valid)
+{
+    emit(valid ? OutputType::FRAME_VALID : OutputType::FRAME_INVALID, offset, length, trailer);
+}
+
+/**
+ * @brief Push the staged records to the writer, dropping what does not fit
+ *
+ * @param  None
+ * @return None
+ */
+void OutputSink::flush()
+{
+    if (staged_ == 0) {
+        return;
+    }
+    size_t n = queue_.push(stage_, staged_);
+    queued_.fetch_add(n, std::memory_order_relaxed);
+    if (n < staged_) {
+        dropped_.fetch_add(staged_ - n, std::memory_order_relaxed);
+    }
+    staged_ = 0;
+    if ((n > 0) && !signaled_.exchange(true)) {
+        sem_post(&sem_);
+    }
+}
+
+/**
+ * @brief Get the counters
+ *
+ * @param  None
+ * @return stats
+ */
+OutputStats OutputSink::getStats()
+{
+    OutputStats st;
+    st.queued = queued_.load(std::memory_order_relaxed);
+    st.dropped = dropped_.load(std::memory_order_relaxed);
+    st.written = written_.load(std::memory_order_relaxed);
+    st.bytes = bytes_.load(std::memory_order_relaxed);
+    st.writes = writes_.load(std::memory_order_relaxed);
+    st.errors = errors_.load(std::memory_order_relaxed);
+    st.files = files_.load(std::memory_order_relaxed);
+    st.direct = direct_.load(std::memory_order_relaxed);
+    return st;
+}
+
+/**
+ * @brief Name of a file of the sink, <path>.<index>.<bin|csv>
+ *
+ * @param  index  0 for the first file
+ * @return file name
+ */
+std::string OutputSink::getFileName(uint64_t index)
+{
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%06llu.%s", (unsigned long long)index,
+             (config_.format == Format::CSV) ? "csv" : "bin");
+    return config_.path + suffix;
+}
+
+/**
+ * @brief Stage a record, pushed once OUTPUT_STAGE have collected
+ *
+ * @param  type    record type
+ * @param  offset  stream offset
+ * @param  length  record length field
+ * @param  value   record value field
+ * @return None
+ */
+void OutputSink::emit(OutputType type, uint64_t offset, uint16_t length, uint32_t value)
+{
+    OutputRecord& r = stage_[staged_++];
+    r.offset = offset;
+    r.timeNs = OutputSink_Now();
+    r.value = value;
+    r.length = length;
+    r.type = type;
+    r.reserved = 0;
+    if (staged_ == OUTPUT_STAGE) {
+        flush();
+    }
+}
+
+/**
+ * @brief Writer loop: drain the queue into the buffer, write a partial
+ *        buffer when idle for flushIntervalMs
+ *
+ * @param  None
+ * @return None
+ */
+void OutputSink::run()
+{
+    OutputRecord batch[OUTPUT_BATCH];
+
+    while (true) {
+        /* Cleared before draining, a flush after this point posts again */
+        signaled_.store(false);
+        bool stopped = isStopped_.load(std::memory_order_acquire);
+        bool any = false;
+        size_t n;
+        while ((n = queue_.pop(batch, OUTPUT_BATCH)) > 0) {
+            for (size_t i = 0; i < n; i++) {
+                append(batch[i]);
+            }
+            any = true;
+        }
+        if (stopped) {
+            break;
+        }
+        if (any) {
+            continue;
+        }
+
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        uint64_t deadline = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec +
+                            (uint64_t)config_.flushIntervalMs * 1000000ull;
+        ts.tv_sec = (time_t)(deadline / 1000000000ull);
+        ts.tv_nsec = (long)(deadline % 1000000000ull);
+        int ret;
+        while (((ret = sem_clockwait(&sem_, CLOCK_MONOTONIC, &ts)) != 0) && (errno == EINTR)) {
+        }
+        if ((ret != 0) && (used_ > 0)) {
+            /* Idle: an O_DIRECT file keeps its unaligned tail until close */
+            write(!direct_.load(std::memory_order_relaxed));
+        }
+    }
+    close();
+}
+
+/**
+ * @brief Format a record into the buffer, rotating the file first if the
+ *        record would take it past maxFileBytes
+ *
+ * @param  r  record
+ * @return None
+ */
+void OutputSink::append(const OutputRecord& r)
+{
+    char line[OUTPUT_MAX_LINE];
+    const uint8_t* src = (const uint8_t*)&r;
+    size_t len = sizeof(r);
+
+    if (config_.format == Format::CSV) {
+        char* p = line;
+        const char* name = OutputSink_TypeNames[(int)r.type];
+        size_t nameLen = strlen(name);
+        memcpy(p, name, nameLen);
+        p += nameLen;
+        *p++ = ',';
+        p = OutputSink_Decimal(p, r.offset);
+        *p++ = ',';
+        p = OutputSink_Decimal(p, r.timeNs);
+        *p++ = ',';
+        p = OutputSink_Decimal(p, r.length);
+        *p++ = ',';
+        p = OutputSink_Decimal(p, r.value);
+        *p++ = '\n';
+        src = (const uint8_t*)line;
+        len = (size_t)(p - line);
+    }
+
+    /* A file holds at least one record, records are never split */
+    uint64_t header = (config_.format == Format::CSV) ? sizeof(OutputSink_CsvHeader) - 1 : 0;
+    if ((config_.maxFileBytes > 0) && (fileBytes_ + len > config_.maxFileBytes) &&
+        (fileBytes_ > header)) {
+        close();
+        open();
+    }
+    memcpy(&buffer_[used_], src, len);
+    used_ += len;
+    fileBytes_ += len;
+    written_.fetch_add(1, std::memory_order_relaxed);
+    if (used_ >= config_.writeBytes) {
+        write(false);
+    }
+}
+
+/**
+ * @brief Write the buffer to the file, the OUTPUT_ALIGN multiple part or
+ *        all of it; the rest moves to the front of the buffer
+ *
+ * @param  all  also write the unaligned tail
+ * @return None
+ */
+void OutputSink::write(bool all)
+{
+    size_t n = all ? used_ : used_ / OUTPUT_ALIGN * OUTPUT_ALIGN;
+    if (n == 0) {
+        return;
+    }
+    if (fd_ >= 0) {
+        size_t done = 0;
+        while (done < n) {
+            ssize_t ret = ::write(fd_, &buffer_[done], n - done);
+            if (ret < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                errors_.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+            done += (size_t)ret;
+        }
+        writes_.fetch_add(1, std::memory_order_relaxed);
+        bytes_.fetch_add(done, std::memory_order_relaxed);
+    }
+    memmove(buffer_, &buffer_[n], used_ - n);
+    used_ -= n;
+}
+
+/**
+ * @brief Open the next file, with O_DIRECT if configured and supported
+ *
+ * @param  None
+ * @return true/false opened or not, the records of a failed file are lost
+ */
+bool OutputSink::open()
+{
+    std::string name = getFileName(fileIndex_);
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+    fd_ = -1;
+    if (config_.direct) {
+        fd_ = ::open(name.c_str(), flags | O_DIRECT, 0644);
+    }
+    direct_.store(fd_ >= 0, std::memory_order_relaxed);
+    if (fd_ < 0) {
+        /* e.g. tmpfs has no O_DIRECT */
+        fd_ = ::open(name.c_str(), flags, 0644);
+    }
+    fileBytes_ = 0;
+    if (fd_ < 0) {
+        errors_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    files_.fetch_add(1, std::memory_order_relaxed);
+    if (config_.format == Format::CSV) {
+        memcpy(&buffer_[used_], OutputSink_CsvHeader, sizeof(OutputSink_CsvHeader) - 1);
+        used_ += sizeof(OutputSink_CsvHeader) - 1;
+        fileBytes_ = sizeof(OutputSink_CsvHeader) - 1;
+    }
+    return true;
+}
+
+/**
+ * @brief Write the rest of the buffer and close the current file
+ *
+ * @param  None
+ * @return None
+ */
+void OutputSink::close()
+{
+    if (fd_ >= 0) {
+        if (direct_.load(std::memory_order_relaxed)) {
+            /* The tail is not a multiple of the alignment */
+            write(false);
+            fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) & ~O_DIRECT);
+        }
+        write(true);
+        ::close(fd_);
+        fd_ = -1;
+    }
+    used_ = 0;
+    fileIndex_++;
+}
+
+/**
+ * @brief Coarse monotonic time, cheap enough for every record
+ *
+ * @param  None
+ * @return ns
+ */
+static uint64_t OutputSink_Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Append the decimal digits of a value
+ *
+ * @param  p      output position
+ * @param  value  value
+ * @return position after the digits
+ */
+static char* OutputSink_Decimal(char* p, uint64_t value)
+{
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    while (n > 0) {
+        *p++ = digits[--n];
+    }
+    return p;
+}
@@ -0,0 +1,131 @@
+/**
+ * @file  OutputSink.h
+ * @brief Match and frame records written to rotating files by a writer thread
+ * @note
+ *
+ */
+#ifndef __OUTPUT_SINK_H__
+#define __OUTPUT_SINK_H__
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <semaphore.h>
+#include "SpscQueue.h"
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*
+ * Alignment and size granule of the file writes, enough for O_DIRECT
+ */
+#define OUTPUT_ALIGN (4096)
+
+/*
+ * Records collected on the parse thread before they are pushed to the queue
+ */
+#define OUTPUT_STAGE (64)
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+enum class OutputType : uint8_t { MATCH, FRAME_VALID, FRAME_INVALID };
+
+/*
+ * Binary file format: the records back to back, host byte order
+ */
+struct OutputRecord {
+    uint64_t offset;    /**< Stream offset of the last header or trailer byte */
+    uint64_t timeNs;    /**< CLOCK_MONOTONIC_COARSE when emitted */
+    uint32_t value;     /**< MATCH: count, FRAME: received trailer */
+    uint16_t length;    /**< MATCH: 2, FRAME: payload length */
+    OutputType type;    /**< Record type */
+    uint8_t reserved;
+};
+
+struct OutputConfig {
+    enum class Format { BINARY, CSV }; /**< File format */
+
+    std::string path = "records";     /**< Files are <path>.<n>.bin or <path>.<n>.csv */
+    Format format = Format::BINARY;
+    size_t queueRecords = 64 * 1024;  /**< Queue slots, a power of two */
+    size_t writeBytes = 1024 * 1024;  /**< Coalesce until this much, a multiple of OUTPUT_ALIGN */
+    uint64_t maxFileBytes = 256ull * 1024 * 1024; /**< Rotate at this size, 0 never */
+    uint32_t flushIntervalMs = 100;   /**< Write a partial buffer after this long idle */
+    bool direct = false;              /**< O_DIRECT, plain writes where unsupported */
+};
+
+struct OutputStats {
+    uint64_t queued = 0;      /**< Records pushed to the queue */
+    uint64_t dropped = 0;     /**< Records lost to a full queue */
+    uint64_t written = 0;     /**< Records in the files */
+    uint64_t bytes = 0;       /**< Bytes in the files */
+    uint64_t writes = 0;      /**< write() calls */
+    uint64_t errors = 0;      /**< Failed writes or opens, their records are lost */
+    uint64_t files = 0;       /**< Files opened */
+    bool direct = false;      /**< The current file uses O_DIRECT */
+};
+
+/*
+ * emit*() and flush() belong to one parse thread and never block: when
+ * the queue is full the records are counted as dropped, so a slow disk
+ * never holds up the ring buffer.
+ */
+class OutputSink {
+    public:
+        typedef OutputConfig::Format Format;
+
+        OutputSink(const OutputConfig& config);
+        ~OutputSink();
+        bool start();                 /**< Open the first file and start the writer */
+        void stop();                  /**< Write all queued records and close */
+        void emitMatch(uint64_t offset, uint64_t count); /**< Header at offset, parse thread */
+        void emitFrame(uint64_t offset, uint16_t length, uint32_t trailer, bool valid); /**< Frame end */
+        void flush();                 /**< Hand the staged records to the writer, parse thread */
+        OutputStats getStats();       /**< Counters, thread safe */
+        std::string getFileName(uint64_t index); /**< Name of the index-th file */
+    private:
+        void emit(OutputType type, uint64_t offset, uint16_t length, uint32_t value); /**< Stage a record */
+        void run();                   /**< Writer thread */
+        void append(const OutputRecord& r); /**< Format a record into the buffer */
+        void write(bool all);         /**< Write the aligned part, or everything */
+        bool open();                  /**< Open the next file */
+        void close();                 /**< Write the rest and close the file */
+
+        OutputConfig config_;         /**< Configuration */
+        SpscQueue<OutputRecord> queue_; /**< Parse thread to writer */
+        OutputRecord stage_[OUTPUT_STAGE]; /**< Records not pushed yet */
+        size_t staged_;               /**< Records in stage_ */
+        uint8_t* buffer_;             /**< Aligned write buffer */
+        size_t capacity_;             /**< Size of buffer_ */
+        size_t used_;                 /**< Bytes in buffer_ */
+        size_t pendingRecords_;       /**< Records in buffer_ */
+        int fd_;                      /**< Current file, -1 none */
+        uint64_t fileIndex_;          /**< Index of the current file */
+        uint64_t fileBytes_;          /**< Bytes of the current file, written or buffered */
+        std::atomic<uint64_t> queued_;
+        std::atomic<uint64_t> dropped_;
+        std::atomic<uint64_t> written_;
+        std::atomic<uint64_t> bytes_;
+        std::atomic<uint64_t> writes_;
+        std::atomic<uint64_t> errors_;
+        std::atomic<uint64_t> files_;
+        std::atomic<bool> direct_;    /**< Current file uses O_DIRECT */
+        std::atomic<bool> signaled_;  /**< A wakeup is pending on sem_ */
+        std::atomic<bool> isStopped_; /**< Stop request */
+        std::thread thread_;          /**< Writer thread */
+        sem_t sem_;                   /**< Wakes the writer */
+};
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+#endif /* __OUTPUT_SINK_H__ */
@@ -0,0 +1,341 @@
+/**
+ * @file  ParseEvents.cpp
+ * @brief Awaitable parse progress events for C++20 coroutines
+ * @note  The parse loop only stores the progress and posts the executor,
+ *        consumers are resumed on the executor thread. Waiters are kept in
+ *        min-heaps by target, so a wakeup only touches the waiters that are
+ *        ready and any number of suspended consumers costs no thread.
+ *
+ */
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include "ParseEvents.h"
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+/**
+ * @brief Initialize the progress counters
+ *
+ * @param  None
+ * @return None
+ */
+ParseEvents::ParseEvents()
+{
+    count_ = 0;
+    buffers_ = 0;
+    signaled_ = false;
+    isStopped_ = false;
+    waiting_ = 0;
+    sem_init(&sem_, 0, 0);
+}
+
+/**
+ * @brief Stop the executor
+ *
+ * @param  None
+ * @return None
+ */
+ParseEvents::~ParseEvents()
+{
+    stop();
+    sem_destroy(&sem_);
+}
+
+/**
+ * @brief Accept consumers, the executor thread is started by the first
+ *        consumer that has to suspend, so a loop nobody awaits costs none
+ *
+ * @param  None
+ * @return None
+ */
+void ParseEvents::start()
+{
+    isStopped_.store(false, std::memory_order_release);
+}
+
+/**
+ * @brief Stop the executor, waiters still pending are resumed so that no
+ *        coroutine frame is leaked, they can check isStopped()
+ *
+ * @param  None
+ * @return None
+ */
+void ParseEvents::stop()
+{
+#if defined(SEQPARSER_EMBEDDED)
+    /* No consumer can suspend, so there is no executor and no waiter */
+    isStopped_.store(true, std::memory_order_release);
+#else
+    std::thread thread;
+    {
+        /* No executor is started by enqueue() after this */
+        std::lock_guard<std::mutex> lock(mutex_);
+        isStopped_.store(true, std::memory_order_release);
+        thread = std::move(thread_);
+    }
+    if (thread.joinable()) {
+        sem_post(&sem_);
+        thread.join();
+    }
+    resumeReady(true);
+#endif
+}
+
+/**
+ * @brief Publish the progress, called from the parse loop after a buffer
+ *
+ * Consecutive publishes before the executor runs are coalesced into a
+ * single wakeup.
+ *
+ * @param  count    match count
+ * @param  buffers  number of buffers processed
+ * @return None
+ */
+void ParseEvents::publish(uint64_t count, uint64_t buffers)
+{
+    /* Sequentially consistent against enqueue(), which counts then checks */
+    count_.store(count);
+    buffers_.store(buffers);
+    if ((waiting_.load() > 0) &&
+        !signaled_.exchange(true, std::memory_order_acq_rel)) {
+        sem_post(&sem_);
+    }
+}
+
+/**
+ * @brief Get the match count, safe from any thread
+ *
+ * @param  None
+ * @return count at the last publish
+ */
+uint64_t ParseEvents::getCount()
+{
+    return count_.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Get the number of buffers processed, safe from any thread
+ *
+ * @param  None
+ * @return buffers at the last publish
+ */
+uint64_t ParseEvents::getBuffers()
+{
+    return buffers_.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Check if the executor was stopped
+ *
+ * @param  None
+ * @return true/false stopped or not
+ */
+bool ParseEvents::isStopped()
+{
+    return isStopped_.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Get the number of suspended consumers
+ *
+ * @param  None
+ * @return number of waiters
+ */
+size_t ParseEvents::getWaiting()
+{
+    return waiting_.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Check if a consumer suspended and started the executor thread
+ *
+ * @param  None
+ * @return true/false running or not
+ */
+bool ParseEvents::isRunning()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return thread_.joinable();
+}
+
+/**
+ * @brief Register a suspended consumer
+ *
+ * @param  onBuffers  wait on the buffer count instead of the match count
+ * @param  target     value to reach
+ * @param  handle     coroutine handle address
+ * @return true/false suspended or not, false when the target was reached
+ *         in the meantime
+ */
+bool ParseEvents::enqueue(bool onBuffers, uint64_t target, void* handle)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    /* Counted before the re-check, so a publish after it posts a wakeup */
+    waiting_.fetch_add(1);
+    uint64_t current = onBuffers ? buffers_.load() : count_.load();
+    if ((current >= target) || isStopped()) {
+        waiting_.fetch_sub(1, std::memory_order_acq_rel);
+        return false;
+    }
+    if (!thread_.joinable()) {
+        thread_ = std::thread(&ParseEvents::run, this);
+    }
+    Waiter waiter = { target, handle };
+    if (onBuffers) {
+        bufferWaiters_.push(waiter);
+    } else {
+        countWaiters_.push(waiter);
+    }
+    return true;
+}
+
+/**
+ * @brief Resume the waiters whose target is reached
+ *
+ * @param  all  resume every waiter regardless of the target
+ * @return None
+ */
+void ParseEvents::resumeReady(bool all)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t count = getCount();
+        uint64_t buffers = getBuffers();
+
+        while (!countWaiters_.empty() && (all || (countWaiters_.top().target <= count))) {
+            ready_.push_back(countWaiters_.top().handle);
+            countWaiters_.pop();
+        }
+        while (!bufferWaiters_.empty() && (all || (bufferWaiters_.top().target <= buffers))) {
+            ready_.push_back(bufferWaiters_.top().handle);
+            bufferWaiters_.pop();
+        }
+        waiting_.fetch_sub(ready_.size(), std::memory_order_acq_rel);
+    }
+
+    /* Resume outside the lock, consumers may wait again */
+#if defined(__cpp_impl_coroutine)
+    for (void* handle : ready_) {
+        std::coroutine_handle<>::from_address(handle).resume();
+    }
+#endif
+    ready_.clear();
+}
+
+/**
+ * @brief Executor loop, resumes consumers on progress until stopped
+ *
+ * @param  None
+ * @return None
+ */
+void ParseEvents::run()
+{
+    while (true) {
+        sem_wait(&sem_);
+        if (isStopped()) {
+            break;
+        }
+        signaled_.exchange(false, std::memory_order_acq_rel);
+        resumeReady(false);
+    }
+}
+
+#if defined(PARSE_EVENTS_AWAIT)
+/**
+ * @brief Awaitable that resumes after n more matches
+ *
+ * @param  n  number of matches to wait for
+ * @return awaitable
+ */
+ParseEvents::Awaiter ParseEvents::nextMatches(uint64_t n)
+{
+    return Awaiter(this, false, getCount() + n);
+}
+
+/**
+ * @brief Awaitable that resumes once the match count changes
+ *
+ * @param  None
+ * @return awaitable
+ */
+ParseEvents::Awaiter ParseEvents::countChanged()
+{
+    return nextMatches(1);
+}
+
+/**
+ * @brief Awaitable that resumes once the next buffer is processed
+ *
+ * @param  None
+ * @return awaitable
+ */
+ParseEvents::Awaiter ParseEvents::bufferProcessed()
+{
+    return Awaiter(this, true, getBuffers() + 1);
+}
+
+/**
+ * @brief Initialize an awaitable on a target value
+ *
+ * @param  events     event source
+ * @param  onBuffers  wait on the buffer count instead of the match count
+ * @param  target     value to reach
+ * @return None
+ */
+ParseEvents::Awaiter::Awaiter(ParseEvents* events, bool onBuffers, uint64_t target)
+{
+    events_ = events;
+    onBuffers_ = onBuffers;
+    target_ = target;
+}
+
+/**
+ * @brief Skip the suspension when the target is already reached
+ *
+ * @param  None
+ * @return true/false target reached or not
+ */
+bool ParseEvents::Awaiter::await_ready()
+{
+    uint64_t current = onBuffers_ ? events_->getBuffers() : events_->getCount();
+    return current >= target_;
+}
+
+/**
+ * @brief Queue the consumer on the executor
+ *
+ * @param  handle  suspended coroutine
+ * @return true/false stay suspended or resume right away
+ */
+bool ParseEvents::Awaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    return events_->enqueue(onBuffers_, target_, handle.address());
+}
+
+/**
+ * @brief Value of the co_await expression
+ *
+ * @param  None
+ * @return match count when resumed
+ */
+uint64_t ParseEvents::Awaiter::await_resume()
+{
+    return events_->getCount();
+}
+#endif
@@ -0,0 +1,121 @@
+/**
+ * @file  ParseEvents.h
+ * @brief Awaitable parse progress events for C++20 coroutines
+ * @note  The coroutine part needs -std=c++20 and is left out of the
+ *        embedded profile, the progress counters are available in any build
+ *
+ */
+#ifndef __PARSE_EVENTS_H__
+#define __PARSE_EVENTS_H__
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <queue>
+#include <vector>
+#include <semaphore.h>
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#endif
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*
+ * Consumers can co_await the events. The embedded profile leaves it out:
+ * a suspended consumer starts the executor thread and is queued on the
+ * heap under a lock, publishing stays a few stores and a sem_post.
+ */
+#if defined(__cpp_impl_coroutine) && !defined(SEQPARSER_EMBEDDED)
+#define PARSE_EVENTS_AWAIT
+#endif
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+class ParseEvents {
+    public:
+        ParseEvents();
+        ~ParseEvents();
+        void start();                /**< Accept consumers, executor starts on demand */
+        void stop();                 /**< Stop the executor, pending waiters resume */
+        void publish(uint64_t count, uint64_t buffers); /**< Progress from the parse loop */
+        uint64_t getCount();         /**< Count at the last publish */
+        uint64_t getBuffers();       /**< Buffers processed at the last publish */
+        bool isStopped();            /**< Executor was stopped */
+        size_t getWaiting();         /**< Number of suspended consumers */
+        bool isRunning();            /**< Executor thread was started */
+#if defined(PARSE_EVENTS_AWAIT)
+        class Awaiter;
+        Awaiter nextMatches(uint64_t n); /**< Resume after n more matches */
+        Awaiter countChanged();          /**< Resume after the next match */
+        Awaiter bufferProcessed();       /**< Resume after the next buffer */
+
+        /*
+         * Awaitable returned by the functions above, co_await gives the
+         * count when resumed
+         */
+        class Awaiter {
+            public:
+                Awaiter(ParseEvents* events, bool onBuffers, uint64_t target);
+                bool await_ready();
+                bool await_suspend(std::coroutine_handle<> handle);
+                uint64_t await_resume();
+            private:
+                ParseEvents* events_;  /**< Event source */
+                bool onBuffers_;       /**< Wait on buffers instead of count */
+                uint64_t target_;      /**< Value to reach */
+        };
+#endif
+    private:
+        struct Waiter {
+            uint64_t target;           /**< Value to reach */
+            void* handle;              /**< Coroutine handle address */
+            bool operator>(const Waiter& other) const { return target > other.target; }
+        };
+        typedef std::priority_queue<Waiter, std::vector<Waiter>, std::greater<Waiter>> WaitQueue;
+
+        void run();                    /**< Executor loop */
+        bool enqueue(bool onBuffers, uint64_t target, void* handle); /**< Register a waiter */
+        void resumeReady(bool all);    /**< Resume waiters whose target is reached */
+
+        std::atomic<uint64_t> count_;   /**< Published match count */
+        std::atomic<uint64_t> buffers_; /**< Published buffer count */
+        std::atomic<bool> signaled_;    /**< Executor wakeup is pending */
+        std::atomic<bool> isStopped_;   /**< Executor stop request */
+        std::atomic<size_t> waiting_;   /**< Number of queued waiters */
+        std::mutex mutex_;              /**< Protects the wait queues */
+        WaitQueue countWaiters_;        /**< Waiters on the match count */
+        WaitQueue bufferWaiters_;       /**< Waiters on the buffer count */
+        std::vector<void*> ready_;      /**< Handles to resume, executor only */
+        std::thread thread_;            /**< Executor thread */
+        sem_t sem_;                     /**< Wakes the executor on progress */
+};
+
+#if defined(PARSE_EVENTS_AWAIT)
+/*
+ * Fire and forget coroutine for consumers of the events, the frame is
+ * released when the coroutine finishes
+ */
+struct ParseTask {
+    struct promise_type {
+        ParseTask get_return_object() { return ParseTask(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+#endif
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+#endif /* __PARSE_EVENTS_H__ */
@@ -0,0 +1,721 @@
+/**
+ * @file  PatternDfa.cpp
+ * @brief Header pattern language compiled to a minimized DFA
+ * @note  The pattern is expanded into a Thompson NFA, the alphabet is
+ *        split into the classes of bytes no element can tell apart, the
+ *        unanchored DFA is built by subset construction over those classes
+ *        and minimized by partition refinement. Scanning costs one class
+ *        lookup and one table lookup per byte whatever the pattern, and
+ *        bytes that keep the DFA in its start state are skipped with SIMD.
+ *
+ */
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include "PatternDfa.h"
+#include <cstring>
+#include <chrono>
+#include <map>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*
+ * Repeat count of x+ and x{m,}
+ */
+#define PATTERN_UNBOUNDED (UINT32_MAX)
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*
+ * NFA state: at most one byte transition plus epsilon transitions
+ */
+struct PatternNfaState {
+    int element;             /**< Element whose bytes move to target, -1 none */
+    int target;              /**< State after the byte */
+    std::vector<int> eps;    /**< Epsilon transitions */
+};
+
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+static int PatternDfa_Hex(const char* p);
+static bool PatternDfa_Number(const char* p, size_t& i, unsigned& value);
+static inline bool PatternDfa_Has(const uint64_t* set, unsigned b);
+#if defined(__SSE2__)
+static inline unsigned PatternDfa_ExitMask(const __m128i* lo, const __m128i* width,
+                                           const uint8_t* p);
+#endif
+
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+/**
+ * @brief Empty DFA, counts nothing until a pattern is compiled
+ *
+ * @param  None
+ * @return None
+ */
+PatternDfa::PatternDfa()
+{
+    memset(classes_, 0, sizeof(classes_));
+    numClasses_ = 1;
+    table_.assign(1, 0);
+    start_ = 0;
+    accept_ = 1;
+    exitCount_ = 0;
+    state_ = 0;
+    count_ = 0;
+    errorPos_ = 0;
+}
+
+/**
+ * @brief Compile a pattern, the previous DFA is kept if it fails
+ *
+ * @param  pattern  pattern text
+ * @return true/false compiled or not, see getError()
+ */
+bool PatternDfa::compile(const char* pattern)
+{
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<Element> elements;
+
+    if (!parse(pattern, elements)) {
+        return false;
+    }
+
+    /* Expand the repeats into a Thompson NFA, state 0 is the start */
+    std::vector<PatternNfaState> nfa;
+    auto add = [&nfa]() {
+        nfa.push_back({ -1, -1, {} });
+        return (int)nfa.size() - 1;
+    };
+    int cur = add();
+    for (size_t k = 0; k < elements.size(); k++) {
+        const Element& e = elements[k];
+        int copy = cur;
+        for (unsigned r = 0; r < e.min; r++) {
+            copy = cur;
+            int next = add();
+            nfa[copy].element = (int)k;
+            nfa[copy].target = next;
+            cur = next;
+        }
+        if (e.max == PATTERN_UNBOUNDED) {
+            if (e.min > 0) {
+                nfa[cur].eps.push_back(copy);
+            } else {
+                int next = add();
+                nfa[cur].element = (int)k;
+                nfa[cur].target = cur;
+                nfa[cur].eps.push_back(next);
+                cur = next;
+            }
+        } else {
+            std::vector<int> optional;
+            for (unsigned r = e.min; r < e.max; r++) {
+                optional.push_back(cur);
+                int next = add();
+                nfa[cur].element = (int)k;
+                nfa[cur].target = next;
+                cur = next;
+            }
+            for (int s : optional) {
+                nfa[s].eps.push_back(cur);
+            }
+        }
+        if (nfa.size() > PATTERN_MAX_NFA_STATES) {
+            return fail("pattern too long once repeats are expanded", 0);
+        }
+    }
+    const int last = cur;
+    const size_t n = nfa.size();
+    const size_t words = (n + 63) / 64;
+
+    /* Epsilon closure of every NFA state as a bit set */
+    std::vector<std::vector<uint64_t>> closure(n, std::vector<uint64_t>(words, 0));
+    for (size_t s = 0; s < n; s++) {
+        std::vector<int> stack(1, (int)s);
+        closure[s][s / 64] |= 1ull << (s % 64);
+        while (!stack.empty()) {
+            int t = stack.back();
+            stack.pop_back();
+            for (int u : nfa[t].eps) {
+                if (!(closure[s][u / 64] & (1ull << (u % 64)))) {
+                    closure[s][u / 64] |= 1ull << (u % 64);
+                    stack.push_back(u);
+                }
+            }
+        }
+    }
+
+    /* Alphabet equivalence classes: split the bytes by every element */
+    uint8_t classes[256];
+    unsigned numClasses = 1;
+    memset(classes, 0, sizeof(classes));
+    for (const Element& e : elements) {
+        std::map<std::pair<unsigned, bool>, unsigned> split;
+        for (unsigned b = 0; b < 256; b++) {
+            auto key = std::make_pair((unsigned)classes[b], PatternDfa_Has(e.set, b));
+            auto it = split.find(key);
+            if (it == split.end()) {
+                it = split.emplace(key, (unsigned)split.size()).first;
+            }
+            classes[b] = (uint8_t)it->second;
+        }
+        numClasses = (unsigned)split.size();
+    }
+    std::vector<unsigned> rep(numClasses);
+    for (int b = 255; b >= 0; b--) {
+        rep[classes[b]] = (unsigned)b;
+    }
+
+    /* Subset construction, the start closure is added after every byte so
+     * a match can begin anywhere in the stream */
+    std::vector<std::vector<uint64_t>> dstates;
+    std::map<std::vector<uint64_t>, int> index;
+    std::vector<int> delta;
+    const std::vector<uint64_t>& startSet = closure[0];
+    dstates.push_back(startSet);
+    index.emplace(startSet, 0);
+    for (size_t d = 0; d < dstates.size(); d++) {
+        for (unsigned c = 0; c < numClasses; c++) {
+            std::vector<uint64_t> next = startSet;
+            for (size_t s = 0; s < n; s++) {
+                if ((dstates[d][s / 64] & (1ull << (s % 64))) && (nfa[s].element >= 0) &&
+                    PatternDfa_Has(elements[nfa[s].element].set, rep[c])) {
+                    const std::vector<uint64_t>& reach = closure[nfa[s].target];
+                    for (size_t w = 0; w < words; w++) {
+                        next[w] |= reach[w];
+                    }
+                }
+            }
+            auto it = index.find(next);
+            if (it == index.end()) {
+                if (dstates.size() >= PATTERN_MAX_DFA_STATES) {
+                    return fail("too many DFA states", 0);
+                }
+                it = index.emplace(next, (int)dstates.size()).first;
+                dstates.push_back(next);
+            }
+            delta.push_back(it->second);
+        }
+    }
+    const size_t m = dstates.size();
+    std::vector<bool> accepting(m);
+    for (size_t d = 0; d < m; d++) {
+        accepting[d] = (dstates[d][last / 64] & (1ull << (last % 64))) != 0;
+    }
+
+    /* Moore minimization: refine until the number of blocks is stable */
+    std::vector<int> block(m);
+    unsigned blocks = 0;
+    for (size_t d = 0; d < m; d++) {
+        block[d] = accepting[d] ? 1 : 0;
+    }
+    while (true) {
+        std::map<std::vector<int>, int> signature;
+        std::vector<int> refined(m);
+        for (size_t d = 0; d < m; d++) {
+            std::vector<int> key(1, block[d]);
+            for (unsigned c = 0; c < numClasses; c++) {
+                key.push_back(block[delta[d * numClasses + c]]);
+            }
+            auto it = signature.find(key);
+            if (it == signature.end()) {
+                it = signature.emplace(key, (int)signature.size()).first;
+            }
+            refined[d] = it->second;
+        }
+        block.swap(refined);
+        if (signature.size() == blocks) {
+            break;
+        }
+        blocks = (unsigned)signature.size();
+    }
+
+    /* Number the accepting states last so a match is a single compare */
+    std::vector<int> id(blocks, -1);
+    std::vector<int> member(blocks, -1);
+    unsigned next = 0;
+    unsigned firstAccept = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t d = 0; d < m; d++) {
+            if ((accepting[d] == (pass == 1)) && (id[block[d]] < 0)) {
+                id[block[d]] = (int)next++;
+                member[block[d]] = (int)d;
+            }
+        }
+        firstAccept = (pass == 0) ? next : firstAccept;
+    }
+    if ((size_t)blocks * numClasses > 65536) {
+        return fail("transition table too large", 0);
+    }
+
+    table_.assign((size_t)blocks * numClasses, 0);
+    for (unsigned b = 0; b < blocks; b++) {
+        int d = member[b];
+        for (unsigned c = 0; c < numClasses; c++) {
+            table_[(size_t)id[b] * numClasses + c] =
+                (uint16_t)(id[block[delta[d * numClasses + c]]] * numClasses);
+        }
+    }
+    memcpy(classes_, classes, sizeof(classes_));
+    numClasses_ = numClasses;
+    start_ = (uint16_t)(id[block[0]] * numClasses);
+    accept_ = (uint16_t)(firstAccept * numClasses);
+
+    /* Ranges of bytes leaving the start state, searched for when idle */
+    exitCount_ = 0;
+    for (unsigned b = 0; b < 256; b++) {
+        if (table_[start_ + classes_[b]] == start_) {
+            continue;
+        }
+        if ((exitCount_ > 0) && (exitHi_[exitCount_ - 1] + 1u == b)) {
+            exitHi_[exitCount_ - 1] = (uint8_t)b;
+        } else if (exitCount_ < PATTERN_MAX_EXITS) {
+            exitLo_[exitCount_] = (uint8_t)b;
+            exitHi_[exitCount_] = (uint8_t)b;
+            exitCount_++;
+        } else {
+            exitCount_ = 0;
+            break;
+        }
+    }
+    /* Search vectors for findExit(), unused ranges repeat the first one */
+    for (unsigned e = 0; e < PATTERN_MAX_EXITS; e++) {
+        unsigned k = (e < exitCount_) ? e : 0;
+        memset(exitLoVec_[e], exitLo_[k], sizeof(exitLoVec_[e]));
+        memset(exitWidthVec_[e], exitHi_[k] - exitLo_[k], sizeof(exitWidthVec_[e]));
+    }
+
+    stats_.nfaStates = (unsigned)n;
+    stats_.dfaStates = (unsigned)m;
+    stats_.states = blocks;
+    stats_.classes = numClasses;
+    stats_.tableBytes = table_.size() * sizeof(uint16_t) + sizeof(classes_);
+    stats_.compileNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - begin).count();
+    error_.clear();
+    errorPos_ = 0;
+    reset();
+    return true;
+}
+
+/**
+ * @brief Parse the pattern text into elements
+ *
+ * @param  pattern   pattern text
+ * @param  elements  parsed elements
+ * @return true/false valid or not
+ */
+bool PatternDfa::parse(const char* pattern, std::vector<Element>& elements)
+{
+    size_t i = 0;
+
+    while (true) {
+        while ((pattern[i] == ' ') || (pattern[i] == '\t')) {
+            i++;
+        }
+        if (pattern[i] == '\0') {
+            break;
+        }
+
+        Element e;
+        memset(e.set, 0, sizeof(e.set));
+        e.min = 1;
+        e.max = 1;
+        size_t at = i;
+        if ((pattern[i] == '?') && (pattern[i + 1] == '?')) {
+            memset(e.set, 0xFF, sizeof(e.set));
+            i += 2;
+        } else if (pattern[i] == '[') {
+            bool negate = false;
+            bool any = false;
+            i++;
+            if (pattern[i] == '^') {
+                negate = true;
+                i++;
+            }
+            while (true) {
+                while ((pattern[i] == ' ') || (pattern[i] == '\t') || (pattern[i] == ',')) {
+                    i++;
+                }
+                if (pattern[i] == ']') {
+                    i++;
+                    break;
+                }
+                if (pattern[i] == '\0') {
+                    return fail("unterminated byte class", at);
+                }
+                int lo = PatternDfa_Hex(&pattern[i]);
+                if (lo < 0) {
+                    return fail("expected a hex byte in the class", i);
+                }
+                i += 2;
+                int hi = lo;
+                if (pattern[i] == '-') {
+                    hi = PatternDfa_Hex(&pattern[i + 1]);
+                    if (hi < 0) {
+                        return fail("expected a hex byte after '-'", i + 1);
+                    }
+                    if (hi < lo) {
+                        return fail("reversed range", i - 2);
+                    }
+                    i += 3;
+                }
+                for (int b = lo; b <= hi; b++) {
+                    e.set[b / 64] |= 1ull << (b % 64);
+                }
+                any = true;
+            }
+            if (!any) {
+                return fail("empty byte class", at);
+            }
+            if (negate) {
+                for (auto& w : e.set) {
+                    w = ~w;
+                }
+                if ((e.set[0] | e.set[1] | e.set[2] | e.set[3]) == 0) {
+                    return fail("byte class matches no byte", at);
+                }
+            }
+        } else {
+            int b = PatternDfa_Hex(&pattern[i]);
+            if (b < 0) {
+                return fail("expected a hex byte, ?? or [", i);
+            }
+            e.set[b / 64] |= 1ull << (b % 64);
+            i += 2;
+        }
+
+        if (pattern[i] == '+') {
+            e.max = PATTERN_UNBOUNDED;
+            i++;
+        } else if (pattern[i] == '{') {
+            size_t brace = i;
+            i++;
+            if (!PatternDfa_Number(pattern, i, e.min)) {
+                return fail("expected a repeat count", i);
+            }
+            e.max = e.min;
+            if (pattern[i] == ',') {
+                i++;
+                if (pattern[i] == '}') {
+                    e.max = PATTERN_UNBOUNDED;
+                } else if (!PatternDfa_Number(pattern, i, e.max)) {
+                    return fail("expected a repeat count", i);
+                }
+            }
+            if (pattern[i] != '}') {
+                return fail("expected '}'", i);
+            }
+            i++;
+            if ((e.max < e.min) || (e.max == 0)) {
+                return fail("invalid repeat range", brace);
+            }
+            if ((e.min > PATTERN_MAX_REPEAT) ||
+                ((e.max != PATTERN_UNBOUNDED) && (e.max > PATTERN_MAX_REPEAT))) {
+                return fail("repeat count too large", brace);
+            }
+        }
+        elements.push_back(e);
+    }
+
+    if (elements.empty()) {
+        return fail("empty pattern", 0);
+    }
+    bool empty = true;
+    for (const Element& e : elements) {
+        empty = empty && (e.min == 0);
+    }
+    if (empty) {
+        return fail("pattern matches the empty string", 0);
+    }
+    return true;
+}
+
+/**
+ * @brief Record a compile error
+ *
+ * @param  error  message
+ * @param  pos    offset in the pattern
+ * @return false
+ */
+bool PatternDfa::fail(const char* error, size_t pos)
+{
+    error_ = error;
+    errorPos_ = pos;
+    return false;
+}
+
+/**
+ * @brief Count the matches ending in a block
+ *
+ * @param  data  bytes to scan
+ * @param  len   number of bytes
+ * @return None
+ */
+void PatternDfa::scan(const uint8_t* data, size_t len)
+{
+    const uint16_t* table = table_.data();
+    uint32_t row = state_;
+    uint64_t count = count_;
+    size_t i = 0;
+
+    if (exitCount_ == 0) {
+        /* Every byte can leave the start state, plain table walk */
+        for (; i < len; i++) {
+            row = table[row + classes_[data[i]]];
+            count += (row >= accept_);
+        }
+    }
+#if defined(__SSE2__)
+    __m128i lo[PATTERN_MAX_EXITS];
+    __m128i width[PATTERN_MAX_EXITS];
+    for (unsigned e = 0; e < PATTERN_MAX_EXITS; e++) {
+        lo[e] = _mm_load_si128((const __m128i*)exitLoVec_[e]);
+        width[e] = _mm_load_si128((const __m128i*)exitWidthVec_[e]);
+    }
+#endif
+    unsigned dense = 0;
+    while (i < len) {
+        if (row == start_) {
+            if (dense >= PATTERN_DENSE_EXITS) {
+                /* Searching costs more than it skips, walk the table */
+                size_t end = (len - i > PATTERN_DENSE_WALK) ? i + PATTERN_DENSE_WALK : len;
+                for (; i < end; i++) {
+                    row = table[row + classes_[data[i]]];
+                    count += (row >= accept_);
+                }
+                dense = 0;
+                continue;
+            }
+#if defined(__SSE2__)
+            /* The next vector inline, findExit() beyond it */
+            unsigned mask = (i + 16 <= len) ? PatternDfa_ExitMask(lo, width, &data[i]) : 0;
+            size_t skip = (mask != 0) ? (size_t)__builtin_ctz(mask) : findExit(&data[i], len - i);
+#else
+            size_t skip = findExit(&data[i], len - i);
+#endif
+            dense = (skip < PATTERN_DENSE_SKIP) ? dense + 1 : 0;
+            i += skip;
+            if (i >= len) {
+                break;
+            }
+        }
+        row = table[row + classes_[data[i]]];
+        count += (row >= accept_);
+        i++;
+    }
+    state_ = (uint16_t)row;
+    count_ = count;
+}
+
+/**
+ * @brief Find the first byte that leaves the start state
+ *
+ * @param  data  bytes to search
+ * @param  len   number of bytes
+ * @return index of the first exit byte, len if there is none
+ */
+size_t PatternDfa::findExit(const uint8_t* data, size_t len)
+{
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    /* Unsigned range test: (v - lo) == min(v - lo, hi - lo), the vectors
+     * are built by compile() */
+    __m128i lo[PATTERN_MAX_EXITS];
+    __m128i width[PATTERN_MAX_EXITS];
+    for (unsigned e = 0; e < PATTERN_MAX_EXITS; e++) {
+        lo[e] = _mm_load_si128((const __m128i*)exitLoVec_[e]);
+        width[e] = _mm_load_si128((const __m128i*)exitWidthVec_[e]);
+    }
+    for (; i + 16 <= len; i += 16) {
+        unsigned mask = PatternDfa_ExitMask(lo, width, &data[i]);
+        if (mask != 0) {
+            return i + (size_t)__builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; i < len; i++) {
+        if (table_[start_ + classes_[data[i]]] != start_) {
+            return i;
+        }
+    }
+    return len;
+}
+
+/**
+ * @brief Back to the start state with a zero count
+ *
+ * @param  None
+ * @return None
+ */
+void PatternDfa::reset()
+{
+    state_ = start_;
+    count_ = 0;
+}
+
+/**
+ * @brief Continue from another DFA, e.g. the previous version of a pattern
+ *
+ * The count always carries over. The state only does if both compiled to
+ * the same table, otherwise the scan restarts from the start state and a
+ * match in progress is lost.
+ *
+ * @param  old  DFA to continue from
+ * @return true/false the state carried over or not
+ */
+bool PatternDfa::carryOver(const PatternDfa& old)
+{
+    count_ = old.count_;
+    if ((table_ != old.table_) || (start_ != old.start_) ||
+        (memcmp(classes_, old.classes_, sizeof(classes_)) != 0)) {
+        state_ = start_;
+        return false;
+    }
+    state_ = old.state_;
+    return true;
+}
+
+/**
+ * @brief Get the number of matches
+ *
+ * @param  None
+ * @return count
+ */
+uint64_t PatternDfa::getCount()
+{
+    return count_;
+}
+
+/**
+ * @brief Get the size and compile time of the current DFA
+ *
+ * @param  None
+ * @return stats
+ */
+const PatternStats& PatternDfa::getStats()
+{
+    return stats_;
+}
+
+/**
+ * @brief Get the last compile error
+ *
+ * @param  None
+ * @return message, empty after a successful compile
+ */
+const char* PatternDfa::getError()
+{
+    return error_.c_str();
+}
+
+/**
+ * @brief Get the pattern offset of the last compile error
+ *
+ * @param  None
+ * @return offset
+ */
+size_t PatternDfa::getErrorPos()
+{
+    return errorPos_;
+}
+
+/**
+ * @brief Two hex digits
+ *
+ * @param  p  text
+ * @return byte value, -1 if not two hex digits
+ */
+static int PatternDfa_Hex(const char* p)
+{
+    int value = 0;
+    for (int k = 0; k < 2; k++) {
+        char c = p[k];
+        int d;
+        if ((c >= '0') && (c <= '9')) {
+            d = c - '0';
+        } else if ((c >= 'a') && (c <= 'f')) {
+            d = c - 'a' + 10;
+        } else if ((c >= 'A') && (c <= 'F')) {
+            d = c - 'A' + 10;
+        } else {
+            return -1;
+        }
+        value = value * 16 + d;
+    }
+    return value;
+}
+
+/**
+ * @brief Decimal repeat count
+ *
+ * @param  p      text
+ * @param  i      offset, advanced past the digits
+ * @param  value  parsed number
+ * @return true/false number found or not
+ */
+static bool PatternDfa_Number(const char* p, size_t& i, unsigned& value)
+{
+    size_t at = i;
+    value = 0;
+    while ((p[i] >= '0') && (p[i] <= '9')) {
+        /* Saturate, the caller rejects anything above the limit */
+        if (value <= PATTERN_MAX_REPEAT) {
+            value = value * 10 + (unsigned)(p[i] - '0');
+        }
+        i++;
+    }
+    return i > at;
+}
+
+/**
+ * @brief Byte membership of an element set
+ *
+ * @param  set  256 bit set
+ * @param  b    byte
+ * @return true/false member or not
+ */
+static inline bool PatternDfa_Has(const uint64_t* set, unsigned b)
+{
+    return (set[b / 64] >> (b % 64)) & 1;
+}
+
+#if defined(__SSE2__)
+/**
+ * @brief Bytes of a vector that leave the start state
+ *
+ * Unsigned range test: (v - lo) == min(v - lo, hi - lo)
+ *
+ * @param  lo     low byte of each exit range
+ * @param  width  hi - lo of each exit range
+ * @param  p      16 bytes to test
+ * @return one bit per exit byte
+ */
+static inline unsigned PatternDfa_ExitMask(const __m128i* lo, const __m128i* width,
+                                           const uint8_t* p)
+{
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    __m128i d0 = _mm_sub_epi8(v, lo[0]);
+    __m128i d1 = _mm_sub_epi8(v, lo[1]);
+    __m128i d2 = _mm_sub_epi8(v, lo[2]);
+    __m128i d3 = _mm_sub_epi8(v, lo[3]);
+    __m128i hit = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(d0, width[0]), d0),
+                     _mm_cmpeq_epi8(_mm_min_epu8(d1, width[1]), d1)),
+        _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(d2, width[2]), d2),
+                     _mm_cmpeq_epi8(_mm_min_epu8(d3, width[3]), d3)));
+    return (unsigned)_mm_movemask_epi8(hit);
+}
+#endif
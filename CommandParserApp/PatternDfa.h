@@ -0,0 +1,109 @@
+/**
+ * @file  PatternDfa.h
+ * @brief Header pattern language compiled to a minimized DFA
+ * @note  Patterns are whitespace separated elements, each optionally
+ *        followed by a repeat:
+ *          A5          one byte, two hex digits
+ *          ??          any byte
+ *          [00-0F 20]  byte class of ranges and bytes, [^...] negated
+ *          x+  x{m}  x{m,}  x{m,n}   repeats
+ *        e.g. "A5+ 5A" (the CmdSeqParser header), "A5 ?? 5A",
+ *        "A5 [00-0F] 5A", "A5 ??{1,4} 5A". Every stream position where a
+ *        match ends is counted once, overlapping matches included.
+ *
+ */
+#ifndef __PATTERN_DFA_H__
+#define __PATTERN_DFA_H__
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*
+ * Compile limits: expanded pattern length, DFA states during subset
+ * construction, largest bounded repeat
+ */
+#define PATTERN_MAX_NFA_STATES (1024)
+#define PATTERN_MAX_DFA_STATES (4096)
+#define PATTERN_MAX_REPEAT     (255)
+
+/*
+ * Most byte ranges leaving the start state that are searched with SIMD
+ */
+#define PATTERN_MAX_EXITS (4)
+
+/*
+ * Searches in a row that skip fewer than PATTERN_DENSE_SKIP bytes before
+ * the scan stops searching and walks the table for PATTERN_DENSE_WALK
+ */
+#define PATTERN_DENSE_SKIP  (4)
+#define PATTERN_DENSE_EXITS (4)
+#define PATTERN_DENSE_WALK  (1024)
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*
+ * Result of a compile
+ */
+struct PatternStats {
+    unsigned nfaStates = 0;  /**< States of the expanded pattern */
+    unsigned dfaStates = 0;  /**< States after subset construction */
+    unsigned states = 0;     /**< States after minimization */
+    unsigned classes = 0;    /**< Alphabet equivalence classes */
+    size_t tableBytes = 0;   /**< Transition table plus class map */
+    uint64_t compileNs = 0;  /**< Parse, construction and minimization */
+};
+
+class PatternDfa {
+    public:
+        PatternDfa();
+        bool compile(const char* pattern);  /**< Replace the pattern, resets the count */
+        const char* getError();             /**< Why the last compile failed */
+        size_t getErrorPos();               /**< Pattern offset of the error */
+        void scan(const uint8_t* data, size_t len); /**< Process a block of the stream */
+        void reset();                       /**< Back to the start state, count 0 */
+        bool carryOver(const PatternDfa& old); /**< Take the count, and the state if the DFA is the same */
+        uint64_t getCount();                /**< Matches so far */
+        const PatternStats& getStats();     /**< Size and compile time of the DFA */
+    private:
+        struct Element {
+            uint64_t set[4];                /**< Bytes accepted */
+            unsigned min;                   /**< Least repeats */
+            unsigned max;                   /**< Most repeats, UINT32_MAX unbounded */
+        };
+        bool parse(const char* pattern, std::vector<Element>& elements); /**< Text to elements */
+        bool fail(const char* error, size_t pos); /**< Record a compile error */
+        size_t findExit(const uint8_t* data, size_t len); /**< Skip bytes looping on start */
+
+        std::vector<uint16_t> table_;  /**< Next state row offset per row and class */
+        uint8_t classes_[256];         /**< Byte to equivalence class */
+        unsigned numClasses_;          /**< Number of classes, the row length */
+        uint16_t start_;               /**< Row offset of the start state */
+        uint16_t accept_;              /**< Rows from here on are accepting */
+        uint8_t exitLo_[PATTERN_MAX_EXITS];  /**< Byte ranges leaving the start state */
+        uint8_t exitHi_[PATTERN_MAX_EXITS];
+        unsigned exitCount_;           /**< 0 when the start state cannot be skipped */
+        alignas(16) uint8_t exitLoVec_[PATTERN_MAX_EXITS][16];    /**< exitLo_ per lane */
+        alignas(16) uint8_t exitWidthVec_[PATTERN_MAX_EXITS][16]; /**< exitHi_ - exitLo_ per lane */
+        uint16_t state_;               /**< Current row, kept across blocks */
+        uint64_t count_;               /**< Matches so far */
+        PatternStats stats_;           /**< Stats of the last successful compile */
+        std::string error_;            /**< Last compile error */
+        size_t errorPos_;              /**< Offset of the last compile error */
+};
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+#endif /* __PATTERN_DFA_H__ */
@@ -0,0 +1,299 @@
+/**
+ * @file  PatternSet.cpp
+ * @brief Named header patterns, reloaded while the parser runs
+ * @note  Reclamation: the parse thread bumps the epoch after each swap
+ *        and tags the replaced version with it. A reader publishes the
+ *        epoch it entered at before it loads current_, so a version may
+ *        be freed once every active reader entered at or after its tag.
+ *        All of it is seq_cst, which orders the reader's slot store
+ *        before its load of current_ against the swap and the slot scan.
+ *
+ */
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include "PatternSet.h"
+#include <ctime>
+#include <thread>
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+static uint64_t PatternSet_Now(void);
+
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+/**
+ * @brief Empty set, nothing is counted until the first reload
+ *
+ * @param  None
+ * @return None
+ */
+PatternSet::PatternSet()
+{
+    current_ = NULL;
+    pending_ = NULL;
+    epoch_ = 1;
+    for (auto& r : readers_) {
+        r = 0;
+    }
+    version_ = 0;
+    inUse_ = 0;
+    swaps_ = 0;
+    lastSwapNs_ = 0;
+    maxSwapNs_ = 0;
+    retiredCount_ = 0;
+    reclaimed_ = 0;
+}
+
+/**
+ * @brief Free all versions, no thread may use the set any more
+ *
+ * @param  None
+ * @return None
+ */
+PatternSet::~PatternSet()
+{
+    delete current_.load();
+    delete pending_.load();
+    for (auto& r : retired_) {
+        delete r.first;
+    }
+}
+
+/**
+ * @brief Compile a new set of patterns and publish it to the parse thread
+ *
+ * Nothing changes if a pattern does not compile or a name repeats. A
+ * version published before and not taken up yet is replaced.
+ *
+ * @param  specs  named patterns
+ * @return true/false published or not, see getError()
+ */
+bool PatternSet::reload(const std::vector<PatternSpec>& specs)
+{
+    std::unique_ptr<Table> t(new Table());
+    t->specs = specs;
+    t->dfas.resize(specs.size());
+    t->counts.reset(new std::atomic<uint64_t>[specs.size()]);
+    for (size_t i = 0; i < specs.size(); i++) {
+        for (size_t j = 0; j < i; j++) {
+            if (specs[j].name == specs[i].name) {
+                error_ = "duplicate name " + specs[i].name;
+                return false;
+            }
+        }
+        if (!t->dfas[i].compile(specs[i].pattern.c_str())) {
+            error_ = specs[i].name + ": " + t->dfas[i].getError();
+            return false;
+        }
+        t->counts[i] = 0;
+    }
+    error_.clear();
+    t->version = ++version_;
+    t->publishedNs = PatternSet_Now();
+
+    /* A version the parse thread has not taken is not visible to anyone */
+    delete pending_.exchange(t.release(), std::memory_order_acq_rel);
+    return true;
+}
+
+/**
+ * @brief Why the last reload failed
+ *
+ * @param  None
+ * @return message, empty after a successful reload
+ */
+const char* PatternSet::getError()
+{
+    return error_.c_str();
+}
+
+/**
+ * @brief Take up a published version, then scan a block with all patterns
+ *
+ * Any block boundary is a safe point: unchanged patterns keep their DFA
+ * state, so matches spanning the swap are still found.
+ *
+ * @param  data  bytes to scan
+ * @param  len   number of bytes
+ * @return None
+ */
+void PatternSet::scan(const uint8_t* data, size_t len)
+{
+    if (pending_.load(std::memory_order_relaxed) != NULL) {
+        Table* next = pending_.exchange(NULL, std::memory_order_acquire);
+        if (next != NULL) {
+            adopt(next);
+        }
+    }
+    if (!retired_.empty()) {
+        reclaim();
+    }
+
+    Table* t = current_.load(std::memory_order_relaxed);
+    if (t == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < t->dfas.size(); i++) {
+        t->dfas[i].scan(data, len);
+        t->counts[i].store(t->dfas[i].getCount(), std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Get the count of every pattern of the version in use
+ *
+ * @param  None
+ * @return name and count per pattern
+ */
+std::vector<std::pair<std::string, uint64_t>> PatternSet::getCounts()
+{
+    std::vector<std::pair<std::string, uint64_t>> counts;
+    int slot = enter();
+    Table* t = current_.load();
+    if (t != NULL) {
+        for (size_t i = 0; i < t->specs.size(); i++) {
+            counts.emplace_back(t->specs[i].name, t->counts[i].load(std::memory_order_relaxed));
+        }
+    }
+    leave(slot);
+    return counts;
+}
+
+/**
+ * @brief Get the swap latency and reclamation counters
+ *
+ * @param  None
+ * @return stats
+ */
+PatternSetStats PatternSet::getStats()
+{
+    PatternSetStats st;
+    st.version = inUse_.load(std::memory_order_relaxed);
+    st.swaps = swaps_.load(std::memory_order_relaxed);
+    st.lastSwapNs = lastSwapNs_.load(std::memory_order_relaxed);
+    st.maxSwapNs = maxSwapNs_.load(std::memory_order_relaxed);
+    st.retired = retiredCount_.load(std::memory_order_relaxed);
+    st.reclaimed = reclaimed_.load(std::memory_order_relaxed);
+    return st;
+}
+
+/**
+ * @brief Switch to a new version, carrying the counts over by name
+ *
+ * @param  next  new version
+ * @return None
+ */
+void PatternSet::adopt(Table* next)
+{
+    Table* old = current_.load(std::memory_order_relaxed);
+    if (old != NULL) {
+        for (size_t i = 0; i < next->specs.size(); i++) {
+            for (size_t j = 0; j < old->specs.size(); j++) {
+                if (old->specs[j].name == next->specs[i].name) {
+                    next->dfas[i].carryOver(old->dfas[j]);
+                    next->counts[i] = next->dfas[i].getCount();
+                    break;
+                }
+            }
+        }
+    }
+    current_.store(next);
+    uint64_t tag = epoch_.fetch_add(1) + 1;
+    if (old != NULL) {
+        retired_.emplace_back(old, tag);
+        retiredCount_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t ns = PatternSet_Now() - next->publishedNs;
+    inUse_.store(next->version, std::memory_order_relaxed);
+    swaps_.fetch_add(1, std::memory_order_relaxed);
+    lastSwapNs_.store(ns, std::memory_order_relaxed);
+    if (ns > maxSwapNs_.load(std::memory_order_relaxed)) {
+        maxSwapNs_.store(ns, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Free the replaced versions that no active reader can hold
+ *
+ * @param  None
+ * @return None
+ */
+void PatternSet::reclaim()
+{
+    uint64_t oldest = UINT64_MAX;
+    for (auto& r : readers_) {
+        uint64_t e = r.load();
+        if ((e != 0) && (e < oldest)) {
+            oldest = e;
+        }
+    }
+
+    size_t n = 0;
+    for (auto& r : retired_) {
+        if (r.second <= oldest) {
+            delete r.first;
+            reclaimed_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            retired_[n++] = r;
+        }
+    }
+    retired_.resize(n);
+}
+
+/**
+ * @brief Enter a read: claim a slot and publish the current epoch in it
+ *
+ * @param  None
+ * @return slot
+ */
+int PatternSet::enter()
+{
+    while (true) {
+        for (int s = 0; s < PATTERN_SET_READERS; s++) {
+            uint64_t idle = 0;
+            if ((readers_[s].load(std::memory_order_relaxed) == 0) &&
+                readers_[s].compare_exchange_strong(idle, epoch_.load())) {
+                return s;
+            }
+        }
+        /* More concurrent readers than slots */
+        std::this_thread::yield();
+    }
+}
+
+/**
+ * @brief Leave a read
+ *
+ * @param  slot  slot returned by enter()
+ * @return None
+ */
+void PatternSet::leave(int slot)
+{
+    readers_[slot].store(0, std::memory_order_release);
+}
+
+/**
+ * @brief Monotonic time
+ *
+ * @param  None
+ * @return ns
+ */
+static uint64_t PatternSet_Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
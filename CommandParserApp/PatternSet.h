@@ -0,0 +1,98 @@
+/**
+ * @file  PatternSet.h
+ * @brief Named header patterns, reloaded while the parser runs
+ * @note
+ *
+ */
+#ifndef __PATTERN_SET_H__
+#define __PATTERN_SET_H__
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "PatternDfa.h"
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*
+ * Threads that can read the counts at the same time
+ */
+#define PATTERN_SET_READERS (16)
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+struct PatternSpec {
+    std::string name;     /**< Counter name, kept across reloads */
+    std::string pattern;  /**< PatternDfa syntax */
+};
+
+struct PatternSetStats {
+    uint64_t version = 0;     /**< Version in use by the parse thread, 0 none */
+    uint64_t swaps = 0;       /**< Versions taken up by the parse thread */
+    uint64_t lastSwapNs = 0;  /**< reload() to take up, last swap */
+    uint64_t maxSwapNs = 0;   /**< reload() to take up, worst swap */
+    uint64_t retired = 0;     /**< Versions replaced */
+    uint64_t reclaimed = 0;   /**< Replaced versions freed */
+};
+
+/*
+ * reload() compiles a new version on the calling thread and publishes it.
+ * The parse thread takes it up at its next scan() with one atomic
+ * exchange, so the hot path has no lock. Counts carry over by pattern
+ * name. A replaced version is freed by the parse thread once no reader
+ * that could still see it is inside getCounts() (epoch based
+ * reclamation). reload() is for one control thread at a time.
+ */
+class PatternSet {
+    public:
+        PatternSet();
+        ~PatternSet();
+        bool reload(const std::vector<PatternSpec>& specs); /**< Compile and publish, any thread */
+        const char* getError();       /**< Why the last reload failed */
+        void scan(const uint8_t* data, size_t len); /**< Parse thread only */
+        std::vector<std::pair<std::string, uint64_t>> getCounts(); /**< Counts per name, any thread */
+        PatternSetStats getStats();   /**< Swap latency and reclamation, any thread */
+    private:
+        struct Table {
+            uint64_t version;
+            uint64_t publishedNs;     /**< Time of reload() */
+            std::vector<PatternSpec> specs;
+            std::vector<PatternDfa> dfas; /**< Scan state, parse thread only */
+            std::unique_ptr<std::atomic<uint64_t>[]> counts; /**< Counts published after each scan */
+        };
+        void adopt(Table* next);      /**< Switch to a new version */
+        void reclaim();               /**< Free versions no reader can see */
+        int enter();                  /**< Start of a read, returns the slot */
+        void leave(int slot);         /**< End of a read */
+
+        std::atomic<Table*> current_; /**< Version in use */
+        std::atomic<Table*> pending_; /**< Published, not taken up yet */
+        std::vector<std::pair<Table*, uint64_t>> retired_; /**< Replaced versions and their epoch, parse thread only */
+        std::atomic<uint64_t> epoch_; /**< Bumped on every swap */
+        std::atomic<uint64_t> readers_[PATTERN_SET_READERS]; /**< Epoch of each active reader, 0 idle */
+        uint64_t version_;            /**< Last published version, reload() only */
+        std::string error_;           /**< Last reload error, reload() only */
+        std::atomic<uint64_t> inUse_;  /**< Version of current_ */
+        std::atomic<uint64_t> swaps_;
+        std::atomic<uint64_t> lastSwapNs_;
+        std::atomic<uint64_t> maxSwapNs_;
+        std::atomic<uint64_t> retiredCount_;
+        std::atomic<uint64_t> reclaimed_;
+};
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+#endif /* __PATTERN_SET_H__ */
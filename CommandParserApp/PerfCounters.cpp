@@ -0,0 +1,347 @@
+/**
+ * @file  PerfCounters.cpp
+ * @brief Hardware counters (perf_event_open) around parse calls
+ * @note  All events are read at once as one group so that the per call
+ *        deltas belong to the same interval. When the kernel multiplexes
+ *        the group the deltas are scaled by enabled/running time.
+ *
+ */
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include "PerfCounters.h"
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+static uint64_t PerfCounters_Now(void);
+
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+/*
+ * perf_event_attr type and config of each PerfEvent
+ */
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} PerfCounters_Events[(int)PerfEvent::COUNT] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+};
+
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+/**
+ * @brief Nothing is opened until the first begin()
+ *
+ * @param  None
+ * @return None
+ */
+PerfCounters::PerfCounters()
+{
+    for (int e = 0; e < (int)PerfEvent::COUNT; e++) {
+        fds_[e] = -1;
+        index_[e] = -1;
+        start_[e] = 0;
+    }
+    leader_ = -1;
+    opened_ = 0;
+    tried_ = false;
+    startNs_ = 0;
+    startEnabled_ = 0;
+    startRunning_ = 0;
+}
+
+/**
+ * @brief Close the counters
+ *
+ * @param  None
+ * @return None
+ */
+PerfCounters::~PerfCounters()
+{
+    for (int e = 0; e < (int)PerfEvent::COUNT; e++) {
+        if (fds_[e] >= 0) {
+            close(fds_[e]);
+        }
+    }
+}
+
+/**
+ * @brief Open the counter group of the calling thread, user space only
+ *
+ * @param  None
+ * @return None
+ */
+void PerfCounters::open()
+{
+    tried_ = true;
+    for (int e = 0; e < (int)PerfEvent::COUNT; e++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PerfCounters_Events[e].type;
+        attr.config = PerfCounters_Events[e].config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+        int fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, leader_, 0);
+        if (fd < 0) {
+            continue;
+        }
+        if (leader_ < 0) {
+            leader_ = fd;
+        }
+        fds_[e] = fd;
+        index_[e] = opened_++;
+    }
+}
+
+/**
+ * @brief Read the whole group
+ *
+ * @param  values   counter values by PerfEvent
+ * @param  enabled  group enabled time
+ * @param  running  group running time
+ * @return true/false read or not
+ */
+bool PerfCounters::readGroup(uint64_t* values, uint64_t* enabled, uint64_t* running)
+{
+    uint64_t buf[3 + (int)PerfEvent::COUNT];
+
+    if (leader_ < 0) {
+        return false;
+    }
+    ssize_t len = ::read(leader_, buf, sizeof(buf));
+    if ((len < (ssize_t)(3 * sizeof(uint64_t))) || (buf[0] != (uint64_t)opened_)) {
+        return false;
+    }
+    *enabled = buf[1];
+    *running = buf[2];
+    for (int e = 0; e < (int)PerfEvent::COUNT; e++) {
+        values[e] = (index_[e] >= 0) ? buf[3 + index_[e]] : 0;
+    }
+    return true;
+}
+
+/**
+ * @brief Start measuring a call
+ *
+ * @param  None
+ * @return None
+ */
+void PerfCounters::begin()
+{
+    if (!tried_) {
+        open();
+    }
+    if (!readGroup(start_, &startEnabled_, &startRunning_)) {
+        startEnabled_ = 0;
+        startRunning_ = 0;
+    }
+    startNs_ = PerfCounters_Now();
+}
+
+/**
+ * @brief Add the call since begin() to a kernel and distribution
+ *
+ * @param  kernel        kernel name, e.g. "bulk"
+ * @param  distribution  input name, e.g. "density 1e-3"
+ * @param  bytes         bytes parsed by the call
+ * @return None
+ */
+void PerfCounters::end(const char* kernel, const char* distribution, uint64_t bytes)
+{
+    end(resolve(kernel, distribution), bytes);
+}
+
+/**
+ * @brief Add the call since begin() to totals from resolve()
+ *
+ * Only reads the counters, for callers that measure every batch.
+ *
+ * @param  sample  totals of the kernel and distribution
+ * @param  bytes   bytes parsed by the call
+ * @return None
+ */
+void PerfCounters::end(PerfSample* sample, uint64_t bytes)
+{
+    uint64_t ns = PerfCounters_Now() - startNs_;
+    uint64_t values[(int)PerfEvent::COUNT];
+    uint64_t enabled;
+    uint64_t running;
+
+    PerfSample& s = *sample;
+    s.calls++;
+    s.bytes += bytes;
+    s.ns += ns;
+    if (readGroup(values, &enabled, &running) && (running > startRunning_)) {
+        /* Scale up when the group only ran part of the time */
+        double scale = (double)(enabled - startEnabled_) / (double)(running - startRunning_);
+        for (int e = 0; e < (int)PerfEvent::COUNT; e++) {
+            s.values[e] += (uint64_t)((double)(values[e] - start_[e]) * scale);
+        }
+    }
+}
+
+/**
+ * @brief Get the totals of a kernel on a distribution, created empty if
+ *        not measured yet. The pointer stays valid for the lifetime of
+ *        the counters.
+ *
+ * @param  kernel        kernel name
+ * @param  distribution  input name
+ * @return totals to pass to end()
+ */
+PerfSample* PerfCounters::resolve(const char* kernel, const char* distribution)
+{
+    return &samples_[std::make_pair(std::string(kernel), std::string(distribution))];
+}
+
+/**
+ * @brief Check whether hardware counters are measured
+ *
+ * @param  None
+ * @return true/false at least one counter is open or not, false before
+ *         the first begin()
+ */
+bool PerfCounters::isAvailable()
+{
+    return leader_ >= 0;
+}
+
+/**
+ * @brief Check whether an event is counted
+ *
+ * @param  event  event
+ * @return true/false counted or not
+ */
+bool PerfCounters::has(PerfEvent event)
+{
+    return fds_[(int)event] >= 0;
+}
+
+/**
+ * @brief Get the totals of a kernel on a distribution
+ *
+ * @param  kernel        kernel name
+ * @param  distribution  input name
+ * @param  sample        totals
+ * @return true/false measured or not
+ */
+bool PerfCounters::getSample(const char* kernel, const char* distribution, PerfSample& sample)
+{
+    auto it = samples_.find(std::make_pair(std::string(kernel), std::string(distribution)));
+    if (it == samples_.end()) {
+        return false;
+    }
+    sample = it->second;
+    return true;
+}
+
+/**
+ * @brief Print per byte metrics of every kernel and distribution
+ *
+ * @param  fp  output
+ * @return None
+ */
+void PerfCounters::print(FILE* fp)
+{
+    if (!isAvailable()) {
+        int paranoid = -1;
+        FILE* pf = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+        if (pf != NULL) {
+            if (fscanf(pf, "%d", &paranoid) != 1) {
+                paranoid = -1;
+            }
+            fclose(pf);
+        }
+        fprintf(fp, "hardware counters unavailable (perf_event_paranoid %d or no PMU), timing only\n",
+                paranoid);
+    }
+    fprintf(fp, "%-12s %-14s %8s %8s %8s %6s %8s %10s %10s\n", "kernel", "input", "ns/B",
+            "cyc/B", "ins/B", "IPC", "brmiss%", "L1miss/KB", "LLCmiss/KB");
+    for (const auto& entry : samples_) {
+        const PerfSample& s = entry.second;
+        const uint64_t* v = s.values;
+        double bytes = (s.bytes > 0) ? (double)s.bytes : 1.0;
+        double cycles = (double)v[(int)PerfEvent::CYCLES];
+        double branches = (double)v[(int)PerfEvent::BRANCHES];
+        char cols[6][16];
+        auto col = [&](int i, bool valid, const char* fmt, double value) {
+            if (valid) {
+                snprintf(cols[i], sizeof(cols[i]), fmt, value);
+            } else {
+                snprintf(cols[i], sizeof(cols[i]), "-");
+            }
+        };
+        col(0, has(PerfEvent::CYCLES), "%.3f", cycles / bytes);
+        col(1, has(PerfEvent::INSTRUCTIONS), "%.3f", (double)v[(int)PerfEvent::INSTRUCTIONS] / bytes);
+        col(2, has(PerfEvent::INSTRUCTIONS) && (cycles > 0), "%.2f",
+            (double)v[(int)PerfEvent::INSTRUCTIONS] / ((cycles > 0) ? cycles : 1.0));
+        col(3, has(PerfEvent::BRANCH_MISSES) && (branches > 0), "%.2f",
+            100.0 * (double)v[(int)PerfEvent::BRANCH_MISSES] / ((branches > 0) ? branches : 1.0));
+        col(4, has(PerfEvent::L1D_MISSES), "%.2f", (double)v[(int)PerfEvent::L1D_MISSES] * 1024.0 / bytes);
+        col(5, has(PerfEvent::LLC_MISSES), "%.3f", (double)v[(int)PerfEvent::LLC_MISSES] * 1024.0 / bytes);
+        fprintf(fp, "%-12s %-14s %8.3f %8s %8s %6s %8s %10s %10s\n", entry.first.first.c_str(),
+                entry.first.second.c_str(), (double)s.ns / bytes, cols[0], cols[1], cols[2],
+                cols[3], cols[4], cols[5]);
+    }
+}
+
+/**
+ * @brief Name of an event
+ *
+ * @param  event  event
+ * @return name
+ */
+const char* PerfCounters::getEventName(PerfEvent event)
+{
+    switch (event) {
+    case PerfEvent::CYCLES:
+        return "cycles";
+    case PerfEvent::INSTRUCTIONS:
+        return "instructions";
+    case PerfEvent::BRANCHES:
+        return "branches";
+    case PerfEvent::BRANCH_MISSES:
+        return "branch-misses";
+    case PerfEvent::L1D_MISSES:
+        return "L1d-read-misses";
+    case PerfEvent::LLC_MISSES:
+        return "LLC-misses";
+    default:
+        return "?";
+    }
+}
+
+/**
+ * @brief Monotonic time
+ *
+ * @param  None
+ * @return ns
+ */
+static uint64_t PerfCounters_Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
@@ -0,0 +1,79 @@
+/**
+ * @file  PerfCounters.h
+ * @brief Hardware counters (perf_event_open) around parse calls
+ * @note
+ *
+ */
+#ifndef __PERF_COUNTERS_H__
+#define __PERF_COUNTERS_H__
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <utility>
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+enum class PerfEvent { CYCLES, INSTRUCTIONS, BRANCHES, BRANCH_MISSES, L1D_MISSES, LLC_MISSES, COUNT };
+
+/*
+ * Totals of the measured calls of one kernel on one input distribution
+ */
+struct PerfSample {
+    uint64_t calls = 0;   /**< Measured calls */
+    uint64_t bytes = 0;   /**< Bytes parsed */
+    uint64_t ns = 0;      /**< Wall clock time */
+    uint64_t values[(int)PerfEvent::COUNT] = { 0 }; /**< Counter totals, scaled if multiplexed */
+};
+
+/*
+ * Counters of the thread that calls begin()/end(). The group is opened on
+ * the first begin(), so it must always be used from the same thread. Events
+ * the CPU or perf_event_paranoid do not allow are left out; with none left
+ * only the time is measured.
+ */
+class PerfCounters {
+    public:
+        PerfCounters();
+        ~PerfCounters();
+        void begin();           /**< Start measuring a call */
+        void end(const char* kernel, const char* distribution, uint64_t bytes); /**< Add the call */
+        void end(PerfSample* sample, uint64_t bytes); /**< Add the call to resolved totals */
+        PerfSample* resolve(const char* kernel, const char* distribution); /**< Totals for end(), stable */
+        bool isAvailable();     /**< At least one hardware counter is open */
+        bool has(PerfEvent event); /**< The event is counted */
+        bool getSample(const char* kernel, const char* distribution, PerfSample& sample); /**< Totals */
+        void print(FILE* fp);   /**< Per byte table of all kernels and distributions */
+        static const char* getEventName(PerfEvent event);
+    private:
+        void open();            /**< Open the group for the calling thread */
+        bool readGroup(uint64_t* values, uint64_t* enabled, uint64_t* running); /**< Read all counters */
+
+        int fds_[(int)PerfEvent::COUNT];   /**< Counter fds, -1 if not counted */
+        int index_[(int)PerfEvent::COUNT]; /**< Position in the group read, -1 if not counted */
+        int leader_;            /**< Group leader fd, -1 timing only */
+        int opened_;            /**< Counters in the group */
+        bool tried_;            /**< open() was called */
+        uint64_t startNs_;      /**< Time at begin() */
+        uint64_t start_[(int)PerfEvent::COUNT]; /**< Counters at begin() */
+        uint64_t startEnabled_; /**< Group enabled time at begin() */
+        uint64_t startRunning_; /**< Group running time at begin() */
+        std::map<std::pair<std::string, std::string>, PerfSample> samples_; /**< Totals per kernel and distribution */
+};
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+#endif /* __PERF_COUNTERS_H__ */
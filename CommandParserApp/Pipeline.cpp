@@ -0,0 +1,419 @@
+/**
+ * @file  Pipeline.cpp
+ * @brief Staged parse engine: ring drain, header scan, frame check, sink
+ * @note  The ingest stage copies the ring into pool buffers so the producer
+ *        can refill it while the later stages work. The sink returns the
+ *        buffers to ingest through the input queue of the ingest stage.
+ *
+ */
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include "Pipeline.h"
+#include "Trace.h"
+#include <chrono>
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*
+ * Idle waiting: spin, then yield, then sleep
+ */
+#define PIPELINE_SPIN_LIMIT  (64)
+#define PIPELINE_YIELD_LIMIT (256)
+#define PIPELINE_SLEEP_US    (20)
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+/**
+ * @brief Allocate the buffer pool and the queues between the stages
+ *
+ * @param  shmem     ring filled by the producer
+ * @param  parser    header scan
+ * @param  verifier  frame check, NULL to skip
+ * @param  config    batch, buffer and queue sizes, stage CPUs
+ * @return None
+ */
+Pipeline::Pipeline(SharedMem* shmem, CmdSeqParser* parser, FrameVerifier* verifier,
+                   const PipelineConfig& config)
+{
+    assert(shmem != NULL);
+    assert(parser != NULL);
+    assert((config.batchSize > 0) && (config.batchSize <= PIPELINE_MAX_BATCH));
+    assert(config.queueDepth <= config.buffers);
+    /* Ingest holds a whole batch of free buffers before passing any on */
+    assert(config.batchSize <= config.buffers);
+
+    shmem_ = shmem;
+    parser_ = parser;
+    verifier_ = verifier;
+    config_ = config;
+    isStopped_ = false;
+    count_ = parser->getCount();
+    bytes_ = 0;
+    offset_ = parser->getOffset();
+    sem_init(&sem_, 0, 0);
+
+    /* The free list holds every buffer, the stage queues bound the work in flight */
+    queues_[INGEST] = new SpscQueue<BufferDesc>(config.buffers);
+    for (int s = SCAN; s < PIPELINE_STAGES; s++) {
+        queues_[s] = new SpscQueue<BufferDesc>(config.queueDepth);
+    }
+
+    bool ok = pool_.allocate(config.buffers * config.bufferSize, config.policy);
+    assert(ok);
+    (void)ok;
+    for (size_t i = 0; i < config.buffers; i++) {
+        BufferDesc desc = { pool_.data() + i * config.bufferSize, 0, 0, 0 };
+        queues_[INGEST]->push(&desc, 1);
+    }
+    for (int s = 0; s < PIPELINE_STAGES; s++) {
+        done_[s] = false;
+    }
+}
+
+/**
+ * @brief Stop the stages and release the queues
+ *
+ * @param  None
+ * @return None
+ */
+Pipeline::~Pipeline()
+{
+    stop();
+    for (int s = 0; s < PIPELINE_STAGES; s++) {
+        delete queues_[s];
+    }
+    sem_destroy(&sem_);
+}
+
+/**
+ * @brief Set the output of the sink stage, must be called before start()
+ *
+ * @param  sink  called on the sink thread for every buffer in order
+ * @return None
+ */
+void Pipeline::setSink(std::function<void(const BufferDesc&)> sink)
+{
+    sink_ = sink;
+}
+
+/**
+ * @brief Start one thread per stage, pinned when configured
+ *
+ * The parser must not have a frame verifier of its own, and it must not
+ * share an OutputSink with the verifier, see FrameVerifier::setOutputSink().
+ *
+ * @param  None
+ * @return None
+ */
+void Pipeline::start()
+{
+    /* Frames are verified in the frame stage, not by the scan stage too */
+    assert(parser_->getFrameVerifier() == NULL);
+
+    /* The scan and frame stages are two producers, a sink takes only one */
+    assert((verifier_ == NULL) || (verifier_->getOutputSink() == NULL) ||
+           (verifier_->getOutputSink() != parser_->getOutputSink()));
+
+    threads_[INGEST] = std::thread(&Pipeline::ingest, this);
+    for (int s = SCAN; s < PIPELINE_STAGES; s++) {
+        threads_[s] = std::thread(&Pipeline::runStage, this, (Stage)s);
+    }
+    for (int s = 0; s < PIPELINE_STAGES; s++) {
+        if (config_.cpus[s] >= 0) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(config_.cpus[s], &cpus);
+            MemPolicy_PinThread(threads_[s].native_handle(), &cpus);
+        }
+    }
+}
+
+/**
+ * @brief Stop the pipeline, data already in the ring is processed first
+ *
+ * @param  None
+ * @return None
+ */
+void Pipeline::stop()
+{
+    if (!threads_[INGEST].joinable()) {
+        return;
+    }
+    isStopped_.store(true, std::memory_order_release);
+    sem_post(&sem_);
+    for (int s = 0; s < PIPELINE_STAGES; s++) {
+        threads_[s].join();
+    }
+}
+
+/**
+ * @brief Notify that data is available, same contract as BackgroundTask
+ *
+ * @param  None
+ * @return None
+ */
+void Pipeline::notifyDataAvailable()
+{
+    if (Trace::isEnabled()) {
+        Trace::record(TraceEvent::NOTIFY, shmem_->Count());
+    }
+    sem_post(&sem_);
+}
+
+/**
+ * @brief Get the header count after the scan stage
+ *
+ * @param  None
+ * @return count value
+ */
+uint64_t Pipeline::getCount()
+{
+    return count_.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Get the number of bytes that went through the sink
+ *
+ * @param  None
+ * @return byte count
+ */
+uint64_t Pipeline::getBytes()
+{
+    return bytes_.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Get the metrics of a stage
+ *
+ * A stage with a full input queue and few empty stalls is the bottleneck.
+ *
+ * @param  stage  pipeline stage
+ * @return metrics
+ */
+StageStats Pipeline::getStats(Stage stage)
+{
+    StageStats stats;
+    Counters& c = counters_[stage];
+
+    stats.items = c.items.load(std::memory_order_relaxed);
+    stats.batches = c.batches.load(std::memory_order_relaxed);
+    stats.stallsEmpty = c.stallsEmpty.load(std::memory_order_relaxed);
+    stats.stallsFull = c.stallsFull.load(std::memory_order_relaxed);
+    stats.occupancy = 0.0;
+    uint64_t samples = c.occupancySamples.load(std::memory_order_relaxed);
+    if (samples > 0) {
+        stats.occupancy = (double)c.occupancySum.load(std::memory_order_relaxed) /
+                          (double)samples / (double)queues_[stage]->capacity();
+    }
+    return stats;
+}
+
+/**
+ * @brief Name of a stage
+ *
+ * @param  stage  pipeline stage
+ * @return name
+ */
+const char* Pipeline::getStageName(Stage stage)
+{
+    static const char* names[PIPELINE_STAGES] = { "ingest", "scan", "frame", "sink" };
+    return names[stage];
+}
+
+/**
+ * @brief Wait step of an idle stage
+ *
+ * @param  spins  number of idle rounds so far, reset by the caller on work
+ * @return None
+ */
+void Pipeline::backoff(unsigned& spins)
+{
+    spins++;
+    if (spins < PIPELINE_SPIN_LIMIT) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    } else if (spins < PIPELINE_YIELD_LIMIT) {
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(PIPELINE_SLEEP_US));
+    }
+}
+
+/**
+ * @brief Push a batch to the next stage, waiting while its queue is full
+ *
+ * @param  stage  stage that produced the batch
+ * @param  batch  descriptors
+ * @param  n      number of descriptors
+ * @return None
+ */
+void Pipeline::forward(Stage stage, BufferDesc* batch, size_t n)
+{
+    SpscQueue<BufferDesc>* out = queues_[(stage + 1) % PIPELINE_STAGES];
+    unsigned spins = 0;
+    size_t done = 0;
+
+    while (done < n) {
+        size_t pushed = out->push(&batch[done], n - done);
+        done += pushed;
+        if (done < n) {
+            counters_[stage].stallsFull.fetch_add(1, std::memory_order_relaxed);
+            backoff(spins);
+        }
+    }
+}
+
+/**
+ * @brief Ring drain stage, copies the ring into pool buffers on each signal
+ *
+ * @param  None
+ * @return None
+ */
+void Pipeline::ingest()
+{
+    BufferDesc batch[PIPELINE_MAX_BATCH];
+    Counters& c = counters_[INGEST];
+
+    while (true) {
+        sem_wait(&sem_);
+        Trace::record(TraceEvent::WAKE, 1);
+        bool stopped = isStopped_.load(std::memory_order_acquire);
+
+        size_t n = 0;
+        while (true) {
+            const uint8_t* first;
+            const uint8_t* second;
+            size_t firstLen;
+            size_t secondLen;
+            if (shmem_->GetRegions(&first, &firstLen, &second, &secondLen) == 0) {
+                break;
+            }
+            if (firstLen == 0) {
+                first = second;
+                firstLen = secondLen;
+            }
+
+            /* Wait for a free buffer, the sink returns them */
+            unsigned spins = 0;
+            while (queues_[INGEST]->pop(&batch[n], 1) == 0) {
+                c.stallsEmpty.fetch_add(1, std::memory_order_relaxed);
+                backoff(spins);
+            }
+            c.occupancySum.fetch_add(queues_[INGEST]->size() + 1, std::memory_order_relaxed);
+            c.occupancySamples.fetch_add(1, std::memory_order_relaxed);
+
+            size_t len = (firstLen < config_.bufferSize) ? firstLen : config_.bufferSize;
+            memcpy(batch[n].data, first, len);
+            batch[n].len = len;
+            batch[n].offset = offset_;
+            batch[n].matches = 0;
+            offset_ += len;
+            shmem_->Release(len);
+            c.items.fetch_add(1, std::memory_order_relaxed);
+
+            if (++n == config_.batchSize) {
+                c.batches.fetch_add(1, std::memory_order_relaxed);
+                forward(INGEST, batch, n);
+                n = 0;
+            }
+        }
+
+        /* Partial batch at the end of the drain */
+        if (n > 0) {
+            c.batches.fetch_add(1, std::memory_order_relaxed);
+            forward(INGEST, batch, n);
+        }
+        if (stopped) {
+            break;
+        }
+    }
+    done_[INGEST].store(true, std::memory_order_release);
+}
+
+/**
+ * @brief Work of the scan, frame and sink stages on one buffer
+ *
+ * @param  stage  pipeline stage
+ * @param  desc   buffer
+ * @return None
+ */
+void Pipeline::process(Stage stage, BufferDesc& desc)
+{
+    switch (stage) {
+    case SCAN: {
+        uint64_t before = parser_->getCount();
+        parser_->parseBlock(desc.data, desc.len);
+        uint64_t after = parser_->getCount();
+        desc.matches = after - before;
+        count_.store(after, std::memory_order_release);
+        break;
+    }
+    case FRAME:
+        if (verifier_ != NULL) {
+            verifier_->feed(desc.data, desc.len);
+        }
+        break;
+    case SINK:
+        if (sink_) {
+            sink_(desc);
+        }
+        bytes_.fetch_add(desc.len, std::memory_order_release);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Loop of the scan, frame and sink stages
+ *
+ * The stage exits once the previous stage has exited and its input queue
+ * is drained.
+ *
+ * @param  stage  pipeline stage
+ * @return None
+ */
+void Pipeline::runStage(Stage stage)
+{
+    BufferDesc batch[PIPELINE_MAX_BATCH];
+    SpscQueue<BufferDesc>* in = queues_[stage];
+    Counters& c = counters_[stage];
+    unsigned spins = 0;
+
+    while (true) {
+        size_t n = in->pop(batch, config_.batchSize);
+        if (n == 0) {
+            if (done_[stage - 1].load(std::memory_order_acquire) && (in->size() == 0)) {
+                break;
+            }
+            c.stallsEmpty.fetch_add(1, std::memory_order_relaxed);
+            backoff(spins);
+            continue;
+        }
+        spins = 0;
+        c.occupancySum.fetch_add(in->size() + n, std::memory_order_relaxed);
+        c.occupancySamples.fetch_add(1, std::memory_order_relaxed);
+
+        for (size_t i = 0; i < n; i++) {
+            process(stage, batch[i]);
+        }
+        c.items.fetch_add(n, std::memory_order_relaxed);
+        c.batches.fetch_add(1, std::memory_order_relaxed);
+        forward(stage, batch, n);
+    }
+    done_[stage].store(true, std::memory_order_release);
+}
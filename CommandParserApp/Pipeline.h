@@ -0,0 +1,115 @@
+/**
+ * @file  Pipeline.h
+ * @brief Staged parse engine: ring drain, header scan, frame check, sink
+ * @note  Each stage runs in its own thread and passes batches of buffer
+ *        descriptors to the next stage through bounded SPSC queues
+ *
+ */
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <semaphore.h>
+#include "SharedMem.h"
+#include "CmdSeqParser.h"
+#include "FrameVerifier.h"
+#include "MemPolicy.h"
+#include "SpscQueue.h"
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+#define PIPELINE_STAGES    (4)
+#define PIPELINE_MAX_BATCH (256)
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*
+ * Descriptor of a buffer of the pool moving through the stages
+ */
+struct BufferDesc {
+    uint8_t* data;      /**< Buffer in the pool */
+    size_t len;         /**< Number of valid bytes */
+    uint64_t offset;    /**< Stream offset of the first byte */
+    uint64_t matches;   /**< Headers ending in this buffer, set by scan */
+};
+
+struct PipelineConfig {
+    size_t batchSize = 8;      /**< Descriptors moved per queue operation, at most buffers */
+    size_t bufferSize = 4096;  /**< Bytes per pool buffer */
+    size_t buffers = 256;      /**< Pool buffers, a power of two */
+    size_t queueDepth = 64;    /**< Slots between stages, a power of two */
+    int cpus[PIPELINE_STAGES] = { -1, -1, -1, -1 }; /**< CPU per stage, -1 unpinned */
+    MemPolicy policy;          /**< Placement of the buffer pool */
+};
+
+struct StageStats {
+    uint64_t items;        /**< Descriptors processed */
+    uint64_t batches;      /**< Batches processed */
+    uint64_t stallsEmpty;  /**< Waits on an empty input queue */
+    uint64_t stallsFull;   /**< Waits on a full output queue */
+    double occupancy;      /**< Mean fill of the input queue, 0 to 1 */
+};
+
+class Pipeline {
+    public:
+        enum Stage { INGEST, SCAN, FRAME, SINK }; /**< Pipeline stages */
+
+        Pipeline(SharedMem* shmem, CmdSeqParser* parser, FrameVerifier* verifier,
+                 const PipelineConfig& config);
+        ~Pipeline();
+        void setSink(std::function<void(const BufferDesc&)> sink); /**< Output of the last stage */
+        void start();                 /**< Start the stage threads */
+        void stop();                  /**< Drain and stop the stage threads */
+        void notifyDataAvailable();   /**< Notify that the ring has data */
+        uint64_t getCount();          /**< Header count, thread safe */
+        uint64_t getBytes();          /**< Bytes through the sink, thread safe */
+        StageStats getStats(Stage stage); /**< Occupancy and stall metrics */
+        static const char* getStageName(Stage stage); /**< Name for reports */
+    private:
+        struct alignas(SPSC_CACHE_LINE) Counters {
+            std::atomic<uint64_t> items{0};
+            std::atomic<uint64_t> batches{0};
+            std::atomic<uint64_t> stallsEmpty{0};
+            std::atomic<uint64_t> stallsFull{0};
+            std::atomic<uint64_t> occupancySum{0};
+            std::atomic<uint64_t> occupancySamples{0};
+        };
+
+        void ingest();                /**< Ring drain stage */
+        void runStage(Stage stage);   /**< Scan, frame and sink stages */
+        void process(Stage stage, BufferDesc& desc); /**< Work of a stage */
+        void forward(Stage stage, BufferDesc* batch, size_t n); /**< Push to the next stage */
+        static void backoff(unsigned& spins); /**< Wait step when idle */
+
+        SharedMem* shmem_;            /**< Ring filled by the producer */
+        CmdSeqParser* parser_;        /**< Header scan */
+        FrameVerifier* verifier_;     /**< Frame check, may be NULL */
+        PipelineConfig config_;       /**< Configuration */
+        std::function<void(const BufferDesc&)> sink_; /**< Output, may be empty */
+        MemRegion pool_;              /**< Buffer pool */
+        SpscQueue<BufferDesc>* queues_[PIPELINE_STAGES]; /**< Input queue per stage */
+        Counters counters_[PIPELINE_STAGES]; /**< Metrics per stage */
+        std::atomic<bool> done_[PIPELINE_STAGES]; /**< Stage has exited */
+        std::thread threads_[PIPELINE_STAGES];    /**< Stage threads */
+        std::atomic<bool> isStopped_; /**< Stop request */
+        std::atomic<uint64_t> count_; /**< Header count after scan */
+        std::atomic<uint64_t> bytes_; /**< Bytes through the sink */
+        uint64_t offset_;             /**< Stream offset, ingest only */
+        sem_t sem_;                   /**< Data available signal */
+};
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+#endif /* __PIPELINE_H__ */
@@ -0,0 +1,217 @@
+/**
+ * @file  RateStats.cpp
+ * @brief Time windowed match/byte rates and inter-match gap histogram
+ * @note  The parse thread adds each buffer to the bucket of the current
+ *        second and minute. Buckets are reused round robin and guarded by
+ *        their epoch like a sequence lock, so readers never block the
+ *        writer and skip buckets that belong to another epoch. The clock is
+ *        CLOCK_MONOTONIC_COARSE, read through the vDSO without a syscall.
+ *
+ */
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include "RateStats.h"
+#include <ctime>
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+/**
+ * @brief Empty rings and histogram
+ *
+ * @param  None
+ * @return None
+ */
+RateStats::RateStats()
+{
+    for (auto& g : gaps_) {
+        g.store(0, std::memory_order_relaxed);
+    }
+    lastMatch_ = 0;
+    matched_ = false;
+}
+
+/**
+ * @brief Add a parsed buffer to the current second and minute
+ *
+ * @param  matches  matches in the buffer
+ * @param  bytes    bytes in the buffer
+ * @param  now      time in seconds, RateStats::now() by default
+ * @return None
+ */
+void RateStats::record(uint64_t matches, uint64_t bytes, uint64_t now)
+{
+    Bucket& sec = advance(seconds_, RATE_STATS_SECONDS, now);
+    Bucket& min = advance(minutes_, RATE_STATS_MINUTES, now / 60);
+
+    /* Single writer, plain load/store is enough */
+    uint64_t secMatches = sec.matches.load(std::memory_order_relaxed) + matches;
+    uint64_t secBytes = sec.bytes.load(std::memory_order_relaxed) + bytes;
+    sec.matches.store(secMatches, std::memory_order_relaxed);
+    sec.bytes.store(secBytes, std::memory_order_relaxed);
+    min.matches.store(min.matches.load(std::memory_order_relaxed) + matches,
+                      std::memory_order_relaxed);
+    min.bytes.store(min.bytes.load(std::memory_order_relaxed) + bytes,
+                    std::memory_order_relaxed);
+    if (secMatches > min.peakMatches.load(std::memory_order_relaxed)) {
+        min.peakMatches.store(secMatches, std::memory_order_relaxed);
+    }
+    if (secBytes > min.peakBytes.load(std::memory_order_relaxed)) {
+        min.peakBytes.store(secBytes, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Add the gap between this match and the previous one
+ *
+ * @param  offset  stream offset of the match
+ * @return None
+ */
+void RateStats::recordMatch(uint64_t offset)
+{
+    if (matched_ && (offset > lastMatch_)) {
+        unsigned k = 63 - (unsigned)__builtin_clzll(offset - lastMatch_);
+        gaps_[k].store(gaps_[k].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    lastMatch_ = offset;
+    matched_ = true;
+}
+
+/**
+ * @brief Totals and per second peaks of the last seconds
+ *
+ * @param  seconds  window length, at most RATE_STATS_SECONDS - 4
+ * @param  now      time in seconds, RateStats::now() by default
+ * @return window including the current, partial second
+ */
+RateWindow RateStats::getSeconds(unsigned seconds, uint64_t now)
+{
+    RateWindow w;
+
+    if (seconds > RATE_STATS_SECONDS - 4) {
+        seconds = RATE_STATS_SECONDS - 4;
+    }
+    for (uint64_t k = 0; (k < seconds) && (k <= now); k++) {
+        uint64_t s = now - k;
+        RateWindow b;
+        if (read(seconds_[s % RATE_STATS_SECONDS], s, b)) {
+            w.matches += b.matches;
+            w.bytes += b.bytes;
+            w.peakMatches = (b.matches > w.peakMatches) ? b.matches : w.peakMatches;
+            w.peakBytes = (b.bytes > w.peakBytes) ? b.bytes : w.peakBytes;
+        }
+    }
+    return w;
+}
+
+/**
+ * @brief Totals and per second peaks of the last minutes
+ *
+ * @param  minutes  window length, at most RATE_STATS_MINUTES - 4
+ * @param  now      time in seconds, RateStats::now() by default
+ * @return window including the current, partial minute
+ */
+RateWindow RateStats::getMinutes(unsigned minutes, uint64_t now)
+{
+    RateWindow w;
+    uint64_t current = now / 60;
+
+    if (minutes > RATE_STATS_MINUTES - 4) {
+        minutes = RATE_STATS_MINUTES - 4;
+    }
+    for (uint64_t k = 0; (k < minutes) && (k <= current); k++) {
+        uint64_t m = current - k;
+        RateWindow b;
+        if (read(minutes_[m % RATE_STATS_MINUTES], m, b)) {
+            w.matches += b.matches;
+            w.bytes += b.bytes;
+            w.peakMatches = (b.peakMatches > w.peakMatches) ? b.peakMatches : w.peakMatches;
+            w.peakBytes = (b.peakBytes > w.peakBytes) ? b.peakBytes : w.peakBytes;
+        }
+    }
+    return w;
+}
+
+/**
+ * @brief Copy the inter-match gap histogram
+ *
+ * @param  hist  RATE_STATS_GAP_BUCKETS counts, bucket k for [2^k, 2^(k+1)) bytes
+ * @return None
+ */
+void RateStats::getGapHistogram(uint64_t* hist)
+{
+    for (size_t k = 0; k < RATE_STATS_GAP_BUCKETS; k++) {
+        hist[k] = gaps_[k].load(std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Coarse monotonic time, resolution of a scheduler tick
+ *
+ * @param  None
+ * @return seconds
+ */
+uint64_t RateStats::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec;
+}
+
+/**
+ * @brief Bucket holding epoch, reset first when it still holds an old one
+ *
+ * @param  ring   bucket ring
+ * @param  size   ring size
+ * @param  epoch  second or minute
+ * @return bucket
+ */
+RateStats::Bucket& RateStats::advance(Bucket* ring, size_t size, uint64_t epoch)
+{
+    Bucket& b = ring[epoch % size];
+    if (b.epoch.load(std::memory_order_relaxed) != epoch) {
+        b.epoch.store(UINT64_MAX, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        b.matches.store(0, std::memory_order_relaxed);
+        b.bytes.store(0, std::memory_order_relaxed);
+        b.peakMatches.store(0, std::memory_order_relaxed);
+        b.peakBytes.store(0, std::memory_order_relaxed);
+        b.epoch.store(epoch, std::memory_order_release);
+    }
+    return b;
+}
+
+/**
+ * @brief Read a bucket if it holds epoch
+ *
+ * @param  b      bucket
+ * @param  epoch  second or minute expected
+ * @param  w      counts of the bucket
+ * @return true/false bucket held epoch for the whole read or not
+ */
+bool RateStats::read(Bucket& b, uint64_t epoch, RateWindow& w)
+{
+    if (b.epoch.load(std::memory_order_acquire) != epoch) {
+        return false;
+    }
+    w.matches = b.matches.load(std::memory_order_relaxed);
+    w.bytes = b.bytes.load(std::memory_order_relaxed);
+    w.peakMatches = b.peakMatches.load(std::memory_order_relaxed);
+    w.peakBytes = b.peakBytes.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return b.epoch.load(std::memory_order_relaxed) == epoch;
+}
@@ -0,0 +1,81 @@
+/**
+ * @file  RateStats.h
+ * @brief Time windowed match/byte rates and inter-match gap histogram
+ * @note
+ *
+ */
+#ifndef __RATE_STATS_H__
+#define __RATE_STATS_H__
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*
+ * Ring sizes: a minute of seconds and an hour of minutes, with headroom so
+ * the bucket being filled never overlaps the queried window
+ */
+#define RATE_STATS_SECONDS (64)
+#define RATE_STATS_MINUTES (64)
+
+/*
+ * Gap histogram bucket k counts gaps of [2^k, 2^(k+1)) bytes
+ */
+#define RATE_STATS_GAP_BUCKETS (64)
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*
+ * Rates over a window
+ */
+struct RateWindow {
+    uint64_t matches = 0;  /**< Matches in the window */
+    uint64_t bytes = 0;    /**< Bytes in the window */
+    uint64_t peakMatches = 0; /**< Highest matches in one second */
+    uint64_t peakBytes = 0;   /**< Highest bytes in one second */
+};
+
+/*
+ * Single writer (the parse thread), any number of lock-free readers
+ */
+class RateStats {
+    public:
+        RateStats();
+        void record(uint64_t matches, uint64_t bytes, uint64_t now = RateStats::now()); /**< Add a parsed buffer */
+        void recordMatch(uint64_t offset);    /**< Add the gap to the previous match */
+        RateWindow getSeconds(unsigned seconds, uint64_t now = RateStats::now()); /**< Last seconds, up to 60 */
+        RateWindow getMinutes(unsigned minutes, uint64_t now = RateStats::now()); /**< Last minutes, up to 60 */
+        void getGapHistogram(uint64_t* hist); /**< Copy RATE_STATS_GAP_BUCKETS counts */
+        static uint64_t now();                /**< Coarse monotonic clock in seconds */
+    private:
+        struct Bucket {
+            std::atomic<uint64_t> epoch{UINT64_MAX}; /**< Second or minute held, UINT64_MAX while reset */
+            std::atomic<uint64_t> matches{0};
+            std::atomic<uint64_t> bytes{0};
+            std::atomic<uint64_t> peakMatches{0};    /**< Minute buckets: highest second */
+            std::atomic<uint64_t> peakBytes{0};
+        };
+        static Bucket& advance(Bucket* ring, size_t size, uint64_t epoch); /**< Bucket of epoch, reset if stale */
+        static bool read(Bucket& b, uint64_t epoch, RateWindow& w);      /**< Consistent read of a bucket */
+
+        Bucket seconds_[RATE_STATS_SECONDS]; /**< Per second ring */
+        Bucket minutes_[RATE_STATS_MINUTES]; /**< Per minute ring */
+        std::atomic<uint64_t> gaps_[RATE_STATS_GAP_BUCKETS]; /**< Inter-match gap histogram */
+        uint64_t lastMatch_;                 /**< Offset of the previous match, writer only */
+        bool matched_;                       /**< A match was seen, writer only */
+};
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+#endif /* __RATE_STATS_H__ */
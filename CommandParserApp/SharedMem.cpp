@@ -8,6 +8,7 @@
 /* Header                                                                */
 /*-----------------------------------------------------------------------*/
 #include "SharedMem.h"
+#include "Trace.h"
 /*-----------------------------------------------------------------------*/
 /* Macro                                                                 */
 /*-----------------------------------------------------------------------*/
@@ -27,29 +28,289 @@
 /* Function                                                              */
 /*-----------------------------------------------------------------------*/
 /**
- * @brief Allocates shared memory of size 16 bytes
+ * @brief Allocates shared memory of SHARED_MEM_SIZE bytes
  *
  * @param  None
  * @return None
  */
-SharedMem::SharedMem() 
+SharedMem::SharedMem() : SharedMem(SHARED_MEM_SIZE, MemPolicy())
 {
-    shMemAddr_= new uint8_t[SHARED_MEM_SIZE];
-    memset(shMemAddr_, 0, SHARED_MEM_SIZE);
+}
+
+#if defined(SEQPARSER_EMBEDDED)
+/**
+ * @brief Allocates shared memory of a given size and placement
+ *
+ * @param  size    size of the memory in bytes, a power of two
+ * @param  policy  hugepage and NUMA placement of the memory
+ * @return None
+ */
+SharedMem::SharedMem(size_t size, const MemPolicy& policy)
+{
+    /* A power of two so the free-running totals index correctly after
+     * they wrap, e.g. on 32-bit targets */
+    assert((size > 0) && ((size & (size - 1)) == 0));
+    bool ok = region_.allocate(size, policy);
+    assert(ok);
+    (void)ok;
+    shMemAddr_ = region_.data();
+    size_ = size;
+    put_total_ = 0;
+    get_total_ = 0;
+}
+
+/**
+ * @brief Uses memory owned by the caller, e.g. a static array, so that
+ *        no heap is needed
+ *
+ * @param  storage  memory of at least size bytes, outlives the object
+ * @param  size     size of the memory in bytes, a power of two
+ * @return None
+ */
+SharedMem::SharedMem(uint8_t* storage, size_t size)
+{
+    assert((storage != NULL) && (size > 0) && ((size & (size - 1)) == 0));
+    shMemAddr_ = storage;
+    size_ = size;
+    put_total_ = 0;
+    get_total_ = 0;
+}
+
+/**
+ * @brief releases the shared memory, caller memory is left alone
+ *
+ * @param  None
+ * @return None
+ */
+SharedMem::~SharedMem()
+{
+    region_.release();
+}
+
+/**
+ * @brief Put the data to shared memory, wait-free for one producer
+ *
+ * Safe in a signal handler. The caller checks IsFull() first, as an ISR
+ * checks the FIFO: with one producer the space can only grow meanwhile.
+ *
+ * @param  data  data to be written
+ * @return None
+ */
+void SharedMem::PutData(uint8_t data) {
+    size_t put = put_total_.load(std::memory_order_relaxed);
+    assert(put - get_total_.load(std::memory_order_acquire) < size_);
+    shMemAddr_[put & (size_ - 1)] = data;
+    put_total_.store(put + 1, std::memory_order_release);
+}
+
+/**
+ * @brief Put a block of data to shared memory, as much as fits
+ *
+ * Wait-free for one producer and safe in a signal handler.
+ *
+ * @param  data  data to be written
+ * @param  len   number of bytes
+ * @return number of bytes written
+ */
+size_t SharedMem::PutBlock(const uint8_t* data, size_t len) {
+    size_t put = put_total_.load(std::memory_order_relaxed);
+    size_t n = size_ - (put - get_total_.load(std::memory_order_acquire));
+    if (len < n) {
+        n = len;
+    }
+    size_t index = put & (size_ - 1);
+    size_t first = size_ - index;
+    if (first > n) {
+        first = n;
+    }
+    memcpy(&shMemAddr_[index], data, first);
+    memcpy(shMemAddr_, &data[first], n - first);
+    put_total_.store(put + n, std::memory_order_release);
+    return n;
+}
+
+/**
+ * @brief Get the data from shared memory
+ *
+ * @param  None
+ * @return data read data from the memory
+ */
+uint8_t SharedMem::GetData() {
+    size_t get = get_total_.load(std::memory_order_relaxed);
+    assert(put_total_.load(std::memory_order_acquire) != get);
+    uint8_t data = shMemAddr_[get & (size_ - 1)];
+    get_total_.store(get + 1, std::memory_order_release);
+    return data;
+}
+
+/**
+ * @brief check if the memory is empty
+ *
+ * @param  None
+ * @return true/false memory is empty or not
+ */
+bool SharedMem::IsEmpty() {
+    return Count() == 0;
+}
+
+/**
+ * @brief check if the memory is full
+ *
+ * @param  None
+ * @return true/false memory is full or not
+ */
+bool SharedMem::IsFull() {
+    return Count() == size_;
+}
+
+/**
+ * @brief Size of the memory
+ *
+ * @param  None
+ * @return size in bytes
+ */
+size_t SharedMem::Size() {
+    return size_;
+}
+
+/**
+ * @brief Number of bytes waiting to be read
+ *
+ * @param  None
+ * @return count in bytes
+ */
+size_t SharedMem::Count() {
+    size_t get = get_total_.load(std::memory_order_acquire);
+    return put_total_.load(std::memory_order_acquire) - get;
+}
+
+/**
+ * @brief Get the readable data in place, without copying
+ *
+ * @param  first      start of the first region
+ * @param  firstLen   length of the first region
+ * @param  second     start of the second region
+ * @param  secondLen  length of the second region, 0 if no wraparound
+ * @return total length of readable data
+ */
+size_t SharedMem::GetRegions(const uint8_t** first, size_t* firstLen,
+                             const uint8_t** second, size_t* secondLen) {
+    size_t get = get_total_.load(std::memory_order_relaxed);
+    size_t count = put_total_.load(std::memory_order_acquire) - get;
+    size_t index = get & (size_ - 1);
+    size_t tail = size_ - index;
+
+    *first = &shMemAddr_[index];
+    *second = shMemAddr_;
+    if (count <= tail) {
+        *firstLen = count;
+        *secondLen = 0;
+    } else {
+        *firstLen = tail;
+        *secondLen = count - tail;
+    }
+    return count;
+}
+
+/**
+ * @brief Consume the data returned by GetRegions
+ *
+ * @param  len  number of bytes to consume
+ * @return None
+ */
+void SharedMem::Release(size_t len) {
+    size_t get = get_total_.load(std::memory_order_relaxed);
+    assert(len <= put_total_.load(std::memory_order_acquire) - get);
+    get_total_.store(get + len, std::memory_order_release);
+}
+
+/**
+ * @brief Get the free space in place, so that a producer can write to it
+ *        directly instead of through PutData
+ *
+ * @param  first      start of the first region
+ * @param  firstLen   length of the first region
+ * @param  second     start of the second region
+ * @param  secondLen  length of the second region, 0 if no wraparound
+ * @return total free space
+ */
+size_t SharedMem::GetFreeRegions(uint8_t** first, size_t* firstLen,
+                                 uint8_t** second, size_t* secondLen) {
+    size_t put = put_total_.load(std::memory_order_relaxed);
+    size_t space = size_ - (put - get_total_.load(std::memory_order_acquire));
+    size_t index = put & (size_ - 1);
+    size_t tail = size_ - index;
+
+    *first = &shMemAddr_[index];
+    *second = shMemAddr_;
+    if (space <= tail) {
+        *firstLen = space;
+        *secondLen = 0;
+    } else {
+        *firstLen = tail;
+        *secondLen = space - tail;
+    }
+    return space;
+}
+
+/**
+ * @brief Publish the data written to the regions returned by GetFreeRegions
+ *
+ * @param  len  number of bytes written
+ * @return None
+ */
+void SharedMem::Commit(size_t len) {
+    size_t put = put_total_.load(std::memory_order_relaxed);
+    assert(len <= size_ - (put - get_total_.load(std::memory_order_acquire)));
+    put_total_.store(put + len, std::memory_order_release);
+}
+#else
+/**
+ * @brief Allocates shared memory of a given size and placement
+ *
+ * @param  size    size of the memory in bytes
+ * @param  policy  hugepage and NUMA placement of the memory
+ * @return None
+ */
+SharedMem::SharedMem(size_t size, const MemPolicy& policy)
+{
+    assert(size > 0);
+    bool ok = region_.allocate(size, policy);
+    assert(ok);
+    (void)ok;
+    shMemAddr_ = region_.data();
+    size_ = size;
     get_index_ = 0;
     put_index_ = 0;
     count_ = 0;
 }
 
 /**
- * @brief releases the shared memory
+ * @brief Uses memory owned by the caller, e.g. a static array
+ *
+ * @param  storage  memory of at least size bytes, outlives the object
+ * @param  size     size of the memory in bytes
+ * @return None
+ */
+SharedMem::SharedMem(uint8_t* storage, size_t size)
+{
+    assert((storage != NULL) && (size > 0));
+    shMemAddr_ = storage;
+    size_ = size;
+    get_index_ = 0;
+    put_index_ = 0;
+    count_ = 0;
+}
+
+/**
+ * @brief releases the shared memory, caller memory is left alone
  *
  * @param  None
  * @return None
  */
 SharedMem::~SharedMem()
 {
-    delete[] shMemAddr_;
+    region_.release();
 }
 
 /**
@@ -59,13 +320,41 @@ SharedMem::~SharedMem()
  * @return None
  */
 void SharedMem::PutData(uint8_t data) {
-    assert(count_ < SHARED_MEM_SIZE);
+    assert(count_ < size_);
     std::lock_guard<std::mutex> lock(mutex_);
     shMemAddr_[put_index_] = data;
-    put_index_ = (put_index_ + 1) % SHARED_MEM_SIZE;
+    put_index_ = (put_index_ + 1) % size_;
     ++count_;
 }
 
+/**
+ * @brief Put a block of data to shared memory, as much as fits
+ *
+ * @param  data  data to be written
+ * @param  len   number of bytes
+ * @return number of bytes written
+ */
+size_t SharedMem::PutBlock(const uint8_t* data, size_t len) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t n = size_ - count_;
+    if (len < n) {
+        n = len;
+    }
+    size_t first = size_ - put_index_;
+    if (first > n) {
+        first = n;
+    }
+    memcpy(&shMemAddr_[put_index_], data, first);
+    memcpy(shMemAddr_, &data[first], n - first);
+    put_index_ = (put_index_ + n) % size_;
+    count_ += n;
+    Trace::record(TraceEvent::PUT, n);
+    if (n < len) {
+        Trace::record(TraceEvent::DROP, len - n);
+    }
+    return n;
+}
+
 /**
  * @brief Get the data from shared memory
  *
@@ -78,7 +367,7 @@ uint8_t SharedMem::GetData() {
 
     std::lock_guard<std::mutex> lock(mutex_);
     data = shMemAddr_[get_index_];
-    get_index_ = (get_index_ + 1) % SHARED_MEM_SIZE;
+    get_index_ = (get_index_ + 1) % size_;
     --count_;
     return data;
 }
@@ -102,5 +391,113 @@ bool SharedMem::IsEmpty() {
  */
 bool SharedMem::IsFull() {
     std::lock_guard<std::mutex> lock(mutex_);
-    return count_ == SHARED_MEM_SIZE;
+    return count_ == size_;
+}
+
+/**
+ * @brief Size of the memory
+ *
+ * @param  None
+ * @return size in bytes
+ */
+size_t SharedMem::Size() {
+    return size_;
+}
+
+/**
+ * @brief Number of bytes waiting to be read
+ *
+ * @param  None
+ * @return count in bytes
+ */
+size_t SharedMem::Count() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return count_;
+}
+
+/**
+ * @brief Get the readable data in place, without copying
+ *
+ * The data may wrap around the end of the memory, in that case it is
+ * returned as two regions. The regions stay valid until Release() as the
+ * producer only writes to the free part of the memory.
+ *
+ * @param  first      start of the first region
+ * @param  firstLen   length of the first region
+ * @param  second     start of the second region
+ * @param  secondLen  length of the second region, 0 if no wraparound
+ * @return total length of readable data
+ */
+size_t SharedMem::GetRegions(const uint8_t** first, size_t* firstLen,
+                             const uint8_t** second, size_t* secondLen) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t count = count_;
+    size_t tail = size_ - get_index_;
+
+    *first = &shMemAddr_[get_index_];
+    *second = shMemAddr_;
+    if (count <= tail) {
+        *firstLen = count;
+        *secondLen = 0;
+    } else {
+        *firstLen = tail;
+        *secondLen = count - tail;
+    }
+    return count;
+}
+
+/**
+ * @brief Consume the data returned by GetRegions
+ *
+ * @param  len  number of bytes to consume
+ * @return None
+ */
+void SharedMem::Release(size_t len) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    assert(len <= count_);
+    get_index_ = (get_index_ + len) % size_;
+    count_ -= len;
+}
+
+/**
+ * @brief Get the free space in place, so that a producer can write to it
+ *        directly (e.g. with readv) instead of through PutData
+ *
+ * @param  first      start of the first region
+ * @param  firstLen   length of the first region
+ * @param  second     start of the second region
+ * @param  secondLen  length of the second region, 0 if no wraparound
+ * @return total free space
+ */
+size_t SharedMem::GetFreeRegions(uint8_t** first, size_t* firstLen,
+                                 uint8_t** second, size_t* secondLen) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t space = size_ - count_;
+    size_t tail = size_ - put_index_;
+
+    *first = &shMemAddr_[put_index_];
+    *second = shMemAddr_;
+    if (space <= tail) {
+        *firstLen = space;
+        *secondLen = 0;
+    } else {
+        *firstLen = tail;
+        *secondLen = space - tail;
+    }
+    return space;
+}
+
+/**
+ * @brief Publish the data written to the regions returned by GetFreeRegions
+ *
+ * @param  len  number of bytes written
+ * @return None
+ */
+void SharedMem::Commit(size_t len) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    assert(len <= size_ - count_);
+    put_index_ = (put_index_ + len) % size_;
+    count_ += len;
+    Trace::record(TraceEvent::PUT, len);
 }
+#endif
@@ -12,32 +12,64 @@
 #include <cstdint>
 #include <cstring>
 #include <cassert>
+#if defined(SEQPARSER_EMBEDDED)
+#include <atomic>
+#else
 #include <mutex>
+#endif
+#include "MemPolicy.h"
 /*-----------------------------------------------------------------------*/
 /* Macro                                                                 */
 /*-----------------------------------------------------------------------*/
 /*
- * The shared memory size between application and test is 16 bytes
+ * The shared memory size between application and test is 16 bytes by
+ * default, larger rings are created with an explicit size
  */
+#ifndef SHARED_MEM_SIZE
 #define SHARED_MEM_SIZE (16)
+#endif
 
 /*-----------------------------------------------------------------------*/
 /* DataType                                                              */
 /*-----------------------------------------------------------------------*/
+/*
+ * Embedded profile (SEQPARSER_EMBEDDED): the producer side is wait-free
+ * for one producer, e.g. an interrupt or signal handler. A SharedMem on
+ * caller provided static memory needs no heap. Sizes must be a power of
+ * two, the ring is indexed by masking free-running byte totals.
+ */
 class SharedMem{
     public: 
         SharedMem();        /**< Allocate shared memory */
+        SharedMem(size_t size, const MemPolicy& policy); /**< Allocate with a placement policy */
+        SharedMem(uint8_t* storage, size_t size); /**< Use caller provided memory */
         ~SharedMem();       /**< Release the shared memory */
         void PutData(uint8_t data); /**< Put the data in shared memory */
+        size_t PutBlock(const uint8_t* data, size_t len); /**< Put as much of a block as fits */
         uint8_t GetData();   /**< Get the data from shared memory */
         bool IsEmpty();      /**< Check empty condition */
         bool IsFull();       /**< Check Full condition */
+        size_t Size();       /**< Size of the memory */
+        size_t Count();      /**< Bytes waiting to be read */
+        size_t GetRegions(const uint8_t** first, size_t* firstLen,
+                          const uint8_t** second, size_t* secondLen); /**< Readable data in place */
+        void Release(size_t len); /**< Consume data returned by GetRegions */
+        size_t GetFreeRegions(uint8_t** first, size_t* firstLen,
+                              uint8_t** second, size_t* secondLen); /**< Free space in place */
+        void Commit(size_t len);  /**< Publish data written to GetFreeRegions */
     private:
+        MemRegion region_;   /**< Placement of the shared memory, unused with caller memory */
         uint8_t* shMemAddr_; /**< Pointer to shared memory */
-        uint8_t get_index_;  /**< Index in the memory for the get data */ 
-        uint8_t put_index_;  /**< Index in the memory for the put data */
-        uint8_t count_;      /**< Total count of data */
+        size_t size_;        /**< Size of the shared memory */
+#if defined(SEQPARSER_EMBEDDED)
+        std::atomic<size_t> put_total_; /**< Bytes ever put, written by the producer only */
+        std::atomic<size_t> get_total_; /**< Bytes ever got, written by the consumer only */
+#else
+        size_t get_index_;   /**< Index in the memory for the get data */ 
+        size_t put_index_;   /**< Index in the memory for the put data */
+        size_t count_;       /**< Total count of data */
         std::mutex mutex_;   /**< Mutex for safe access */
+#endif
 };
 /*-----------------------------------------------------------------------*/
 /* Prototype                                                             */
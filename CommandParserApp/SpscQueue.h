@@ -0,0 +1,138 @@
+/**
+ * @file  SpscQueue.h
+ * @brief Bounded lock-free single producer single consumer queue
+ * @note  Template, so the implementation lives in the header
+ *
+ */
+#ifndef __SPSC_QUEUE_H__
+#define __SPSC_QUEUE_H__
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include <cstddef>
+#include <cassert>
+#include <atomic>
+#include <vector>
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+#define SPSC_CACHE_LINE (64)
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+/*
+ * Items are moved in batches, each side publishes a whole batch with one
+ * atomic store and caches the index of the other side to avoid touching
+ * its cache line on every call.
+ */
+template <typename T>
+class SpscQueue {
+    public:
+        /**
+         * @brief Allocate the slots
+         *
+         * @param  capacity  number of slots, a power of two
+         * @return None
+         */
+        explicit SpscQueue(size_t capacity) : slots_(capacity)
+        {
+            assert((capacity > 0) && ((capacity & (capacity - 1)) == 0));
+            mask_ = capacity - 1;
+            head_ = 0;
+            tail_ = 0;
+            headCache_ = 0;
+            tailCache_ = 0;
+        }
+
+        /**
+         * @brief Push up to n items, producer side only
+         *
+         * @param  items  items to push
+         * @param  n      number of items
+         * @return number of items pushed, less than n when the queue is full
+         */
+        size_t push(const T* items, size_t n)
+        {
+            size_t tail = tail_.load(std::memory_order_relaxed);
+            size_t space = slots_.size() - (tail - headCache_);
+            if (space < n) {
+                headCache_ = head_.load(std::memory_order_acquire);
+                space = slots_.size() - (tail - headCache_);
+            }
+            if (n > space) {
+                n = space;
+            }
+            for (size_t i = 0; i < n; i++) {
+                slots_[(tail + i) & mask_] = items[i];
+            }
+            tail_.store(tail + n, std::memory_order_release);
+            return n;
+        }
+
+        /**
+         * @brief Pop up to max items, consumer side only
+         *
+         * @param  items  popped items
+         * @param  max    maximum number of items
+         * @return number of items popped, 0 when the queue is empty
+         */
+        size_t pop(T* items, size_t max)
+        {
+            size_t head = head_.load(std::memory_order_relaxed);
+            size_t avail = tailCache_ - head;
+            if (avail < max) {
+                tailCache_ = tail_.load(std::memory_order_acquire);
+                avail = tailCache_ - head;
+            }
+            if (max > avail) {
+                max = avail;
+            }
+            for (size_t i = 0; i < max; i++) {
+                items[i] = slots_[(head + i) & mask_];
+            }
+            head_.store(head + max, std::memory_order_release);
+            return max;
+        }
+
+        /**
+         * @brief Approximate number of queued items, any thread
+         *
+         * @param  None
+         * @return number of items
+         */
+        size_t size()
+        {
+            size_t head = head_.load(std::memory_order_acquire);
+            size_t tail = tail_.load(std::memory_order_acquire);
+            return tail - head;
+        }
+
+        /**
+         * @brief Number of slots
+         *
+         * @param  None
+         * @return capacity
+         */
+        size_t capacity()
+        {
+            return slots_.size();
+        }
+    private:
+        std::vector<T> slots_;       /**< Queue storage */
+        size_t mask_;                /**< capacity - 1 */
+        alignas(SPSC_CACHE_LINE) std::atomic<size_t> head_; /**< Next slot to pop */
+        size_t tailCache_;           /**< Consumer copy of tail_ */
+        alignas(SPSC_CACHE_LINE) std::atomic<size_t> tail_; /**< Next slot to push */
+        size_t headCache_;           /**< Producer copy of head_ */
+};
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+#endif /* __SPSC_QUEUE_H__ */
@@ -10,12 +10,40 @@
 #include <gtest/gtest.h>
 #include <thread>
 #include <chrono>
+#include <random>
+#include <functional>
+#include <fstream>
+#include <map>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <csignal>
 
 /* Include application code here */
 #include "Application.cpp"
 #include "CmdSeqParser.cpp"
 #include "BackgroundTask.cpp"
 #include "SharedMem.cpp"
+#include "MemPolicy.cpp"
+#include "Checkpoint.cpp"
+#include "ApproxMatcher.cpp"
+#include "Crc.cpp"
+#include "FrameVerifier.cpp"
+#include "ParseEvents.cpp"
+#include "Pipeline.cpp"
+#include "IngestServer.cpp"
+#include "FileReader.cpp"
+#include "RateStats.cpp"
+#include "PatternDfa.cpp"
+#include "DiffHarness.cpp"
+#include "LaneScheduler.cpp"
+#include "PerfCounters.cpp"
+#include "Trace.cpp"
+#include "OutputSink.cpp"
+#include "PatternSet.cpp"
+#include "BitSlipMatcher.cpp"
+#include "CommandStats.cpp"
+#include "LoadGenerator.cpp"
 
 /*-----------------------------------------------------------------------*/
 /* Macro                                                                 */
@@ -625,6 +653,1570 @@ TEST_F(TestApp, MultiSequence_5) {
     TestApp_SignalAndTest(true, true, 10);
 }
 
+TEST_F(TestApp, CheckpointRestore) {
+    /* Fill the shared memory buffer, ending with half of a sequence */
+    shmem_->PutData(0xA5);
+    shmem_->PutData(0x5A);
+    for(int i=2;i<SHARED_MEM_SIZE-1;i++){ 
+        shmem_->PutData(0x0);
+    }
+    shmem_->PutData(0xA5);
+
+    /* Signal and test conditions */
+    TestApp_SignalAndTest(true, true, 1);
+
+    /* Serialize the state as it would be written on shutdown */
+    ParserCheckpoint cp;
+    uint8_t record[CHECKPOINT_RECORD_SIZE];
+    processor_->checkpoint(cp);
+    EXPECT_EQ(Checkpoint_Encode(cp, record), (size_t)CHECKPOINT_RECORD_SIZE);
+
+    /* Warm restart in a new parser and complete the sequence */
+    SharedMem shmem;
+    CmdSeqParser parser(&shmem);
+    ParserCheckpoint restored;
+    EXPECT_TRUE(Checkpoint_Decode(record, sizeof(record), restored));
+    EXPECT_TRUE(parser.restore(restored));
+    EXPECT_EQ(parser.getState(), CmdSeqParser::State::FOUND_A5);
+
+    shmem.PutData(0x5A);
+    for(int i=1;i<SHARED_MEM_SIZE;i++){ 
+        shmem.PutData(0x0);
+    }
+    parser.parser();
+    EXPECT_EQ(parser.getCount(), (uint64_t)2);
+    EXPECT_EQ(parser.getOffset(), (uint64_t)(2 * SHARED_MEM_SIZE));
+
+    /* Invalid state is rejected */
+    restored.state = 0xFF;
+    EXPECT_FALSE(parser.restore(restored));
+}
+
+TEST(Checkpoint, SnapshotMultiChannel) {
+    const char* path = "/tmp/seqparser_checkpoint_test.bin";
+    const size_t channels = 2500;
+    Checkpointer ckpt(path, channels, 10);
+
+    /* Publish from the "parse loop" while the snapshot thread runs */
+    ckpt.start();
+    for (size_t i = 0; i < channels; i++) {
+        ParserCheckpoint cp;
+        cp.state = (uint8_t)(i % 3);
+        cp.counter = i * 7;
+        cp.offset = i * SHARED_MEM_SIZE;
+        ckpt.publish(i, cp);
+    }
+    ckpt.stop();
+
+    /* One contiguous blob per thousand channels */
+    std::vector<ParserCheckpoint> cps;
+    EXPECT_TRUE(Checkpointer::load(path, cps));
+    ASSERT_EQ(cps.size(), channels);
+    for (size_t i = 0; i < channels; i++) {
+        EXPECT_EQ(cps[i].state, (uint8_t)(i % 3));
+        EXPECT_EQ(cps[i].counter, (uint64_t)(i * 7));
+        EXPECT_EQ(cps[i].offset, (uint64_t)(i * SHARED_MEM_SIZE));
+    }
+
+    /* Truncated file must be rejected */
+    std::vector<uint8_t> blob(Checkpoint_BlobSize(2));
+    Checkpoint_EncodeBlob(cps.data(), 0, 2, blob.data());
+    EXPECT_TRUE(Checkpoint_DecodeBlobs(blob.data(), blob.size(), cps));
+    EXPECT_FALSE(Checkpoint_DecodeBlobs(blob.data(), blob.size() - 1, cps));
+    unlink(path);
+}
+
+TEST(RunSkipping, MatchesScalarPath) {
+    SharedMem shmem;
+    CmdSeqParser bulk(&shmem);
+    CmdSeqParser scalar(&shmem);
+    std::vector<uint8_t> stream(4096, 0x00);
+
+    /* Headers near block edges, in runs of fill bytes and back to back */
+    const size_t pos[] = { 0, 15, 18, 31, 100, 1000, 2047, 4094 };
+    for (size_t p : pos) {
+        stream[p] = 0xA5;
+        stream[p + 1] = 0x5A;
+    }
+    for (size_t i = 200; i < 300; i++) {
+        stream[i] = (i & 1) ? 0x5A : 0xA5;
+    }
+    std::fill(stream.begin() + 3000, stream.begin() + 3100, 0xFF);
+    stream[3050] = 0xA5;
+    stream[3051] = 0xA5;
+    stream[3052] = 0x5A;
+
+    /* Parse in odd sized pieces so candidates straddle the blocks */
+    for (size_t i = 0; i < stream.size(); i += 37) {
+        size_t len = std::min<size_t>(37, stream.size() - i);
+        bulk.parseBlock(&stream[i], len);
+        scalar.parseBlockScalar(&stream[i], len);
+        EXPECT_EQ(bulk.getState(), scalar.getState());
+    }
+    EXPECT_EQ(bulk.getCount(), scalar.getCount());
+    EXPECT_EQ(bulk.getCount(), (uint64_t)(8 + 50 + 1));
+    EXPECT_EQ(bulk.getOffset(), (uint64_t)stream.size());
+}
+
+TEST(ApproxMatcher, CountsBitErrorsAcrossBuffers) {
+    const uint8_t header[] = { 0xA5, 0x5A };
+    SharedMem shmem;
+    CmdSeqParser parser(&shmem);
+    ApproxMatcher approx(header, sizeof(header), 2);
+    parser.setApproxMatcher(&approx);
+
+    /* Exact, 1 bit error, 2 bit errors split across buffers, 3 bit errors */
+    const uint8_t stream[] = {
+        0xA5, 0x5A, 0x00, 0x00, 0xA4, 0x5A, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xA5,
+        0x59, 0x00, 0x00, 0xA5, 0x5A, 0x00, 0x00, 0x00,
+        0x00, 0xA1, 0x53, 0x00, 0x00, 0x00, 0x00, 0x00,
+    };
+    for (size_t i = 0; i < sizeof(stream); i++) {
+        shmem.PutData(stream[i]);
+        if (shmem.IsFull()) {
+            parser.parser();
+        }
+    }
+
+    EXPECT_EQ(parser.getCount(), (uint64_t)2);
+    EXPECT_EQ(approx.getExactCount(), (uint64_t)2);
+    EXPECT_EQ(approx.getCount(1), (uint64_t)1);
+    EXPECT_EQ(approx.getCount(2), (uint64_t)1);
+    EXPECT_EQ(parser.getApproxCount(), (uint64_t)2);
+}
+
+TEST(ApproxMatcher, BlockSplitsMatchBruteForce) {
+    const uint8_t header[] = { 0xA5, 0x5A, 0x01 };
+    const unsigned k = 4;
+    std::vector<uint8_t> stream(5000);
+    std::mt19937 rng(42);
+    for (size_t i = 0; i < stream.size(); i++) {
+        stream[i] = (rng() % 4 == 0) ? header[i % 3] ^ (uint8_t)(1u << (rng() % 8)) : (uint8_t)rng();
+    }
+
+    /* Brute force bit distance of every window */
+    uint64_t expected[k + 1] = { 0 };
+    for (size_t i = 0; i + sizeof(header) <= stream.size(); i++) {
+        unsigned distance = 0;
+        for (size_t f = 0; f < sizeof(header); f++) {
+            distance += __builtin_popcount(stream[i + f] ^ header[f]);
+        }
+        if (distance <= k) {
+            expected[distance]++;
+        }
+    }
+
+    /* Chunks shorter than the pattern, around and above the SIMD width */
+    ApproxMatcher approx(header, sizeof(header), k);
+    const size_t chunks[] = { 1, 2, 17, 100, 16, 1, 1000, 3, 33 };
+    size_t pos = 0;
+    for (size_t c = 0; pos < stream.size(); c++) {
+        size_t len = std::min(chunks[c % 9], stream.size() - pos);
+        approx.scan(&stream[pos], len);
+        pos += len;
+    }
+    for (unsigned d = 0; d <= k; d++) {
+        EXPECT_EQ(approx.getCount(d), expected[d]);
+    }
+}
+
+TEST(BitSlipMatcher, HeadersAtEveryBitOffsetAcrossBlocks) {
+    /* Random bits with headers dropped in at random bit offsets */
+    std::mt19937 rng(45);
+    std::vector<uint8_t> bits(80000);
+    for (auto& b : bits) {
+        b = (uint8_t)(rng() & 1);
+    }
+    for (size_t n = 0; n < 400; n++) {
+        size_t at = rng() % (bits.size() - 16);
+        for (unsigned k = 0; k < 16; k++) {
+            bits[at + k] = (uint8_t)((0xA55A >> (15 - k)) & 1);
+        }
+    }
+    std::vector<uint8_t> stream(bits.size() / 8, 0);
+    for (size_t i = 0; i < bits.size(); i++) {
+        stream[i / 8] |= (uint8_t)(bits[i] << (7 - i % 8));
+    }
+
+    /* Brute force every bit offset */
+    uint64_t expected[8] = { 0 };
+    uint64_t last = 0;
+    for (size_t i = 0; i + 16 <= bits.size(); i++) {
+        unsigned v = 0;
+        for (unsigned k = 0; k < 16; k++) {
+            v = (v << 1) | bits[i + k];
+        }
+        if (v == 0xA55A) {
+            expected[i % 8]++;
+            last = i;
+        }
+    }
+
+    /* Chunks below, at and above the word size */
+    BitSlipMatcher slip;
+    EXPECT_EQ(slip.getSlip(), -1);
+    const size_t chunks[] = { 1, 7, 8, 9, 1, 64, 3, 1000, 15 };
+    size_t pos = 0;
+    for (size_t c = 0; pos < stream.size(); c++) {
+        size_t len = std::min(chunks[c % 9], stream.size() - pos);
+        slip.scan(&stream[pos], len);
+        pos += len;
+    }
+    uint64_t total = 0;
+    for (unsigned s = 0; s < 8; s++) {
+        EXPECT_EQ(slip.getCount(s), expected[s]) << "slip " << s;
+        EXPECT_GT(expected[s], (uint64_t)0);
+        total += expected[s];
+    }
+    EXPECT_EQ(slip.getCount(), total);
+    EXPECT_EQ(slip.getLastBitOffset(), (uint64_t)last);
+    EXPECT_EQ(slip.getSlip(), (int)(last % 8));
+
+    /* A byte aligned stream slipped by 3 bits is lost to the byte parser */
+    std::vector<uint8_t> aligned(4096, 0x00);
+    for (size_t i = 10; i + 1 < aligned.size(); i += 37) {
+        aligned[i] = 0xA5;
+        aligned[i + 1] = 0x5A;
+    }
+    std::vector<uint8_t> slipped(aligned.size() + 1, 0x00);
+    for (size_t i = 0; i < aligned.size(); i++) {
+        slipped[i] |= (uint8_t)(aligned[i] >> 3);
+        slipped[i + 1] |= (uint8_t)(aligned[i] << 5);
+    }
+    SharedMem shmem(1024, MemPolicy());
+    CmdSeqParser parser(&shmem);
+    BitSlipMatcher link;
+    parser.setBitSlipMatcher(&link);
+    for (size_t i = 0; i < slipped.size(); i += 500) {
+        size_t len = std::min<size_t>(500, slipped.size() - i);
+        EXPECT_EQ(shmem.PutBlock(&slipped[i], len), len);
+        parser.parseAvailable();
+    }
+    EXPECT_EQ(parser.getCount(), (uint64_t)0);
+    EXPECT_EQ(parser.getBitSlipCount(), (uint64_t)((aligned.size() - 10 - 2) / 37 + 1));
+    EXPECT_EQ(link.getCount(3), link.getCount());
+    EXPECT_EQ(link.getSlip(), 3);
+
+    /* The bulk path used by Pipeline and FileReader finds them as well */
+    CmdSeqParser bulk(&shmem);
+    BitSlipMatcher bulkLink;
+    bulk.setBitSlipMatcher(&bulkLink);
+    bulk.parseBlock(slipped.data(), slipped.size());
+    EXPECT_EQ(bulk.getBitSlipCount(), parser.getBitSlipCount());
+}
+
+TEST(Crc, CheckValuesAndImplementations) {
+    const uint8_t check[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+    EXPECT_EQ(Crc16(check, sizeof(check)), 0x906E);
+    EXPECT_EQ(Crc32c(check, sizeof(check)), 0xE3069283u);
+
+    /* All implementations agree for every length and alignment */
+    std::vector<uint8_t> data(300);
+    std::mt19937 rng(7);
+    for (auto& b : data) {
+        b = (uint8_t)rng();
+    }
+    for (size_t off = 0; off < 8; off++) {
+        for (size_t len = 0; len + off <= data.size(); len += 13) {
+            const uint8_t* p = &data[off];
+            uint32_t ref32 = Crc32c_UpdateImpl(CrcImpl::BYTEWISE, CRC32C_INIT, p, len);
+            EXPECT_EQ(Crc32c_UpdateImpl(CrcImpl::SLICE_BY_8, CRC32C_INIT, p, len), ref32);
+            EXPECT_EQ(Crc32c_UpdateImpl(CrcImpl::HARDWARE, CRC32C_INIT, p, len), ref32);
+            uint16_t ref16 = Crc16_UpdateImpl(CrcImpl::BYTEWISE, CRC16_INIT, p, len);
+            EXPECT_EQ(Crc16_UpdateImpl(CrcImpl::SLICE_BY_8, CRC16_INIT, p, len), ref16);
+        }
+    }
+}
+
+TEST(FrameVerifier, FramesAcrossBuffersAndWraparound) {
+    FrameVerifier crc16(FrameVerifier::CrcType::CRC16);
+    FrameVerifier crc32(FrameVerifier::CrcType::CRC32C);
+    std::vector<uint8_t> s16;
+    std::vector<uint8_t> s32;
+
+    /* Good frame, corrupted frame, good frame longer than the buffer */
+    for (int f = 0; f < 3; f++) {
+        std::vector<uint8_t> payload(f == 2 ? 40 : 5);
+        for (size_t i = 0; i < payload.size(); i++) {
+            payload[i] = (uint8_t)(i * 31 + f);
+        }
+        uint16_t c16 = Crc16(payload.data(), payload.size());
+        uint32_t c32 = Crc32c(payload.data(), payload.size());
+        if (f == 1) {
+            payload[2] ^= 0x10;
+        }
+        for (auto* s : { &s16, &s32 }) {
+            s->insert(s->end(), { 0x00, 0xA5, 0x5A, (uint8_t)payload.size() });
+            s->insert(s->end(), payload.begin(), payload.end());
+        }
+        s16.insert(s16.end(), { (uint8_t)c16, (uint8_t)(c16 >> 8), 0x00 });
+        s32.insert(s32.end(), { (uint8_t)c32, (uint8_t)(c32 >> 8),
+                                (uint8_t)(c32 >> 16), (uint8_t)(c32 >> 24), 0x00 });
+    }
+
+    /* CRC16 stream through the parser, 16 bytes at a time */
+    SharedMem shmem;
+    CmdSeqParser parser(&shmem);
+    parser.setFrameVerifier(&crc16);
+    s16.resize((s16.size() + SHARED_MEM_SIZE - 1) / SHARED_MEM_SIZE * SHARED_MEM_SIZE, 0);
+    for (uint8_t b : s16) {
+        shmem.PutData(b);
+        if (shmem.IsFull()) {
+            parser.parser();
+        }
+    }
+    EXPECT_EQ(parser.getCount(), (uint64_t)3);
+    EXPECT_EQ(crc16.getValidCount(), (uint64_t)2);
+    EXPECT_EQ(crc16.getInvalidCount(), (uint64_t)1);
+
+    /* CRC32C stream split in two regions at every position */
+    for (size_t split = 0; split <= s32.size(); split++) {
+        FrameVerifier verifier(FrameVerifier::CrcType::CRC32C);
+        verifier.feed(s32.data(), split);
+        verifier.feed(s32.data() + split, s32.size() - split);
+        EXPECT_EQ(verifier.getValidCount(), (uint64_t)2);
+        EXPECT_EQ(verifier.getInvalidCount(), (uint64_t)1);
+    }
+
+    /* A capture read from a file is checked as well */
+    const char* path = "/tmp/seqparser_frames_test.bin";
+    FILE* fp = fopen(path, "wb");
+    ASSERT_NE(fp, nullptr);
+    ASSERT_EQ(fwrite(s32.data(), 1, s32.size(), fp), s32.size());
+    fclose(fp);
+    FileReaderConfig config;
+    config.blockSize = 4096;
+    FileReader reader(config);
+    SharedMem fileMem;
+    CmdSeqParser fileParser(&fileMem);
+    fileParser.setFrameVerifier(&crc32);
+    ASSERT_TRUE(reader.read(path, &fileParser));
+    unlink(path);
+    EXPECT_EQ(crc32.getValidCount(), (uint64_t)2);
+    EXPECT_EQ(crc32.getInvalidCount(), (uint64_t)1);
+}
+
+TEST(MemPolicy, HugePageRingOnNodeWithPinnedWorker) {
+    MemPolicy policy;
+    policy.hugePages = true;
+    policy.node = 0;
+
+    /* Hugepages fall back to normal pages when none are reserved, the
+     * embedded profile only takes power of two rings */
+#if defined(SEQPARSER_EMBEDDED)
+    const size_t size = MEM_HUGE_PAGE_SIZE;
+#else
+    const size_t size = MEM_HUGE_PAGE_SIZE + 1;
+#endif
+    SharedMem shmem(size, policy);
+    EXPECT_EQ(shmem.Size(), size);
+    CmdSeqParser parser(&shmem);
+    BackgroundTask task(&parser);
+    Application app(&task);
+
+    cpu_set_t cpus;
+    if (MemPolicy_NodeCpus(0, &cpus)) {
+        app.setCpuSet(cpus);
+    }
+    app.start();
+
+    /* Fill the large ring and parse it in place */
+    for (size_t i = 0; i < shmem.Size(); i++) {
+        shmem.PutData((i % 1000 == 998) ? 0xA5 : (i % 1000 == 999) ? 0x5A : 0x00);
+    }
+    app.dataAvailable();
+    while (!shmem.IsEmpty()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    app.stop();
+    EXPECT_EQ(parser.getCount(), (uint64_t)(shmem.Size() / 1000));
+    EXPECT_EQ(parser.getOffset(), (uint64_t)shmem.Size());
+}
+
+TEST_F(TestApp, CountIsPublishedToOtherThreads) {
+    shmem_->PutData(0xA5);
+    shmem_->PutData(0x5A);
+    for(int i=2;i<SHARED_MEM_SIZE;i++){ 
+        shmem_->PutData(0x0);
+    }
+
+    /* Signal and test conditions */
+    TestApp_SignalAndTest(true, true, 1);
+    EXPECT_EQ(app_->getCount(), (uint64_t)1);
+}
+
+#if defined(PARSE_EVENTS_AWAIT)
+static std::atomic<int> awaitDone(0);
+
+static ParseTask TestApp_AwaitMatches(Application* app, uint64_t n) {
+    uint64_t count = co_await app->nextMatches(n);
+    if (count >= n) {
+        awaitDone++;
+    }
+}
+
+static ParseTask TestApp_AwaitBuffer(Application* app) {
+    co_await app->bufferProcessed();
+    co_await app->countChanged();
+    awaitDone++;
+}
+
+TEST_F(TestApp, AwaitParseEvents) {
+    /* Thousands of suspended consumers, no thread each */
+    awaitDone = 0;
+    for (int i = 0; i < 3000; i++) {
+        TestApp_AwaitMatches(app_, 1 + i % 3);
+    }
+    TestApp_AwaitBuffer(app_);
+    EXPECT_EQ(awaitDone.load(), 0);
+
+    /* One match per buffer */
+    for (int b = 0; b < 3; b++) {
+        shmem_->PutData(0xA5);
+        shmem_->PutData(0x5A);
+        for(int i=2;i<SHARED_MEM_SIZE;i++){ 
+            shmem_->PutData(0x0);
+        }
+        TestApp_SignalAndTest(true, true, b + 1);
+    }
+    EXPECT_EQ(awaitDone.load(), 3001);
+}
+
+static ParseTask TestApp_AwaitEvents(ParseEvents* events) {
+    co_await events->countChanged();
+    awaitDone++;
+}
+
+TEST(ParseEvents, ExecutorStartsOnFirstWaiter) {
+    /* Progress nobody awaits costs no thread */
+    ParseEvents events;
+    events.start();
+    events.publish(1, 1);
+    EXPECT_FALSE(events.isRunning());
+
+    awaitDone = 0;
+    TestApp_AwaitEvents(&events);
+    EXPECT_TRUE(events.isRunning());
+    EXPECT_EQ(events.getWaiting(), (size_t)1);
+
+    events.publish(2, 2);
+    for (int i = 0; (i < 5000) && (awaitDone.load() == 0); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(awaitDone.load(), 1);
+    events.stop();
+    EXPECT_FALSE(events.isRunning());
+}
+#endif
+
+TEST(Pipeline, StagesMatchSerialParse) {
+    /* Random stream with headers and CRC16 frames */
+    std::vector<uint8_t> stream;
+    std::mt19937 rng(3);
+    while (stream.size() < 20000) {
+        if (rng() % 8 == 0) {
+            uint8_t payload[6];
+            for (auto& b : payload) {
+                b = (uint8_t)(rng() & 0x7F);
+            }
+            uint16_t crc = Crc16(payload, sizeof(payload));
+            stream.insert(stream.end(), { 0xA5, 0x5A, (uint8_t)sizeof(payload) });
+            stream.insert(stream.end(), payload, payload + sizeof(payload));
+            stream.insert(stream.end(), { (uint8_t)crc, (uint8_t)(crc >> 8) });
+        } else {
+            stream.push_back((rng() % 3 == 0) ? 0xA5 : (uint8_t)rng());
+        }
+    }
+    SharedMem ref;
+    CmdSeqParser serial(&ref);
+    FrameVerifier serialFrames(FrameVerifier::CrcType::CRC16);
+    serial.parseBlock(stream.data(), stream.size());
+    serialFrames.feed(stream.data(), stream.size());
+
+    /* Small buffers and batches so headers and frames straddle them */
+    PipelineConfig config;
+    config.batchSize = 3;
+    config.bufferSize = 7;
+    config.buffers = 16;
+    config.queueDepth = 4;
+    SharedMem shmem(64, MemPolicy());
+    CmdSeqParser parser(&shmem);
+    FrameVerifier frames(FrameVerifier::CrcType::CRC16);
+    Pipeline pipeline(&shmem, &parser, &frames, config);
+    uint64_t expectedOffset = 0;
+    bool inOrder = true;
+    pipeline.setSink([&](const BufferDesc& desc) {
+        inOrder = inOrder && (desc.offset == expectedOffset);
+        expectedOffset += desc.len;
+    });
+    pipeline.start();
+
+    size_t pos = 0;
+    while (pos < stream.size()) {
+        pos += shmem.PutBlock(&stream[pos], stream.size() - pos);
+        pipeline.notifyDataAvailable();
+        while (!shmem.IsEmpty()) {
+            std::this_thread::yield();
+        }
+    }
+    pipeline.stop();
+
+    EXPECT_TRUE(inOrder);
+    EXPECT_EQ(pipeline.getBytes(), (uint64_t)stream.size());
+    EXPECT_EQ(pipeline.getCount(), serial.getCount());
+    EXPECT_EQ(frames.getValidCount(), serialFrames.getValidCount());
+    EXPECT_EQ(frames.getInvalidCount(), serialFrames.getInvalidCount());
+    EXPECT_GT(frames.getValidCount(), (uint64_t)0);
+    StageStats scan = pipeline.getStats(Pipeline::SCAN);
+    EXPECT_EQ(scan.items, pipeline.getStats(Pipeline::SINK).items);
+    EXPECT_LE(scan.occupancy, 1.0);
+}
+
+TEST(IngestServer, SocketsAndPipeChannels) {
+    const char* path = "/tmp/seqparser_ingest_test.sock";
+    IngestServer server(64, MemPolicy());
+    ASSERT_TRUE(server.listen(path));
+    int pipeFds[2];
+    ASSERT_EQ(pipe(pipeFds), 0);
+    EXPECT_EQ(server.addPipe(pipeFds[0]), 0);
+    ASSERT_TRUE(server.start());
+
+    /* Channel n carries 100 * (n + 1) headers, written in pieces of 7 so
+     * headers are split across writes and the ring wraps around */
+    auto send = [](int fd, int headers) {
+        std::vector<uint8_t> data;
+        for (int i = 0; i < headers; i++) {
+            data.insert(data.end(), { 0x00, 0xA5, 0xA5, 0x5A, 0x11 });
+        }
+        for (size_t pos = 0; pos < data.size(); pos += 7) {
+            size_t len = std::min<size_t>(7, data.size() - pos);
+            EXPECT_EQ(write(fd, &data[pos], len), (ssize_t)len);
+        }
+        close(fd);
+    };
+    for (int c = 0; c < 2; c++) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, path);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        ASSERT_EQ(connect(fd, (struct sockaddr*)&addr, sizeof(addr)), 0);
+        send(fd, 100 * (c + 2));
+    }
+    send(pipeFds[1], 100);
+
+    /* Wait for all channels to reach end of stream */
+    for (int i = 0; (i < 1000) && (server.getStats().closed < 3); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    server.stop();
+
+    ASSERT_EQ(server.getChannels(), (size_t)3);
+    EXPECT_EQ(server.getCount(0), (uint64_t)100);
+    EXPECT_EQ(server.getCount(1) + server.getCount(2), (uint64_t)500);
+    EXPECT_TRUE(server.isClosed(1));
+    EXPECT_EQ(server.getTotalCount(), (uint64_t)600);
+    EXPECT_EQ(server.getStats().bytes, (uint64_t)(600 * 5));
+    EXPECT_EQ(server.getStats().accepted, (uint64_t)2);
+
+    /* The server can be started again after a stop */
+    ASSERT_EQ(pipe(pipeFds), 0);
+    EXPECT_EQ(server.addPipe(pipeFds[0]), 3);
+    ASSERT_TRUE(server.start());
+    send(pipeFds[1], 50);
+    for (int i = 0; (i < 1000) && !server.isClosed(3); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    server.stop();
+    EXPECT_EQ(server.getCount(3), (uint64_t)50);
+}
+
+TEST(FileReader, BackendsParseFileInOrder) {
+    const char* path = "/tmp/seqparser_file_reader_test.bin";
+
+    /* Headers at a 13 byte stride cross every 4 KiB block boundary now and
+     * then, the tail block is short */
+    std::vector<uint8_t> data(4096 * 9 + 123, 0x00);
+    uint64_t expected = 0;
+    uint64_t oneBit = 0;
+    for (size_t pos = 5, n = 0; pos + 2 < data.size(); pos += 13, n++) {
+        /* Every 7th header has a bit error, for the approximate count */
+        data[pos + 1] = 0x5A;
+        if (n % 7 == 3) {
+            data[pos] = 0xA4;
+            oneBit++;
+        } else {
+            data[pos] = 0xA5;
+            expected++;
+        }
+    }
+    FILE* fp = fopen(path, "wb");
+    ASSERT_NE(fp, nullptr);
+    ASSERT_EQ(fwrite(data.data(), 1, data.size(), fp), data.size());
+    fclose(fp);
+
+    for (auto backend : { FileReader::Backend::AUTO, FileReader::Backend::IO_URING,
+                          FileReader::Backend::THREAD_POOL, FileReader::Backend::READ,
+                          FileReader::Backend::MMAP }) {
+        FileReaderConfig config;
+        config.backend = backend;
+        config.blockSize = 4096;
+        config.depth = 4;
+        config.threads = 2;
+        FileReader reader(config);
+        SharedMem shmem;
+        CmdSeqParser parser(&shmem);
+        const uint8_t header[] = { 0xA5, 0x5A };
+        ApproxMatcher approx(header, sizeof(header), 1);
+        parser.setApproxMatcher(&approx);
+        bool ok = reader.read(path, &parser);
+        if ((backend == FileReader::Backend::IO_URING) && !ok && (reader.getBytes() == 0)) {
+            /* Kernel without io_uring, AUTO covers the fallback */
+            continue;
+        }
+        ASSERT_TRUE(ok) << FileReader::getBackendName(backend);
+        EXPECT_NE(reader.getBackend(), FileReader::Backend::AUTO);
+        EXPECT_EQ(reader.getBytes(), (uint64_t)data.size());
+        EXPECT_EQ(parser.getCount(), expected) << FileReader::getBackendName(backend);
+        EXPECT_EQ(approx.getExactCount(), expected) << FileReader::getBackendName(backend);
+        EXPECT_EQ(parser.getApproxCount(), oneBit) << FileReader::getBackendName(backend);
+    }
+    unlink(path);
+}
+
+TEST(RateStats, WindowsPeaksAndGaps) {
+    RateStats stats;
+    const uint64_t t0 = 6000; /* Start of minute 100 */
+
+    /* 5 matches per second for 20 s with a burst of 50 at t0 + 7 */
+    for (uint64_t s = 0; s < 20; s++) {
+        stats.record(5, 100, t0 + s);
+        stats.record((s == 7) ? 45 : 0, 0, t0 + s);
+    }
+    RateWindow w = stats.getSeconds(10, t0 + 19);
+    EXPECT_EQ(w.matches, (uint64_t)50);
+    EXPECT_EQ(w.bytes, (uint64_t)1000);
+    EXPECT_EQ(w.peakMatches, (uint64_t)5);
+    EXPECT_EQ(stats.getSeconds(20, t0 + 19).peakMatches, (uint64_t)50);
+    EXPECT_EQ(stats.getSeconds(20, t0 + 19).matches, (uint64_t)145);
+
+    /* Buckets of old seconds are not counted once the ring has moved on */
+    EXPECT_EQ(stats.getSeconds(10, t0 + 40).matches, (uint64_t)0);
+    stats.record(1, 1, t0 + 64 + 3);
+    EXPECT_EQ(stats.getSeconds(1, t0 + 64 + 3).matches, (uint64_t)1);
+    EXPECT_EQ(stats.getSeconds(60, t0 + 64 + 3).matches, (uint64_t)(1 + 5 * 12));
+
+    /* An hour later the burst is the peak of minute 100 only */
+    stats.record(2, 2, t0 + 3000);
+    RateWindow hour = stats.getMinutes(60, t0 + 3000);
+    EXPECT_EQ(hour.peakMatches, (uint64_t)50);
+    EXPECT_EQ(hour.matches, (uint64_t)(145 + 1 + 2));
+    EXPECT_EQ(stats.getMinutes(1, t0 + 3000).peakMatches, (uint64_t)2);
+
+    /* Gaps through the parser: headers 4 bytes apart, then 100 apart,
+     * across block boundaries */
+    SharedMem shmem;
+    CmdSeqParser parser(&shmem);
+    RateStats live;
+    parser.setRateStats(&live);
+    std::vector<uint8_t> data(1000, 0x00);
+    for (size_t pos = 0; pos < 40; pos += 4) {
+        data[pos] = 0xA5;
+        data[pos + 1] = 0x5A;
+    }
+    for (size_t pos = 100; pos < 1000; pos += 100) {
+        data[pos] = 0xA5;
+        data[pos + 1] = 0x5A;
+    }
+    for (size_t pos = 0; pos < data.size(); pos += 33) {
+        parser.parseBlock(&data[pos], std::min<size_t>(33, data.size() - pos));
+    }
+    uint64_t hist[RATE_STATS_GAP_BUCKETS];
+    live.getGapHistogram(hist);
+    EXPECT_EQ(hist[2], (uint64_t)9);   /* 4 */
+    EXPECT_EQ(hist[6], (uint64_t)9);   /* 64 (36 -> 100) and 100 */
+    EXPECT_EQ(live.getSeconds(5).matches, parser.getCount());
+    EXPECT_EQ(live.getSeconds(5).bytes, (uint64_t)1000);
+}
+
+TEST(PatternDfa, PatternsMatchReferenceAcrossBlocks) {
+    /* Bytes drawn mostly from the pattern alphabet so matches are dense */
+    std::mt19937 rng(36);
+    const uint8_t alphabet[] = { 0xA5, 0x5A, 0x03, 0xA7, 0x00, 0x10 };
+    std::vector<uint8_t> data(20000);
+    for (auto& b : data) {
+        b = alphabet[rng() % sizeof(alphabet)];
+    }
+    auto at = [&](size_t e, size_t back) { return (e >= back) ? data[e - back] : -1; };
+    auto inRange = [](int b, int lo, int hi) { return (b >= lo) && (b <= hi); };
+
+    struct Case {
+        const char* pattern;
+        std::function<bool(size_t)> endsAt;
+    };
+    const Case cases[] = {
+        { "A5+ 5A", [&](size_t e) { return (at(e, 0) == 0x5A) && (at(e, 1) == 0xA5); } },
+        { "a5 5a", [&](size_t e) { return (at(e, 0) == 0x5A) && (at(e, 1) == 0xA5); } },
+        { "A5 ?? 5A", [&](size_t e) { return (at(e, 0) == 0x5A) && (at(e, 2) == 0xA5); } },
+        { "A5 [00-0F] 5A", [&](size_t e) {
+            return (at(e, 0) == 0x5A) && inRange(at(e, 1), 0x00, 0x0F) && (at(e, 2) == 0xA5); } },
+        { "A5 ??{1,3} 5A", [&](size_t e) {
+            return (at(e, 0) == 0x5A) &&
+                   ((at(e, 2) == 0xA5) || (at(e, 3) == 0xA5) || (at(e, 4) == 0xA5)); } },
+        { "[A0-AF, 10]{2,} 5A", [&](size_t e) {
+            auto in = [&](int b) { return inRange(b, 0xA0, 0xAF) || (b == 0x10); };
+            return (at(e, 0) == 0x5A) && in(at(e, 1)) && in(at(e, 2)); } },
+        { "[^5A] 5A{2}", [&](size_t e) {
+            return (at(e, 0) == 0x5A) && (at(e, 1) == 0x5A) && (at(e, 2) >= 0) && (at(e, 2) != 0x5A); } },
+    };
+
+    for (const Case& c : cases) {
+        uint64_t expected = 0;
+        for (size_t e = 0; e < data.size(); e++) {
+            expected += c.endsAt(e) ? 1 : 0;
+        }
+        PatternDfa dfa;
+        ASSERT_TRUE(dfa.compile(c.pattern)) << c.pattern << ": " << dfa.getError();
+        dfa.scan(data.data(), data.size());
+        EXPECT_EQ(dfa.getCount(), expected) << c.pattern;
+
+        /* Same count whatever the block boundaries */
+        for (size_t block : { (size_t)1, (size_t)7, (size_t)33 }) {
+            dfa.reset();
+            for (size_t pos = 0; pos < data.size(); pos += block) {
+                dfa.scan(&data[pos], std::min(block, data.size() - pos));
+            }
+            EXPECT_EQ(dfa.getCount(), expected) << c.pattern << " block " << block;
+        }
+    }
+
+    /* The header idiom minimizes to the three states of CmdSeqParser */
+    PatternDfa header;
+    ASSERT_TRUE(header.compile("A5+ 5A"));
+    EXPECT_EQ(header.getStats().states, 3u);
+    EXPECT_EQ(header.getStats().classes, 3u);
+    EXPECT_LE(header.getStats().tableBytes, (size_t)(256 + 3 * 3 * 2));
+
+    SharedMem shmem;
+    CmdSeqParser parser(&shmem);
+    parser.setPatternDfa(&header);
+    for (size_t i = 0; i < data.size() / SHARED_MEM_SIZE * SHARED_MEM_SIZE; i++) {
+        shmem.PutData(data[i]);
+        if (shmem.IsFull()) {
+            parser.parser();
+        }
+    }
+    EXPECT_EQ(parser.getPatternCount(), parser.getCount());
+
+    /* The bulk path used by Pipeline and FileReader counts it as well */
+    PatternDfa bulkHeader;
+    ASSERT_TRUE(bulkHeader.compile("A5+ 5A"));
+    CmdSeqParser bulk(&shmem);
+    bulk.setPatternDfa(&bulkHeader);
+    bulk.parseBlock(data.data(), data.size());
+    EXPECT_EQ(bulk.getPatternCount(), bulk.getCount());
+    EXPECT_GT(bulk.getPatternCount(), (uint64_t)0);
+
+    /* Errors keep the previous DFA and report where they are */
+    const std::pair<const char*, size_t> bad[] = {
+        { "", 0 }, { "A5 G1", 3 }, { "A5 [05-01]", 4 }, { "[00-0F", 0 },
+        { "??{0,2}", 0 }, { "A5{300}", 2 }, { "A5{3,1}", 2 }, { "[^00-FF]", 0 },
+    };
+    for (const auto& b : bad) {
+        EXPECT_FALSE(header.compile(b.first)) << b.first;
+        EXPECT_EQ(header.getErrorPos(), b.second) << b.first << ": " << header.getError();
+    }
+    EXPECT_EQ(header.getStats().states, 3u);
+}
+
+TEST(DiffHarness, AllKernelsEverySplit) {
+    DiffHarness harness;
+    std::mt19937_64 rng(37);
+    std::vector<uint8_t> stream;
+
+    /* Every short stream over {A5, 5A, 00}: covers A5 A5 5A and friends */
+    ASSERT_TRUE(harness.checkExhaustive(7)) << harness.getFailure();
+
+    for (int k = 0; k < (int)DiffHarness::Stream::COUNT; k++) {
+        for (int n = 0; n < 40; n++) {
+            DiffHarness::generate(rng, (DiffHarness::Stream)k, 1 + rng() % 80, stream);
+            ASSERT_TRUE(harness.checkEverySplit(stream)) << harness.getFailure();
+        }
+        /* Long streams with several cuts */
+        for (int n = 0; n < 20; n++) {
+            DiffHarness::generate(rng, (DiffHarness::Stream)k, 4096, stream);
+            std::vector<size_t> cuts;
+            for (int c = 0; c < 6; c++) {
+                cuts.push_back(rng() % (stream.size() + 1));
+            }
+            std::sort(cuts.begin(), cuts.end());
+            ASSERT_TRUE(harness.checkCuts(stream, cuts)) << harness.getFailure();
+        }
+    }
+
+    /* The harness itself catches a wrong result */
+    stream = { 0xA5, 0xA5, 0x5A };
+    EXPECT_EQ(DiffHarness::reference(stream).count, (uint64_t)1);
+    EXPECT_GT(harness.getRuns(), (uint64_t)100000);
+}
+
+/* Soak mode: SEQPARSER_SOAK_SECONDS=600 ./testapp --gtest_filter=DiffHarness.Soak */
+TEST(DiffHarness, Soak) {
+    const char* env = getenv("SEQPARSER_SOAK_SECONDS");
+    if (env == NULL) {
+        GTEST_SKIP() << "set SEQPARSER_SOAK_SECONDS to run";
+    }
+    DiffHarness harness;
+    uint64_t seed = (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+    std::mt19937_64 rng(seed);
+    std::vector<uint8_t> stream;
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(atoi(env));
+
+    while (std::chrono::steady_clock::now() < end) {
+        auto kind = (DiffHarness::Stream)(rng() % (int)DiffHarness::Stream::COUNT);
+        if (rng() % 2) {
+            DiffHarness::generate(rng, kind, rng() % 256, stream);
+            ASSERT_TRUE(harness.checkEverySplit(stream)) << "seed " << seed << "\n"
+                                                         << harness.getFailure();
+        } else {
+            DiffHarness::generate(rng, kind, rng() % 65536, stream);
+            std::vector<size_t> cuts(1 + rng() % 16);
+            for (auto& c : cuts) {
+                c = rng() % (stream.size() + 1);
+            }
+            std::sort(cuts.begin(), cuts.end());
+            ASSERT_TRUE(harness.checkCuts(stream, cuts)) << "seed " << seed << "\n"
+                                                         << harness.getFailure();
+        }
+    }
+    printf("soak: %llu kernel runs, seed %llu\n", (unsigned long long)harness.getRuns(),
+           (unsigned long long)seed);
+}
+
+TEST(LaneScheduler, PriorityDeadlineAndBatching) {
+    SharedMem bulkMem(64 * 1024, MemPolicy());
+    SharedMem lowMem(1024, MemPolicy());
+    SharedMem highMem(1024, MemPolicy());
+    SharedMem lazyMem(1024, MemPolicy());
+    CmdSeqParser bulk(&bulkMem);
+    CmdSeqParser low(&lowMem);
+    CmdSeqParser high(&highMem);
+    CmdSeqParser lazy(&lazyMem);
+    LaneScheduler scheduler;
+
+    LaneConfig config;
+    config.batchBytes = 1024;
+    size_t bulkLane = scheduler.addLane(&bulkMem, &bulk, config);
+    config.batchBytes = 0;
+    config.deadlineUs = 1;
+    config.priority = 1;
+    size_t lowLane = scheduler.addLane(&lowMem, &low, config);
+    config.priority = 5;
+    size_t highLane = scheduler.addLane(&highMem, &high, config);
+    config.priority = 0;
+    config.deadlineUs = 5000;
+    config.batchBytes = 512;
+    size_t lazyLane = scheduler.addLane(&lazyMem, &lazy, config);
+
+    auto put = [&](SharedMem& mem, size_t lane, size_t headers, size_t fill) {
+        std::vector<uint8_t> data(fill, 0x00);
+        for (size_t i = 0; i < headers; i++) {
+            data.insert(data.end(), { 0xA5, 0x5A });
+        }
+        EXPECT_EQ(mem.PutBlock(data.data(), data.size()), data.size());
+        scheduler.notify(lane);
+    };
+    auto waitFor = [&](size_t lane, uint64_t count) {
+        for (int i = 0; (i < 2000) && (scheduler.getCount(lane) < count); i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return scheduler.getCount(lane);
+    };
+
+    /* Everything pending before start, the control lanes overdue: the high
+     * priority lane goes first, the bulk batch last */
+    put(lowMem, lowLane, 10, 0);
+    put(bulkMem, bulkLane, 1000, 60000);
+    put(highMem, highLane, 20, 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    scheduler.start();
+    EXPECT_EQ(waitFor(bulkLane, 1000), (uint64_t)1000);
+    EXPECT_EQ(waitFor(lowLane, 10), (uint64_t)10);
+    EXPECT_EQ(waitFor(highLane, 20), (uint64_t)20);
+    LaneStats hi = scheduler.getStats(highLane);
+    LaneStats lo = scheduler.getStats(lowLane);
+    LaneStats bu = scheduler.getStats(bulkLane);
+    EXPECT_EQ(hi.lastService, (uint64_t)1);
+    EXPECT_EQ(lo.lastService, (uint64_t)2);
+    EXPECT_GT(bu.lastService, (uint64_t)2);
+    EXPECT_LT(hi.maxNs, bu.maxNs);
+    EXPECT_EQ(hi.overdue, (uint64_t)1);
+    EXPECT_GE(bu.services, (uint64_t)(62000 / LANE_BATCH_SLICE));
+    EXPECT_GE(hi.p99Ns, hi.p50Ns);
+
+    /* A batch lane waits for batchBytes, or for its deadline if it has one */
+    put(bulkMem, bulkLane, 1, 100);
+    put(lazyMem, lazyLane, 1, 100);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    EXPECT_EQ(scheduler.getCount(bulkLane), (uint64_t)1000);
+    EXPECT_EQ(waitFor(lazyLane, 1), (uint64_t)1);
+    EXPECT_EQ(scheduler.getStats(lazyLane).overdue, (uint64_t)1);
+    EXPECT_EQ(scheduler.getCount(bulkLane), (uint64_t)1000);
+    put(bulkMem, bulkLane, 1, 1000);
+    EXPECT_EQ(waitFor(bulkLane, 1002), (uint64_t)1002);
+
+    /* Stop drains a batch lane below its threshold */
+    put(bulkMem, bulkLane, 3, 0);
+    scheduler.stop();
+    EXPECT_EQ(scheduler.getCount(bulkLane), (uint64_t)1005);
+
+    /* Before the deadline latency lanes go by earliest deadline alone */
+    LaneScheduler edf;
+    config.batchBytes = 0;
+    config.priority = 9;
+    config.deadlineUs = 400000;
+    size_t lateLane = edf.addLane(&highMem, &high, config);
+    config.priority = 0;
+    config.deadlineUs = 200000;
+    size_t soonLane = edf.addLane(&lowMem, &low, config);
+    const uint8_t header[] = { 0xA5, 0x5A };
+    highMem.PutBlock(header, sizeof(header));
+    edf.notify(lateLane);
+    lowMem.PutBlock(header, sizeof(header));
+    edf.notify(soonLane);
+    edf.start();
+    for (int i = 0; (i < 2000) && (edf.getCount(lateLane) + edf.getCount(soonLane) < 2); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    edf.stop();
+    EXPECT_EQ(edf.getStats(soonLane).lastService, (uint64_t)1);
+    EXPECT_EQ(edf.getStats(lateLane).lastService, (uint64_t)2);
+    EXPECT_EQ(edf.getStats(soonLane).overdue, (uint64_t)0);
+}
+
+TEST(FlushPolicy, PartialBuffersParsedWithinMaxDelay) {
+    SharedMem shmem(4096, MemPolicy());
+    CmdSeqParser parser(&shmem);
+    BackgroundTask task(&parser);
+    Application app(&task);
+    FlushPolicy policy;
+    policy.maxDelayUs = 20000;
+    policy.thresholdBytes = 4;
+    app.setFlushPolicy(policy);
+    app.start();
+
+    auto waitCount = [&](uint64_t count) {
+        auto start = std::chrono::steady_clock::now();
+        while ((app.getCount() < count) &&
+               (std::chrono::steady_clock::now() - start < std::chrono::seconds(2))) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        return std::chrono::steady_clock::now() - start;
+    };
+
+    /* At the threshold: parsed at the next tick, half the max delay */
+    const uint8_t six[] = { 0x00, 0xA5, 0x5A, 0x00, 0x00, 0x00 };
+    EXPECT_EQ(shmem.PutBlock(six, sizeof(six)), sizeof(six));
+    auto waited = waitCount(1);
+    EXPECT_EQ(app.getCount(), (uint64_t)1);
+    EXPECT_LT(waited, std::chrono::milliseconds(200));
+
+    /* Below the threshold: parsed once the max delay is reached, without
+     * the producer ever signaling */
+    const uint8_t two[] = { 0xA5, 0x5A };
+    EXPECT_EQ(shmem.PutBlock(two, sizeof(two)), sizeof(two));
+    waited = waitCount(2);
+    EXPECT_EQ(app.getCount(), (uint64_t)2);
+    EXPECT_LT(waited, std::chrono::milliseconds(500));
+
+    /* A signal still parses at once, the buffer need not be full */
+    EXPECT_EQ(shmem.PutBlock(two, sizeof(two)), sizeof(two));
+    app.dataAvailable();
+    waitCount(3);
+    app.stop();
+
+    FlushStats st = task.getFlushStats();
+    EXPECT_EQ(app.getCount(), (uint64_t)3);
+    EXPECT_GE(st.threshold, (uint64_t)1);
+    EXPECT_GE(st.deadline, (uint64_t)1);
+    EXPECT_LE(st.signaled, (uint64_t)1);
+    EXPECT_EQ(st.threshold + st.deadline + st.signaled, (uint64_t)3);
+    EXPECT_EQ(st.thresholdBytes, (size_t)4);
+    EXPECT_EQ(shmem.Count(), (size_t)0);
+}
+
+TEST(PerfCounters, ParseBatchesPerKernelAndInput) {
+    PerfCounters perf;
+    std::vector<uint8_t> data(64 * 1024, 0x00);
+    for (size_t i = 0; i + 1 < data.size(); i += 97) {
+        data[i] = 0xA5;
+        data[i + 1] = 0x5A;
+    }
+
+    SharedMem shmem(4096, MemPolicy());
+    CmdSeqParser parser(&shmem);
+    parser.setPerfCounters(&perf, "sparse");
+    for (size_t pos = 0; pos < data.size(); pos += 4096) {
+        EXPECT_EQ(shmem.PutBlock(&data[pos], 4096), (size_t)4096);
+        parser.parseAvailable();
+    }
+    perf.begin();
+    parser.parseBlockScalar(data.data(), data.size());
+    perf.end("scalar", "sparse", data.size());
+
+    PerfSample bulk;
+    PerfSample scalar;
+    ASSERT_TRUE(perf.getSample("bulk", "sparse", bulk));
+    ASSERT_TRUE(perf.getSample("scalar", "sparse", scalar));
+    PerfSample none;
+    EXPECT_FALSE(perf.getSample("bulk", "dense", none));
+    EXPECT_EQ(bulk.calls, (uint64_t)16);
+    EXPECT_EQ(bulk.bytes, (uint64_t)data.size());
+    /* The parser added to the totals it resolved once */
+    EXPECT_EQ(perf.resolve("bulk", "sparse")->calls, (uint64_t)16);
+    EXPECT_EQ(scalar.calls, (uint64_t)1);
+    EXPECT_GT(bulk.ns + scalar.ns, (uint64_t)0);
+    if (perf.has(PerfEvent::INSTRUCTIONS)) {
+        /* The run skipping path retires far fewer instructions per byte */
+        EXPECT_LT(bulk.values[(int)PerfEvent::INSTRUCTIONS], scalar.values[(int)PerfEvent::INSTRUCTIONS]);
+    } else {
+        /* No PMU or not allowed: timing only */
+        EXPECT_EQ(bulk.values[(int)PerfEvent::INSTRUCTIONS], (uint64_t)0);
+    }
+
+    char* text = NULL;
+    size_t size = 0;
+    FILE* fp = open_memstream(&text, &size);
+    perf.print(fp);
+    fclose(fp);
+    EXPECT_NE(strstr(text, "scalar"), nullptr);
+    free(text);
+}
+
+TEST(Trace, WorkerEventsAndChromeDump) {
+#if defined(SEQPARSER_EMBEDDED)
+    GTEST_SKIP() << "the embedded profile compiles the trace records out";
+#endif
+    std::vector<TraceEntry> entries;
+    SharedMem shmem;
+    CmdSeqParser parser(&shmem);
+    BackgroundTask task(&parser);
+    Application app(&task);
+    const uint8_t seq[] = { 0xA5, 0x5A, 0x00, 0x00 };
+
+    /* Off: nothing is recorded */
+    Trace::clear();
+    EXPECT_EQ(shmem.PutBlock(seq, sizeof(seq)), sizeof(seq));
+    parser.parseAvailable();
+    Trace::collect(entries);
+    EXPECT_TRUE(entries.empty());
+
+    Trace::enable(true);
+    app.start();
+    for (int i = 0; i < 4; i++) {
+        EXPECT_EQ(shmem.PutBlock(seq, sizeof(seq)), sizeof(seq));
+    }
+    app.dataAvailable();
+    while (app.getCount() < 5) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    const uint8_t more[20] = { 0xA5, 0x5A };
+    EXPECT_EQ(shmem.PutBlock(more, sizeof(more)), (size_t)SHARED_MEM_SIZE);
+    app.dataAvailable();
+    while (app.getCount() < 6) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    app.stop();
+    Trace::enable(false);
+    Trace::record(TraceEvent::DROP, 99);
+
+    ASSERT_GT(Trace::collect(entries), (size_t)0);
+    uint32_t self = (uint32_t)syscall(SYS_gettid);
+    std::map<TraceEvent, std::vector<uint32_t>> mine;
+    std::map<TraceEvent, std::vector<uint32_t>> worker;
+    double last = -1.0;
+    uint32_t lastTid = 0;
+    for (const TraceEntry& e : entries) {
+        (e.tid == self ? mine : worker)[e.event].push_back(e.arg);
+        if (e.tid == lastTid) {
+            EXPECT_GE(e.us, last);
+        }
+        last = e.us;
+        lastTid = e.tid;
+    }
+    EXPECT_EQ(mine[TraceEvent::PUT], (std::vector<uint32_t>{ 4, 4, 4, 4, 16 }));
+    EXPECT_EQ(mine[TraceEvent::DROP], (std::vector<uint32_t>{ 4 }));
+    EXPECT_EQ(mine[TraceEvent::NOTIFY], (std::vector<uint32_t>{ 16, 16 }));
+    EXPECT_EQ(worker[TraceEvent::PARSE_BEGIN], (std::vector<uint32_t>{ 16, 16 }));
+    EXPECT_EQ(worker[TraceEvent::PARSE_END], (std::vector<uint32_t>{ 4, 1 }));
+    EXPECT_EQ(worker[TraceEvent::WAKE].size(), (size_t)3);
+    EXPECT_EQ(Trace::getLost(), (uint64_t)0);
+
+    /* A full ring keeps the newest records */
+    Trace::enable(true);
+    for (int i = 0; i < TRACE_RING_SIZE + 10; i++) {
+        Trace::record(TraceEvent::PUT, i);
+    }
+    Trace::enable(false);
+    Trace::collect(entries);
+    EXPECT_GE(Trace::getLost(), (uint64_t)10);
+    uint32_t newest = 0;
+    for (const TraceEntry& e : entries) {
+        newest = (e.tid == self) ? e.arg : newest;
+    }
+    EXPECT_EQ(newest, (uint32_t)(TRACE_RING_SIZE + 9));
+
+    char path[] = "/tmp/seqparser_trace_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    ASSERT_TRUE(Trace::dump(path));
+    std::ifstream in(path);
+    std::string json((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    unlink(path);
+    EXPECT_EQ(json.compare(0, 2, "{\""), 0);
+    EXPECT_NE(json.find("\"ph\":\"B\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"put\""), std::string::npos);
+    EXPECT_NE(json.find("thread_name"), std::string::npos);
+    EXPECT_EQ(json.compare(json.size() - 3, 3, "]}\n"), 0);
+
+    /* Short-lived threads reuse the collected ring of an exited thread */
+    Trace::clear();
+    Trace::enable(true);
+    auto burst = []() { std::thread([]() { Trace::record(TraceEvent::PUT, 7); }).join(); };
+    burst();
+    Trace::collect(entries);
+    size_t rings = Trace::getRingCount();
+    for (int i = 0; i < 10; i++) {
+        burst();
+        EXPECT_EQ(Trace::collect(entries), (size_t)1);
+    }
+    EXPECT_EQ(Trace::getRingCount(), rings);
+    EXPECT_EQ(Trace::getLost(), (uint64_t)0);
+
+    /* Not collected: the registry stops at TRACE_MAX_RINGS and counts the
+     * records of the rings it reuses as lost */
+    for (size_t i = 0; i < TRACE_MAX_RINGS + 5; i++) {
+        burst();
+    }
+    Trace::enable(false);
+    EXPECT_EQ(Trace::getRingCount(), (size_t)TRACE_MAX_RINGS);
+    size_t kept = Trace::collect(entries);
+    EXPECT_EQ(kept + Trace::getLost(), (size_t)(TRACE_MAX_RINGS + 5));
+    Trace::clear();
+}
+
+TEST(LoadGenerator, CountsMatchWithDropsSplitsAndBursts) {
+    /* Unpaced into small rings: bytes are dropped, counts still exact */
+    LoadConfig config;
+    config.producers = 3;
+    config.rate = 0;
+    config.chunkBytes = 100;
+    config.density = 1e-2;
+    config.splitProbability = 0.5;
+    config.ringBytes = 1024;
+    config.flush.maxDelayUs = 200;
+    config.durationMs = 100;
+    LoadReport r = LoadGenerator(config).run();
+    EXPECT_TRUE(r.ok);
+    EXPECT_GT(r.expected, (uint64_t)0);
+    EXPECT_EQ(r.counted, r.expected);
+    EXPECT_EQ(r.offered, r.accepted + r.dropped);
+    EXPECT_EQ(r.offered % config.chunkBytes, (uint64_t)0);
+    EXPECT_GT(r.sustainedBytesPerSec, 0.0);
+    EXPECT_LE(r.p50Ns, r.p99Ns);
+    EXPECT_LE(r.p99Ns, r.maxNs);
+
+    /* Paced bursts with back pressure: only the chunks cut off by the end
+     * of the run are dropped, full buffers only */
+    config.producers = 2;
+    config.rate = 2e6;
+    config.shape = LoadShape::ON_OFF;
+    config.burstDuty = 0.5;
+    config.burstPeriodUs = 5000;
+    config.flush.maxDelayUs = 0;
+    config.blocking = true;
+    r = LoadGenerator(config).run();
+    EXPECT_TRUE(r.ok);
+    EXPECT_LT(r.dropped, (uint64_t)(config.producers * config.chunkBytes));
+    EXPECT_NEAR(r.offeredBytesPerSec, 2 * 2e6, 2e6);
+}
+
+TEST(OutputSink, MatchAndFrameRecordsWithRotation) {
+    char dir[] = "/tmp/seqparser_out_XXXXXX";
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    std::vector<uint8_t> stream(50000, 0x00);
+    std::vector<uint64_t> offsets;
+    for (size_t i = 100; i + 1 < stream.size(); i += 251) {
+        stream[i] = 0xA5;
+        stream[i + 1] = 0x5A;
+        offsets.push_back(i + 1);
+    }
+
+    /* CSV, rotated every 4 KiB */
+    OutputConfig config;
+    config.path = std::string(dir) + "/matches";
+    config.format = OutputConfig::Format::CSV;
+    config.maxFileBytes = 4096;
+    config.writeBytes = 4096;
+    OutputSink sink(config);
+    ASSERT_TRUE(sink.start());
+    SharedMem shmem(1024, MemPolicy());
+    CmdSeqParser parser(&shmem);
+    parser.setOutputSink(&sink);
+    for (size_t pos = 0; pos < stream.size(); pos += 1000) {
+        EXPECT_EQ(shmem.PutBlock(&stream[pos], 1000), (size_t)1000);
+        parser.parseAvailable();
+    }
+    sink.stop();
+
+    OutputStats st = sink.getStats();
+    EXPECT_EQ(st.queued, (uint64_t)offsets.size());
+    EXPECT_EQ(st.dropped, (uint64_t)0);
+    EXPECT_EQ(st.errors, (uint64_t)0);
+    EXPECT_GT(st.files, (uint64_t)1);
+    std::vector<uint64_t> got;
+    uint64_t fileBytes = 0;
+    for (uint64_t f = 0; f < st.files; f++) {
+        std::ifstream in(sink.getFileName(f));
+        std::string line;
+        ASSERT_TRUE(std::getline(in, line));
+        EXPECT_EQ(line, "type,offset,time_ns,length,value");
+        while (std::getline(in, line)) {
+            unsigned long long offset, time, length, value;
+            ASSERT_EQ(sscanf(line.c_str(), "match,%llu,%llu,%llu,%llu", &offset, &time, &length, &value), 4);
+            got.push_back(offset);
+            EXPECT_EQ(value, (unsigned long long)got.size());
+        }
+        struct stat sb;
+        ASSERT_EQ(stat(sink.getFileName(f).c_str(), &sb), 0);
+        EXPECT_LE(sb.st_size, 4096);
+        fileBytes += (uint64_t)sb.st_size;
+        unlink(sink.getFileName(f).c_str());
+    }
+    EXPECT_EQ(got, offsets);
+    EXPECT_EQ(fileBytes, st.bytes);
+
+    /* Binary frames; a queue the writer never drains drops the excess */
+    OutputConfig small;
+    small.path = std::string(dir) + "/frames";
+    small.queueRecords = 64;
+    OutputSink frames(small);
+    FrameVerifier verifier(FrameVerifier::CrcType::CRC16);
+    verifier.setOutputSink(&frames);
+    const uint8_t payload[] = { 0x01, 0x02, 0x03 };
+    uint16_t crc = Crc16_Update(CRC16_INIT, payload, sizeof(payload)) ^ CRC16_XOR;
+    const uint8_t frame[] = { 0xA5, 0x5A, 3, 0x01, 0x02, 0x03, (uint8_t)crc, (uint8_t)(crc >> 8) };
+    const uint8_t bad[] = { 0xA5, 0x5A, 1, 0x07, 0x00, 0x00 };
+    verifier.feed(frame, sizeof(frame));
+    verifier.feed(bad, sizeof(bad));
+    for (int i = 0; i < 100; i++) {
+        verifier.feed(frame, sizeof(frame));
+    }
+    EXPECT_EQ(frames.getStats().queued, (uint64_t)64);
+    EXPECT_EQ(frames.getStats().dropped, (uint64_t)38);
+    ASSERT_TRUE(frames.start());
+    frames.stop();
+
+    std::ifstream in(frames.getFileName(0), std::ios::binary);
+    OutputRecord r[2];
+    ASSERT_TRUE(in.read((char*)r, sizeof(r)));
+    EXPECT_EQ(r[0].type, OutputType::FRAME_VALID);
+    EXPECT_EQ(r[0].offset, (uint64_t)7);
+    EXPECT_EQ(r[0].length, 3);
+    EXPECT_EQ(r[0].value, (uint32_t)crc);
+    EXPECT_EQ(r[1].type, OutputType::FRAME_INVALID);
+    EXPECT_EQ(r[1].offset, (uint64_t)13);
+    EXPECT_EQ(frames.getStats().bytes, (uint64_t)(64 * sizeof(OutputRecord)));
+    unlink(frames.getFileName(0).c_str());
+    rmdir(dir);
+}
+
+TEST(PatternSet, HotReloadCarriesCountersAcrossSwap) {
+    SharedMem shmem(1024, MemPolicy());
+    CmdSeqParser parser(&shmem);
+    PatternSet patterns;
+    parser.setPatternSet(&patterns);
+    ASSERT_TRUE(patterns.reload({ { "a", "A5 00 5A" }, { "b", "A5 ?? 5A" } }));
+
+    /* Both patterns are in the middle of a match at the buffer boundary */
+    const uint8_t first[] = { 0xA5, 0x00, 0x5A, 0x11, 0xA5, 0x00 };
+    const uint8_t second[] = { 0x5A, 0xA5, 0x01, 0x5A };
+    shmem.PutBlock(first, sizeof(first));
+    parser.parseAvailable();
+    std::vector<std::pair<std::string, uint64_t>> counts = patterns.getCounts();
+    ASSERT_EQ(counts.size(), (size_t)2);
+    EXPECT_EQ(counts[0].second, (uint64_t)1);
+    EXPECT_EQ(counts[1].second, (uint64_t)1);
+
+    /* a is unchanged and keeps its state, b keeps its count only, c is new */
+    EXPECT_FALSE(patterns.reload({ { "a", "A5 00 5A" }, { "x", "A5 [" } }));
+    EXPECT_EQ(std::string(patterns.getError()).rfind("x: ", 0), (size_t)0);
+    EXPECT_FALSE(patterns.reload({ { "a", "A5" }, { "a", "5A" } }));
+    ASSERT_TRUE(patterns.reload({ { "c", "5A" }, { "b", "A5 [00-0F] 5A" }, { "a", "A5 00 5A" } }));
+    EXPECT_EQ(patterns.getStats().version, (uint64_t)1);
+    shmem.PutBlock(second, sizeof(second));
+    parser.parseAvailable();
+    counts = patterns.getCounts();
+    ASSERT_EQ(counts.size(), (size_t)3);
+    EXPECT_EQ(counts[0], std::make_pair(std::string("c"), (uint64_t)2));
+    EXPECT_EQ(counts[1], std::make_pair(std::string("b"), (uint64_t)2));
+    EXPECT_EQ(counts[2], std::make_pair(std::string("a"), (uint64_t)2));
+    PatternSetStats st = patterns.getStats();
+    EXPECT_EQ(st.version, (uint64_t)2);
+    EXPECT_EQ(st.swaps, (uint64_t)2);
+    EXPECT_EQ(st.retired, (uint64_t)1);
+    EXPECT_EQ(st.reclaimed, (uint64_t)1);
+    EXPECT_GT(st.maxSwapNs, (uint64_t)0);
+
+    /* Readers never see a count go back while versions come and go */
+    std::atomic<bool> done(false);
+    std::atomic<uint64_t> reads(0);
+    std::thread reader([&]() {
+        uint64_t last = 0;
+        while (!done.load()) {
+            for (const auto& c : patterns.getCounts()) {
+                if (c.first == "a") {
+                    EXPECT_GE(c.second, last);
+                    last = c.second;
+                }
+            }
+            reads.fetch_add(1);
+        }
+    });
+    const uint8_t header[] = { 0xA5, 0x00, 0x5A, 0x00 };
+    for (int i = 0; i < 500; i++) {
+        const char* other = (i % 2 == 0) ? "5A" : "00";
+        ASSERT_TRUE(patterns.reload({ { "a", "A5 00 5A" }, { "o", other } }));
+        shmem.PutBlock(header, sizeof(header));
+        parser.parseAvailable();
+        if (i % 50 == 0) {
+            std::this_thread::yield();
+        }
+    }
+    done = true;
+    reader.join();
+    shmem.PutBlock(header, sizeof(header));
+    parser.parseAvailable();
+    EXPECT_GT(reads.load(), (uint64_t)0);
+    EXPECT_EQ(patterns.getCounts()[0].second, (uint64_t)(2 + 501));
+    st = patterns.getStats();
+    EXPECT_EQ(st.swaps, (uint64_t)502);
+    EXPECT_EQ(st.reclaimed, st.retired);
+
+    /* The bulk path used by Pipeline and FileReader takes up reloads too */
+    CmdSeqParser bulk(&shmem);
+    PatternSet bulkPatterns;
+    bulk.setPatternSet(&bulkPatterns);
+    ASSERT_TRUE(bulkPatterns.reload({ { "a", "A5 00 5A" } }));
+    bulk.parseBlock(header, sizeof(header));
+    ASSERT_TRUE(bulkPatterns.reload({ { "a", "A5 00 5A" }, { "z", "00" } }));
+    bulk.parseBlock(header, sizeof(header));
+    counts = bulkPatterns.getCounts();
+    ASSERT_EQ(counts.size(), (size_t)2);
+    EXPECT_EQ(counts[0].second, (uint64_t)2);
+    EXPECT_EQ(counts[1].second, (uint64_t)2);
+    EXPECT_EQ(bulkPatterns.getStats().swaps, (uint64_t)2);
+}
+
+TEST(CommandStats, HeavyHittersAcrossChannelsAndMerge) {
+    /* Two byte IDs, skewed so a few dominate; fill never forms a header */
+    std::mt19937 rng(46);
+    std::vector<uint8_t> channels[2];
+    std::map<uint32_t, uint64_t> exact;
+    const size_t headers = 20000;
+    for (size_t n = 0; n < headers; n++) {
+        uint32_t r = rng() % 1000;
+        uint32_t id = (r < 400) ? 0x0101 : (r < 600) ? 0x4F02 : (r < 700) ? 0x0303 + (r % 4) : rng() % 0x5000;
+        exact[id]++;
+        std::vector<uint8_t>& ch = channels[n % 2];
+        ch.push_back(0xA5);
+        ch.push_back(0x5A);
+        ch.push_back((uint8_t)(id >> 8));
+        ch.push_back((uint8_t)id);
+        for (uint32_t f = rng() % 6; f > 0; f--) {
+            ch.push_back((uint8_t)(rng() % 0x50));
+        }
+    }
+
+    /* Each channel on its own parser, with IDs cut by the buffer ends */
+    CommandStatsConfig config;
+    config.idBytes = 2;
+    config.topK = 16;
+    config.width = 1024;
+    CommandStats stats[2] = { CommandStats(config), CommandStats(config) };
+    std::atomic<bool> done(false);
+    std::thread reader([&]() {
+        while (!done.load()) {
+            std::vector<CommandCount> top = stats[0].getTop();
+            for (size_t i = 0; i < top.size(); i++) {
+                EXPECT_LE(top[i].error, top[i].count);
+                if (i > 0) {
+                    EXPECT_GE(top[i - 1].count, top[i].count);
+                }
+            }
+        }
+    });
+    for (int c = 0; c < 2; c++) {
+        SharedMem shmem(1024, MemPolicy());
+        CmdSeqParser parser(&shmem);
+        parser.setCommandStats(&stats[c]);
+        const size_t chunks[] = { 1, 3, 999, 2, 501, 77 };
+        size_t pos = 0;
+        for (size_t k = 0; pos < channels[c].size(); k++) {
+            size_t len = std::min(chunks[k % 6], channels[c].size() - pos);
+            EXPECT_EQ(shmem.PutBlock(&channels[c][pos], len), len);
+            parser.parseAvailable();
+            pos += len;
+        }
+        EXPECT_EQ(parser.getCount(), (uint64_t)(headers / 2));
+    }
+    done = true;
+    reader.join();
+
+    CommandStatsConfig other = config;
+    other.width = 2048;
+    CommandStats wide(other);
+    EXPECT_FALSE(stats[0].merge(wide));
+    CommandStats total(config);
+    EXPECT_TRUE(total.merge(stats[0]));
+    EXPECT_TRUE(total.merge(stats[1]));
+    EXPECT_EQ(total.getTotal(), (uint64_t)headers);
+
+    /* Space-Saving and count-min bounds hold on the merged summary */
+    std::vector<CommandCount> top = total.getTop();
+    ASSERT_EQ(top.size(), config.topK);
+    EXPECT_EQ(top[0].id, (uint32_t)0x0101);
+    EXPECT_EQ(top[1].id, (uint32_t)0x4F02);
+    for (const CommandCount& c : top) {
+        uint64_t truth = exact.count(c.id) ? exact[c.id] : 0;
+        EXPECT_GE(c.count, truth) << c.id;
+        EXPECT_LE(c.count - c.error, truth) << c.id;
+    }
+    for (const auto& e : exact) {
+        if (e.second > headers / config.topK) {
+            EXPECT_TRUE(std::any_of(top.begin(), top.end(),
+                                    [&](const CommandCount& c) { return c.id == e.first; })) << e.first;
+        }
+        uint64_t estimate = total.estimate(e.first);
+        EXPECT_GE(estimate, e.second);
+        EXPECT_LE(estimate, e.second + total.getErrorBound());
+    }
+    total.reset();
+    EXPECT_EQ(total.getTotal(), (uint64_t)0);
+    EXPECT_TRUE(total.getTop().empty());
+}
+
+#if defined(SEQPARSER_EMBEDDED)
+/*
+ * Producer state of the SIGALRM test, only touched by the handler
+ */
+static struct {
+    SharedMem* shmem;
+    Application* app;
+    std::atomic<uint64_t> signals;
+    std::atomic<uint64_t> headers;     /**< Frames put with at least their header */
+    std::atomic<uint64_t> dropped;     /**< Bytes that did not fit */
+    std::atomic<uint64_t> puts;
+    std::atomic<uint64_t> totalNs;
+    std::atomic<uint64_t> maxNs;
+} alarmProducer;
+
+static void TestApp_AlarmPut(int sig) {
+    (void)sig;
+    int saved = errno;
+    static const uint8_t frame[] = { 0xA5, 0x5A, 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 };
+    SharedMem* shmem = alarmProducer.shmem;
+    for (int f = 0; f < 4; f++) {
+        size_t put = 0;
+        for (; put < sizeof(frame); put++) {
+            if (shmem->IsFull()) {
+                break;
+            }
+            struct timespec t0, t1;
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            shmem->PutData(frame[put]);
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            uint64_t ns = (uint64_t)(t1.tv_sec - t0.tv_sec) * 1000000000ull + (uint64_t)(t1.tv_nsec - t0.tv_nsec);
+            alarmProducer.puts.store(alarmProducer.puts.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            alarmProducer.totalNs.store(alarmProducer.totalNs.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+            if (ns > alarmProducer.maxNs.load(std::memory_order_relaxed)) {
+                alarmProducer.maxNs.store(ns, std::memory_order_relaxed);
+            }
+        }
+        if (put >= 2) {
+            alarmProducer.headers.store(alarmProducer.headers.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+        alarmProducer.dropped.store(alarmProducer.dropped.load(std::memory_order_relaxed) + sizeof(frame) - put, std::memory_order_relaxed);
+    }
+    if (shmem->Count() >= shmem->Size() / 2) {
+        alarmProducer.app->dataAvailable();
+    }
+    alarmProducer.signals.store(alarmProducer.signals.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    errno = saved;
+}
+#endif
+
+TEST(Embedded, PutDataFromSignalHandler) {
+#if !defined(SEQPARSER_EMBEDDED)
+    GTEST_SKIP() << "build with -DSEQPARSER_EMBEDDED, PutData takes a lock otherwise";
+#else
+    /* Static ring memory, nothing on the heap */
+    static uint8_t storage[4096];
+    SharedMem shmem(storage, sizeof(storage));
+    CmdSeqParser parser(&shmem);
+    BackgroundTask task(&parser);
+    Application app(&task);
+    app.setFlushPolicy(FlushPolicy{ 1000, 0 });
+    alarmProducer.shmem = &shmem;
+    alarmProducer.app = &app;
+
+    /* Only this thread takes the signal, it is the single producer */
+    sigset_t alarm;
+    sigemptyset(&alarm);
+    sigaddset(&alarm, SIGALRM);
+    ASSERT_EQ(pthread_sigmask(SIG_BLOCK, &alarm, NULL), 0);
+    app.start();
+    struct sigaction sa, old;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = TestApp_AlarmPut;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    ASSERT_EQ(sigaction(SIGALRM, &sa, &old), 0);
+    struct itimerval timer = { { 0, 100 }, { 0, 100 } };
+    ASSERT_EQ(setitimer(ITIMER_REAL, &timer, NULL), 0);
+    ASSERT_EQ(pthread_sigmask(SIG_UNBLOCK, &alarm, NULL), 0);
+
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+    while (std::chrono::steady_clock::now() < end) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    struct itimerval off = { { 0, 0 }, { 0, 0 } };
+    setitimer(ITIMER_REAL, &off, NULL);
+    pthread_sigmask(SIG_BLOCK, &alarm, NULL);
+    sigaction(SIGALRM, &old, NULL);
+    pthread_sigmask(SIG_UNBLOCK, &alarm, NULL);
+
+    app.dataAvailable();
+    auto start = std::chrono::steady_clock::now();
+    while ((app.getCount() < alarmProducer.headers.load()) &&
+           (std::chrono::steady_clock::now() - start < std::chrono::seconds(2))) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    app.stop();
+    uint64_t puts = alarmProducer.puts.load();
+    printf("signals %llu, puts %llu, dropped %llu, put latency mean %.0f ns, worst %llu ns\n",
+           (unsigned long long)alarmProducer.signals.load(), (unsigned long long)puts,
+           (unsigned long long)alarmProducer.dropped.load(),
+           (double)alarmProducer.totalNs.load() / (double)(puts ? puts : 1),
+           (unsigned long long)alarmProducer.maxNs.load());
+    EXPECT_GT(alarmProducer.signals.load(), (uint64_t)100);
+    EXPECT_EQ(parser.getCount(), alarmProducer.headers.load());
+    EXPECT_EQ(puts + alarmProducer.dropped.load(), alarmProducer.signals.load() * 32);
+#endif
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
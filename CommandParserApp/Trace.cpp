@@ -0,0 +1,432 @@
+/**
+ * @file  Trace.cpp
+ * @brief Per thread event trace rings, dumped as Chrome trace JSON
+ * @note  A ring has a single writer, its thread. Readers copy the ring
+ *        and then drop the records the writer may have overwritten in
+ *        the meantime, like the seqlock of the rate buckets, so neither
+ *        side ever waits for the other.
+ *
+ */
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include "Trace.h"
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+#define TRACE_RING_MASK ((uint64_t)TRACE_RING_SIZE - 1)
+
+static_assert((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0, "TRACE_RING_SIZE must be a power of two");
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+struct TraceRecord {
+    uint64_t tsc;       /**< Time stamp counter */
+    uint32_t arg;       /**< Event argument, saturated */
+    uint16_t event;     /**< TraceEvent */
+    uint16_t reserved;
+};
+
+struct TraceRing {
+    std::atomic<uint64_t> head{0};  /**< Records written, by the owner only */
+    std::atomic<uint64_t> base{0};  /**< First record after the last clear() */
+    std::atomic<bool> live{true};   /**< Owner thread still running */
+    uint64_t read = 0;              /**< head at the last collect(), under Trace_Mutex */
+    uint32_t tid = 0;               /**< Kernel thread id of the owner */
+    char name[16] = { 0 };          /**< Thread name */
+    TraceRecord records[TRACE_RING_SIZE];
+};
+
+/*
+ * Ring of the calling thread, marked dead when the thread exits
+ */
+struct TraceThread {
+    TraceRing* ring = NULL;
+    ~TraceThread() {
+        if (ring != NULL) {
+            ring->live.store(false, std::memory_order_release);
+        }
+    }
+};
+
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+static TraceRing* Trace_Open(void);
+static uint64_t Trace_Tsc(void);
+static uint64_t Trace_Now(void);
+static double Trace_TicksPerUs(void);
+
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+std::atomic<bool> Trace::enabled_{false};
+
+static std::mutex Trace_Mutex;                 /**< Guards the ring list */
+static std::vector<TraceRing*> Trace_Rings;    /**< Rings of all threads */
+static thread_local TraceThread Trace_Thread;  /**< Ring of this thread */
+static uint64_t Trace_Lost = 0;                /**< Overwritten at the last collect() */
+static uint64_t Trace_Dropped = 0;             /**< Unread in reused rings since then */
+static uint64_t Trace_StartTsc = 0;            /**< Counter at the first enable() */
+static uint64_t Trace_StartNs = 0;             /**< Monotonic time at the first enable() */
+
+/*
+ * Name of each event and of its argument in the dump
+ */
+static const char* const Trace_Names[(int)TraceEvent::COUNT] = {
+    "put", "notify", "wake", "parse_begin", "parse_end", "drop"
+};
+static const char* const Trace_ArgNames[(int)TraceEvent::COUNT] = {
+    "bytes", "pending", "signaled", "bytes", "matches", "bytes"
+};
+
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+/**
+ * @brief Switch tracing on or off, records of earlier runs are kept
+ *
+ * @param  on  true to record
+ * @return None
+ */
+void Trace::enable(bool on)
+{
+    if (on) {
+        std::lock_guard<std::mutex> lock(Trace_Mutex);
+        if (Trace_StartNs == 0) {
+            Trace_StartTsc = Trace_Tsc();
+            Trace_StartNs = Trace_Now();
+        }
+    }
+    enabled_.store(on, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Name the calling thread in dumps, e.g. "worker" or "producer"
+ *
+ * @param  name  up to 15 characters
+ * @return None
+ */
+void Trace::setThreadName(const char* name)
+{
+    TraceRing* ring = (Trace_Thread.ring != NULL) ? Trace_Thread.ring : Trace_Open();
+    std::lock_guard<std::mutex> lock(Trace_Mutex);
+    snprintf(ring->name, sizeof(ring->name), "%s", name);
+}
+
+/**
+ * @brief Append a record to the ring of the calling thread
+ *
+ * @param  event  event
+ * @param  arg    event argument
+ * @return None
+ */
+void Trace::write(TraceEvent event, uint64_t arg)
+{
+    TraceRing* ring = Trace_Thread.ring;
+    if (ring == NULL) {
+        ring = Trace_Open();
+    }
+
+    /* The slot may alias a record a reader is copying, the fence keeps
+     * the previous head store ahead of the slot stores */
+    uint64_t h = ring->head.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    TraceRecord& r = ring->records[h & TRACE_RING_MASK];
+    r.tsc = Trace_Tsc();
+    r.arg = (arg < UINT32_MAX) ? (uint32_t)arg : UINT32_MAX;
+    r.event = (uint16_t)event;
+    ring->head.store(h + 1, std::memory_order_release);
+}
+
+/**
+ * @brief Copy the records of all rings, oldest first per thread
+ *
+ * Records overwritten while copying are left out and counted in
+ * getLost(), with those the writer wrapped over before.
+ *
+ * @param  entries  records, grouped by thread
+ * @return number of records
+ */
+size_t Trace::collect(std::vector<TraceEntry>& entries)
+{
+    std::vector<TraceRecord> copy(TRACE_RING_SIZE);
+    double ticksPerUs = Trace_TicksPerUs();
+    std::lock_guard<std::mutex> lock(Trace_Mutex);
+
+    entries.clear();
+    Trace_Lost = Trace_Dropped;
+    Trace_Dropped = 0;
+    for (TraceRing* ring : Trace_Rings) {
+        uint64_t base = ring->base.load(std::memory_order_relaxed);
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        ring->read = head;
+        uint64_t from = (head > base + TRACE_RING_SIZE) ? head - TRACE_RING_SIZE : base;
+        for (uint64_t i = from; i < head; i++) {
+            copy[i & TRACE_RING_MASK] = ring->records[i & TRACE_RING_MASK];
+        }
+
+        /* The writer may be storing into the slot of record after - SIZE */
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t after = ring->head.load(std::memory_order_relaxed);
+        if (after + 1 > from + TRACE_RING_SIZE) {
+            from = after + 1 - TRACE_RING_SIZE;
+        }
+        Trace_Lost += (from > base) ? from - base : 0;
+        for (uint64_t i = from; i < head; i++) {
+            const TraceRecord& r = copy[i & TRACE_RING_MASK];
+            TraceEntry e;
+            e.tid = ring->tid;
+            e.event = (TraceEvent)r.event;
+            e.arg = r.arg;
+            e.us = (double)(int64_t)(r.tsc - Trace_StartTsc) / ticksPerUs;
+            entries.push_back(e);
+        }
+    }
+    return entries.size();
+}
+
+/**
+ * @brief Write the records as Chrome trace JSON, for chrome://tracing or
+ *        ui.perfetto.dev
+ *
+ * Parse calls are duration slices, the other events instants on the
+ * thread track.
+ *
+ * @param  path  output file
+ * @return true/false written or not
+ */
+bool Trace::dump(const char* path)
+{
+    std::vector<TraceEntry> entries;
+    collect(entries);
+
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL) {
+        return false;
+    }
+    int pid = (int)getpid();
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"lost\":%llu},\"traceEvents\":[\n",
+            (unsigned long long)getLost());
+    {
+        std::lock_guard<std::mutex> lock(Trace_Mutex);
+        const char* sep = "";
+        for (TraceRing* ring : Trace_Rings) {
+            fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,"
+                    "\"args\":{\"name\":\"%s\"}}", sep, pid, ring->tid, ring->name);
+            sep = ",\n";
+        }
+    }
+
+    /* A wrapped ring can start inside a parse call, its end is dropped */
+    std::map<uint32_t, int> depth;
+    for (const TraceEntry& e : entries) {
+        const char* ph = "i";
+        const char* name = getEventName(e.event);
+        if (e.event == TraceEvent::PARSE_BEGIN) {
+            ph = "B";
+            name = "parse";
+            depth[e.tid]++;
+        } else if (e.event == TraceEvent::PARSE_END) {
+            if (depth[e.tid] == 0) {
+                continue;
+            }
+            ph = "E";
+            name = "parse";
+            depth[e.tid]--;
+        }
+        fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"%s\",%s\"pid\":%d,\"tid\":%u,\"ts\":%.3f,"
+                "\"args\":{\"%s\":%u}}", name, ph, (ph[0] == 'i') ? "\"s\":\"t\"," : "",
+                pid, e.tid, e.us, Trace_ArgNames[(int)e.event], e.arg);
+    }
+    fprintf(fp, "\n]}\n");
+    return (fclose(fp) == 0);
+}
+
+/**
+ * @brief Forget the records so far and the rings of exited threads
+ *
+ * @param  None
+ * @return None
+ */
+void Trace::clear()
+{
+    std::lock_guard<std::mutex> lock(Trace_Mutex);
+    size_t n = 0;
+    for (TraceRing* ring : Trace_Rings) {
+        if (ring->live.load(std::memory_order_acquire)) {
+            ring->base.store(ring->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+            ring->read = ring->base.load(std::memory_order_relaxed);
+            Trace_Rings[n++] = ring;
+        } else {
+            delete ring;
+        }
+    }
+    Trace_Rings.resize(n);
+    Trace_Lost = 0;
+    Trace_Dropped = 0;
+}
+
+/**
+ * @brief Records lost to ring wraparound at the last collect() or dump(),
+ *        and records of exited threads whose ring was reused before it
+ *        was collected
+ *
+ * @param  None
+ * @return records
+ */
+uint64_t Trace::getLost()
+{
+    std::lock_guard<std::mutex> lock(Trace_Mutex);
+    return Trace_Lost;
+}
+
+/**
+ * @brief Number of rings, of live threads and of exited threads not
+ *        reused or cleared yet
+ *
+ * @param  None
+ * @return rings
+ */
+size_t Trace::getRingCount()
+{
+    std::lock_guard<std::mutex> lock(Trace_Mutex);
+    return Trace_Rings.size();
+}
+
+/**
+ * @brief Name of an event in dumps
+ *
+ * @param  event  event
+ * @return name
+ */
+const char* Trace::getEventName(TraceEvent event)
+{
+    return ((int)event < (int)TraceEvent::COUNT) ? Trace_Names[(int)event] : "?";
+}
+
+/**
+ * @brief Give the calling thread a ring
+ *
+ * The ring of an exited thread is reused once collect() has read all of
+ * it. With TRACE_MAX_RINGS rings any exited thread's ring is, and its
+ * unread records are counted in getLost(). A new ring is created only if
+ * neither is found.
+ *
+ * @param  None
+ * @return ring
+ */
+static TraceRing* Trace_Open(void)
+{
+    uint32_t tid = (uint32_t)syscall(SYS_gettid);
+    char name[sizeof(TraceRing::name)];
+    if (pthread_getname_np(pthread_self(), name, sizeof(name)) != 0) {
+        snprintf(name, sizeof(name), "%u", tid);
+    }
+
+    TraceRing* ring = NULL;
+    {
+        std::lock_guard<std::mutex> lock(Trace_Mutex);
+        TraceRing* dead = NULL;
+        for (TraceRing* r : Trace_Rings) {
+            if (r->live.load(std::memory_order_acquire)) {
+                continue;
+            }
+            if (r->read == r->head.load(std::memory_order_relaxed)) {
+                ring = r;
+                break;
+            }
+            dead = (dead == NULL) ? r : dead;
+        }
+        if ((ring == NULL) && (dead != NULL) && (Trace_Rings.size() >= TRACE_MAX_RINGS)) {
+            uint64_t head = dead->head.load(std::memory_order_relaxed);
+            uint64_t from = (dead->read > dead->base.load(std::memory_order_relaxed)) ?
+                            dead->read : dead->base.load(std::memory_order_relaxed);
+            Trace_Dropped += head - from;
+            ring = dead;
+        }
+        if (ring != NULL) {
+            /* Records of the previous owner are not shown again */
+            uint64_t head = ring->head.load(std::memory_order_relaxed);
+            ring->base.store(head, std::memory_order_relaxed);
+            ring->read = head;
+            ring->live.store(true, std::memory_order_relaxed);
+        } else {
+            ring = new TraceRing();
+            Trace_Rings.push_back(ring);
+        }
+        ring->tid = tid;
+        memcpy(ring->name, name, sizeof(name));
+    }
+    Trace_Thread.ring = ring;
+    return ring;
+}
+
+/**
+ * @brief Time stamp counter, the monotonic clock where there is none
+ *
+ * @param  None
+ * @return ticks
+ */
+static uint64_t Trace_Tsc(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return Trace_Now();
+#endif
+}
+
+/**
+ * @brief Monotonic time
+ *
+ * @param  None
+ * @return ns
+ */
+static uint64_t Trace_Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Counter rate, measured against the monotonic clock since the
+ *        first enable() over at least 10 ms
+ *
+ * @param  None
+ * @return ticks per us
+ */
+static double Trace_TicksPerUs(void)
+{
+    uint64_t startNs;
+    uint64_t startTsc;
+    {
+        std::lock_guard<std::mutex> lock(Trace_Mutex);
+        startNs = Trace_StartNs;
+        startTsc = Trace_StartTsc;
+    }
+    if (startNs == 0) {
+        return 1000.0;
+    }
+    while (Trace_Now() < startNs + 10000000ull) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    uint64_t ns = Trace_Now();
+    uint64_t tsc = Trace_Tsc();
+    return (double)(tsc - startTsc) * 1000.0 / (double)(ns - startNs);
+}
@@ -0,0 +1,102 @@
+/**
+ * @file  Trace.h
+ * @brief Per thread event trace rings, dumped as Chrome trace JSON
+ * @note
+ *
+ */
+#ifndef __TRACE_H__
+#define __TRACE_H__
+/*-----------------------------------------------------------------------*/
+/* Header                                                                */
+/*-----------------------------------------------------------------------*/
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <vector>
+/*-----------------------------------------------------------------------*/
+/* Macro                                                                 */
+/*-----------------------------------------------------------------------*/
+/*
+ * Records kept per thread, a power of two. A full ring overwrites its
+ * oldest records.
+ */
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE (4096)
+#endif
+
+/*
+ * Rings kept before a new thread takes over the ring of an exited thread
+ * that was not collected yet, its unread records counted in getLost()
+ */
+#ifndef TRACE_MAX_RINGS
+#define TRACE_MAX_RINGS (64)
+#endif
+
+/*-----------------------------------------------------------------------*/
+/* DataType                                                              */
+/*-----------------------------------------------------------------------*/
+enum class TraceEvent : uint16_t {
+    PUT,          /**< Producer batch written to a ring, arg bytes */
+    NOTIFY,       /**< Data available signal, arg bytes waiting */
+    WAKE,         /**< Worker returned from its wait, arg 1 signaled, 0 timed out */
+    PARSE_BEGIN,  /**< Parse call started, arg bytes */
+    PARSE_END,    /**< Parse call done, arg matches found */
+    DROP,         /**< Producer bytes that did not fit, arg bytes */
+    COUNT
+};
+
+/*
+ * A record converted for reading, time relative to Trace::enable()
+ */
+struct TraceEntry {
+    uint32_t tid;       /**< Kernel thread id */
+    TraceEvent event;   /**< Event */
+    uint32_t arg;       /**< Event argument */
+    double us;          /**< Time in us */
+};
+
+/*
+ * Each thread writes to its own ring, created on its first record, so a
+ * record is a few stores and no lock. Rings stay readable after their
+ * thread has exited, until clear() or until a new thread reuses them once
+ * collected (or, past TRACE_MAX_RINGS, not). With tracing off a record costs one
+ * relaxed load and a branch. The embedded profile (SEQPARSER_EMBEDDED)
+ * compiles the records out, as creating a ring allocates under a lock.
+ */
+class Trace {
+    public:
+        static void enable(bool on);          /**< Switch tracing on or off at runtime */
+        static bool isEnabled() {             /**< Tracing is on */
+#if defined(SEQPARSER_EMBEDDED)
+            return false;
+#else
+            return enabled_.load(std::memory_order_relaxed);
+#endif
+        }
+        static void record(TraceEvent event, uint64_t arg) { /**< Record if on */
+            if (isEnabled()) {
+                write(event, arg);
+            }
+        }
+        static void setThreadName(const char* name); /**< Name of the calling thread in dumps */
+        static size_t collect(std::vector<TraceEntry>& entries); /**< Records of all rings */
+        static bool dump(const char* path);   /**< Write Chrome/Perfetto trace JSON */
+        static void clear();                  /**< Forget the records so far */
+        static uint64_t getLost();            /**< Records overwritten before collect() */
+        static size_t getRingCount();         /**< Rings of live and exited threads */
+        static const char* getEventName(TraceEvent event);
+    private:
+        static void write(TraceEvent event, uint64_t arg); /**< Append to the thread ring */
+
+        static std::atomic<bool> enabled_;    /**< Runtime switch */
+};
+/*-----------------------------------------------------------------------*/
+/* Prototype                                                             */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Variable                                                              */
+/*-----------------------------------------------------------------------*/
+/*-----------------------------------------------------------------------*/
+/* Function                                                              */
+/*-----------------------------------------------------------------------*/
+#endif /* __TRACE_H__ */